@@ -84,6 +84,9 @@ void alm2allmaps_mpi(double *alm_real, double *alm_imag, float *mapvec, float *m
   double plmeps;
   long firstl;
   long firstM,lastM,NMThisTask;
+  int NumThreads,thread;
+  double **plmThreads;
+  plmgen_data **plmdataThreads;
   
   double runTime;
 #ifdef OUTPUT_SHT_LOADBALANCE
@@ -93,6 +96,7 @@ void alm2allmaps_mpi(double *alm_real, double *alm_imag, float *mapvec, float *m
   double transTime,fftTime,sumTime,pixTime,plmTime;
   
   fftwf_complex *mapvec_complex[6];
+  float *mapvec_south;
   double *mTime;
   long Nchunks,chunkInd;
   
@@ -105,6 +109,10 @@ void alm2allmaps_mpi(double *alm_real, double *alm_imag, float *mapvec, float *m
   double *transDataImag;
   long NmTD,NrTD;
   long mind;
+  double sgn;
+  double pn_real,pn_imag,ps_real,ps_imag;
+  double gpn_real,gpn_imag,gps_real,gps_imag;
+  double gppn_real,gppn_imag,gpps_real,gpps_imag;
   
   //init timing and basic data for plan
   runTime = -MPI_Wtime();
@@ -121,7 +129,7 @@ void alm2allmaps_mpi(double *alm_real, double *alm_imag, float *mapvec, float *m
   Nmaps = 6;
   Nside = order2nside(plan.order);
   Nrings = 2*Nside;
-  plmeps = 1e-30;
+  plmeps = SHT_PLMEPS;
   lmax = plan.lmax;
   mapvec_complex[0] = (fftwf_complex*) mapvec;
   mapvec_complex[1] = (fftwf_complex*) mapvec_gt;
@@ -168,7 +176,39 @@ void alm2allmaps_mpi(double *alm_real, double *alm_imag, float *mapvec, float *m
   assert(plm != NULL);
   memTot += sizeof(double)*(lmax + 1);
   plmTime -= MPI_Wtime();
-  plmdata = plmgen_init(lmax,plmeps);
+  if(plan.plmdata != NULL && plan.plmdata->lmax == lmax && plan.plmdata->eps == plmeps)
+    {
+      plmdata = plan.plmdata;
+      plmgen_reset(plmdata);
+    }
+  else
+    plmdata = plmgen_init(lmax,plmeps);
+  
+  //each thread needs its own plm buffer and plm generator since plmgen keeps state between calls
+#ifdef USE_OPENMP
+  NumThreads = omp_get_max_threads();
+#else
+  NumThreads = 1;
+#endif
+  plmThreads = (double**)malloc(sizeof(double*)*NumThreads);
+  assert(plmThreads != NULL);
+  plmdataThreads = (plmgen_data**)malloc(sizeof(plmgen_data*)*NumThreads);
+  assert(plmdataThreads != NULL);
+  plmThreads[0] = plm;
+  plmdataThreads[0] = plmdata;
+  for(thread=1;thread<NumThreads;++thread)
+    {
+      plmThreads[thread] = (double*)malloc(sizeof(double)*(lmax + 1));
+      assert(plmThreads[thread] != NULL);
+      memTot += sizeof(double)*(lmax + 1);
+      if(thread < plan.NumPlmThreads && plan.plmdataThreads[thread]->lmax == lmax && plan.plmdataThreads[thread]->eps == plmeps)
+	{
+	  plmdataThreads[thread] = plan.plmdataThreads[thread];
+	  plmgen_reset(plmdataThreads[thread]);
+	}
+      else
+	plmdataThreads[thread] = plmgen_init(lmax,plmeps);
+    }
   plmTime += MPI_Wtime();
   
   //compute layout for transposed data
@@ -294,11 +334,22 @@ void alm2allmaps_mpi(double *alm_real, double *alm_imag, float *mapvec, float *m
 	      }
 	}
       
-      //sum over l at fixed m for each ring using only alms on ThisTask
+      //sum over l at fixed m for each ring using only alms on ThisTask - each m is done by one thread
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1) reduction(+:plmTime) \
+  private(mind,lmind,i,l,lmin,firstl,plm,plmdata,sfact,sgn,rval,ival, \
+	  pn_real,pn_imag,ps_real,ps_imag,gpn_real,gpn_imag,gps_real,gps_imag, \
+	  gppn_real,gppn_imag,gpps_real,gpps_imag,gradplmn,gradplms,gradplm_lm1_n,gradplm_lm1_s, \
+	  ncos_nsin,ncos_nsin2,ncos2_nsin2,fac1,fac2,fac3,gradquantn,gradquants,gradfact)
+#endif
       for(m=firstM;m<=lastM;++m)
 	{
+#ifdef USE_OPENMP
+	  plm = plmThreads[omp_get_thread_num()];
+	  plmdata = plmdataThreads[omp_get_thread_num()];
+#endif
 	  mind = m-firstM;
-	  mTime[mind] -= MPI_Wtime();
+	  mTime[mind] -= SHT_WTIME();
 	  
 	  //sum over rings - lmind tracks alm coefficients for this m
 	  lmind = (lmax+1)*(m-firstM) + ((firstM-2)*(firstM+1))/2 - ((m-2)*(m+1))/2;
@@ -308,46 +359,75 @@ void alm2allmaps_mpi(double *alm_real, double *alm_imag, float *mapvec, float *m
 	      lmin = get_lmin_ylm(m,(float) (nsinthetaRingChunk[i]));
 	      if(lmin <= lmax)
 		{
-		  plmTime -= MPI_Wtime();
+		  plmTime -= SHT_WTIME();
 		  plmgen(ncosthetaRingChunk[i],nsinthetaRingChunk[i],m,plm,&firstl,plmdata);
-		  plmTime += MPI_Wtime();
+		  plmTime += SHT_WTIME();
 		  
 		  //now do sum over l
 		  if(firstl <= lmax)
 		    {
-		      //alm -> map - mapNum = 0 
+		      //alm -> map - mapNum = 0, 2 and 5
+		      //the sums are done into local accumulators with the sign of the south ring applied as 
+		      //a multiplication so that the loop has no carried dependence and can be vectorized
 		      sfact = 1.0 - (((firstl+m)%2) << 1);
+		      pn_real = 0.0;
+		      pn_imag = 0.0;
+		      ps_real = 0.0;
+		      ps_imag = 0.0;
+		      gpn_real = 0.0;
+		      gpn_imag = 0.0;
+		      gps_real = 0.0;
+		      gps_imag = 0.0;
+		      gppn_real = 0.0;
+		      gppn_imag = 0.0;
+		      gpps_real = 0.0;
+		      gpps_imag = 0.0;
+#pragma omp simd private(sgn,rval,ival) reduction(+:pn_real,pn_imag,ps_real,ps_imag,gpn_real,gpn_imag,gps_real,gps_imag, \
+						   gppn_real,gppn_imag,gpps_real,gpps_imag)
 		      for(l=firstl;l<=lmax;++l)
 			{
-			  //this is always true assert((((l+m)%2 == 0 && sfact == 1.0)) || (((l+m)%2 == 1 && sfact == -1.0)));
+			  sgn = ((l-firstl) & 1) ? -1.0 : 1.0;
 			  
 			  //pure synthesis of map
 			  rval = alm_real[lmind + l-m]*plm[l];
 			  ival = alm_imag[lmind + l-m]*plm[l];
-			  qmn_real[0][i][mind] += rval;
-			  qmn_imag[0][i][mind] += ival;
-			  qms_real[0][i][mind] += sfact*rval;
-			  qms_imag[0][i][mind] += sfact*ival;			  
+			  pn_real += rval;
+			  pn_imag += ival;
+			  ps_real += sgn*rval;
+			  ps_imag += sgn*ival;
 			  
 			  //gradient w.r.t. phi is i*m/sin(\theta)P_{lm}\exp(i*m*\phi)*a_{lm} \hat{\phi}
 			  rval *= m;
 			  ival *= m;
-			  qmn_real[2][i][mind] -= ival;//+= -1.0*alm_imag[lmind + l-m]*plm[l]*((double) m);
-			  qmn_imag[2][i][mind] += rval;//alm_real[lmind + l-m]*plm[l]*((double) m);
-			  qms_real[2][i][mind] -= sfact*ival;//+= sfact*(-1.0)*alm_imag[lmind + l-m]*plm[l]*((double) m);
-			  qms_imag[2][i][mind] += sfact*rval;//sfact*alm_real[lmind + l-m]*plm[l]*((double) m);
+			  gpn_real += ival;
+			  gpn_imag += rval;
+			  gps_real += sgn*ival;
+			  gps_imag += sgn*rval;
 			  
 			  //del2phi_div_sin2theta is -m^2/sin^{2}(\theta)P_{lm}\exp(i*m*\phi)*a_{lm}
 			  rval *= m;
 			  ival *= m;
-			  qmn_real[5][i][mind] -= rval;//+= -1.0*alm_real[lmind + l-m]*plm[l]*((double) (m*m));
-			  qmn_imag[5][i][mind] -= ival;//+= -1.0*alm_imag[lmind + l-m]*plm[l]*((double) (m*m));
-			  qms_real[5][i][mind] -= sfact*rval;//+= sfact*(-1.0)*alm_real[lmind + l-m]*plm[l]*((double) (m*m));
-			  qms_imag[5][i][mind] -= sfact*ival;//+= sfact*(-1.0)*alm_imag[lmind + l-m]*plm[l]*((double) (m*m));
-			  
-			  sfact = -sfact;
+			  gppn_real += rval;
+			  gppn_imag += ival;
+			  gpps_real += sgn*rval;
+			  gpps_imag += sgn*ival;
 			}
 		      
+		      qmn_real[0][i][mind] += pn_real;
+		      qmn_imag[0][i][mind] += pn_imag;
+		      qms_real[0][i][mind] += sfact*ps_real;
+		      qms_imag[0][i][mind] += sfact*ps_imag;
+		      
+		      qmn_real[2][i][mind] -= gpn_real;
+		      qmn_imag[2][i][mind] += gpn_imag;
+		      qms_real[2][i][mind] -= sfact*gps_real;
+		      qms_imag[2][i][mind] += sfact*gps_imag;
+		      
+		      qmn_real[5][i][mind] -= gppn_real;
+		      qmn_imag[5][i][mind] -= gppn_imag;
+		      qms_real[5][i][mind] -= sfact*gpps_real;
+		      qms_imag[5][i][mind] -= sfact*gpps_imag;
+		      
 		      //grad theta, grad2 theta, and gradthetgradphi transforms
 		      sfact = 1.0 - 2.0*((firstl+m)%2);
 		      ncos_nsin = ncosthetaRingChunk[i]/nsinthetaRingChunk[i];
@@ -449,7 +529,7 @@ void alm2allmaps_mpi(double *alm_real, double *alm_imag, float *mapvec, float *m
 		} //if(lmax >= lmin)
 	    } //for(i=0;i<NringChunk;++i)
 	  
-	  mTime[mind] += MPI_Wtime();
+	  mTime[mind] += SHT_WTIME();
 	
 	} //for(m=firstM;m<=lastM;++m)
       
@@ -476,10 +556,21 @@ void alm2allmaps_mpi(double *alm_real, double *alm_imag, float *mapvec, float *m
   get_ring_info2(2*Nside,&nstartpix,&ringpix,&ncostheta,&nsintheta,&shifted,plan.order);
   
   //sum over l at fixed m for each ring using only alms on ThisTask
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1) reduction(+:plmTime) \
+  private(mind,mapNum,lmind,i,l,lmin,firstl,plm,plmdata,sfact,sgn,rval,ival, \
+	  pn_real,pn_imag,ps_real,ps_imag,gpn_real,gpn_imag,gps_real,gps_imag, \
+	  gppn_real,gppn_imag,gpps_real,gpps_imag,gradplmn,gradplms,gradplm_lm1_n,gradplm_lm1_s, \
+	  ncos_nsin,ncos_nsin2,ncos2_nsin2,fac1,fac2,fac3,gradquantn,gradquants,gradfact)
+#endif
   for(m=firstM;m<=lastM;++m)
     {
+#ifdef USE_OPENMP
+      plm = plmThreads[omp_get_thread_num()];
+      plmdata = plmdataThreads[omp_get_thread_num()];
+#endif
       mind = m-firstM;
-      mTime[mind] -= MPI_Wtime();
+      mTime[mind] -= SHT_WTIME();
       
       for(mapNum=0;mapNum<6;++mapNum)
 	{
@@ -494,9 +585,9 @@ void alm2allmaps_mpi(double *alm_real, double *alm_imag, float *mapvec, float *m
       lmin = get_lmin_ylm(m,(float) (nsintheta));
       if(lmin <= lmax)
 	{
-	  plmTime -= MPI_Wtime();
+	  plmTime -= SHT_WTIME();
 	  plmgen(ncostheta,nsintheta,m,plm,&firstl,plmdata);
-	  plmTime += MPI_Wtime();
+	  plmTime += SHT_WTIME();
 	  
 	  //now do sum over l
 	  if(firstl <= lmax)
@@ -579,7 +670,7 @@ void alm2allmaps_mpi(double *alm_real, double *alm_imag, float *mapvec, float *m
 	    }//if(firstl <= lmax)
 	}//if(lmax >= lmin)
       
-      mTime[mind] += MPI_Wtime();
+      mTime[mind] += SHT_WTIME();
       
     }//for(m=firstM;m<=lastM;++m)
   
@@ -597,7 +688,17 @@ void alm2allmaps_mpi(double *alm_real, double *alm_imag, float *mapvec, float *m
   //free some mem
   free(plm);
   memTot -= sizeof(double)*(lmax+1);
-  plmgen_destroy(plmdata);
+  if(plmdata != plan.plmdata)
+    plmgen_destroy(plmdata);
+  for(thread=1;thread<NumThreads;++thread)
+    {
+      free(plmThreads[thread]);
+      memTot -= sizeof(double)*(lmax+1);
+      if(thread >= plan.NumPlmThreads || plmdataThreads[thread] != plan.plmdataThreads[thread])
+	plmgen_destroy(plmdataThreads[thread]);
+    }
+  free(plmThreads);
+  free(plmdataThreads);
   
   free(svec);
   memTot -= sizeof(double)*(lmax+1)*NMThisTask;
@@ -1024,6 +1125,7 @@ void alm2allmaps_mpi(double *alm_real, double *alm_imag, float *mapvec, float *m
   
   //finally do ring FFTs
   fftTime -= MPI_Wtime();
+  init_ring_fft_plans(plan.order);
 
 #ifdef DEBUG
 #if DEBUG_LEVEL > 0  
@@ -1040,7 +1142,8 @@ void alm2allmaps_mpi(double *alm_real, double *alm_imag, float *mapvec, float *m
       for(mapNum=0;mapNum<6;++mapNum)
 	{
 	  mapvec = (float*) (mapvec_complex[mapNum] + plan.northStartIndMapvec[nring-firstRing]);
-	  ring_synthesis(ringpix,shifted,mapvec);
+	  mapvec_south = (float*) (mapvec_complex[mapNum] + plan.southStartIndMapvec[nring-firstRing]);
+	  ring_synthesis_pair(ringpix,shifted,mapvec,mapvec_south);
 	  
 	  if(mapNum == 2 || mapNum == 5 || mapNum == 4)
 	    for(i=0;i<ringpix;++i)
@@ -1050,8 +1153,7 @@ void alm2allmaps_mpi(double *alm_real, double *alm_imag, float *mapvec, float *m
 	    for(i=0;i<ringpix;++i)
 	      mapvec[i] /= nsintheta;
 	  
-	  mapvec = (float*) (mapvec_complex[mapNum] + plan.southStartIndMapvec[nring-firstRing]);
-	  ring_synthesis(ringpix,shifted,mapvec);
+	  mapvec = mapvec_south;
 	  
 	  if(mapNum == 2 || mapNum == 5 || mapNum == 4)
 	    for(i=0;i<ringpix;++i)
@@ -50,6 +50,12 @@
 #include "healpix_utils.h"
 #include "healpix_shtrans.h"
 
+static double alm2map_sum_ringchunk_m(long m, long firstM, long lmax, long NringChunk, 
+				      double *ncosthetaRingChunk, double *nsinthetaRingChunk,
+				      double *alm_real, double *alm_imag,
+				      double **qmn_real, double **qmn_imag, double **qms_real, double **qms_imag,
+				      double *plm, plmgen_data *plmdata, double *mTime);
+
 void alm2map_mpi(double *alm_real, double *alm_imag, float *mapvec, HEALPixSHTPlan plan)
 {
   int NTasks,ThisTask;
@@ -58,9 +64,8 @@ void alm2map_mpi(double *alm_real, double *alm_imag, float *mapvec, HEALPixSHTPl
   double *transDataRealRecv,*transDataImagRecv;
   long NrTDR,NmTDR;
   
-  long nring,j,i,lmind,l,m,mp,k,lmin,ringpix_complex;
-  double sfact,skfact;
-  double rval,ival;
+  long nring,j,i,l,m,mp,k,ringpix_complex;
+  double skfact;
   
   long nstartpix,ringpix,shifted;
   double nsintheta,ncostheta;
@@ -79,8 +84,10 @@ void alm2map_mpi(double *alm_real, double *alm_imag, float *mapvec, HEALPixSHTPl
   double *plm;
   plmgen_data *plmdata;
   double plmeps;
-  long firstl;
   long firstM,lastM,NMThisTask;
+  int NumThreads,thread;
+  double **plmThreads;
+  plmgen_data **plmdataThreads;
   
   double runTime;
 #ifdef OUTPUT_SHT_LOADBALANCE
@@ -90,6 +97,7 @@ void alm2map_mpi(double *alm_real, double *alm_imag, float *mapvec, HEALPixSHTPl
   double transTime,fftTime,sumTime,pixTime,plmTime;
   
   fftwf_complex *mapvec_complex;
+  float *mapvec_south;
   double *mTime;
   long Nchunks,chunkInd;
   
@@ -97,7 +105,6 @@ void alm2map_mpi(double *alm_real, double *alm_imag, float *mapvec, HEALPixSHTPl
   double *transDataReal;
   double *transDataImag;
   long NmTD,NrTD;
-  long mind;
   
   //init timing and basic data for plan
   runTime = -MPI_Wtime();
@@ -113,7 +120,7 @@ void alm2map_mpi(double *alm_real, double *alm_imag, float *mapvec, HEALPixSHTPl
   
   Nside = order2nside(plan.order);
   Nrings = 2*Nside;
-  plmeps = 1e-30;
+  plmeps = SHT_PLMEPS;
   lmax = plan.lmax;
   mapvec_complex = (fftwf_complex*) mapvec;
     
@@ -156,7 +163,39 @@ void alm2map_mpi(double *alm_real, double *alm_imag, float *mapvec, HEALPixSHTPl
   assert(plm != NULL);
   memTot += sizeof(double)*(lmax + 1);
   plmTime -= MPI_Wtime();
-  plmdata = plmgen_init(lmax,plmeps);
+  if(plan.plmdata != NULL && plan.plmdata->lmax == lmax && plan.plmdata->eps == plmeps)
+    {
+      plmdata = plan.plmdata;
+      plmgen_reset(plmdata);
+    }
+  else
+    plmdata = plmgen_init(lmax,plmeps);
+  
+  //each thread needs its own plm buffer and plm generator since plmgen keeps state between calls
+#ifdef USE_OPENMP
+  NumThreads = omp_get_max_threads();
+#else
+  NumThreads = 1;
+#endif
+  plmThreads = (double**)malloc(sizeof(double*)*NumThreads);
+  assert(plmThreads != NULL);
+  plmdataThreads = (plmgen_data**)malloc(sizeof(plmgen_data*)*NumThreads);
+  assert(plmdataThreads != NULL);
+  plmThreads[0] = plm;
+  plmdataThreads[0] = plmdata;
+  for(thread=1;thread<NumThreads;++thread)
+    {
+      plmThreads[thread] = (double*)malloc(sizeof(double)*(lmax + 1));
+      assert(plmThreads[thread] != NULL);
+      memTot += sizeof(double)*(lmax + 1);
+      if(thread < plan.NumPlmThreads && plan.plmdataThreads[thread]->lmax == lmax && plan.plmdataThreads[thread]->eps == plmeps)
+	{
+	  plmdataThreads[thread] = plan.plmdataThreads[thread];
+	  plmgen_reset(plmdataThreads[thread]);
+	}
+      else
+	plmdataThreads[thread] = plmgen_init(lmax,plmeps);
+    }
   plmTime += MPI_Wtime();
   
   //compute layout for transposed data
@@ -269,50 +308,21 @@ void alm2map_mpi(double *alm_real, double *alm_imag, float *mapvec, HEALPixSHTPl
 	    }
 	}
       
-      //sum over l at fixed m for each ring using only alms on ThisTask
+      //sum over l at fixed m for each ring using only alms on ThisTask - each m is done by one thread
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1) reduction(+:plmTime)
+#endif
       for(m=firstM;m<=lastM;++m)
 	{
-	  mind = m-firstM;
-	  mTime[mind] -= MPI_Wtime();
-	  
-	  //sum over rings - lmind tracks alm coefficients for this m
-	  lmind = (lmax+1)*(m-firstM) + ((firstM-2)*(firstM+1))/2 - ((m-2)*(m+1))/2;
-	  for(i=0;i<NringChunk;++i)
-	    {
-	      //do not sum over Ylm which are too small
-	      lmin = get_lmin_ylm(m,(float) (nsinthetaRingChunk[i]));
-	      if(lmin <= lmax)
-		{
-		  plmTime -= MPI_Wtime();
-		  plmgen(ncosthetaRingChunk[i],nsinthetaRingChunk[i],m,plm,&firstl,plmdata);
-		  plmTime += MPI_Wtime();
-		  
-		  //now do sum over l
-		  if(firstl <= lmax)
-		    {
-		      //alm -> map - mapNum = 0 
-		      sfact = 1.0 - (((firstl+m)%2) << 1);
-		      for(l=firstl;l<=lmax;++l)
-			{
-			  //this is always true assert((((l+m)%2 == 0 && sfact == 1.0)) || (((l+m)%2 == 1 && sfact == -1.0)));
-			  
-			  //pure synthesis of map
-			  rval = alm_real[lmind + l-m]*plm[l];
-			  ival = alm_imag[lmind + l-m]*plm[l];
-			  qmn_real[i][mind] += rval;
-			  qmn_imag[i][mind] += ival;
-			  qms_real[i][mind] += sfact*rval;
-			  qms_imag[i][mind] += sfact*ival;			  
-			  
-			  sfact = -sfact;
-			}
-		    } //if(firstl <= lmax)
-		} //if(lmax >= lmin)
-	    } //for(i=0;i<NringChunk;++i)
-	  
-	  mTime[mind] += MPI_Wtime();
-	
-	} //for(m=firstM;m<=lastM;++m)
+#ifdef USE_OPENMP
+	  int tnum = omp_get_thread_num();
+#else
+	  int tnum = 0;
+#endif
+	  plmTime += alm2map_sum_ringchunk_m(m,firstM,lmax,NringChunk,ncosthetaRingChunk,nsinthetaRingChunk,
+					     alm_real,alm_imag,qmn_real,qmn_imag,qms_real,qms_imag,
+					     plmThreads[tnum],plmdataThreads[tnum],mTime);
+	}
       
       //put data in array for transpose
       for(i=0;i<NringChunk;++i)
@@ -332,46 +342,33 @@ void alm2map_mpi(double *alm_real, double *alm_imag, float *mapvec, HEALPixSHTPl
       
     }//for(chunkInd=0;chunkInd<Nchunks;++chunkInd)
   
-  ///do last ring on equator as a special case to avoid branching in loops
+  ///do last ring on equator as a chunk with one ring - only the north ring values are used
   get_ring_info2(2*Nside,&nstartpix,&ringpix,&ncostheta,&nsintheta,&shifted,plan.order);
+  ncosthetaRingChunk[0] = ncostheta;
+  nsinthetaRingChunk[0] = nsintheta;
+  for(j=0;j<Nqm;++j)
+    {
+      qmn_real[0][j] = 0.0;
+      qmn_imag[0][j] = 0.0;
+      qms_real[0][j] = 0.0;
+      qms_imag[0][j] = 0.0;
+    }
   
   //sum over l at fixed m for each ring using only alms on ThisTask
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1) reduction(+:plmTime)
+#endif
   for(m=firstM;m<=lastM;++m)
     {
-      mind = m-firstM;
-      mTime[mind] -= MPI_Wtime();
-      
-      qmn_real[0][mind] = 0.0;
-      qmn_imag[0][mind] = 0.0;
-      
-      //lmind tracks alm coefficients for this m
-      lmind = (lmax+1)*(m-firstM) + ((firstM-2)*(firstM+1))/2 - ((m-2)*(m+1))/2;
-      
-      //do not sum over Ylm which are too small
-      lmin = get_lmin_ylm(m,(float) (nsintheta));
-      if(lmin <= lmax)
-	{
-	  plmTime -= MPI_Wtime();
-	  plmgen(ncostheta,nsintheta,m,plm,&firstl,plmdata);
-	  plmTime += MPI_Wtime();
-	  
-	  //now do sum over l
-	  if(firstl <= lmax)
-	    {
-	      for(l=firstl;l<=lmax;++l)
-		{
-		  //alm -> map
-		  rval = alm_real[lmind + l-m]*plm[l];
-		  ival = alm_imag[lmind + l-m]*plm[l];
-		  qmn_real[0][mind] += rval;//alm_real[lmind + l-m]*plm[l];
-		  qmn_imag[0][mind] += ival;//alm_imag[lmind + l-m]*plm[l];
-		}
-	    }//if(firstl <= lmax)
-	}//if(lmax >= lmin)
-      
-      mTime[mind] += MPI_Wtime();
-      
-    }//for(m=firstM;m<=lastM;++m)
+#ifdef USE_OPENMP
+      int tnum = omp_get_thread_num();
+#else
+      int tnum = 0;
+#endif
+      plmTime += alm2map_sum_ringchunk_m(m,firstM,lmax,1,ncosthetaRingChunk,nsinthetaRingChunk,
+					 alm_real,alm_imag,qmn_real,qmn_imag,qms_real,qms_imag,
+					 plmThreads[tnum],plmdataThreads[tnum],mTime);
+    }
   
   nring = 2*Nside - 1;
   for(k=0;k<NmTD;++k)
@@ -384,7 +381,17 @@ void alm2map_mpi(double *alm_real, double *alm_imag, float *mapvec, HEALPixSHTPl
   //free some mem
   free(plm);
   memTot -= sizeof(double)*(lmax+1);
-  plmgen_destroy(plmdata);
+  if(plmdata != plan.plmdata)
+    plmgen_destroy(plmdata);
+  for(thread=1;thread<NumThreads;++thread)
+    {
+      free(plmThreads[thread]);
+      memTot -= sizeof(double)*(lmax+1);
+      if(thread >= plan.NumPlmThreads || plmdataThreads[thread] != plan.plmdataThreads[thread])
+	plmgen_destroy(plmdataThreads[thread]);
+    }
+  free(plmThreads);
+  free(plmdataThreads);
   
   for(i=0;i<NringChunkBase;++i)
     {
@@ -792,6 +799,7 @@ void alm2map_mpi(double *alm_real, double *alm_imag, float *mapvec, HEALPixSHTPl
   
   //finally do ring FFTs
   fftTime -= MPI_Wtime();
+  init_ring_fft_plans(plan.order);
 
 #ifdef DEBUG
 #if DEBUG_LEVEL > 0  
@@ -806,10 +814,8 @@ void alm2map_mpi(double *alm_real, double *alm_imag, float *mapvec, HEALPixSHTPl
       get_ring_info2(nring,&nstartpix,&ringpix,&ncostheta,&nsintheta,&shifted,plan.order);
       
       mapvec = (float*) (mapvec_complex + plan.northStartIndMapvec[nring-firstRing]);
-      ring_synthesis(ringpix,shifted,mapvec);
-      
-      mapvec = (float*) (mapvec_complex + plan.southStartIndMapvec[nring-firstRing]);
-      ring_synthesis(ringpix,shifted,mapvec);
+      mapvec_south = (float*) (mapvec_complex + plan.southStartIndMapvec[nring-firstRing]);
+      ring_synthesis_pair(ringpix,shifted,mapvec,mapvec_south);
       
       ringTime[nring-firstRing] += MPI_Wtime();
     }
@@ -921,3 +927,71 @@ void alm2map_mpi(double *alm_real, double *alm_imag, float *mapvec, HEALPixSHTPl
 #endif
 }
 
+/* 
+  does the sums over l at fixed m for the NringChunk rings of a chunk and returns the time spent making plms
+  
+  only column m-firstM of the q arrays and mTime is touched, so different m can be done at once in different threads
+  the l sums are done into local accumulators with the alternating sign of the south ring applied as a 
+  multiplication so that the loop has no carried dependence and can be vectorized - with USE_OPENMP 
+  the compiler is allowed to reorder the sums
+*/
+static double alm2map_sum_ringchunk_m(long m, long firstM, long lmax, long NringChunk, 
+				      double *ncosthetaRingChunk, double *nsinthetaRingChunk,
+				      double *alm_real, double *alm_imag,
+				      double **qmn_real, double **qmn_imag, double **qms_real, double **qms_imag,
+				      double *plm, plmgen_data *plmdata, double *mTime)
+{
+  long i,l,lmind,lmin,firstl,mind;
+  double sfact,rval,ival,sgn,sumn_real,sumn_imag,sums_real,sums_imag;
+  double plmTime = 0.0;
+  
+  mind = m-firstM;
+  mTime[mind] -= SHT_WTIME();
+  
+  //sum over rings - lmind tracks alm coefficients for this m
+  lmind = (lmax+1)*(m-firstM) + ((firstM-2)*(firstM+1))/2 - ((m-2)*(m+1))/2;
+  for(i=0;i<NringChunk;++i)
+    {
+      //do not sum over Ylm which are too small
+      lmin = get_lmin_ylm(m,(float) (nsinthetaRingChunk[i]));
+      if(lmin <= lmax)
+	{
+	  plmTime -= SHT_WTIME();
+	  plmgen(ncosthetaRingChunk[i],nsinthetaRingChunk[i],m,plm,&firstl,plmdata);
+	  plmTime += SHT_WTIME();
+	  
+	  //now do sum over l
+	  if(firstl <= lmax)
+	    {
+	      //the sign of the south ring term is sfact at l = firstl and alternates with l
+	      sfact = 1.0 - (((firstl+m)%2) << 1);
+	      sumn_real = 0.0;
+	      sumn_imag = 0.0;
+	      sums_real = 0.0;
+	      sums_imag = 0.0;
+#pragma omp simd reduction(+:sumn_real,sumn_imag,sums_real,sums_imag)
+	      for(l=firstl;l<=lmax;++l)
+		{
+		  sgn = ((l-firstl) & 1) ? -1.0 : 1.0;
+		  
+		  //pure synthesis of map
+		  rval = alm_real[lmind + l-m]*plm[l];
+		  ival = alm_imag[lmind + l-m]*plm[l];
+		  sumn_real += rval;
+		  sumn_imag += ival;
+		  sums_real += sgn*rval;
+		  sums_imag += sgn*ival;
+		}
+	      
+	      qmn_real[i][mind] += sumn_real;
+	      qmn_imag[i][mind] += sumn_imag;
+	      qms_real[i][mind] += sfact*sums_real;
+	      qms_imag[i][mind] += sfact*sums_imag;
+	    } //if(firstl <= lmax)
+	} //if(lmax >= lmin)
+    } //for(i=0;i<NringChunk;++i)
+  
+  mTime[mind] += SHT_WTIME();
+  
+  return plmTime;
+}
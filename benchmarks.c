@@ -0,0 +1,60 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <mpi.h>
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+#include "raytrace.h"
+#include "gridtilecache.h"
+#include "mgpoissonsolve.h"
+
+/* stand alone driver for the timing tests of the ray tracing building blocks - build with 'make benchmarks'
+   usage: raytrace_benchmarks [all|gtc|mgsmooth]
+   gtc - grid tile cache vs. GridCellHash for the 3D potential ray stencils on a 512^3 grid with 1000000 sample points
+   mgsmooth - MG red-black smoothers on the MG patch grid sizes up to 1024 cells on a side with 4 sweeps per blocked call
+   the tests only run on task 0
+*/
+int main(int argc, char **argv)
+{
+  const char *which = "all";
+
+#ifdef USE_OPENMP
+  int provided;
+  int rc = MPI_Init_thread(&argc,&argv,MPI_THREAD_FUNNELED,&provided);
+#else
+  int rc = MPI_Init(&argc,&argv);
+#endif
+  if(rc != MPI_SUCCESS)
+    {
+      fprintf(stderr,"Error starting MPI program. Terminating.\n");
+      MPI_Abort(MPI_COMM_WORLD,rc);
+    }
+  MPI_Comm_size(MPI_COMM_WORLD,&NTasks);
+  MPI_Comm_rank(MPI_COMM_WORLD,&ThisTask);
+
+  if(argc >= 2)
+    which = argv[1];
+  if(strcmp(which,"all") != 0 && strcmp(which,"gtc") != 0 && strcmp(which,"mgsmooth") != 0)
+    {
+      if(ThisTask == 0)
+	fprintf(stderr,"unknown benchmark '%s' - use all, gtc or mgsmooth\n",which);
+      MPI_Abort(MPI_COMM_WORLD,1);
+    }
+
+  if(ThisTask == 0)
+    {
+#ifdef USE_OPENMP
+      fprintf(stderr,"using %d OpenMP threads per task.\n",omp_get_max_threads());
+#endif
+      if(strcmp(which,"all") == 0 || strcmp(which,"gtc") == 0)
+	test_gtc_vs_gchash(512,1000000);
+
+      if(strcmp(which,"all") == 0 || strcmp(which,"mgsmooth") == 0)
+	test_mgsmooth_speed(1024,4);
+    }
+
+  MPI_Finalize();
+  return 0;
+}
@@ -37,6 +37,7 @@ void read_config(char *filename)
   rayTraceData.GalOutputName[0] = '\0';
   rayTraceData.HEALPixRingWeightPath[0] = '\0';
   rayTraceData.HEALPixWindowFunctionPath[0] = '\0';
+  rayTraceData.SHTLoadBalancePath[0] = '\0';
   rayTraceData.maxRayMemImbalance = 0.25;
   rayTraceData.MGConvFact = -1.0;
   rayTraceData.ComvSmoothingScale = -1.0;
@@ -45,6 +46,9 @@ void read_config(char *filename)
   rayTraceData.MaxNFFT = -1;
   rayTraceData.ThreeDPotSnapList[0] = '\0';
   rayTraceData.LengthConvFact = -1.0;
+  rayTraceData.MaxPrefetchMemMB = 1024.0;
+  rayTraceData.MGInitGuess = 0;
+  rayTraceData.MaxMGStencilMemMB = 512.0;
   
   //make output dir
   mkdir(rayTraceData.OutputPath,02755);
@@ -140,14 +144,18 @@ void read_config(char *filename)
       ASSIGN_CONFIG_LONG(SHTOrder);
       ASSIGN_CONFIG_STR(HEALPixRingWeightPath);
       ASSIGN_CONFIG_STR(HEALPixWindowFunctionPath);
+      ASSIGN_CONFIG_STR(SHTLoadBalancePath);
       
       ASSIGN_CONFIG_DOUBLE(ComvSmoothingScale);
       ASSIGN_CONFIG_DOUBLE(maxRayMemImbalance);
       ASSIGN_CONFIG_DOUBLE(MGConvFact);
+      ASSIGN_CONFIG_LONG(MGInitGuess);
+      ASSIGN_CONFIG_DOUBLE(MaxMGStencilMemMB);
       
       ASSIGN_CONFIG_LONG(MaxNFFT);
       ASSIGN_CONFIG_STR(ThreeDPotSnapList);
       ASSIGN_CONFIG_DOUBLE(LengthConvFact);
+      ASSIGN_CONFIG_DOUBLE(MaxPrefetchMemMB);
       
       ASSIGN_CONFIG_STR(GalsFileList);
       ASSIGN_CONFIG_STR(GalOutputName);
@@ -168,6 +176,7 @@ void read_config(char *filename)
   
   //error check
   assert(rayTraceData.maxRayMemImbalance > 0.0);
+  assert(rayTraceData.MGInitGuess == 0 || rayTraceData.MGInitGuess == 1);
   
   assert(rayTraceData.ComvSmoothingScale > 0.0);
   rayTraceData.minComvSmoothingScale = rayTraceData.ComvSmoothingScale;
@@ -182,6 +191,8 @@ void read_config(char *filename)
   
   assert(rayTraceData.rayOrder >= rayTraceData.bundleOrder);
   assert(rayTraceData.SHTOrder >= rayTraceData.bundleOrder);
+  if(strlen(rayTraceData.SHTLoadBalancePath) == 0)
+    strcpy(rayTraceData.SHTLoadBalancePath,rayTraceData.OutputPath);
     
   if(strlen(rayTraceData.GalsFileList) > 0)
     {
@@ -12,6 +12,7 @@
 #include "raytrace.h"
 #include "fftpoissonsolve.h"
 #include "gridcellhash.h"
+#include "gridtilecache.h"
 #include "lgadgetio.h"
 
 #define WRAPIF(id,N) {if(id >= N) id -= N; if(id < 0) id += N; assert(id >= 0 && id < N);}
@@ -32,9 +33,9 @@ static void get_units(char *fbase, double *L, double *a);
 /* Notes for how to do this
 
 1) compute for each bundle cell the range of grid cells needed
-   for now do this step using an array of cells and inthash.c
+   the cells are kept in a dense tile cache (gridtilecache.c) over their bounding box
 
-2) sort cells by index
+2) bucket cells by the task which owns their slab
 
 3) send/recv cells needed from other processors
 
@@ -164,13 +165,13 @@ void threedpot_poissondriver(void)
   double chimax = rayTraceData.planeRad + binL/2.0;
   double dchi = (chimax-chimin)/Nint;
   
-  //init grid cell hash table
-  GridCellHash *gch;
+  //init grid tile cache
+  GridTileCache *gtc;
   
   double vec[3];
   long j,k;
   long ip1,jp1,kp1;
-  long id,n,m;
+  long n,m;
   long di,dj,dk;
   long ii,jj,kk;
   double rad;
@@ -178,15 +179,14 @@ void threedpot_poissondriver(void)
   long rind;
   long ind;
   long pp[3],pm[3],mp[3],mm[3];
-  long indvec[3][3][3];
+  long iv[3],jv[3],kv[3];
   double cost,cosp,sint,sinp;
-  double theta,phi,r;
+  double theta,phi,r,rvec[3];
   double dx,dy,dz;
   double val,fac1,fac2;
   
   long NumActiveBundleCells;
   long *activeBundleCellInds;
-  long MaxNumActiveBundleCells;
   NumActiveBundleCells = 0;
   for(bind=0;bind<NbundleCells;++bind) {
     if(ISSETBITFLAG(bundleCells[bind].active,PRIMARY_BUNDLECELL)) {
@@ -203,229 +203,657 @@ void threedpot_poissondriver(void)
     }
   }
   assert(n == NumActiveBundleCells);
-  MPI_Allreduce(&NumActiveBundleCells,&MaxNumActiveBundleCells,1,MPI_LONG,MPI_MAX,MPI_COMM_WORLD);
   long abind;
   
   long Ngbuff = 0;
   GridCell *gbuff = NULL;
   
-  int sendTask,recvTask;
-  int level,log2NTasks = 0;
-  long offset;
-  long Nsend,Nrecv;
-  MPI_Status Stat;
-  while(NTasks > (1 << log2NTasks))
-    ++log2NTasks;
+  int pass;
+  int *slabTask;
+  int *Nreq,*reqOffset,*Nserve,*serveOffset,*reqCurr;
+  long NserveTot,*reqIds,*serveIds,*reqSlots;
+  double *reqVals,*serveVals;
   
-  for(abind=0;abind<MaxNumActiveBundleCells;++abind) {
-    //setup gridcell hash
-    gch = init_gchash();
-    
-    //get index of bundle cell working with
-    if(abind < NumActiveBundleCells) {
+  //get grid cells needed by all of the active bundle cells - the cache dedups cells shared by bundle cells
+  //the first pass finds the bounding box of the stencils and the second one adds the cells
+  gtc = init_gtc(NFFT);
+  for(pass=0;pass<2;++pass) {
+    if(pass == 1)
+      build_gtc(gtc);
+    for(abind=0;abind<NumActiveBundleCells;++abind) {
       bind = activeBundleCellInds[abind];
-    }
-    
-    //get grid cells needed
-    if(abind < NumActiveBundleCells) {
-      if(ISSETBITFLAG(bundleCells[bind].active,PRIMARY_BUNDLECELL)) {
-	for(rind=0;rind<bundleCells[bind].Nrays;++rind) {
-	  r = sqrt(bundleCells[bind].rays[rind].n[0]*bundleCells[bind].rays[rind].n[0] + 
-		   bundleCells[bind].rays[rind].n[1]*bundleCells[bind].rays[rind].n[1] + 
-		   bundleCells[bind].rays[rind].n[2]*bundleCells[bind].rays[rind].n[2]);
+      for(rind=0;rind<bundleCells[bind].Nrays;++rind) {
+	r = sqrt(RAY_N(bundleCells[bind],rind,0)*RAY_N(bundleCells[bind],rind,0) + 
+		 RAY_N(bundleCells[bind],rind,1)*RAY_N(bundleCells[bind],rind,1) + 
+		 RAY_N(bundleCells[bind],rind,2)*RAY_N(bundleCells[bind],rind,2));
+	
+	for(n=0;n<Nint;++n) {
+	  //comp 3D loc
+	  rad = chimin + n*dchi + 0.5*dchi;
 	  
-	  for(n=0;n<Nint;++n) {
-	    //comp 3D loc
-	    rad = chimin + n*dchi + 0.5*dchi;
-	    
-	    vec[0] = bundleCells[bind].rays[rind].n[0]*rad/r;
-	    vec[1] = bundleCells[bind].rays[rind].n[1]*rad/r;
-	    vec[2] = bundleCells[bind].rays[rind].n[2]*rad/r;
-	    
-	    for(m=0;m<3;++m) {
-	      while(vec[m] < 0)
-		vec[m] += L;
-	      while(vec[m] >= L)
-		vec[m] -= L;
-	    }
-	    
-	    i = (long) (vec[0]/dL);
-	    WRAPIF(i,NFFT);
+	  vec[0] = RAY_N(bundleCells[bind],rind,0)*rad/r;
+	  vec[1] = RAY_N(bundleCells[bind],rind,1)*rad/r;
+	  vec[2] = RAY_N(bundleCells[bind],rind,2)*rad/r;
+	  
+	  for(m=0;m<3;++m) {
+	    while(vec[m] < 0)
+	      vec[m] += L;
+	    while(vec[m] >= L)
+	      vec[m] -= L;
+	  }
+	  
+	  i = (long) (vec[0]/dL);
+	  WRAPIF(i,NFFT);
+	  
+	  j = (long) (vec[1]/dL);
+	  WRAPIF(j,NFFT);
+	  
+	  k = (long) (vec[2]/dL);
+	  WRAPIF(k,NFFT);
+	  
+	  if(pass == 0) {
+	    ii = i - 1;
+	    WRAPIF(ii,NFFT);
+	    jj = j - 1;
+	    WRAPIF(jj,NFFT);
+	    kk = k - 1;
+	    WRAPIF(kk,NFFT);
+	    addbbox_gtc(gtc,ii,jj,kk);
 	    
-	    j = (long) (vec[1]/dL);
-	    WRAPIF(j,NFFT);
+	    ii = i + 2;
+	    WRAPIF(ii,NFFT);
+	    jj = j + 2;
+	    WRAPIF(jj,NFFT);
+	    kk = k + 2;
+	    WRAPIF(kk,NFFT);
+	    addbbox_gtc(gtc,ii,jj,kk);
 	    
-	    k = (long) (vec[2]/dL);
-	    WRAPIF(k,NFFT);
+	    continue;
+	  }
+	  
+	  //get all eight cells for interp plus those needed for all of the derivs
+	  for(di=-1;di<=2;++di) {
+	    ii = i + di;
+	    WRAPIF(ii,NFFT);
 	    
-	    //get all eight cells for interp plus those needed for all of the derivs
-	    for(di=-1;di<=2;++di) {
-	      ii = i + di;
-	      WRAPIF(ii,NFFT);
+	    for(dj=-1;dj<=2;++dj) {
+	      jj = j + dj;
+	      WRAPIF(jj,NFFT);
 	      
-	      for(dj=-1;dj<=2;++dj) {
-		jj = j + dj;
-		WRAPIF(jj,NFFT);
+	      for(dk=-1;dk<=2;++dk) {
+		kk = k + dk;
+		WRAPIF(kk,NFFT);
 		
-		for(dk=-1;dk<=2;++dk) {
-		  kk = k + dk;
-		  WRAPIF(kk,NFFT);
-		  
-		  id = THREEDIND(ii,jj,kk,NFFT);
-		  ind = getid_gchash(gch,id);
-		}//for(dk=-1;dk<=2;++dk)
-	      }//for(dj=-1;dj<=2;++dj)
-	    }//for(di=-1;di<=2;++di)
-	  }//for(n=0;n<Nint;++n)
-	}//for(rind=0;rind<bundleCells[bind].Nrays;++rind)
+		ind = getid_gtc(gtc,ii,jj,kk);
+	      }//for(dk=-1;dk<=2;++dk)
+	    }//for(dj=-1;dj<=2;++dj)
+	  }//for(di=-1;di<=2;++di)
+	}//for(n=0;n<Nint;++n)
+      }//for(rind=0;rind<bundleCells[bind].Nrays;++rind)
+    }//for(abind=0;abind<NumActiveBundleCells;++abind)
+  }//for(pass=0;pass<2;++pass)
+  assert(gtc->NumCells > 0 || NumActiveBundleCells == 0);
+  
+  //get the cells from the tasks which own their slabs with one all-to-all for the ids and one for the values
+  //the cells are bucketed by owner with a counting pass over the cache, so no sort is needed
+  slabTask = (int*)malloc(sizeof(int)*NFFT);
+  assert(slabTask != NULL);
+  for(n=0;n<NTasks;++n)
+    for(i=TaskN0LocalStart[n];i<TaskN0LocalStart[n]+TaskN0Local[n];++i)
+      slabTask[i] = (int) n;
+  
+  Nreq = (int*)malloc(sizeof(int)*NTasks*5);
+  assert(Nreq != NULL);
+  reqOffset = Nreq + NTasks;
+  Nserve = reqOffset + NTasks;
+  serveOffset = Nserve + NTasks;
+  reqCurr = serveOffset + NTasks;
+  
+  for(n=0;n<NTasks;++n)
+    Nreq[n] = 0;
+  for(m=0;m<GTC_NUMSLOTS(gtc);++m) {
+    if(!(gtc->used[m]))
+      continue;
+    slot2ijk_gtc(gtc,m,&i,&j,&k);
+    Nreq[slabTask[i]] += 1;
+  }
+  
+  MPI_Alltoall(Nreq,1,MPI_INT,Nserve,1,MPI_INT,MPI_COMM_WORLD);
+  
+  reqOffset[0] = 0;
+  serveOffset[0] = 0;
+  for(n=1;n<NTasks;++n) {
+    reqOffset[n] = reqOffset[n-1] + Nreq[n-1];
+    serveOffset[n] = serveOffset[n-1] + Nserve[n-1];
+  }
+  NserveTot = serveOffset[NTasks-1] + Nserve[NTasks-1];
+  
+  reqIds = (long*)malloc(sizeof(long)*(gtc->NumCells+1));
+  assert(reqIds != NULL);
+  reqSlots = (long*)malloc(sizeof(long)*(gtc->NumCells+1));
+  assert(reqSlots != NULL);
+  reqVals = (double*)malloc(sizeof(double)*(gtc->NumCells+1));
+  assert(reqVals != NULL);
+  serveIds = (long*)malloc(sizeof(long)*(NserveTot+1));
+  assert(serveIds != NULL);
+  serveVals = (double*)malloc(sizeof(double)*(NserveTot+1));
+  assert(serveVals != NULL);
+  
+  for(n=0;n<NTasks;++n)
+    reqCurr[n] = reqOffset[n];
+  for(m=0;m<GTC_NUMSLOTS(gtc);++m) {
+    if(!(gtc->used[m]))
+      continue;
+    slot2ijk_gtc(gtc,m,&i,&j,&k);
+    n = reqCurr[slabTask[i]];
+    reqCurr[slabTask[i]] += 1;
+    reqIds[n] = THREEDIND(i,j,k,NFFT);
+    reqSlots[n] = m;
+  }
+  MPI_Alltoallv(reqIds,Nreq,reqOffset,MPI_LONG,serveIds,Nserve,serveOffset,MPI_LONG,MPI_COMM_WORLD);
+  
+  //fill cells for other processors
+  for(m=0;m<NserveTot;++m) {
+    id2ijk(serveIds[m],NFFT,&i,&j,&k);
+    
+    if(!(i >= N0LocalStart && i < N0LocalStart+N0Local)) {
+      fprintf(stderr,"%04d: requested cell not in slab assertion going to fail! %s:%d\n",ThisTask,__FILE__,__LINE__);
+      fflush(stderr);
+    }
+    assert(i >= N0LocalStart && i < N0LocalStart+N0Local);
+    
+    serveVals[m] = fftwrin[((i-N0LocalStart)*NFFT + j) * (2*(NFFT/2+1)) + k];
+  }
+  
+  MPI_Alltoallv(serveVals,Nserve,serveOffset,MPI_DOUBLE,reqVals,Nreq,reqOffset,MPI_DOUBLE,MPI_COMM_WORLD);
+  for(n=0;n<gtc->NumCells;++n)
+    gtc->vals[reqSlots[n]] = reqVals[n];
+  
+  free(slabTask);
+  free(Nreq);
+  free(reqIds);
+  free(reqSlots);
+  free(reqVals);
+  free(serveIds);
+  free(serveVals);
+  
+  //double check the received cells for all zeros - catches errors
+  //the full FFTW slab is checked once per snapshot at the end of comp_pot_snap
+  m = 0;
+  for(i=0;i<GTC_NUMSLOTS(gtc);++i)
+    if(gtc->used[i] && gtc->vals[i] != 0.0) m = 1;
+  if(m != 1 && gtc->NumCells > 0) {
+    fprintf(stderr,"%04d: all potential cells are zero in gtc!\n",ThisTask);
+    fflush(stderr);
+    assert(m == 1);
+  }
+  
+  //interp to rays and comp derivs
+  int dind1,dind2;
+  double jac[3][3];
+  
+  //do pot - read straight from the cache
+  for(abind=0;abind<NumActiveBundleCells;++abind) {
+    bind = activeBundleCellInds[abind];
+    
+    for(rind=0;rind<bundleCells[bind].Nrays;++rind) {
+      r = sqrt(RAY_N(bundleCells[bind],rind,0)*RAY_N(bundleCells[bind],rind,0) +
+	       RAY_N(bundleCells[bind],rind,1)*RAY_N(bundleCells[bind],rind,1) +
+	       RAY_N(bundleCells[bind],rind,2)*RAY_N(bundleCells[bind],rind,2));
       
-	assert(gch->NumGridCells > 0);
+      for(n=0;n<Nint;++n) {
+	//comp 3D loc
+	rad = chimin + n*dchi + 0.5*dchi;
 	
-      }//if(ISSETBITFLAG(bundleCells[bind].active,PRIMARY_BUNDLECELL))
-    }//if(abind < NumActiveBundleCells)
-    
-    //sort to get into slab order
-    sortcells_gchash(gch);
-        
-    //do send/recvs to get cells from other processors
-    /*algorithm to loop through pairs of tasks linearly
-      -lifted from Gadget-2 under GPL (http://www.gnu.org/copyleft/gpl.html)
-      -see pm_periodic.c from Gadget-2 at http://www.mpa-garching.mpg.de/gadget/
-    */  
-    for(level = 0; level < (1 << log2NTasks); level++) {
-      // note: for level=0, target is the same task
-      sendTask = ThisTask;
-      recvTask = ThisTask ^ level;
-      if(recvTask < NTasks) { 
-	//comp # of cells needed from other processor and offset
-	offset = -1;
-	Nrecv = 0;
-	for(n=0;n<gch->NumGridCells;++n)
-	  {
-	    if(gch->GridCells[n].id >= TaskN0LocalStart[recvTask]*NFFT*NFFT &&
-                 gch->GridCells[n].id < TaskN0LocalStart[recvTask]*NFFT*NFFT + TaskN0Local[recvTask]*NFFT*NFFT
-	       && offset < 0)
-	      offset = n;
-	    if(gch->GridCells[n].id >= TaskN0LocalStart[recvTask]*NFFT*NFFT &&
-	       gch->GridCells[n].id < TaskN0LocalStart[recvTask]*NFFT*NFFT + TaskN0Local[recvTask]*NFFT*NFFT)
-	      {
-		Nrecv += 1;
-		id2ijk(gch->GridCells[n].id,NFFT,&i,&j,&k);
-		assert(i >= TaskN0LocalStart[recvTask] && i < TaskN0LocalStart[recvTask]+TaskN0Local[recvTask]);
-	      }
-	    if(gch->GridCells[n].id >= TaskN0LocalStart[recvTask]*NFFT*NFFT + TaskN0Local[recvTask]*NFFT*NFFT)
-	      break;
-	  }
+	vec[0] = RAY_N(bundleCells[bind],rind,0)*rad/r;
+	vec[1] = RAY_N(bundleCells[bind],rind,1)*rad/r;
+	vec[2] = RAY_N(bundleCells[bind],rind,2)*rad/r;
 	
-	if(!((offset >= 0 && Nrecv > 0) || (offset == -1 && Nrecv == 0))) {
-	  fprintf(stderr,"%04d: %d->%d Nrecv = %ld, offset = %ld, tot = %ld\n",ThisTask,sendTask,recvTask,Nrecv,offset,gch->NumGridCells);
-	  fflush(stderr);
+	for(m=0;m<3;++m) {
+	  while(vec[m] < 0)
+	    vec[m] += L;
+	  while(vec[m] >= L)
+	    vec[m] -= L;
 	}
-	assert((offset >= 0 && Nrecv > 0) || (offset == -1 && Nrecv == 0));
 	
-	if(sendTask != recvTask) {
-	  MPI_Sendrecv(&Nrecv,1,MPI_LONG,recvTask,TAG_POTCELL_NUM,
-		       &Nsend,1,MPI_LONG,recvTask,TAG_POTCELL_NUM,
-		       MPI_COMM_WORLD,&Stat);
+	i = (long) (vec[0]/dL);
+	dx = (vec[0] - i*dL)/dL;
+	
+	j = (long) (vec[1]/dL);
+	dy = (vec[1] - j*dL)/dL;
+	
+	k = (long) (vec[2]/dL);
+	dz = (vec[2] - k*dL)/dL;
+	
+	WRAPIF(i,NFFT);
+	ip1 = i + 1;
+	WRAPIF(ip1,NFFT);
+	
+	WRAPIF(j,NFFT);
+	jp1 = j + 1;
+	WRAPIF(jp1,NFFT);
+	
+	WRAPIF(k,NFFT);
+	kp1 = k + 1;
+	WRAPIF(kp1,NFFT);
 	  
-	  if(Nrecv > 0 || Nsend > 0) {
-	    //get cells to send
-	    if(Nsend > Ngbuff) {
-	      gbuff = (GridCell*)realloc(gbuff,sizeof(GridCell)*Nsend);
-	      assert(gbuff != NULL);
-	      Ngbuff = Nsend;
-	    }
-	    MPI_Sendrecv(gch->GridCells+offset,sizeof(GridCell)*Nrecv,MPI_BYTE,recvTask,TAG_POTCELL_IDS,
-			 gbuff,sizeof(GridCell)*Nsend,MPI_BYTE,recvTask,TAG_POTCELL_IDS,
-			 MPI_COMM_WORLD,&Stat);
+	//interp deriv val
+	val = 0.0;
+	  
+	ind = getonlyid_gtc(gtc,i,j,k);
+	assert(ind != GTC_INVALID);
+	val += gtc->vals[ind]*(1.0 - dx)*(1.0 - dy)*(1.0 - dz);
+	
+	ind = getonlyid_gtc(gtc,i,j,kp1);
+	assert(ind != GTC_INVALID);
+	val += gtc->vals[ind]*(1.0 - dx)*(1.0 - dy)*dz;
+	
+	ind = getonlyid_gtc(gtc,i,jp1,k);
+	assert(ind != GTC_INVALID);
+	val += gtc->vals[ind]*(1.0 - dx)*dy*(1.0 - dz);
+	
+	ind = getonlyid_gtc(gtc,i,jp1,kp1);
+	assert(ind != GTC_INVALID);
+	val += gtc->vals[ind]*(1.0 - dx)*dy*dz;
+	
+	ind = getonlyid_gtc(gtc,ip1,j,k);
+	assert(ind != GTC_INVALID);
+	val += gtc->vals[ind]*dx*(1.0 - dy)*(1.0 - dz);
+	
+	ind = getonlyid_gtc(gtc,ip1,j,kp1);
+	assert(ind != GTC_INVALID);
+	val += gtc->vals[ind]*dx*(1.0 - dy)*dz;
+	
+	ind = getonlyid_gtc(gtc,ip1,jp1,k);
+	assert(ind != GTC_INVALID);
+	val += gtc->vals[ind]*dx*dy*(1.0 - dz);
+	
+	ind = getonlyid_gtc(gtc,ip1,jp1,kp1);
+	assert(ind != GTC_INVALID);
+	val += gtc->vals[ind]*dx*dy*dz;
+	
+	RAY_PHI(bundleCells[bind],rind) += val;
+	
+	//check to make sure not inf or nan
+	assert(gsl_finite(RAY_PHI(bundleCells[bind],rind)));
+	
+      }//for(n=0;n<Nint;++n)
+    }//for(rind=0;rind<bundleCells[bind].Nrays;++rind)
+  }//for(abind=0;abind<NumActiveBundleCells;++abind)
+  
+  //make sure buff cells are parallel to the cache slots - the id of a buff cell is its slot
+  Ngbuff = GTC_NUMSLOTS(gtc);
+  gbuff = (GridCell*)realloc(gbuff,sizeof(GridCell)*(Ngbuff+1));
+  assert(gbuff != NULL);
+  
+  //do first derivs
+  for(dind1=0;dind1<3;++dind1) {
+    //comp deriv for this direction
+    //mark cells with no deriv with -1 for id
+    for(m=0;m<GTC_NUMSLOTS(gtc);++m)
+      {
+	//get the wrapped coords of nbr cells
+	gbuff[m].id = -1;
+	if(!(gtc->used[m]))
+	  continue;
+	slot2ijk_gtc(gtc,m,&i,&j,&k);
+	
+	for(n=0;n<3;++n) {
+	  iv[n] = i + n - 1;
+	  WRAPIF(iv[n],NFFT);
+	  jv[n] = j + n - 1;
+	  WRAPIF(jv[n],NFFT);
+	  kv[n] = k + n - 1;
+	  WRAPIF(kv[n],NFFT);
+	}
+	
+	//get derivs
+	//build the stencil
+	for(n=0;n<3;++n) {
+	  if(n == dind1) {
+#ifdef FACE_GRAD
+	    pp[n] = 2;
+	    pm[n] = 1;
+#else
+	    pp[n] = 2;
+	    pm[n] = 0;
+#endif
+	  } 
+	  else {
+	    pp[n] = 1;
+	    pm[n] = 1;
+	  }
+	}
+	
+	//eval stencil parts
+	gbuff[m].val = 0.0;
 	    
-	    //fill cells for other processor
-	    for(m=0;m<Nsend;++m) {
-	      id2ijk(gbuff[m].id,NFFT,&i,&j,&k);
-	      
-	      if(!(i >= N0LocalStart && i < N0LocalStart+N0Local)) {
-		fprintf(stderr,"%04d: send != recv slab assertion going to fail! %s:%d\n",ThisTask,__FILE__,__LINE__);
-		fflush(stderr);
+	ind = getonlyid_gtc(gtc,iv[pp[0]],jv[pp[1]],kv[pp[2]]);
+	if(ind == GTC_INVALID)
+	  continue;
+	gbuff[m].val += gtc->vals[ind];
+	    
+	ind = getonlyid_gtc(gtc,iv[pm[0]],jv[pm[1]],kv[pm[2]]);
+	if(ind == GTC_INVALID)
+	  continue;
+	gbuff[m].val -= gtc->vals[ind];
+	
+	gbuff[m].val /= dL;
+#ifndef FACE_GRAD
+	gbuff[m].val /= 2.0;
+#endif
+	gbuff[m].id = m;
+      }//for(m=0;m<GTC_NUMSLOTS(gtc);++m)
+  
+    //now add part needed to the rays
+    for(abind=0;abind<NumActiveBundleCells;++abind) {
+      bind = activeBundleCellInds[abind];
+      
+      for(rind=0;rind<bundleCells[bind].Nrays;++rind) {
+	//comp jacobian matrix
+	rvec[0] = RAY_N(bundleCells[bind],rind,0);
+	rvec[1] = RAY_N(bundleCells[bind],rind,1);
+	rvec[2] = RAY_N(bundleCells[bind],rind,2);
+	vec2ang(rvec,&theta,&phi);
+	cost = cos(theta);
+	sint = sin(theta);
+	cosp = cos(phi);
+	sinp = sin(phi);
+	
+	//xhat = jac[0][0] that + jac[0][1] phat + jac[0][2] rhat
+	jac[0][0] = cosp*cost;
+	jac[0][1] = -sinp;
+	jac[0][2] = cosp*sint;
+	
+	//yhat = jac[1][0] that + jac[1][1] phat + jac[1][2] rhat
+	jac[1][0] = sinp*cost;
+	jac[1][1] = cosp;
+	jac[1][2] = sinp*sint;
+	
+	//zhat = jac[2][0] that + jac[2][1] phat + jac[2][2] rhat
+	jac[2][0] = -sint;
+	jac[2][1] = 0.0;
+	jac[2][2] = cost;
+	
+	r = sqrt(RAY_N(bundleCells[bind],rind,0)*RAY_N(bundleCells[bind],rind,0) +
+		 RAY_N(bundleCells[bind],rind,1)*RAY_N(bundleCells[bind],rind,1) +
+		 RAY_N(bundleCells[bind],rind,2)*RAY_N(bundleCells[bind],rind,2));
+	
+	for(n=0;n<Nint;++n) {
+	  //comp 3D loc
+	  rad = chimin + n*dchi + 0.5*dchi;
+	  
+	  vec[0] = RAY_N(bundleCells[bind],rind,0)*rad/r;
+	  vec[1] = RAY_N(bundleCells[bind],rind,1)*rad/r;
+	  vec[2] = RAY_N(bundleCells[bind],rind,2)*rad/r;
+	  
+	  for(m=0;m<3;++m) {
+	    while(vec[m] < 0)
+	      vec[m] += L;
+	    while(vec[m] >= L)
+	      vec[m] -= L;
+	  }
+	  
+	  i = (long) (vec[0]/dL);
+	  dx = (vec[0] - i*dL)/dL;
+
+	  j = (long) (vec[1]/dL);
+	  dy = (vec[1] - j*dL)/dL;
+
+	  k = (long) (vec[2]/dL);
+	  dz = (vec[2] - k*dL)/dL;
+	  
+#ifdef FACE_GRAD
+	  if(dind1 == 0) {
+	    if(dx < 0.5) {
+	      --i;
+	      dx += 0.5;
+	    } else {
+	      dx -= 0.5;
+	    }
+	  } else if(dind1 == 1) {
+	    if(dy < 0.5) {
+	      --j;
+	      dy += 0.5;
+	    } else {
+	      dy -= 0.5;
+	    }               
+	  } else {
+	    if(dz < 0.5) {
+	      --k;
+	      dz += 0.5;
+	    } else {
+	      dz -= 0.5;
+	    }                               
+	  }
+#endif
+	  
+	  WRAPIF(i,NFFT);
+	  ip1 = i + 1;
+	  WRAPIF(ip1,NFFT);
+	  
+	  WRAPIF(j,NFFT);
+	  jp1 = j + 1;
+	  WRAPIF(jp1,NFFT);
+	  
+	  WRAPIF(k,NFFT);
+	  kp1 = k + 1;
+	  WRAPIF(kp1,NFFT);
+	  
+	  //interp deriv val
+	  val = 0.0;
+	  
+	  ind = getonlyid_gtc(gtc,i,j,k);
+	  assert(ind != GTC_INVALID);
+	  assert(gbuff[ind].id != -1);
+	  val += gbuff[ind].val*(1.0 - dx)*(1.0 - dy)*(1.0 - dz);
+	  
+	  ind = getonlyid_gtc(gtc,i,j,kp1);
+	  assert(ind != GTC_INVALID);
+	  assert(gbuff[ind].id != -1);
+	  val += gbuff[ind].val*(1.0 - dx)*(1.0 - dy)*dz;
+	  
+	  ind = getonlyid_gtc(gtc,i,jp1,k);
+	  assert(ind != GTC_INVALID);
+	  assert(gbuff[ind].id != -1);
+	  val += gbuff[ind].val*(1.0 - dx)*dy*(1.0 - dz);
+	  
+	  ind = getonlyid_gtc(gtc,i,jp1,kp1);
+	  assert(ind != GTC_INVALID);
+	  assert(gbuff[ind].id != -1);
+	  val += gbuff[ind].val*(1.0 - dx)*dy*dz;
+	  
+	  ind = getonlyid_gtc(gtc,ip1,j,k);
+	  assert(ind != GTC_INVALID);
+	  assert(gbuff[ind].id != -1);
+	  val += gbuff[ind].val*dx*(1.0 - dy)*(1.0 - dz);
+	  
+	  ind = getonlyid_gtc(gtc,ip1,j,kp1);
+	  assert(ind != GTC_INVALID);
+	  assert(gbuff[ind].id != -1);
+	  val += gbuff[ind].val*dx*(1.0 - dy)*dz;
+	  
+	  ind = getonlyid_gtc(gtc,ip1,jp1,k);
+	  assert(ind != GTC_INVALID);
+	  assert(gbuff[ind].id != -1);
+	  val += gbuff[ind].val*dx*dy*(1.0 - dz);
+	  
+	  ind = getonlyid_gtc(gtc,ip1,jp1,kp1);
+	  assert(ind != GTC_INVALID);
+	  assert(gbuff[ind].id != -1);
+	  val += gbuff[ind].val*dx*dy*dz;
+	  
+	  //do the projections and add to ray
+	  for(ii=0;ii<2;++ii)
+	    RAY_ALPHA(bundleCells[bind],rind,ii) += val*jac[dind1][ii];
+	  
+	  //check to make sure not inf or nan
+	  assert(gsl_finite(RAY_ALPHA(bundleCells[bind],rind,0)));
+	  assert(gsl_finite(RAY_ALPHA(bundleCells[bind],rind,1)));
+	  
+	}//for(n=0;n<Nint;++n)
+      }//for(rind=0;rind<bundleCells[bind].Nrays;++rind)
+    }//for(abind=0;abind<NumActiveBundleCells;++abind)
+  }//for(dind1=0;dind1<3;++dind1)
+  
+  //do second derivs
+  for(dind1=0;dind1<3;++dind1)
+    for(dind2=dind1;dind2<3;++dind2) {
+      //comp deriv for this direction
+      //mark cells with no deriv with -1 for id
+      for(m=0;m<GTC_NUMSLOTS(gtc);++m)
+	{
+	  //get the wrapped coords of nbr cells
+	  gbuff[m].id = -1;
+	  if(!(gtc->used[m]))
+	    continue;
+	  slot2ijk_gtc(gtc,m,&i,&j,&k);
+	  
+	  for(n=0;n<3;++n) {
+	    iv[n] = i + n - 1;
+	    WRAPIF(iv[n],NFFT);
+	    jv[n] = j + n - 1;
+	    WRAPIF(jv[n],NFFT);
+	    kv[n] = k + n - 1;
+	    WRAPIF(kv[n],NFFT);
+	  }
+	  
+	  //get derivs
+	  if(dind1 == dind2) {
+	    //build the stencil
+	    for(n=0;n<3;++n) {
+	      if(n == dind1) {
+		pp[n] = 2;
+		pm[n] = 0;
+	      } else {
+		pp[n] = 1;
+		pm[n] = 1;
 	      }
-	      assert(i >= N0LocalStart && i < N0LocalStart+N0Local);
-	      
-	      gbuff[m].val = fftwrin[((i-N0LocalStart)*NFFT + j) * (2*(NFFT/2+1)) + k];
 	    }
 	    
-	    //send cells to other processor
-	    MPI_Sendrecv(gbuff,sizeof(GridCell)*Nsend,MPI_BYTE,recvTask,TAG_POTCELL_VALS,
-			 gch->GridCells+offset,sizeof(GridCell)*Nrecv,MPI_BYTE,recvTask,TAG_POTCELL_VALS,
-			 MPI_COMM_WORLD,&Stat);
+	    //eval stencil parts
+	    gbuff[m].val = -2.0*(gtc->vals[m]);
+	    
+	    ind = getonlyid_gtc(gtc,iv[pp[0]],jv[pp[1]],kv[pp[2]]);
+	    if(ind == GTC_INVALID)
+	      continue;
+	    gbuff[m].val += gtc->vals[ind];
 	    
-	  }// if(Nrecv > 0 || Nsend > 0)
-	}// if(sendTask != recvTask)
-	else {
-	  //store pot
-	  for(m=0;m<Nrecv;++m) {
-	    id2ijk(gch->GridCells[m+offset].id,NFFT,&i,&j,&k);
+	    ind = getonlyid_gtc(gtc,iv[pm[0]],jv[pm[1]],kv[pm[2]]);
+	    if(ind == GTC_INVALID)
+	      continue;
+	    gbuff[m].val += gtc->vals[ind];
 	    
-	    if(!(i >= N0LocalStart && i < N0LocalStart+N0Local)) {
-	      fprintf(stderr,"%04d: send == recv slab assertion going to fail! %s:%d\n",ThisTask,__FILE__,__LINE__);
-	      fflush(stderr);
+	    gbuff[m].val /= dL;
+	    gbuff[m].val /= dL;
+	    gbuff[m].id = m;
+
+	  } else {
+	    //build the stencil
+	    for(n=0;n<3;++n) {
+	      if(n == dind1) {
+		pp[n] = 2;
+		pm[n] = 2;
+#ifdef VERTEX_MIXED_PARTIAL
+		mp[n] = 1;
+		mm[n] = 1;
+#else
+		mp[n] = 0;
+		mm[n] = 0;
+#endif
+	      } else if(n == dind2) {
+		pp[n] = 2;
+		mp[n] = 2;
+#ifdef VERTEX_MIXED_PARTIAL
+		pm[n] = 1;
+		mm[n] = 1;
+#else
+		pm[n] = 0;
+		mm[n] = 0;
+#endif
+	      } else {
+		pp[n] = 1;
+		pm[n] = 1;
+		mp[n] = 1;
+		mm[n] = 1;
+	      }
 	    }
 	    
-	    assert(i >= N0LocalStart && i < N0LocalStart+N0Local);
-	    gch->GridCells[m+offset].val = fftwrin[((i-N0LocalStart)*NFFT + j) * (2*(NFFT/2+1)) + k];
-	  }//for(m=0;m<Nrecv;++m
-	}//else for if(sendTask != recvTask) 
-      }// if(recvTask < NTasks)
-    }// for(level = 0; level < (1 << log2NTasks); level++)
-    
-    
-    //double check FFTs for all zeros - catches errors
-    m = 0;
-    for(i=0;i<N0Local;++i)
-      for(j=0;j<NFFT;++j)
-	for(k=0;k<2*(NFFT/2+1);++k)
-	  if(fftwrin[(i*NFFT + j)*(2*(NFFT/2+1)) + k] != 0.0) m = 1;
-    if(m != 1 && N0Local > 0) {
-      fprintf(stderr,"%04d: all potential cells are zero in FFTW real array!\n",ThisTask);
-      fflush(stderr);
-      assert(m == 1);
-    }
-    m = 0;
-    for(i=0;i<gch->NumGridCells;++i)
-      if(gch->GridCells[i].val != 0.0) m = 1;
-    if(m != 1 && gch->NumGridCells > 0) {
-      fprintf(stderr,"%04d: all potential cells are zero in gch!\n",ThisTask);
-      fflush(stderr);
-      assert(m == 1);
-    }
-    
-    //interp to rays and comp derivs
-    int dind1,dind2;
-    double jac[3][3];
-    if(abind < NumActiveBundleCells) {
-      if(ISSETBITFLAG(bundleCells[bind].active,PRIMARY_BUNDLECELL)) {
-	
-	//make sure buff cells are the same length as gch cells
-	Ngbuff = gch->NumGridCells;
-	gbuff = (GridCell*)realloc(gbuff,sizeof(GridCell)*Ngbuff);
-	assert(gbuff != NULL);
-	
-	//do pot
-	for(m=0;m<gch->NumGridCells;++m) {
-	  gbuff[m].id = gch->GridCells[m].id;
-	  gbuff[m].val = gch->GridCells[m].val;
-	}
+	    //eval stencil parts
+	    gbuff[m].val = 0.0;
+	    
+	    ind = getonlyid_gtc(gtc,iv[pp[0]],jv[pp[1]],kv[pp[2]]);
+	    if(ind == GTC_INVALID)
+	      continue;
+	    gbuff[m].val += gtc->vals[ind];
+	    
+	    ind = getonlyid_gtc(gtc,iv[pm[0]],jv[pm[1]],kv[pm[2]]);
+	    if(ind == GTC_INVALID)
+	      continue;
+	    gbuff[m].val -= gtc->vals[ind];
+	    
+	    ind = getonlyid_gtc(gtc,iv[mp[0]],jv[mp[1]],kv[mp[2]]);
+	    if(ind == GTC_INVALID)
+	      continue;
+	    gbuff[m].val -= gtc->vals[ind];
+	    
+	    ind = getonlyid_gtc(gtc,iv[mm[0]],jv[mm[1]],kv[mm[2]]);
+	    if(ind == GTC_INVALID)
+	      continue;
+	    gbuff[m].val += gtc->vals[ind];
+	    
+	    gbuff[m].val /= dL;
+	    gbuff[m].val /= dL;
+#ifndef VERTEX_MIXED_PARTIAL
+	    gbuff[m].val /= 2.0;
+	    gbuff[m].val /= 2.0;
+#endif
+	    gbuff[m].id = m;
+	  }//end of else
+	  
+	}//for(m=0;m<GTC_NUMSLOTS(gtc);++m)
+      
+      //now add part needed to the rays
+      for(abind=0;abind<NumActiveBundleCells;++abind) {
+	bind = activeBundleCellInds[abind];
 	
 	for(rind=0;rind<bundleCells[bind].Nrays;++rind) {
-	  r = sqrt(bundleCells[bind].rays[rind].n[0]*bundleCells[bind].rays[rind].n[0] +
-		   bundleCells[bind].rays[rind].n[1]*bundleCells[bind].rays[rind].n[1] +
-		   bundleCells[bind].rays[rind].n[2]*bundleCells[bind].rays[rind].n[2]);
+	  //comp jacobian matrix
+	  rvec[0] = RAY_N(bundleCells[bind],rind,0);
+	  rvec[1] = RAY_N(bundleCells[bind],rind,1);
+	  rvec[2] = RAY_N(bundleCells[bind],rind,2);
+	  vec2ang(rvec,&theta,&phi);
+	  cost = cos(theta);
+	  sint = sin(theta);
+	  cosp = cos(phi);
+	  sinp = sin(phi);
+	  
+	  //xhat = jac[0][0] that + jac[0][1] phat + jac[0][2] rhat
+	  jac[0][0] = cosp*cost;
+	  jac[0][1] = -sinp;
+	  jac[0][2] = cosp*sint;
+	  
+	  //yhat = jac[1][0] that + jac[1][1] phat + jac[1][2] rhat
+	  jac[1][0] = sinp*cost;
+	  jac[1][1] = cosp;
+	  jac[1][2] = sinp*sint;
+	  
+	  //zhat = jac[2][0] that + jac[2][1] phat + jac[2][2] rhat
+	  jac[2][0] = -sint;
+	  jac[2][1] = 0.0;
+	  jac[2][2] = cost;
+	  
+	  r = sqrt(RAY_N(bundleCells[bind],rind,0)*RAY_N(bundleCells[bind],rind,0) +
+		   RAY_N(bundleCells[bind],rind,1)*RAY_N(bundleCells[bind],rind,1) +
+		   RAY_N(bundleCells[bind],rind,2)*RAY_N(bundleCells[bind],rind,2));
 	  
 	  for(n=0;n<Nint;++n) {
 	    //comp 3D loc
 	    rad = chimin + n*dchi + 0.5*dchi;
 	    
-	    vec[0] = bundleCells[bind].rays[rind].n[0]*rad/r;
-	    vec[1] = bundleCells[bind].rays[rind].n[1]*rad/r;
-	    vec[2] = bundleCells[bind].rays[rind].n[2]*rad/r;
+	    vec[0] = RAY_N(bundleCells[bind],rind,0)*rad/r;
+	    vec[1] = RAY_N(bundleCells[bind],rind,1)*rad/r;
+	    vec[2] = RAY_N(bundleCells[bind],rind,2)*rad/r;
 	    
 	    for(m=0;m<3;++m) {
 	      while(vec[m] < 0)
@@ -434,679 +862,176 @@ void threedpot_poissondriver(void)
 		vec[m] -= L;
 	    }
 	    
-	    i = (long) (vec[0]/dL);
-	    dx = (vec[0] - i*dL)/dL;
-	    
-	    j = (long) (vec[1]/dL);
-	    dy = (vec[1] - j*dL)/dL;
-	    
-	    k = (long) (vec[2]/dL);
-	    dz = (vec[2] - k*dL)/dL;
-	    
-	    WRAPIF(i,NFFT);
-	    ip1 = i + 1;
-	    WRAPIF(ip1,NFFT);
-	    
-	    WRAPIF(j,NFFT);
-	    jp1 = j + 1;
-	    WRAPIF(jp1,NFFT);
-	    
-	    WRAPIF(k,NFFT);
-	    kp1 = k + 1;
-	    WRAPIF(kp1,NFFT);
+	    if(dind1 != dind2) {
+	      //vertex centered for dind1 != dind2
+	      i = (long) (vec[0]/dL);
+	      dx = (vec[0] - i*dL)/dL;
+#ifdef VERTEX_MIXED_PARTIAL
+	      if(dx < 0.5) {
+		--i;
+		dx += 0.5;
+	      } else {
+		dx -= 0.5;
+	      }
+#endif
+	      WRAPIF(i,NFFT);
+	      ip1 = i + 1;
+	      WRAPIF(ip1,NFFT);
+	      
+	      j = (long) (vec[1]/dL);
+	      dy = (vec[1] - j*dL)/dL;
+#ifdef VERTEX_MIXED_PARTIAL
+	      if(dy < 0.5) {
+		--j;
+		dy += 0.5;
+	      } else {
+		dy -= 0.5;
+	      }
+#endif
+	      WRAPIF(j,NFFT);
+	      jp1 = j + 1;
+	      WRAPIF(jp1,NFFT);
 	      
+	      k = (long) (vec[2]/dL);
+	      dz = (vec[2] - k*dL)/dL;
+#ifdef VERTEX_MIXED_PARTIAL
+	      if(dz < 0.5) {
+		--k;
+		dz += 0.5;
+	      } else {
+		dz -= 0.5;
+	      }
+#endif
+	      WRAPIF(k,NFFT);
+	      kp1 = k + 1;
+	      WRAPIF(kp1,NFFT);
+	      
+	    } else {
+	      //cell centered for dind1 == dind2
+	      i = (long) (vec[0]/dL);
+	      dx = (vec[0] - i*dL)/dL;
+	      WRAPIF(i,NFFT);
+	      ip1 = i + 1;
+	      WRAPIF(ip1,NFFT);
+	      
+	      j = (long) (vec[1]/dL);
+	      dy = (vec[1] - j*dL)/dL;
+	      WRAPIF(j,NFFT);
+	      jp1 = j + 1;
+	      WRAPIF(jp1,NFFT);
+	      
+	      k = (long) (vec[2]/dL);
+	      dz = (vec[2] - k*dL)/dL;
+	      WRAPIF(k,NFFT);
+	      kp1 = k + 1;
+	      WRAPIF(kp1,NFFT);
+	    }
+	    
 	    //interp deriv val
 	    val = 0.0;
-	      
-	    id = THREEDIND(i,j,k,NFFT);
-	    ind = getonlyid_gchash(gch,id);
-	    assert(ind != GCH_INVALID);
+	    
+	    ind = getonlyid_gtc(gtc,i,j,k);
+	    assert(ind != GTC_INVALID);
 	    assert(gbuff[ind].id != -1);
-	    assert(gbuff[ind].id == gch->GridCells[ind].id);
 	    val += gbuff[ind].val*(1.0 - dx)*(1.0 - dy)*(1.0 - dz);
 	    
-	    id = THREEDIND(i,j,kp1,NFFT);
-	    ind = getonlyid_gchash(gch,id);
-	    assert(ind != GCH_INVALID);
+	    ind = getonlyid_gtc(gtc,i,j,kp1);
+	    assert(ind != GTC_INVALID);
 	    assert(gbuff[ind].id != -1);
-	    assert(gbuff[ind].id == gch->GridCells[ind].id);
 	    val += gbuff[ind].val*(1.0 - dx)*(1.0 - dy)*dz;
 	    
-	    id = THREEDIND(i,jp1,k,NFFT);
-	    ind = getonlyid_gchash(gch,id);
-	    assert(ind != GCH_INVALID);
+	    ind = getonlyid_gtc(gtc,i,jp1,k);
+	    assert(ind != GTC_INVALID);
 	    assert(gbuff[ind].id != -1);
-	    assert(gbuff[ind].id == gch->GridCells[ind].id);
 	    val += gbuff[ind].val*(1.0 - dx)*dy*(1.0 - dz);
 	    
-	    id = THREEDIND(i,jp1,kp1,NFFT);
-	    ind = getonlyid_gchash(gch,id);
-	    assert(ind != GCH_INVALID);
+	    ind = getonlyid_gtc(gtc,i,jp1,kp1);
+	    assert(ind != GTC_INVALID);
 	    assert(gbuff[ind].id != -1);
-	    assert(gbuff[ind].id == gch->GridCells[ind].id);
 	    val += gbuff[ind].val*(1.0 - dx)*dy*dz;
 	    
-	    id = THREEDIND(ip1,j,k,NFFT);
-	    ind = getonlyid_gchash(gch,id);
-	    assert(ind != GCH_INVALID);
+	    ind = getonlyid_gtc(gtc,ip1,j,k);
+	    assert(ind != GTC_INVALID);
 	    assert(gbuff[ind].id != -1);
-	    assert(gbuff[ind].id == gch->GridCells[ind].id);
 	    val += gbuff[ind].val*dx*(1.0 - dy)*(1.0 - dz);
 	    
-	    id = THREEDIND(ip1,j,kp1,NFFT);
-	    ind = getonlyid_gchash(gch,id);
-	    assert(ind != GCH_INVALID);
+	    ind = getonlyid_gtc(gtc,ip1,j,kp1);
+	    assert(ind != GTC_INVALID);
 	    assert(gbuff[ind].id != -1);
-	    assert(gbuff[ind].id == gch->GridCells[ind].id);
 	    val += gbuff[ind].val*dx*(1.0 - dy)*dz;
 	    
-	    id = THREEDIND(ip1,jp1,k,NFFT);
-	    ind = getonlyid_gchash(gch,id);
-	    assert(ind != GCH_INVALID);
+	    ind = getonlyid_gtc(gtc,ip1,jp1,k);
+	    assert(ind != GTC_INVALID);
 	    assert(gbuff[ind].id != -1);
-	    assert(gbuff[ind].id == gch->GridCells[ind].id);
 	    val += gbuff[ind].val*dx*dy*(1.0 - dz);
 	    
-	    id = THREEDIND(ip1,jp1,kp1,NFFT);
-	    ind = getonlyid_gchash(gch,id);
-	    assert(ind != GCH_INVALID);
+	    ind = getonlyid_gtc(gtc,ip1,jp1,kp1);
+	    assert(ind != GTC_INVALID);
 	    assert(gbuff[ind].id != -1);
-	    assert(gbuff[ind].id == gch->GridCells[ind].id);
 	    val += gbuff[ind].val*dx*dy*dz;
 	    
-	    bundleCells[bind].rays[rind].phi += val;
+	    //do the projections and add to ray
+	    for(ii=0;ii<2;++ii)
+	      for(jj=0;jj<2;++jj)
+		RAY_U(bundleCells[bind],rind,ii*2+jj) += val*jac[dind1][ii]*jac[dind2][jj];
+	    
+	    if(dind1 != dind2) {
+	      for(ii=0;ii<2;++ii)
+		for(jj=0;jj<2;++jj)
+		  RAY_U(bundleCells[bind],rind,ii*2+jj) += val*jac[dind2][ii]*jac[dind1][jj];
+	    }
 	    
 	    //check to make sure not inf or nan
-	    assert(gsl_finite(bundleCells[bind].rays[rind].phi));
+	    assert(gsl_finite(RAY_U(bundleCells[bind],rind,0)));
+	    assert(gsl_finite(RAY_U(bundleCells[bind],rind,1)));
+	    assert(gsl_finite(RAY_U(bundleCells[bind],rind,2)));
+	    assert(gsl_finite(RAY_U(bundleCells[bind],rind,3)));
 	    
 	  }//for(n=0;n<Nint;++n)
 	}//for(rind=0;rind<bundleCells[bind].Nrays;++rind)
-	
-	//do first derivs
-	for(dind1=0;dind1<3;++dind1) {
-	  //comp deriv for this direction
-	  //mark cells with no deriv with -1 for id
-	  for(m=0;m<gch->NumGridCells;++m)
-	    {
-	      //get ids of nbr cells
-	      gbuff[m].id = -1;
-	      id2ijk(gch->GridCells[m].id,NFFT,&i,&j,&k);
-	      
-	      for(di=-1;di<=1;++di) {
-		ii = i + di;
-		WRAPIF(ii,NFFT);
-		for(dj=-1;dj<=1;++dj) {
-		  jj = j + dj;
-		  WRAPIF(jj,NFFT);
-		  for(dk=-1;dk<=1;++dk) {
-		    kk = k + dk;
-		    WRAPIF(kk,NFFT);
-		    
-		    indvec[di+1][dj+1][dk+1] = THREEDIND(ii,jj,kk,NFFT);
-		  }
-		}
-	      }
-	      
-	      //get derivs
-	      //build the stencil
-	      for(n=0;n<3;++n) {
-		if(n == dind1) {
-#ifdef FACE_GRAD
-		  pp[n] = 2;
-		  pm[n] = 1;
-#else
-		  pp[n] = 2;
-		  pm[n] = 0;
-#endif
-		} 
-		else {
-		  pp[n] = 1;
-		  pm[n] = 1;
-		}
-	      }
-	      
-	      //eval stencil parts
-	      gbuff[m].val = 0.0;
-		  
-	      id = indvec[pp[0]][pp[1]][pp[2]];
-	      ind = getonlyid_gchash(gch,id);
-	      if(ind == GCH_INVALID)
-		continue;
-	      gbuff[m].val += gch->GridCells[ind].val;
-		  
-	      id = indvec[pm[0]][pm[1]][pm[2]];
-	      ind = getonlyid_gchash(gch,id);
-	      if(ind == GCH_INVALID)
-		continue;
-	      gbuff[m].val -= gch->GridCells[ind].val;
-	      
-	      gbuff[m].val /= dL;
-#ifndef FACE_GRAD
-	      gbuff[m].val /= 2.0;
-#endif
-	      gbuff[m].id = gch->GridCells[m].id;
-	    }//for(m=0;m<gch-NumGridCells;++m)
-	
-	  //now add part needed to the rays
-	  for(rind=0;rind<bundleCells[bind].Nrays;++rind) {
-	    //comp jacobian matrix
-	    vec2ang(bundleCells[bind].rays[rind].n,&theta,&phi);
-	    cost = cos(theta);
-	    sint = sin(theta);
-	    cosp = cos(phi);
-	    sinp = sin(phi);
-	    
-	    //xhat = jac[0][0] that + jac[0][1] phat + jac[0][2] rhat
-	    jac[0][0] = cosp*cost;
-	    jac[0][1] = -sinp;
-	    jac[0][2] = cosp*sint;
-	    
-	    //yhat = jac[1][0] that + jac[1][1] phat + jac[1][2] rhat
-	    jac[1][0] = sinp*cost;
-	    jac[1][1] = cosp;
-	    jac[1][2] = sinp*sint;
-	    
-	    //zhat = jac[2][0] that + jac[2][1] phat + jac[2][2] rhat
-	    jac[2][0] = -sint;
-	    jac[2][1] = 0.0;
-	    jac[2][2] = cost;
-	    
-	    r = sqrt(bundleCells[bind].rays[rind].n[0]*bundleCells[bind].rays[rind].n[0] +
-		     bundleCells[bind].rays[rind].n[1]*bundleCells[bind].rays[rind].n[1] +
-		     bundleCells[bind].rays[rind].n[2]*bundleCells[bind].rays[rind].n[2]);
-	    
-	    for(n=0;n<Nint;++n) {
-	      //comp 3D loc
-	      rad = chimin + n*dchi + 0.5*dchi;
-	      
-	      vec[0] = bundleCells[bind].rays[rind].n[0]*rad/r;
-	      vec[1] = bundleCells[bind].rays[rind].n[1]*rad/r;
-	      vec[2] = bundleCells[bind].rays[rind].n[2]*rad/r;
-	      
-	      for(m=0;m<3;++m) {
-		while(vec[m] < 0)
-		  vec[m] += L;
-		while(vec[m] >= L)
-		  vec[m] -= L;
-	      }
-	      
-	      i = (long) (vec[0]/dL);
-	      dx = (vec[0] - i*dL)/dL;
-
-	      j = (long) (vec[1]/dL);
-	      dy = (vec[1] - j*dL)/dL;
-
-	      k = (long) (vec[2]/dL);
-	      dz = (vec[2] - k*dL)/dL;
-	      
-#ifdef FACE_GRAD
-	      if(dind1 == 0) {
-		if(dx < 0.5) {
-		  --i;
-		  dx += 0.5;
-		} else {
-		  dx -= 0.5;
-		}
-	      } else if(dind1 == 1) {
-		if(dy < 0.5) {
-		  --j;
-		  dy += 0.5;
-		} else {
-		  dy -= 0.5;
-		}		
-	      } else {
-		if(dz < 0.5) {
-		  --k;
-		  dz += 0.5;
-		} else {
-		  dz -= 0.5;
-		}				
-	      }
-#endif
-	      
-	      WRAPIF(i,NFFT);
-	      ip1 = i + 1;
-	      WRAPIF(ip1,NFFT);
-	      
-	      WRAPIF(j,NFFT);
-	      jp1 = j + 1;
-	      WRAPIF(jp1,NFFT);
-	      
-	      WRAPIF(k,NFFT);
-	      kp1 = k + 1;
-	      WRAPIF(kp1,NFFT);
-	      
-	      //interp deriv val
-	      val = 0.0;
-	      
-	      id = THREEDIND(i,j,k,NFFT);
-	      ind = getonlyid_gchash(gch,id);
-	      assert(ind != GCH_INVALID);
-	      assert(gbuff[ind].id != -1);
-	      assert(gbuff[ind].id == gch->GridCells[ind].id);
-	      val += gbuff[ind].val*(1.0 - dx)*(1.0 - dy)*(1.0 - dz);
-	      
-	      id = THREEDIND(i,j,kp1,NFFT);
-	      ind = getonlyid_gchash(gch,id);
-	      assert(ind != GCH_INVALID);
-	      assert(gbuff[ind].id != -1);
-	      assert(gbuff[ind].id == gch->GridCells[ind].id);
-	      val += gbuff[ind].val*(1.0 - dx)*(1.0 - dy)*dz;
-	      
-	      id = THREEDIND(i,jp1,k,NFFT);
-	      ind = getonlyid_gchash(gch,id);
-	      assert(ind != GCH_INVALID);
-	      assert(gbuff[ind].id != -1);
-	      assert(gbuff[ind].id == gch->GridCells[ind].id);
-	      val += gbuff[ind].val*(1.0 - dx)*dy*(1.0 - dz);
-	      
-	      id = THREEDIND(i,jp1,kp1,NFFT);
-	      ind = getonlyid_gchash(gch,id);
-	      assert(ind != GCH_INVALID);
-	      assert(gbuff[ind].id != -1);
-	      assert(gbuff[ind].id == gch->GridCells[ind].id);
-	      val += gbuff[ind].val*(1.0 - dx)*dy*dz;
-	      
-	      id = THREEDIND(ip1,j,k,NFFT);
-	      ind = getonlyid_gchash(gch,id);
-	      assert(ind != GCH_INVALID);
-	      assert(gbuff[ind].id != -1);
-	      assert(gbuff[ind].id == gch->GridCells[ind].id);
-	      val += gbuff[ind].val*dx*(1.0 - dy)*(1.0 - dz);
-	      
-	      id = THREEDIND(ip1,j,kp1,NFFT);
-	      ind = getonlyid_gchash(gch,id);
-	      assert(ind != GCH_INVALID);
-	      assert(gbuff[ind].id != -1);
-	      assert(gbuff[ind].id == gch->GridCells[ind].id);
-	      val += gbuff[ind].val*dx*(1.0 - dy)*dz;
-	      
-	      id = THREEDIND(ip1,jp1,k,NFFT);
-	      ind = getonlyid_gchash(gch,id);
-	      assert(ind != GCH_INVALID);
-	      assert(gbuff[ind].id != -1);
-	      assert(gbuff[ind].id == gch->GridCells[ind].id);
-	      val += gbuff[ind].val*dx*dy*(1.0 - dz);
-	      
-	      id = THREEDIND(ip1,jp1,kp1,NFFT);
-	      ind = getonlyid_gchash(gch,id);
-	      assert(ind != GCH_INVALID);
-	      assert(gbuff[ind].id != -1);
-	      assert(gbuff[ind].id == gch->GridCells[ind].id);
-	      val += gbuff[ind].val*dx*dy*dz;
-	      
-	      //do the projections and add to ray
-	      for(ii=0;ii<2;++ii)
-		bundleCells[bind].rays[rind].alpha[ii] += val*jac[dind1][ii];
-	      
-	      //check to make sure not inf or nan
-	      assert(gsl_finite(bundleCells[bind].rays[rind].alpha[0]));
-	      assert(gsl_finite(bundleCells[bind].rays[rind].alpha[1]));
-	      
-	    }//for(n=0;n<Nint;++n)
-	  }//for(rind=0;rind<bundleCells[bind].Nrays;++rind)
-	}//for(dind1=0;dind1<3;++dind1)
-	
-	//do second derivs
-	for(dind1=0;dind1<3;++dind1)
-	  for(dind2=dind1;dind2<3;++dind2) {
-	    //comp deriv for this direction
-	    //mark cells with no deriv with -1 for id
-	    for(m=0;m<gch->NumGridCells;++m)
-	      {
-		//get ids of nbr cells
-		gbuff[m].id = -1;
-		id2ijk(gch->GridCells[m].id,NFFT,&i,&j,&k);
-		
-		for(di=-1;di<=1;++di) {
-		  ii = i + di;
-		  WRAPIF(ii,NFFT);
-		  for(dj=-1;dj<=1;++dj) {
-		    jj = j + dj;
-		    WRAPIF(jj,NFFT);
-		    for(dk=-1;dk<=1;++dk) {
-		      kk = k + dk;
-		      WRAPIF(kk,NFFT);
-		      
-		      indvec[di+1][dj+1][dk+1] = THREEDIND(ii,jj,kk,NFFT);
-		    }
-		  }
-		}
-		
-		//get derivs
-		if(dind1 == dind2) {
-		  //build the stencil
-		  for(n=0;n<3;++n) {
-		    if(n == dind1) {
-		      pp[n] = 2;
-		      pm[n] = 0;
-		    } else {
-		      pp[n] = 1;
-		      pm[n] = 1;
-		    }
-		  }
-		  
-		  //eval stencil parts
-		  gbuff[m].val = -2.0*(gch->GridCells[m].val);
-		  
-		  id = indvec[pp[0]][pp[1]][pp[2]];
-		  ind = getonlyid_gchash(gch,id);
-		  if(ind == GCH_INVALID)
-		    continue;
-		  gbuff[m].val += gch->GridCells[ind].val;
-		  
-		  id = indvec[pm[0]][pm[1]][pm[2]];
-		  ind = getonlyid_gchash(gch,id);
-		  if(ind == GCH_INVALID)
-		    continue;
-		  gbuff[m].val += gch->GridCells[ind].val;
-		  
-		  gbuff[m].val /= dL;
-		  gbuff[m].val /= dL;
-		  gbuff[m].id = gch->GridCells[m].id;
-
-		} else {
-		  //build the stencil
-		  for(n=0;n<3;++n) {
-		    if(n == dind1) {
-		      pp[n] = 2;
-		      pm[n] = 2;
-#ifdef VERTEX_MIXED_PARTIAL
-		      mp[n] = 1;
-		      mm[n] = 1;
-#else
-		      mp[n] = 0;
-		      mm[n] = 0;
-#endif
-		    } else if(n == dind2) {
-		      pp[n] = 2;
-		      mp[n] = 2;
-#ifdef VERTEX_MIXED_PARTIAL
-		      pm[n] = 1;
-		      mm[n] = 1;
-#else
-		      pm[n] = 0;
-		      mm[n] = 0;
-#endif
-		    } else {
-		      pp[n] = 1;
-		      pm[n] = 1;
-		      mp[n] = 1;
-		      mm[n] = 1;
-		    }
-		  }
-		  
-		  //eval stencil parts
-		  gbuff[m].val = 0.0;
-		  
-		  id = indvec[pp[0]][pp[1]][pp[2]];
-                  ind = getonlyid_gchash(gch,id);
-                  if(ind == GCH_INVALID)
-                    continue;
-                  gbuff[m].val += gch->GridCells[ind].val;
-		  
-                  id = indvec[pm[0]][pm[1]][pm[2]];
-                  ind = getonlyid_gchash(gch,id);
-                  if(ind == GCH_INVALID)
-                    continue;
-                  gbuff[m].val -= gch->GridCells[ind].val;
-		  
-		  id = indvec[mp[0]][mp[1]][mp[2]];
-                  ind = getonlyid_gchash(gch,id);
-                  if(ind == GCH_INVALID)
-                    continue;
-                  gbuff[m].val -= gch->GridCells[ind].val;
-		  
-		  id = indvec[mm[0]][mm[1]][mm[2]];
-                  ind = getonlyid_gchash(gch,id);
-                  if(ind == GCH_INVALID)
-                    continue;
-                  gbuff[m].val += gch->GridCells[ind].val;
-		  
-                  gbuff[m].val /= dL;
-		  gbuff[m].val /= dL;
-#ifndef VERTEX_MIXED_PARTIAL
-		  gbuff[m].val /= 2.0;
-		  gbuff[m].val /= 2.0;
-#endif
-                  gbuff[m].id = gch->GridCells[m].id;
-		}//end of else
-		
-	      }//for(m=0;m<gch-NumGridCells;++m)
-	    
-	    //now add part needed to the rays
-	    for(rind=0;rind<bundleCells[bind].Nrays;++rind) {
-	      //comp jacobian matrix
-	      vec2ang(bundleCells[bind].rays[rind].n,&theta,&phi);
-	      cost = cos(theta);
-	      sint = sin(theta);
-	      cosp = cos(phi);
-	      sinp = sin(phi);
-	      
-	      //xhat = jac[0][0] that + jac[0][1] phat + jac[0][2] rhat
-	      jac[0][0] = cosp*cost;
-	      jac[0][1] = -sinp;
-	      jac[0][2] = cosp*sint;
-	      
-	      //yhat = jac[1][0] that + jac[1][1] phat + jac[1][2] rhat
-	      jac[1][0] = sinp*cost;
-	      jac[1][1] = cosp;
-	      jac[1][2] = sinp*sint;
-	      
-	      //zhat = jac[2][0] that + jac[2][1] phat + jac[2][2] rhat
-	      jac[2][0] = -sint;
-	      jac[2][1] = 0.0;
-	      jac[2][2] = cost;
-	      
-	      r = sqrt(bundleCells[bind].rays[rind].n[0]*bundleCells[bind].rays[rind].n[0] +
-		       bundleCells[bind].rays[rind].n[1]*bundleCells[bind].rays[rind].n[1] +
-		       bundleCells[bind].rays[rind].n[2]*bundleCells[bind].rays[rind].n[2]);
-	      
-	      for(n=0;n<Nint;++n) {
-		//comp 3D loc
-		rad = chimin + n*dchi + 0.5*dchi;
-		
-		vec[0] = bundleCells[bind].rays[rind].n[0]*rad/r;
-		vec[1] = bundleCells[bind].rays[rind].n[1]*rad/r;
-		vec[2] = bundleCells[bind].rays[rind].n[2]*rad/r;
-		
-		for(m=0;m<3;++m) {
-		  while(vec[m] < 0)
-		    vec[m] += L;
-		  while(vec[m] >= L)
-		    vec[m] -= L;
-		}
-		
-		if(dind1 != dind2) {
-		  //vertex centered for dind1 != dind2
-		  i = (long) (vec[0]/dL);
-		  dx = (vec[0] - i*dL)/dL;
-#ifdef VERTEX_MIXED_PARTIAL
-		  if(dx < 0.5) {
-		    --i;
-		    dx += 0.5;
-		  } else {
-		    dx -= 0.5;
-		  }
-#endif
-		  WRAPIF(i,NFFT);
-		  ip1 = i + 1;
-		  WRAPIF(ip1,NFFT);
-		  
-		  j = (long) (vec[1]/dL);
-		  dy = (vec[1] - j*dL)/dL;
-#ifdef VERTEX_MIXED_PARTIAL
-		  if(dy < 0.5) {
-		    --j;
-		    dy += 0.5;
-		  } else {
-		    dy -= 0.5;
-		  }
-#endif
-		  WRAPIF(j,NFFT);
-		  jp1 = j + 1;
-		  WRAPIF(jp1,NFFT);
-		  
-		  k = (long) (vec[2]/dL);
-		  dz = (vec[2] - k*dL)/dL;
-#ifdef VERTEX_MIXED_PARTIAL
-		  if(dz < 0.5) {
-		    --k;
-		    dz += 0.5;
-		  } else {
-		    dz -= 0.5;
-		  }
-#endif
-		  WRAPIF(k,NFFT);
-		  kp1 = k + 1;
-		  WRAPIF(kp1,NFFT);
-		  
-		} else {
-		  //cell centered for dind1 == dind2
-		  i = (long) (vec[0]/dL);
-		  dx = (vec[0] - i*dL)/dL;
-		  WRAPIF(i,NFFT);
-		  ip1 = i + 1;
-		  WRAPIF(ip1,NFFT);
-		  
-		  j = (long) (vec[1]/dL);
-		  dy = (vec[1] - j*dL)/dL;
-		  WRAPIF(j,NFFT);
-		  jp1 = j + 1;
-		  WRAPIF(jp1,NFFT);
-		  
-		  k = (long) (vec[2]/dL);
-		  dz = (vec[2] - k*dL)/dL;
-		  WRAPIF(k,NFFT);
-		  kp1 = k + 1;
-		  WRAPIF(kp1,NFFT);
-		}
-		
-		//interp deriv val
-		val = 0.0;
-		
-		id = THREEDIND(i,j,k,NFFT);
-		ind = getonlyid_gchash(gch,id);
-		assert(ind != GCH_INVALID);
-		assert(gbuff[ind].id != -1);
-		assert(gbuff[ind].id == gch->GridCells[ind].id);
-		val += gbuff[ind].val*(1.0 - dx)*(1.0 - dy)*(1.0 - dz);
-		
-		id = THREEDIND(i,j,kp1,NFFT);
-		ind = getonlyid_gchash(gch,id);
-		assert(ind != GCH_INVALID);
-		assert(gbuff[ind].id != -1);
-		assert(gbuff[ind].id == gch->GridCells[ind].id);
-		val += gbuff[ind].val*(1.0 - dx)*(1.0 - dy)*dz;
-		
-		id = THREEDIND(i,jp1,k,NFFT);
-		ind = getonlyid_gchash(gch,id);
-		assert(ind != GCH_INVALID);
-		assert(gbuff[ind].id != -1);
-		assert(gbuff[ind].id == gch->GridCells[ind].id);
-		val += gbuff[ind].val*(1.0 - dx)*dy*(1.0 - dz);
-		
-		id = THREEDIND(i,jp1,kp1,NFFT);
-		ind = getonlyid_gchash(gch,id);
-		assert(ind != GCH_INVALID);
-		assert(gbuff[ind].id != -1);
-		assert(gbuff[ind].id == gch->GridCells[ind].id);
-		val += gbuff[ind].val*(1.0 - dx)*dy*dz;
-		
-		id = THREEDIND(ip1,j,k,NFFT);
-		ind = getonlyid_gchash(gch,id);
-		assert(ind != GCH_INVALID);
-		assert(gbuff[ind].id != -1);
-		assert(gbuff[ind].id == gch->GridCells[ind].id);
-		val += gbuff[ind].val*dx*(1.0 - dy)*(1.0 - dz);
-		
-		id = THREEDIND(ip1,j,kp1,NFFT);
-		ind = getonlyid_gchash(gch,id);
-		assert(ind != GCH_INVALID);
-		assert(gbuff[ind].id != -1);
-		assert(gbuff[ind].id == gch->GridCells[ind].id);
-		val += gbuff[ind].val*dx*(1.0 - dy)*dz;
-		
-		id = THREEDIND(ip1,jp1,k,NFFT);
-		ind = getonlyid_gchash(gch,id);
-		assert(ind != GCH_INVALID);
-		assert(gbuff[ind].id != -1);
-		assert(gbuff[ind].id == gch->GridCells[ind].id);
-		val += gbuff[ind].val*dx*dy*(1.0 - dz);
-		
-		id = THREEDIND(ip1,jp1,kp1,NFFT);
-		ind = getonlyid_gchash(gch,id);
-		assert(ind != GCH_INVALID);
-		assert(gbuff[ind].id != -1);
-		assert(gbuff[ind].id == gch->GridCells[ind].id);
-		val += gbuff[ind].val*dx*dy*dz;
-		
-		//do the projections and add to ray
-		for(ii=0;ii<2;++ii)
-		  for(jj=0;jj<2;++jj)
-		    bundleCells[bind].rays[rind].U[ii*2+jj] += val*jac[dind1][ii]*jac[dind2][jj];
-		
-		if(dind1 != dind2) {
-		  for(ii=0;ii<2;++ii)
-		    for(jj=0;jj<2;++jj)
-		      bundleCells[bind].rays[rind].U[ii*2+jj] += val*jac[dind2][ii]*jac[dind1][jj];
-		}
-		
-		//check to make sure not inf or nan
-		assert(gsl_finite(bundleCells[bind].rays[rind].U[0]));
-		assert(gsl_finite(bundleCells[bind].rays[rind].U[1]));
-		assert(gsl_finite(bundleCells[bind].rays[rind].U[2]));
-		assert(gsl_finite(bundleCells[bind].rays[rind].U[3]));
-		
-	      }//for(n=0;n<Nint;++n)
-	    }//for(rind=0;rind<bundleCells[bind].Nrays;++rind)
-	
-	  }// for(dind2=dind1;dind2<3;++dind2)
-	
-      }//if(ISSETBITFLAG(bundleCells[bind].active,PRIMARY_BUNDLECELL))
-    }//if(abind < NumActiveBundleCells)
+      }//for(abind=0;abind<NumActiveBundleCells;++abind)
+  
+    }// for(dind2=dind1;dind2<3;++dind2)
+  
+  //get units right
+  for(abind=0;abind<NumActiveBundleCells;++abind) {
+    bind = activeBundleCellInds[abind];
     
-    //get units right
-    if(abind < NumActiveBundleCells) {
-      if(ISSETBITFLAG(bundleCells[bind].active,PRIMARY_BUNDLECELL)) {
-	//fac for second derivs 2.0/CSOL/CSOL*dchi/chi*chi*chi
-	fac2 = 2.0/CSOL/CSOL*dchi*rayTraceData.planeRad;
-	
-	//fac for first derivs 2.0/CSOL/CSOL*dchi/chi*chi
-	fac1 = 2.0/CSOL/CSOL*dchi;
-	
-	for(rind=0;rind<bundleCells[bind].Nrays;++rind) {
-	  for(ii=0;ii<2;++ii)
-	    for(jj=0;jj<2;++jj)
-	      bundleCells[bind].rays[rind].U[ii*2+jj] *= fac2;
-	  
-	  //make mixed partials symmetric
-	  val = (bundleCells[bind].rays[rind].U[0*2+1] + bundleCells[bind].rays[rind].U[1*2+0])/2.0;
-	  bundleCells[bind].rays[rind].U[0*2+1] = val;
-	  bundleCells[bind].rays[rind].U[1*2+0] = val;
-	  
-	  for(ii=0;ii<2;++ii)
-	    bundleCells[bind].rays[rind].alpha[ii] *= fac1;
-	  
-	  //sign shift to match convention of code
-	  for(ii=0;ii<2;++ii)
-	    bundleCells[bind].rays[rind].alpha[ii] *= -1.0;
-	  
-	  //do pot factor = 2/CSOL/CSOL*dchi/chi
-	  bundleCells[bind].rays[rind].phi *= fac1/rayTraceData.planeRad;
-	}//for(rind=0;rind<bundleCells[bind].Nrays;++rind)
-      }//if(ISSETBITFLAG(bundleCells[bind].active,PRIMARY_BUNDLECELL))
-    }//if(abind < NumActiveBundleCells)
+    //fac for second derivs 2.0/CSOL/CSOL*dchi/chi*chi*chi
+    fac2 = 2.0/CSOL/CSOL*dchi*rayTraceData.planeRad;
     
-    //clean it all up
-    free_gchash(gch);
-    if(Ngbuff > 0) {
-      Ngbuff = 0;
-      free(gbuff);
-      gbuff = NULL;
-    }
+    //fac for first derivs 2.0/CSOL/CSOL*dchi/chi*chi
+    fac1 = 2.0/CSOL/CSOL*dchi;
+    
+    for(rind=0;rind<bundleCells[bind].Nrays;++rind) {
+      for(ii=0;ii<2;++ii)
+	for(jj=0;jj<2;++jj)
+	  RAY_U(bundleCells[bind],rind,ii*2+jj) *= fac2;
+      
+      //make mixed partials symmetric
+      val = (RAY_U(bundleCells[bind],rind,0*2+1) + RAY_U(bundleCells[bind],rind,1*2+0))/2.0;
+      RAY_U(bundleCells[bind],rind,0*2+1) = val;
+      RAY_U(bundleCells[bind],rind,1*2+0) = val;
+      
+      for(ii=0;ii<2;++ii)
+	RAY_ALPHA(bundleCells[bind],rind,ii) *= fac1;
+      
+      //sign shift to match convention of code
+      for(ii=0;ii<2;++ii)
+	RAY_ALPHA(bundleCells[bind],rind,ii) *= -1.0;
+      
+      //do pot factor = 2/CSOL/CSOL*dchi/chi
+      RAY_PHI(bundleCells[bind],rind) *= fac1/rayTraceData.planeRad;
+    }//for(rind=0;rind<bundleCells[bind].Nrays;++rind)
+  }//for(abind=0;abind<NumActiveBundleCells;++abind)
   
-  }//for(abind=0;abind<MaxNumActiveBundleCells;++abind)
+  //clean it all up
+  free_gtc(gtc);
+  if(gbuff != NULL) {
+    Ngbuff = 0;
+    free(gbuff);
+    gbuff = NULL;
+  }
   
   free(activeBundleCellInds);
   
@@ -10,6 +10,7 @@
 #include "fftpoissonsolve.h"
 #include "lgadgetio.h"
 #include "gridcellhash.h"
+#include "gridtilecache.h"
 
 //global defs for this file
 ptrdiff_t NFFT;
@@ -46,14 +47,16 @@ void comp_pot_snap(char *fbase)
   long ii,jj,kk;
   GridCell *gbuff = NULL;
   long Ngbuff = 0;
-  long id,ind;
+  long ind;
   double time;
   double potfact;
   int MyIOGroup,NumIOGroups,IOGroup;
   
-  //init grid cell hash table
-  GridCellHash *gch = init_gchash();
-  assert(gch != NULL);
+  //init grid tile cache - particles can land anywhere in the box so the cache spans all of it
+  GridTileCache *gtc = init_gtc(NFFT);
+  assert(gtc != NULL);
+  addfullbbox_gtc(gtc);
+  build_gtc(gtc);
   
   //get units
   get_units(fbase,&L,&Ntot,&a);  
@@ -116,37 +119,29 @@ void comp_pot_snap(char *fbase)
 	      k = k%NFFT;
 	      kk = kk%NFFT;
 	      
-	      id = (i*NFFT + j)*NFFT + k;
-	      ind = getid_gchash(gch,id);
-	      gch->GridCells[ind].val += (1.0 - dx)*(1.0 - dy)*(1.0 - dz);
+	      ind = getid_gtc(gtc,i,j,k);
+	      gtc->vals[ind] += (1.0 - dx)*(1.0 - dy)*(1.0 - dz);
 	      
-	      id = (i*NFFT + j)*NFFT + kk;
-	      ind = getid_gchash(gch,id);
-	      gch->GridCells[ind].val += (1.0 - dx)*(1.0 - dy)*dz;
+	      ind = getid_gtc(gtc,i,j,kk);
+	      gtc->vals[ind] += (1.0 - dx)*(1.0 - dy)*dz;
 	      
-	      id = (i*NFFT + jj)*NFFT + k;
-	      ind = getid_gchash(gch,id);
-	      gch->GridCells[ind].val += (1.0 - dx)*dy*(1.0 - dz);
+	      ind = getid_gtc(gtc,i,jj,k);
+	      gtc->vals[ind] += (1.0 - dx)*dy*(1.0 - dz);
 	      
-	      id = (i*NFFT + jj)*NFFT + kk;
-	      ind = getid_gchash(gch,id);
-	      gch->GridCells[ind].val  += (1.0 - dx)*dy*dz;
+	      ind = getid_gtc(gtc,i,jj,kk);
+	      gtc->vals[ind]  += (1.0 - dx)*dy*dz;
 	      
-	      id = (ii*NFFT + j)*NFFT + k;
-	      ind = getid_gchash(gch,id);
-	      gch->GridCells[ind].val += dx*(1.0 - dy)*(1.0 - dz);
+	      ind = getid_gtc(gtc,ii,j,k);
+	      gtc->vals[ind] += dx*(1.0 - dy)*(1.0 - dz);
 	      
-	      id = (ii*NFFT + j)*NFFT + kk;
-	      ind = getid_gchash(gch,id);
-	      gch->GridCells[ind].val  += dx*(1.0 - dy)*dz;
+	      ind = getid_gtc(gtc,ii,j,kk);
+	      gtc->vals[ind]  += dx*(1.0 - dy)*dz;
 	      
-	      id = (ii*NFFT + jj)*NFFT + k;
-	      ind = getid_gchash(gch,id);
-	      gch->GridCells[ind].val += dx*dy*(1.0 - dz);
+	      ind = getid_gtc(gtc,ii,jj,k);
+	      gtc->vals[ind] += dx*dy*(1.0 - dz);
 	      
-	      id = (ii*NFFT + jj)*NFFT + kk;
-	      ind = getid_gchash(gch,id);
-	      gch->GridCells[ind].val += dx*dy*dz;
+	      ind = getid_gtc(gtc,ii,jj,kk);
+	      gtc->vals[ind] += dx*dy*dz;
 	    }
 	  
 	  free(px);
@@ -163,10 +158,6 @@ void comp_pot_snap(char *fbase)
     }
   }
   
-  //manage mem for hash
-  minmem_gchash(gch);
-  sortcells_gchash(gch);
-  destroyhash_gchash(gch);
   logProfileTag(PROFILETAG_PARTIO);
   
   time += MPI_Wtime();
@@ -182,94 +173,84 @@ void comp_pot_snap(char *fbase)
       for(k=0;k<2*(NFFT/2+1);++k)
 	fftwrin[(i*NFFT + j)*(2*(NFFT/2+1)) + k] = 0.0;
   
-  /*algorithm to loop through pairs of tasks linearly
-    -lifted from Gadget-2 under GPL (http://www.gnu.org/copyleft/gpl.html)
-    -see pm_periodic.c from Gadget-2 at http://www.mpa-garching.mpg.de/gadget/
-  */  
-  int sendTask,recvTask;
-  int level,log2NTasks = 0;
-  long offset;
-  long Nsend,Nrecv;
-  MPI_Status Stat;
-  while(NTasks > (1 << log2NTasks))
-    ++log2NTasks;
-  for(level = 0; level < (1 << log2NTasks); level++) /* note: for level=0, target is the same task */
+  //send each cell to the task which owns its slab with one all-to-all
+  //the cells are bucketed by owner with a counting pass over the cache, so no sort is needed
+  int *slabTask,*Nsend,*sendOffset,*Nrecv,*recvOffset,*sendCurr;
+  long NrecvTot;
+  GridCell *sbuff;
+  MPI_Datatype MPI_GRIDCELL;
+  
+  slabTask = (int*)malloc(sizeof(int)*NFFT);
+  assert(slabTask != NULL);
+  for(n=0;n<NTasks;++n)
+    for(i=TaskN0LocalStart[n];i<TaskN0LocalStart[n]+TaskN0Local[n];++i)
+      slabTask[i] = (int) n;
+  
+  Nsend = (int*)malloc(sizeof(int)*NTasks*5);
+  assert(Nsend != NULL);
+  sendOffset = Nsend + NTasks;
+  Nrecv = sendOffset + NTasks;
+  recvOffset = Nrecv + NTasks;
+  sendCurr = recvOffset + NTasks;
+  
+  for(n=0;n<NTasks;++n)
+    Nsend[n] = 0;
+  for(m=0;m<GTC_NUMSLOTS(gtc);++m) {
+    if(!(gtc->used[m]))
+      continue;
+    slot2ijk_gtc(gtc,m,&i,&j,&k);
+    Nsend[slabTask[i]] += 1;
+  }
+  
+  MPI_Alltoall(Nsend,1,MPI_INT,Nrecv,1,MPI_INT,MPI_COMM_WORLD);
+  
+  sendOffset[0] = 0;
+  recvOffset[0] = 0;
+  for(n=1;n<NTasks;++n) {
+    sendOffset[n] = sendOffset[n-1] + Nsend[n-1];
+    recvOffset[n] = recvOffset[n-1] + Nrecv[n-1];
+  }
+  NrecvTot = recvOffset[NTasks-1] + Nrecv[NTasks-1];
+  
+  sbuff = (GridCell*)malloc(sizeof(GridCell)*(gtc->NumCells+1));
+  assert(sbuff != NULL);
+  for(n=0;n<NTasks;++n)
+    sendCurr[n] = sendOffset[n];
+  for(m=0;m<GTC_NUMSLOTS(gtc);++m) {
+    if(!(gtc->used[m]))
+      continue;
+    slot2ijk_gtc(gtc,m,&i,&j,&k);
+    n = sendCurr[slabTask[i]];
+    sendCurr[slabTask[i]] += 1;
+    sbuff[n].id = (i*NFFT + j)*NFFT + k;
+    sbuff[n].val = gtc->vals[m];
+  }
+  free_gtc(gtc);
+  free(slabTask);
+  
+  Ngbuff = NrecvTot;
+  gbuff = (GridCell*)malloc(sizeof(GridCell)*(Ngbuff+1));
+  assert(gbuff != NULL);
+  
+  MPI_Type_contiguous((int) (sizeof(GridCell)),MPI_BYTE,&MPI_GRIDCELL);
+  MPI_Type_commit(&MPI_GRIDCELL);
+  MPI_Alltoallv(sbuff,Nsend,sendOffset,MPI_GRIDCELL,gbuff,Nrecv,recvOffset,MPI_GRIDCELL,MPI_COMM_WORLD);
+  MPI_Type_free(&MPI_GRIDCELL);
+  free(sbuff);
+  free(Nsend);
+  
+  //assign dens
+  for(n=0;n<NrecvTot;++n)
     {
-      sendTask = ThisTask;
-      recvTask = ThisTask ^ level;
-      if(recvTask < NTasks) 
+      id2ijk(gbuff[n].id,NFFT,&i,&j,&k);
+      if(!((i >= N0LocalStart && i < N0LocalStart+N0Local)))
 	{
-	  //comp offsets
-	  offset = -1;
-	  Nsend = 0;
-	  for(n=0;n<gch->NumGridCells;++n)
-	    {
-	      if(gch->GridCells[n].id >= TaskN0LocalStart[recvTask]*NFFT*NFFT &&
-		 gch->GridCells[n].id < TaskN0LocalStart[recvTask]*NFFT*NFFT + TaskN0Local[recvTask]*NFFT*NFFT
-		 && offset < 0)
-		offset = n;
-	      if(gch->GridCells[n].id >= TaskN0LocalStart[recvTask]*NFFT*NFFT &&
-		 gch->GridCells[n].id < TaskN0LocalStart[recvTask]*NFFT*NFFT + TaskN0Local[recvTask]*NFFT*NFFT)
-		{
-		  Nsend += 1;
-		  id2ijk(gch->GridCells[n].id,NFFT,&i,&j,&k);
-		  assert(i >= TaskN0LocalStart[recvTask] && i < TaskN0LocalStart[recvTask]+TaskN0Local[recvTask]);
-		}
-	      if(gch->GridCells[n].id >= TaskN0LocalStart[recvTask]*NFFT*NFFT + TaskN0Local[recvTask]*NFFT*NFFT)
-		break;
-	    }
-	  
-	  if(!((offset >= 0 && Nsend > 0) || (offset == -1 && Nsend == 0)))
-	    fprintf(stderr,"%d->%d Nsend = %ld, offset = %ld, tot = %ld\n",sendTask,recvTask,Nsend,offset,gch->NumGridCells);
-	  assert((offset >= 0 && Nsend > 0) || (offset == -1 && Nsend == 0));
-	  
-	  if(sendTask != recvTask)
-	    {
-	      MPI_Sendrecv(&Nsend,1,MPI_LONG,recvTask,TAG_DENS_NUM,
-			   &Nrecv,1,MPI_LONG,recvTask,TAG_DENS_NUM,
-			   MPI_COMM_WORLD,&Stat);
-	      
-	      if(Nrecv > 0 || Nsend > 0)
-		{
-		  if(Nrecv > Ngbuff)
-		    {
-		      gbuff = (GridCell*)realloc(gbuff,sizeof(GridCell)*Nrecv);
-		      assert(gbuff != NULL);
-		      Ngbuff = Nrecv;
-		    }
-		  
-		  //get dens from other processor
-		  MPI_Sendrecv(gch->GridCells+offset,sizeof(GridCell)*Nsend,MPI_BYTE,recvTask,TAG_DENS_RED,
-			       gbuff,sizeof(GridCell)*Nrecv,MPI_BYTE,recvTask,TAG_DENS_RED,
-			       MPI_COMM_WORLD,&Stat);
-		  
-		  //assign dens
-		  for(n=0;n<Nrecv;++n)
-		    {
-		      id2ijk(gbuff[n].id,NFFT,&i,&j,&k);
-		      assert(i >= N0LocalStart && i < N0LocalStart+N0Local);
-		      fftwrin[((i-N0LocalStart)*NFFT + j) * (2*(NFFT/2+1)) + k] += gbuff[n].val;
-		    }
-		}
-	    }
-	  else
-	    {
-	      //assign dens
-	      for(n=0;n<Nsend;++n)
-		{
-		  id2ijk(gch->GridCells[n+offset].id,NFFT,&i,&j,&k);
-		  if(!((i >= N0LocalStart && i < N0LocalStart+N0Local)))
-		    {
-		      fprintf(stderr,"%d: i = %ld, start = %ld, length = %ld\n",ThisTask,i,N0LocalStart,N0LocalStart+N0Local);
-		    }
-		  assert(i >= N0LocalStart && i < N0LocalStart+N0Local);
-		  fftwrin[((i-N0LocalStart)*NFFT + j) * (2*(NFFT/2+1)) + k] += gch->GridCells[n+offset].val;
-		}
-	    }
-	  
-	}/*if(recvTask < NTasks)*/
+	  fprintf(stderr,"%d: i = %ld, start = %ld, length = %ld\n",ThisTask,i,N0LocalStart,N0LocalStart+N0Local);
+	}
+      assert(i >= N0LocalStart && i < N0LocalStart+N0Local);
+      fftwrin[((i-N0LocalStart)*NFFT + j) * (2*(NFFT/2+1)) + k] += gbuff[n].val;
     }
-
+  
   //check cells for all zeros
   m = 0;
   for(i=0;i<N0Local;++i)
@@ -286,8 +267,6 @@ void comp_pot_snap(char *fbase)
   if(ThisTask == 0)
     fprintf(stderr,"shared density in %lf seconds.\n",time);
 
-  free_gchash(gch);
-  
   if(gbuff != NULL)
     {
       free(gbuff);
@@ -21,7 +21,7 @@ static void distribute_gals_to_tasks(SourceGal *buffGals, int *sendCounts, int *
 
 void write_gals2fits(void)
 {
-  long group,NumGroups,i;
+  long i;
   long *firstTaskFiles,*lastTaskFiles,fileNum=-1;
   MPI_Comm fileComm;
   MPI_Group worldGroup,fileGroup;
@@ -46,18 +46,12 @@ void write_gals2fits(void)
   MPI_Group_incl(worldGroup,Nranks,ranks,&fileGroup);
   MPI_Comm_create(MPI_COMM_WORLD,fileGroup,&fileComm);
 
-  NumGroups = rayTraceData.NumGalOutputFiles/rayTraceData.NumFilesIOInParallel;
-  if(rayTraceData.NumGalOutputFiles - NumGroups*rayTraceData.NumFilesIOInParallel > 0)
-    ++NumGroups;
-  for(group=0;group<NumGroups;++group)
-    {
-      if(fileNum/rayTraceData.NumFilesIOInParallel == group)
-	file_write_gals2fits(fileNum,firstTaskFiles[fileNum],lastTaskFiles[fileNum],fileComm);
-
-      /*\\\\\\\\\\\\\\\\\\\\\\\\\\*/
-      MPI_Barrier(MPI_COMM_WORLD);
-      /*\\\\\\\\\\\\\\\\\\\\\\\\\\*/
-    }
+  /* I/O token is passed between the first tasks of files NumFilesIOInParallel apart - see write_rays */
+  if(ThisTask == firstTaskFiles[fileNum] && fileNum >= rayTraceData.NumFilesIOInParallel)
+    io_throttle_wait(firstTaskFiles[fileNum-rayTraceData.NumFilesIOInParallel]);
+  file_write_gals2fits(fileNum,firstTaskFiles[fileNum],lastTaskFiles[fileNum],fileComm);
+  if(ThisTask == firstTaskFiles[fileNum] && fileNum + rayTraceData.NumFilesIOInParallel < rayTraceData.NumGalOutputFiles)
+    io_throttle_pass(firstTaskFiles[fileNum+rayTraceData.NumFilesIOInParallel]);
 
   free(firstTaskFiles);
   free(lastTaskFiles);
@@ -70,6 +64,7 @@ void write_gals2fits(void)
   
   if(ThisTask == 0)
     fprintf(stderr,"writing image gals to disk took %lf seconds.\n",t);
+  io_throttle_report("image gal output");
 }
 
 static void file_write_gals2fits(long fileNum, long firstTask, long lastTask, MPI_Comm fileComm)
@@ -963,74 +958,31 @@ void reorder_gals_for_planes(void)
   free(sg);
 }
 
-typedef struct {
-  long nest;
-  long index;
-} SortGalNest;
-
-static int compSortGalNest(const void *a, const void *b)
-{
-  if(((const SortGalNest*)a)->nest > ((const SortGalNest*)b)->nest)
-    return 1;
-  else if(((const SortGalNest*)a)->nest < ((const SortGalNest*)b)->nest)
-    return -1;
-  else
-    return 0;
-}
-
+/* reorders the gals by their nest index at the ray order with a radix sort on the nest indexes - gals in 
+   the same ray cell keep their order */
 void reorder_gals_nest(SourceGal *buffSgs, long NumBuffSgs)
 {
-  long i;
-  SourceGal sourceGal,saveGal;
-  long rankSource,rankSave,dest;
-  SortGalNest *sg;
+  long i,*order;
+  unsigned long *keys;
   double vec[3];
-  long buffGalSortOrder = HEALPIX_UTILS_MAXORDER;
+  long buffGalSortOrder = rayTraceData.rayOrder;
   
-  sg = (SortGalNest*)malloc(sizeof(SortGalNest)*NumBuffSgs);
-  assert(sg != NULL);
+  keys = (unsigned long*)malloc(sizeof(unsigned long)*NumBuffSgs);
+  assert(keys != NULL);
+  order = (long*)malloc(sizeof(long)*NumBuffSgs);
+  assert(order != NULL);
   
   for(i=0;i<NumBuffSgs;++i)
     {
-      sg[i].index = i;
       vec[0] = buffSgs[i].pos[0];
       vec[1] = buffSgs[i].pos[1];
       vec[2] = buffSgs[i].pos[2];
-      sg[i].nest = vec2nest(vec,buffGalSortOrder);
+      keys[i] = (unsigned long) (vec2nest(vec,buffGalSortOrder));
     }
   
-  //sort them and make rank in sg.task field
-  qsort(sg,(size_t) NumBuffSgs,sizeof(SortGalNest),compSortGalNest);
-  for(i=0;i<NumBuffSgs;++i)
-    sg[sg[i].index].nest = i;
-        
-  for(i=0;i<NumBuffSgs;++i) /* reoder with an in-place algorithm - see Gadget-2 for details - destroys rank */
-    {
-      if(i != sg[i].nest)
-	{
-	  sourceGal = buffSgs[i];
-	  rankSource = sg[i].nest;
-	  dest = sg[i].nest;
-                      
-	  do
-	    {
-	      saveGal = buffSgs[dest];
-	      rankSave = sg[dest].nest;
-                          
-	      buffSgs[dest] = sourceGal;
-	      sg[dest].nest = rankSource;
-                  
-	      if(dest == i)
-		break;
-	      
-	      sourceGal = saveGal;
-	      rankSource = rankSave;
-                  
-	      dest = rankSource;
-	    }
-	  while(1);
-	}
-    }
+  radix_sort_index(keys,NumBuffSgs,2*((int) buffGalSortOrder)+4,order);
+  free(keys);
   
-  free(sg);
+  reorder_by_index(buffSgs,sizeof(SourceGal),NumBuffSgs,order);
+  free(order);
 }
@@ -7,7 +7,7 @@
 const char *ProfileTagNames[] = {"TotalTime","StepTime","SHT","SHTSolve","MapShuffle",
 				 "MG","MGSolve","RayIO","PartIO","RayProp",
 				 "GridSearch","GalIO","RayBuff","Restart","InitEndLoadBal",
-				 "GalMove","GalGridSearch","ImageGalIO","GridKappa","TreeBuild","TreeWalk"};
+				 "GalMove","GalGridSearch","ImageGalIO","SHTSetup","IOWait","GridKappa","TreeBuild","TreeWalk"};
 
 RayTraceData rayTraceData;                               /* global struct with all vars from config file */
 long NbundleCells = 0;                                   /* the number of bundle cells used for overall domain decomp */
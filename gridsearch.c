@@ -36,6 +36,11 @@ void gridsearch(double wpm1, double wpm2)
   if(ThisTask == 0)
     fprintf(stderr,"finding galaxy images with grid search.\n");
   
+#ifdef RAYS_SOA
+  //the grid search works on rays stored as HEALPixRay structs
+  bundlecells_rays_soa2aos();
+#endif
+  
   //get gals for this plane
   binL = rayTraceData.maxComvDistance/rayTraceData.NumLensPlanes;
   NumGalsForThisPlane = 0;
@@ -177,6 +182,10 @@ void gridsearch(double wpm1, double wpm2)
       destroy_buffer_rays(bufferRays);
     }
   
+#ifdef RAYS_SOA
+  bundlecells_rays_aos2soa();
+#endif
+  
   time += MPI_Wtime();
   if(ThisTask == 0)
     fprintf(stderr,"found galaxy images in %lg seconds.\n",time);
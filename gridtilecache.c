@@ -0,0 +1,379 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+#include <mpi.h>
+#include <gsl/gsl_rng.h>
+#include "gridcellhash.h"
+
+#include "gridtilecache.h"
+
+#define GTC_CELLIND(i,j,k) (((((i) & GTC_TILE_MASK) << GTC_TILE_BITS | ((j) & GTC_TILE_MASK)) << GTC_TILE_BITS) | ((k) & GTC_TILE_MASK))
+
+static void axis_bbox_gtc(unsigned char *occ, long Nt, long *tstart, long *tlen);
+static long new_tile_gtc(GridTileCache *gtc, long dind, long i, long j, long k);
+
+GridTileCache *init_gtc(long N)
+{
+  GridTileCache *gtc;
+
+  assert(N > 0);
+  gtc = (GridTileCache*)malloc(sizeof(GridTileCache));
+  assert(gtc != NULL);
+
+  gtc->N = N;
+  gtc->Nt = (N + GTC_TILE_LEN - 1)/GTC_TILE_LEN;
+  gtc->occ = (unsigned char*)malloc(sizeof(unsigned char)*3*gtc->Nt);
+  assert(gtc->occ != NULL);
+  memset(gtc->occ,0,sizeof(unsigned char)*3*gtc->Nt);
+
+  gtc->tstart[0] = 0;
+  gtc->tstart[1] = 0;
+  gtc->tstart[2] = 0;
+  gtc->tlen[0] = 0;
+  gtc->tlen[1] = 0;
+  gtc->tlen[2] = 0;
+  gtc->tileDir = NULL;
+
+  gtc->NumTiles = 0;
+  gtc->NumTilesAlloc = 0;
+  gtc->tileOrigin = NULL;
+  gtc->vals = NULL;
+  gtc->used = NULL;
+  gtc->NumCells = 0;
+
+  return gtc;
+}
+
+void free_gtc(GridTileCache *gtc)
+{
+  if(gtc->occ != NULL)
+    free(gtc->occ);
+  if(gtc->tileDir != NULL)
+    free(gtc->tileDir);
+  if(gtc->tileOrigin != NULL)
+    free(gtc->tileOrigin);
+  if(gtc->vals != NULL)
+    free(gtc->vals);
+  if(gtc->used != NULL)
+    free(gtc->used);
+  free(gtc);
+}
+
+void addbbox_gtc(GridTileCache *gtc, long i, long j, long k)
+{
+  assert(gtc->occ != NULL);
+  assert(i >= 0 && i < gtc->N);
+  assert(j >= 0 && j < gtc->N);
+  assert(k >= 0 && k < gtc->N);
+
+  gtc->occ[i >> GTC_TILE_BITS] = 1;
+  gtc->occ[gtc->Nt + (j >> GTC_TILE_BITS)] = 1;
+  gtc->occ[2*gtc->Nt + (k >> GTC_TILE_BITS)] = 1;
+}
+
+void addfullbbox_gtc(GridTileCache *gtc)
+{
+  assert(gtc->occ != NULL);
+  memset(gtc->occ,1,sizeof(unsigned char)*3*gtc->Nt);
+}
+
+/* the box on each axis is the complement of the largest run of empty tiles,
+   which may wrap around the periodic boundary */
+static void axis_bbox_gtc(unsigned char *occ, long Nt, long *tstart, long *tlen)
+{
+  long t,n,t0,gap,maxgap,maxgapend;
+
+  n = 0;
+  for(t=0;t<Nt;++t)
+    n += occ[t];
+
+  if(n == 0) {
+    *tstart = 0;
+    *tlen = 0;
+    return;
+  }
+
+  if(n == Nt) {
+    *tstart = 0;
+    *tlen = Nt;
+    return;
+  }
+
+  //start right after an occupied tile so every run of empty tiles ends at an occupied one
+  for(t0=0;t0<Nt;++t0)
+    if(occ[t0])
+      break;
+
+  gap = 0;
+  maxgap = 0;
+  maxgapend = t0;
+  for(n=1;n<=Nt;++n) {
+    t = (t0 + n)%Nt;
+    if(occ[t]) {
+      if(gap > maxgap) {
+	maxgap = gap;
+	maxgapend = t;
+      }
+      gap = 0;
+    } else
+      ++gap;
+  }
+
+  *tstart = maxgapend;
+  *tlen = Nt - maxgap;
+}
+
+void build_gtc(GridTileCache *gtc)
+{
+  long n,Ndir;
+
+  assert(gtc->occ != NULL);
+  for(n=0;n<3;++n)
+    axis_bbox_gtc(gtc->occ + n*gtc->Nt,gtc->Nt,&(gtc->tstart[n]),&(gtc->tlen[n]));
+  free(gtc->occ);
+  gtc->occ = NULL;
+
+  Ndir = gtc->tlen[0]*gtc->tlen[1]*gtc->tlen[2];
+  gtc->tileDir = (int*)malloc(sizeof(int)*(Ndir+1));
+  assert(gtc->tileDir != NULL);
+  for(n=0;n<Ndir;++n)
+    gtc->tileDir[n] = GTC_INVALID;
+}
+
+static long new_tile_gtc(GridTileCache *gtc, long dind, long i, long j, long k)
+{
+  long t,N = gtc->N;
+
+  if(gtc->NumTiles == gtc->NumTilesAlloc) {
+    gtc->NumTilesAlloc += gtc->NumTilesAlloc/2 + 64;
+    gtc->tileOrigin = (long*)realloc(gtc->tileOrigin,sizeof(long)*gtc->NumTilesAlloc);
+    assert(gtc->tileOrigin != NULL);
+    gtc->vals = (double*)realloc(gtc->vals,sizeof(double)*gtc->NumTilesAlloc*GTC_TILE_SIZE);
+    assert(gtc->vals != NULL);
+    gtc->used = (unsigned char*)realloc(gtc->used,sizeof(unsigned char)*gtc->NumTilesAlloc*GTC_TILE_SIZE);
+    assert(gtc->used != NULL);
+  }
+
+  t = gtc->NumTiles;
+  gtc->NumTiles += 1;
+  assert(gtc->NumTiles < INT_MAX);
+
+  i -= (i & GTC_TILE_MASK);
+  j -= (j & GTC_TILE_MASK);
+  k -= (k & GTC_TILE_MASK);
+  gtc->tileOrigin[t] = (i*N + j)*N + k;
+  memset(gtc->vals + t*GTC_TILE_SIZE,0,sizeof(double)*GTC_TILE_SIZE);
+  memset(gtc->used + t*GTC_TILE_SIZE,0,sizeof(unsigned char)*GTC_TILE_SIZE);
+  gtc->tileDir[dind] = (int) t;
+
+  return t;
+}
+
+long getonlyid_gtc(GridTileCache *gtc, long i, long j, long k)
+{
+  long ti,tj,tk,t,slot;
+
+  ti = (i >> GTC_TILE_BITS) - gtc->tstart[0];
+  if(ti < 0) ti += gtc->Nt;
+  if(ti >= gtc->tlen[0]) return GTC_INVALID;
+
+  tj = (j >> GTC_TILE_BITS) - gtc->tstart[1];
+  if(tj < 0) tj += gtc->Nt;
+  if(tj >= gtc->tlen[1]) return GTC_INVALID;
+
+  tk = (k >> GTC_TILE_BITS) - gtc->tstart[2];
+  if(tk < 0) tk += gtc->Nt;
+  if(tk >= gtc->tlen[2]) return GTC_INVALID;
+
+  t = gtc->tileDir[(ti*gtc->tlen[1] + tj)*gtc->tlen[2] + tk];
+  if(t == GTC_INVALID) return GTC_INVALID;
+
+  slot = t*GTC_TILE_SIZE + GTC_CELLIND(i,j,k);
+  if(!(gtc->used[slot])) return GTC_INVALID;
+
+  return slot;
+}
+
+long getid_gtc(GridTileCache *gtc, long i, long j, long k)
+{
+  long ti,tj,tk,t,dind,slot;
+
+  ti = (i >> GTC_TILE_BITS) - gtc->tstart[0];
+  if(ti < 0) ti += gtc->Nt;
+  tj = (j >> GTC_TILE_BITS) - gtc->tstart[1];
+  if(tj < 0) tj += gtc->Nt;
+  tk = (k >> GTC_TILE_BITS) - gtc->tstart[2];
+  if(tk < 0) tk += gtc->Nt;
+
+  if(!(ti < gtc->tlen[0] && tj < gtc->tlen[1] && tk < gtc->tlen[2])) {
+    fprintf(stderr,"cell %ld|%ld|%ld is outside of the grid tile cache bounding box! %s:%d\n",i,j,k,__FILE__,__LINE__);
+    fflush(stderr);
+  }
+  assert(ti < gtc->tlen[0] && tj < gtc->tlen[1] && tk < gtc->tlen[2]);
+
+  dind = (ti*gtc->tlen[1] + tj)*gtc->tlen[2] + tk;
+  t = gtc->tileDir[dind];
+  if(t == GTC_INVALID)
+    t = new_tile_gtc(gtc,dind,i,j,k);
+
+  slot = t*GTC_TILE_SIZE + GTC_CELLIND(i,j,k);
+  if(!(gtc->used[slot])) {
+    gtc->used[slot] = 1;
+    gtc->NumCells += 1;
+  }
+
+  return slot;
+}
+
+void slot2ijk_gtc(GridTileCache *gtc, long slot, long *i, long *j, long *k)
+{
+  long t,c,id,N = gtc->N;
+
+  t = slot/GTC_TILE_SIZE;
+  c = slot - t*GTC_TILE_SIZE;
+  assert(t >= 0 && t < gtc->NumTiles);
+
+  id = gtc->tileOrigin[t];
+  *k = id%N;
+  id = (id - (*k))/N;
+  *j = id%N;
+  *i = (id - (*j))/N;
+
+  *k += c & GTC_TILE_MASK;
+  c = c >> GTC_TILE_BITS;
+  *j += c & GTC_TILE_MASK;
+  c = c >> GTC_TILE_BITS;
+  *i += c;
+}
+
+/* times the grid tile cache against GridCellHash for the access pattern of the 3D potential
+   ray stencil - Nsamp points are placed along random rays through a box of N^3 cells and
+   all 64 cells of the stencil around each point are added then looked up again */
+void test_gtc_vs_gchash(long N, long Nsamp)
+{
+  GridCellHash *gch;
+  GridTileCache *gtc;
+  gsl_rng *rng;
+  long n,s,Nray = 64,di,dj,dk,ii,jj,kk,ind;
+  long *ijk;
+  double x[3],dx[3],t,sum1,sum2;
+  double tadd_gch,tget_gch,tadd_gtc,tget_gtc,tbbox_gtc;
+
+  ijk = (long*)malloc(sizeof(long)*3*Nsamp);
+  assert(ijk != NULL);
+  rng = gsl_rng_alloc(gsl_rng_ranlxd2);
+  gsl_rng_set(rng,(unsigned long) (N + Nsamp));
+
+  //make the sample points - rays start near the box center and take unit steps
+  for(s=0;s<Nsamp;) {
+    for(n=0;n<3;++n) {
+      x[n] = 0.5*N + 0.05*N*(gsl_rng_uniform(rng) - 0.5);
+      dx[n] = gsl_rng_uniform(rng) - 0.5;
+    }
+    t = sqrt(dx[0]*dx[0] + dx[1]*dx[1] + dx[2]*dx[2]);
+    for(n=0;n<3;++n)
+      dx[n] /= t;
+
+    for(ii=0;ii<Nray && s<Nsamp;++ii,++s) {
+      for(n=0;n<3;++n) {
+	x[n] += dx[n];
+	ijk[3*s+n] = ((long) (floor(x[n])))%N;
+	if(ijk[3*s+n] < 0) ijk[3*s+n] += N;
+      }
+    }
+  }
+
+  //GridCellHash
+  gch = init_gchash();
+  tadd_gch = -MPI_Wtime();
+  for(s=0;s<Nsamp;++s)
+    for(di=-1;di<=2;++di)
+      for(dj=-1;dj<=2;++dj)
+	for(dk=-1;dk<=2;++dk) {
+	  ii = (ijk[3*s+0] + di + N)%N;
+	  jj = (ijk[3*s+1] + dj + N)%N;
+	  kk = (ijk[3*s+2] + dk + N)%N;
+	  ind = getid_gchash(gch,(ii*N + jj)*N + kk);
+	  gch->GridCells[ind].val = (double) ((ii*N + jj)*N + kk);
+	}
+  tadd_gch += MPI_Wtime();
+
+  sum1 = 0.0;
+  tget_gch = -MPI_Wtime();
+  for(s=0;s<Nsamp;++s)
+    for(di=0;di<=1;++di)
+      for(dj=0;dj<=1;++dj)
+	for(dk=0;dk<=1;++dk) {
+	  ii = (ijk[3*s+0] + di)%N;
+	  jj = (ijk[3*s+1] + dj)%N;
+	  kk = (ijk[3*s+2] + dk)%N;
+	  ind = getonlyid_gchash(gch,(ii*N + jj)*N + kk);
+	  assert(ind != GCH_INVALID);
+	  sum1 += gch->GridCells[ind].val;
+	}
+  tget_gch += MPI_Wtime();
+
+  //GridTileCache
+  gtc = init_gtc(N);
+  tbbox_gtc = -MPI_Wtime();
+  for(s=0;s<Nsamp;++s) {
+    addbbox_gtc(gtc,(ijk[3*s+0] - 1 + N)%N,(ijk[3*s+1] - 1 + N)%N,(ijk[3*s+2] - 1 + N)%N);
+    addbbox_gtc(gtc,(ijk[3*s+0] + 2)%N,(ijk[3*s+1] + 2)%N,(ijk[3*s+2] + 2)%N);
+  }
+  build_gtc(gtc);
+  tbbox_gtc += MPI_Wtime();
+
+  tadd_gtc = -MPI_Wtime();
+  for(s=0;s<Nsamp;++s)
+    for(di=-1;di<=2;++di)
+      for(dj=-1;dj<=2;++dj)
+	for(dk=-1;dk<=2;++dk) {
+	  ii = (ijk[3*s+0] + di + N)%N;
+	  jj = (ijk[3*s+1] + dj + N)%N;
+	  kk = (ijk[3*s+2] + dk + N)%N;
+	  ind = getid_gtc(gtc,ii,jj,kk);
+	  gtc->vals[ind] = (double) ((ii*N + jj)*N + kk);
+	}
+  tadd_gtc += MPI_Wtime();
+
+  sum2 = 0.0;
+  tget_gtc = -MPI_Wtime();
+  for(s=0;s<Nsamp;++s)
+    for(di=0;di<=1;++di)
+      for(dj=0;dj<=1;++dj)
+	for(dk=0;dk<=1;++dk) {
+	  ii = (ijk[3*s+0] + di)%N;
+	  jj = (ijk[3*s+1] + dj)%N;
+	  kk = (ijk[3*s+2] + dk)%N;
+	  ind = getonlyid_gtc(gtc,ii,jj,kk);
+	  assert(ind != GTC_INVALID);
+	  sum2 += gtc->vals[ind];
+	}
+  tget_gtc += MPI_Wtime();
+
+  //check both give the same cells
+  assert(gtc->NumCells == gch->NumGridCells);
+  assert(sum1 == sum2);
+  for(s=0;s<GTC_NUMSLOTS(gtc);++s) {
+    if(!(gtc->used[s]))
+      continue;
+    slot2ijk_gtc(gtc,s,&ii,&jj,&kk);
+    assert(gtc->vals[s] == (double) ((ii*N + jj)*N + kk));
+  }
+
+  fprintf(stderr,"grid tile cache test: N = %ld, %ld samples, %ld cells, %ld tiles (%.1f%% full), bbox = %ld|%ld|%ld tiles\n",
+	  N,Nsamp,gtc->NumCells,gtc->NumTiles,100.0*gtc->NumCells/((double) GTC_NUMSLOTS(gtc)),gtc->tlen[0],gtc->tlen[1],gtc->tlen[2]);
+  fprintf(stderr,"grid tile cache test: add 64 cells/sample = %lf s (GridCellHash) vs %lf + %lf s (bbox) (GridTileCache)\n",
+	  tadd_gch,tadd_gtc,tbbox_gtc);
+  fprintf(stderr,"grid tile cache test: get 8 cells/sample = %lf s (GridCellHash) vs %lf s (GridTileCache)\n",
+	  tget_gch,tget_gtc);
+  fflush(stderr);
+
+  free_gchash(gch);
+  free_gtc(gtc);
+  gsl_rng_free(rng);
+  free(ijk);
+}
@@ -0,0 +1,68 @@
+#ifdef MEMWATCH
+#include "memwatch.h"
+#endif
+
+#ifdef USEMEMCHECK
+#include <memcheck.h>
+#endif
+
+#ifdef DMALLOC
+#include <dmalloc.h>
+#endif
+
+#ifndef _GTCACHE_
+#define _GTCACHE_
+
+/* dense tile store for a sparse set of cells of a periodic N^3 grid
+
+   The grid is cut into cubic tiles of GTC_TILE_LEN^3 cells. A directory of tile indices covers
+   a (possibly wrapped) bounding box of tiles which is set before any cells are added. Tiles are
+   allocated on first touch and their cells are stored contiguously, so a cell lookup is a few
+   shifts and masks plus two loads instead of a hash probe.
+
+   A cell is addressed by its slot, slot = tile*GTC_TILE_SIZE + cell in tile. Slots are stable
+   for the life of the cache, so arrays parallel to gtc->vals can be indexed by them.
+
+   usage:
+     gtc = init_gtc(N);
+     addbbox_gtc(gtc,i,j,k); ... (or addfullbbox_gtc(gtc);)
+     build_gtc(gtc);
+     slot = getid_gtc(gtc,i,j,k); gtc->vals[slot] += ...
+     slot = getonlyid_gtc(gtc,i,j,k); if(slot != GTC_INVALID) ...
+     free_gtc(gtc);
+*/
+
+#define GTC_TILE_BITS 3
+#define GTC_TILE_LEN (1l << GTC_TILE_BITS)
+#define GTC_TILE_MASK (GTC_TILE_LEN - 1)
+#define GTC_TILE_SIZE (GTC_TILE_LEN*GTC_TILE_LEN*GTC_TILE_LEN)
+#define GTC_INVALID -1
+#define GTC_NUMSLOTS(gtc) ((gtc)->NumTiles*GTC_TILE_SIZE)
+
+typedef struct {
+  long N;              //# of grid cells on a side
+  long Nt;             //# of tiles on a side
+  unsigned char *occ;  //per axis tile occupancy used to build the bounding box, 3*Nt
+  long tstart[3];      //first tile of the bounding box on each axis
+  long tlen[3];        //# of tiles in the bounding box on each axis
+  int *tileDir;        //tile index for each tile in the bounding box or GTC_INVALID
+  long NumTiles;
+  long NumTilesAlloc;
+  long *tileOrigin;    //(i*N + j)*N + k of the first cell of each tile
+  double *vals;        //cell values, GTC_NUMSLOTS(gtc) of them
+  unsigned char *used; //1 if the cell has been added, parallel to vals
+  long NumCells;       //# of cells added
+} GridTileCache;
+
+/* in gridtilecache.c */
+GridTileCache *init_gtc(long N);
+void free_gtc(GridTileCache *gtc);
+void addbbox_gtc(GridTileCache *gtc, long i, long j, long k);
+void addfullbbox_gtc(GridTileCache *gtc);
+void build_gtc(GridTileCache *gtc);
+long getid_gtc(GridTileCache *gtc, long i, long j, long k);
+long getonlyid_gtc(GridTileCache *gtc, long i, long j, long k);
+void slot2ijk_gtc(GridTileCache *gtc, long slot, long *i, long *j, long *k);
+void test_gtc_vs_gchash(long N, long Nsamp);
+
+#endif /* _GTCACHE_ */
@@ -242,6 +242,13 @@ void plmgen_destroy(plmgen_data *plmdata)
   free(plmdata);
 }
 
+/* resets the state plmgen keeps between calls so that reused plm data gives the same results as new plm data */
+void plmgen_reset(plmgen_data *plmdata)
+{
+  plmdata->cth_crit = 2.0;
+  plmdata->m_crit = plmdata->lmax + 1;
+}
+
 void plmgen_recalc_recfac(long m, plmgen_data *plmdata)
 {
   if(plmdata->m_last == m)
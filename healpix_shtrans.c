@@ -135,6 +135,9 @@ HEALPixSHTPlan healpixsht_plan(long order)
   
   plan.ring_weights = NULL;
   plan.window_function = NULL;
+  plan.plmdata = NULL;
+  plan.plmdataThreads = NULL;
+  plan.NumPlmThreads = 0;
   
   //get rings for this task
   long i,j,good=1;
@@ -161,60 +164,407 @@ HEALPixSHTPlan healpixsht_plan(long order)
 
 void healpixsht_destroy_internaldata(void)
 {
+  healpixsht_destroy_cached_plans();
+  destroy_ring_fft_plans();
   destroy_mrange_alm2map_healpix_mpi();
   destroy_ringrange_map2alm_healpix_mpi();
 }
 
-void ring_synthesis(long Nphi, long shifted, float *ringvals)
+/*
+  cache of SHT plans indexed by HEALPix order
+  
+  - the plan, the ring weights and the plm recursion data only depend on the order, so they are made the first 
+    time a plan is asked for and then kept until healpixsht_destroy_cached_plans is called
+  - with adaptive load balancing the ring and m ranges are remade from the latest timing data on every call, 
+    but the ring weights and plm recursion data are still reused
+  - never call healpixsht_destroy_plan on a cached plan
+*/
+static HEALPixSHTPlan cachedPlans[HEALPIX_UTILS_MAXORDER+1];
+static int isCachedPlan[HEALPIX_UTILS_MAXORDER+1];
+
+HEALPixSHTPlan healpixsht_get_cached_plan(long order, char *ringWeightPath)
+{
+  HEALPixSHTPlan plan;
+  
+  assert(order >= 0 && order <= HEALPIX_UTILS_MAXORDER);
+  
+  if(isCachedPlan[order])
+    {
+#ifndef STATIC_LOADBAL_SHT
+      plan = healpixsht_plan(order);
+      plan.ring_weights = cachedPlans[order].ring_weights;
+      plan.window_function = cachedPlans[order].window_function;
+      plan.plmdata = cachedPlans[order].plmdata;
+      plan.plmdataThreads = cachedPlans[order].plmdataThreads;
+      plan.NumPlmThreads = cachedPlans[order].NumPlmThreads;
+      
+      cachedPlans[order].ring_weights = NULL;
+      cachedPlans[order].window_function = NULL;
+      cachedPlans[order].plmdata = NULL;
+      cachedPlans[order].plmdataThreads = NULL;
+      cachedPlans[order].NumPlmThreads = 0;
+      healpixsht_destroy_plan(cachedPlans[order]);
+      
+      cachedPlans[order] = plan;
+#endif
+      return cachedPlans[order];
+    }
+  
+  plan = healpixsht_plan(order);
+  if(ringWeightPath != NULL && strlen(ringWeightPath) > 0)
+    read_ring_weights(ringWeightPath,&plan);
+  plan.plmdata = plmgen_init(plan.lmax,SHT_PLMEPS);
+#ifdef USE_OPENMP
+  int thread;
+  plan.NumPlmThreads = omp_get_max_threads();
+  plan.plmdataThreads = (plmgen_data**)malloc(sizeof(plmgen_data*)*plan.NumPlmThreads);
+  assert(plan.plmdataThreads != NULL);
+  plan.plmdataThreads[0] = NULL;
+  for(thread=1;thread<plan.NumPlmThreads;++thread)
+    plan.plmdataThreads[thread] = plmgen_init(plan.lmax,SHT_PLMEPS);
+#endif
+  
+  cachedPlans[order] = plan;
+  isCachedPlan[order] = 1;
+  
+  return plan;
+}
+
+void healpixsht_destroy_cached_plans(void)
+{
+  long order;
+  
+  for(order=0;order<=HEALPIX_UTILS_MAXORDER;++order)
+    {
+      if(isCachedPlan[order])
+	{
+	  healpixsht_destroy_plan(cachedPlans[order]);
+	  isCachedPlan[order] = 0;
+	}
+    }
+}
+
+/*
+  FFTW plans for the ring FFTs
+  
+  - the # of pixels in a HEALPix ring is a multiple of 4 and at most 4*nside, so the plans are kept in a table 
+    indexed by Nphi/4 and each one is made the first time a ring of that length is transformed
+  - the plans work in place on one aligned scratch buffer which rings are copied in and out of
+  - call init_ring_fft_plans with the order of the map before doing any ring FFTs - the table is only 
+    remade if the order changes
+  - define SHT_FFTW_MEASURE to make the plans with FFTW_MEASURE instead of FFTW_ESTIMATE
+  - define SHT_BATCH_RING_FFTS to transform the north and south rings of a ring pair with one FFTW plan 
+    (see ring_synthesis_pair and ring_analysis_pair)
+*/
+#ifdef SHT_FFTW_MEASURE
+#define SHT_FFTW_PLANFLAG FFTW_MEASURE
+#else
+#define SHT_FFTW_PLANFLAG FFTW_ESTIMATE
+#endif
+
+static long ringFFTOrder = -1;
+static long NumRingFFTPlans = 0;
+static fftwf_plan *ringSynthesisPlans[2] = {NULL,NULL};
+static fftwf_plan *ringAnalysisPlans[2] = {NULL,NULL};
+static fftwf_complex *ringFFTBuff = NULL;
+
+void init_ring_fft_plans(long order)
+{
+  long i,k,NphiMax;
+  
+  if(order == ringFFTOrder)
+    return;
+  
+  destroy_ring_fft_plans();
+  
+  NphiMax = 4*order2nside(order);
+  NumRingFFTPlans = NphiMax/4 + 1;
+  for(k=0;k<2;++k)
+    {
+      ringSynthesisPlans[k] = (fftwf_plan*)malloc(sizeof(fftwf_plan)*NumRingFFTPlans);
+      assert(ringSynthesisPlans[k] != NULL);
+      ringAnalysisPlans[k] = (fftwf_plan*)malloc(sizeof(fftwf_plan)*NumRingFFTPlans);
+      assert(ringAnalysisPlans[k] != NULL);
+      for(i=0;i<NumRingFFTPlans;++i)
+	{
+	  ringSynthesisPlans[k][i] = NULL;
+	  ringAnalysisPlans[k][i] = NULL;
+	}
+    }
+  
+  //room for two rings so that ring pairs can be done at once
+  ringFFTBuff = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex)*2*(NphiMax/2+1));
+  assert(ringFFTBuff != NULL);
+  
+  ringFFTOrder = order;
+}
+
+void destroy_ring_fft_plans(void)
+{
+  long i,k;
+  
+  for(k=0;k<2;++k)
+    {
+      if(ringSynthesisPlans[k] != NULL)
+	{
+	  for(i=0;i<NumRingFFTPlans;++i)
+	    if(ringSynthesisPlans[k][i] != NULL)
+	      fftwf_destroy_plan(ringSynthesisPlans[k][i]);
+	  free(ringSynthesisPlans[k]);
+	  ringSynthesisPlans[k] = NULL;
+	}
+      
+      if(ringAnalysisPlans[k] != NULL)
+	{
+	  for(i=0;i<NumRingFFTPlans;++i)
+	    if(ringAnalysisPlans[k][i] != NULL)
+	      fftwf_destroy_plan(ringAnalysisPlans[k][i]);
+	  free(ringAnalysisPlans[k]);
+	  ringAnalysisPlans[k] = NULL;
+	}
+    }
+  
+  if(ringFFTBuff != NULL)
+    fftwf_free(ringFFTBuff);
+  ringFFTBuff = NULL;
+  
+  NumRingFFTPlans = 0;
+  ringFFTOrder = -1;
+}
+
+/* returns the plan for Nrings (1 or 2) rings of length Nphi stored one after the other in ringFFTBuff */
+static fftwf_plan get_ring_fft_plan(long Nphi, long Nrings, int synthesis)
+{
+  fftwf_plan *plan;
+  int n = (int) Nphi;
+  
+  assert(ringFFTBuff != NULL);
+  assert(Nphi%4 == 0 && Nphi/4 < NumRingFFTPlans);
+  assert(Nrings == 1 || Nrings == 2);
+  
+  if(synthesis)
+    plan = &(ringSynthesisPlans[Nrings-1][Nphi/4]);
+  else
+    plan = &(ringAnalysisPlans[Nrings-1][Nphi/4]);
+  
+  if(*plan == NULL)
+    {
+      if(synthesis)
+	*plan = fftwf_plan_many_dft_c2r(1,&n,(int) Nrings,
+					ringFFTBuff,NULL,1,(int) (Nphi/2+1),
+					(float*) ringFFTBuff,NULL,1,(int) (2*(Nphi/2+1)),
+					SHT_FFTW_PLANFLAG);
+      else
+	*plan = fftwf_plan_many_dft_r2c(1,&n,(int) Nrings,
+					(float*) ringFFTBuff,NULL,1,(int) (2*(Nphi/2+1)),
+					ringFFTBuff,NULL,1,(int) (Nphi/2+1),
+					SHT_FFTW_PLANFLAG);
+      assert(*plan != NULL);
+    }
+  
+  return *plan;
+}
+
+/* phase factors from transformation on pixels shifted by half a pixel length*/
+static void shift_ring_phases(long Nphi, fftwf_complex *cring)
 {
   long mp;
   double cosmp,sinmp,tmp[2];
   
-  float *ringvals_out;
-  fftwf_complex *cring,*cring_in;
+  for(mp=0;mp<Nphi/2+1;++mp)
+    {
+      cosmp = cos(mp*M_PI/Nphi);
+      sinmp = sin(mp*M_PI/Nphi);
+      tmp[0] = (double) (cring[mp][0]);
+      tmp[1] = (double) (cring[mp][1]);
+      cring[mp][0] = (float) (tmp[0]*cosmp - tmp[1]*sinmp);
+      cring[mp][1] = (float) (tmp[1]*cosmp + tmp[0]*sinmp);
+    }
+}
+
+void ring_synthesis(long Nphi, long shifted, float *ringvals)
+{
   fftwf_plan plan;
   
-  cring = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex)*(Nphi/2+1));
-  assert(cring != NULL);
-  ringvals_out = (float*) cring;
-  cring_in = (fftwf_complex*) ringvals;
-  plan = fftwf_plan_dft_c2r_1d((int) Nphi,cring,ringvals_out,FFTW_ESTIMATE);
+  plan = get_ring_fft_plan(Nphi,1,1);
+  
+  memcpy(ringFFTBuff,ringvals,sizeof(fftwf_complex)*(Nphi/2+1));
   
-  memmove(cring,cring_in,sizeof(fftwf_complex)*(Nphi/2+1));
-    
-  /* phase factors from transformation on pixels shifted by half a pixel length*/
   if(shifted)
+    shift_ring_phases(Nphi,ringFFTBuff);
+  
+  fftwf_execute(plan);
+  
+  memcpy(ringvals,ringFFTBuff,sizeof(float)*Nphi);
+}
+
+/* does ring_synthesis for the north and south rings of a ring pair, which have the same length and shift */
+void ring_synthesis_pair(long Nphi, long shifted, float *northvals, float *southvals)
+{
+#ifdef SHT_BATCH_RING_FFTS
+  fftwf_plan plan;
+  long dist = Nphi/2+1;
+  
+  plan = get_ring_fft_plan(Nphi,2,1);
+  
+  memcpy(ringFFTBuff,northvals,sizeof(fftwf_complex)*dist);
+  memcpy(ringFFTBuff+dist,southvals,sizeof(fftwf_complex)*dist);
+  
+  if(shifted)
+    {
+      shift_ring_phases(Nphi,ringFFTBuff);
+      shift_ring_phases(Nphi,ringFFTBuff+dist);
+    }
+  
+  fftwf_execute(plan);
+  
+  memcpy(northvals,ringFFTBuff,sizeof(float)*Nphi);
+  memcpy(southvals,ringFFTBuff+dist,sizeof(float)*Nphi);
+#else
+  ring_synthesis(Nphi,shifted,northvals);
+  ring_synthesis(Nphi,shifted,southvals);
+#endif
+}
+
+/*
+  learned cost curves for the SHT load balance
+  
+  - the cost of each m value (or ring) is kept normalized to unit sum and updated after each SHT with 
+    cost = (1-SHT_LOADBAL_WEIGHT)*cost + SHT_LOADBAL_WEIGHT*(measured time)/(total measured time)
+  - if a path is set with healpixsht_set_loadbal_path, the curves are written there every time they 
+    are updated and read back in when the load balance is initialized, so that the next run starts 
+    from the learned curves instead of the polynomial fits below
+*/
+static char shtLoadBalPath[2048] = "";
+
+void healpixsht_set_loadbal_path(char *path)
+{
+  if(path == NULL)
+    shtLoadBalPath[0] = '\0';
+  else
     {
-      for(mp=0;mp<Nphi/2+1;++mp)
+      strncpy(shtLoadBalPath,path,2047);
+      shtLoadBalPath[2047] = '\0';
+    }
+}
+
+#ifndef STATIC_LOADBAL_SHT
+static int update_loadbal_costs(double *times, double *costs, long N)
+{
+  double *globalTimes,totTimes;
+  long i;
+  
+  globalTimes = (double*)malloc(sizeof(double)*N);
+  assert(globalTimes != NULL);
+  MPI_Allreduce(times,globalTimes,(int) N,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+  
+  totTimes = 0.0;
+  for(i=0;i<N;++i)
+    totTimes += globalTimes[i];
+  
+  //no SHTs were done since the last update
+  if(totTimes <= 0.0)
+    {
+      free(globalTimes);
+      return 0;
+    }
+  
+  for(i=0;i<N;++i)
+    costs[i] = (1.0-SHT_LOADBAL_WEIGHT)*costs[i] + SHT_LOADBAL_WEIGHT*globalTimes[i]/totTimes;
+  
+  free(globalTimes);
+  
+  return 1;
+}
+
+static int read_loadbal_costs(char *fname, double *costs, long N)
+{
+  int ThisTask;
+  FILE *fp;
+  long i,Nfile;
+  int good = 0;
+  double totCosts;
+  
+  MPI_Comm_rank(MPI_COMM_WORLD,&ThisTask);
+  
+  if(ThisTask == 0)
+    {
+      fp = fopen(fname,"r");
+      if(fp != NULL)
 	{
-	  cosmp = cos(mp*M_PI/Nphi);
-	  sinmp = sin(mp*M_PI/Nphi);
-	  tmp[0] = (double) (cring[mp][0]);
-	  tmp[1] = (double) (cring[mp][1]);
-	  cring[mp][0] = (float) (tmp[0]*cosmp - tmp[1]*sinmp);
-	  cring[mp][1] = (float) (tmp[1]*cosmp + tmp[0]*sinmp);
+	  good = 1;
+	  if(fscanf(fp,"%ld",&Nfile) != 1 || Nfile != N)
+	    good = 0;
+	  
+	  totCosts = 0.0;
+	  for(i=0;i<N && good;++i)
+	    {
+	      if(fscanf(fp,"%lf",&(costs[i])) != 1 || !(costs[i] >= 0.0))
+		good = 0;
+	      else
+		totCosts += costs[i];
+	    }
+	  fclose(fp);
+	  
+	  if(good && totCosts > 0.0)
+	    {
+	      for(i=0;i<N;++i)
+		costs[i] /= totCosts;
+	      fprintf(stderr,"using SHT load balance from file '%s'!\n",fname);
+	    }
+	  else
+	    {
+	      good = 0;
+	      fprintf(stderr,"could not read SHT load balance from file '%s'!\n",fname);
+	    }
 	}
     }
   
-  fftwf_execute(plan);
-  fftwf_destroy_plan(plan);
+  MPI_Bcast(&good,1,MPI_INT,0,MPI_COMM_WORLD);
+  if(good)
+    MPI_Bcast(costs,(int) N,MPI_DOUBLE,0,MPI_COMM_WORLD);
+  
+  return good;
+}
+
+static void write_loadbal_costs(char *fname, double *costs, long N)
+{
+  int ThisTask;
+  FILE *fp;
+  long i;
   
-  memmove(ringvals,ringvals_out,sizeof(float)*Nphi);
+  MPI_Comm_rank(MPI_COMM_WORLD,&ThisTask);
   
-  fftwf_free(cring);
+  if(ThisTask == 0)
+    {
+      fp = fopen(fname,"w");
+      if(fp == NULL)
+	{
+	  fprintf(stderr,"could not write SHT load balance to file '%s'!\n",fname);
+	  return;
+	}
+      
+      fprintf(fp,"%ld\n",N);
+      for(i=0;i<N;++i)
+	fprintf(fp,"%.10le\n",costs[i]);
+      fclose(fp);
+    }
 }
+#endif
 
 /*
   load-balancing scheme for m values
   
-  - init the scheme with a polynomial fit to some timing data
+  - init the scheme with a polynomial fit to some timing data (or the learned cost curve from an earlier run)
   - after each alm2map_mpi call, a global var with timing data is updated
-  - if you replan the healpix sht by destroying the old pland and calling the planner again, the new timing data is used
+  - if you replan the healpix sht by destroying the old pland and calling the planner again, the new timing data is 
+    folded into the cost curve and used
   
 */
 
 double *alm2mapMTimesGlobal = NULL;
 long Nalm2mapMTimesGlobal = 0;
+static double *alm2mapMCosts = NULL;
 
 void init_mrange_alm2map_healpix_mpi(long order)
 {
@@ -224,29 +574,43 @@ void init_mrange_alm2map_healpix_mpi(long order)
   double c = 3.0*(0.71754502);
   long m;
   double x,dx,integral;
+#ifndef STATIC_LOADBAL_SHT
+  char fname[2048];
+#endif
   
   lmax = order2lmax(order);
   Nalm2mapMTimesGlobal = lmax+1;
   alm2mapMTimesGlobal = (double*)malloc(sizeof(double)*Nalm2mapMTimesGlobal);
   assert(alm2mapMTimesGlobal != NULL);
-
+  alm2mapMCosts = (double*)malloc(sizeof(double)*Nalm2mapMTimesGlobal);
+  assert(alm2mapMCosts != NULL);
+  for(m=0;m<=lmax;++m)
+    alm2mapMTimesGlobal[m] = 0.0;
+  
+#ifndef STATIC_LOADBAL_SHT
+  //start from the cost curve learned in an earlier run if there is one
+  if(strlen(shtLoadBalPath) > 0)
+    {
+      snprintf(fname,sizeof(fname),"%s/shtloadbal_m.%ld",shtLoadBalPath,order);
+      if(read_loadbal_costs(fname,alm2mapMCosts,Nalm2mapMTimesGlobal))
+	return;
+    }
+#endif
+  
   dx = 1.0/(lmax+1);
   x = 0.0;
   for(m=0;m<=lmax;++m)
     {
       x = x+dx;
-      alm2mapMTimesGlobal[m] = (a+b*x+c*x*x)*dx;
+      alm2mapMCosts[m] = (a+b*x+c*x*x)*dx;
     }
   
   integral = 0.0;
   for(m=0;m<=lmax;++m)
-    integral += alm2mapMTimesGlobal[m];
+    integral += alm2mapMCosts[m];
   
-  for(m=0;m<=lmax-1;++m)
-    alm2mapMTimesGlobal[m+1] += alm2mapMTimesGlobal[m];
-
   for(m=0;m<=lmax;++m)
-    alm2mapMTimesGlobal[m] /= integral;
+    alm2mapMCosts[m] /= integral;
 }
 
 void destroy_mrange_alm2map_healpix_mpi(void)
@@ -254,6 +618,9 @@ void destroy_mrange_alm2map_healpix_mpi(void)
   if(alm2mapMTimesGlobal != NULL)
     free(alm2mapMTimesGlobal);
   alm2mapMTimesGlobal = NULL;
+  if(alm2mapMCosts != NULL)
+    free(alm2mapMCosts);
+  alm2mapMCosts = NULL;
   Nalm2mapMTimesGlobal = 0;
 }
 
@@ -262,63 +629,36 @@ void get_mrange_alm2map_healpix_mpi(int MyNTasks, long *firstMTasks, long *lastM
   long i,m;
   double int_per_proc;
   long lmax = order2lmax(order);
-
+  double *cumCosts;
 #ifndef STATIC_LOADBAL_SHT
-  static int initFlag = 1;
-  double *localTimes,totMTimes;
-  long NlocalTimes;
+  char fname[2048];
 #endif
-
+  
 #ifdef STATIC_LOADBAL_SHT
   destroy_mrange_alm2map_healpix_mpi();
   init_mrange_alm2map_healpix_mpi(order);
 #else
-  if(initFlag)
-    {
-      init_mrange_alm2map_healpix_mpi(order);
-      initFlag = 0;
-    }
-  else if(Nalm2mapMTimesGlobal != (lmax+1))
+  if(Nalm2mapMTimesGlobal != (lmax+1))
     {
       destroy_mrange_alm2map_healpix_mpi();
       init_mrange_alm2map_healpix_mpi(order);
     }
-  else if(alm2mapMTimesGlobal == NULL || Nalm2mapMTimesGlobal == 0)
+  else if(update_loadbal_costs(alm2mapMTimesGlobal,alm2mapMCosts,Nalm2mapMTimesGlobal) && strlen(shtLoadBalPath) > 0)
     {
-      init_mrange_alm2map_healpix_mpi(order);
-    }
-  else
-    {
-      /* compute normalized cumulative sum */
-      NlocalTimes = 1 + order2lmax(order);
-      localTimes = (double*)malloc(sizeof(double)*NlocalTimes);
-      assert(localTimes != NULL);
-      for(i=0;i<Nalm2mapMTimesGlobal;++i)
-        localTimes[i] = 0.0;
-      for(i=0;i<Nalm2mapMTimesGlobal;++i)
-        localTimes[i] = alm2mapMTimesGlobal[i];
-      
-      MPI_Allreduce(localTimes,alm2mapMTimesGlobal,(int) Nalm2mapMTimesGlobal,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD); 
-      free(localTimes);
-      
-      totMTimes = 0.0;
-      for(i=0;i<Nalm2mapMTimesGlobal;++i)
-        totMTimes += alm2mapMTimesGlobal[i];
-      
-      for(i=0;i<Nalm2mapMTimesGlobal-1;++i)
-        alm2mapMTimesGlobal[i+1] += alm2mapMTimesGlobal[i];
-
-      for(i=0;i<Nalm2mapMTimesGlobal;++i)
-        alm2mapMTimesGlobal[i] /= totMTimes;
-      
-      if(totMTimes == 0.0)
-	{
-	  destroy_mrange_alm2map_healpix_mpi();
-	  init_mrange_alm2map_healpix_mpi(order);
-	}
+      snprintf(fname,sizeof(fname),"%s/shtloadbal_m.%ld",shtLoadBalPath,order);
+      write_loadbal_costs(fname,alm2mapMCosts,Nalm2mapMTimesGlobal);
     }
 #endif
   
+  /* compute normalized cumulative sum */
+  cumCosts = (double*)malloc(sizeof(double)*Nalm2mapMTimesGlobal);
+  assert(cumCosts != NULL);
+  cumCosts[0] = alm2mapMCosts[0];
+  for(i=0;i<Nalm2mapMTimesGlobal-1;++i)
+    cumCosts[i+1] = cumCosts[i] + alm2mapMCosts[i+1];
+  for(i=0;i<Nalm2mapMTimesGlobal;++i)
+    cumCosts[i] /= cumCosts[Nalm2mapMTimesGlobal-1];
+  
   if(MyNTasks == 1)
     {
       firstMTasks[0] = 0;
@@ -342,7 +682,7 @@ void get_mrange_alm2map_healpix_mpi(int MyNTasks, long *firstMTasks, long *lastM
           
 	  firstMTasks[i] = m;
           
-          while(alm2mapMTimesGlobal[m] < (i+1)*int_per_proc && m < Nalm2mapMTimesGlobal-1)
+	  while(cumCosts[m] < (i+1)*int_per_proc && m < Nalm2mapMTimesGlobal-1)
 	    ++m;
 	  
 	  if(m == firstMTasks[i])
@@ -354,6 +694,8 @@ void get_mrange_alm2map_healpix_mpi(int MyNTasks, long *firstMTasks, long *lastM
       lastMTasks[MyNTasks-1] = lmax;
     }
   
+  free(cumCosts);
+  
   for(i=0;i<Nalm2mapMTimesGlobal;++i)
     alm2mapMTimesGlobal[i] = 0.0;
 }
@@ -513,6 +855,20 @@ void healpixsht_destroy_plan(HEALPixSHTPlan plan)
       free(plan.window_function);
       plan.window_function = NULL;
     }
+  if(plan.plmdata != NULL)
+    {
+      plmgen_destroy(plan.plmdata);
+      plan.plmdata = NULL;
+    }
+  if(plan.plmdataThreads != NULL)
+    {
+      int thread;
+      for(thread=1;thread<plan.NumPlmThreads;++thread)
+	plmgen_destroy(plan.plmdataThreads[thread]);
+      free(plan.plmdataThreads);
+      plan.plmdataThreads = NULL;
+      plan.NumPlmThreads = 0;
+    }
 }
 
 long order2lmax(long _order)
@@ -548,26 +904,37 @@ long get_lmin_ylm(long m, double sintheta)
 
 void ring_analysis(long Nphi, float *ringvals)
 {
-  float *ringvals_in;
-  fftwf_complex *cring,*cring_out;
   fftwf_plan plan;
   
-  cring = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex)*(Nphi/2+1));
-  assert(cring != NULL);
-  ringvals_in = (float*) cring;
-  cring_out = (fftwf_complex*) ringvals;
+  plan = get_ring_fft_plan(Nphi,1,0);
   
-  plan = fftwf_plan_dft_r2c_1d((int) Nphi,ringvals_in,cring,FFTW_ESTIMATE); 
-  
-  memmove(ringvals_in,ringvals,sizeof(float)*Nphi);
+  memcpy(ringFFTBuff,ringvals,sizeof(float)*Nphi);
   
   fftwf_execute(plan);
   
-  fftwf_destroy_plan(plan);
+  memcpy(ringvals,ringFFTBuff,sizeof(fftwf_complex)*(Nphi/2+1));
+}
+
+/* does ring_analysis for the north and south rings of a ring pair */
+void ring_analysis_pair(long Nphi, float *northvals, float *southvals)
+{
+#ifdef SHT_BATCH_RING_FFTS
+  fftwf_plan plan;
+  long dist = Nphi/2+1;
   
-  memmove(cring_out,cring,sizeof(fftwf_complex)*(Nphi/2+1));
+  plan = get_ring_fft_plan(Nphi,2,0);
   
-  fftwf_free(cring);
+  memcpy(ringFFTBuff,northvals,sizeof(float)*Nphi);
+  memcpy(ringFFTBuff+dist,southvals,sizeof(float)*Nphi);
+  
+  fftwf_execute(plan);
+  
+  memcpy(northvals,ringFFTBuff,sizeof(fftwf_complex)*dist);
+  memcpy(southvals,ringFFTBuff+dist,sizeof(fftwf_complex)*dist);
+#else
+  ring_analysis(Nphi,northvals);
+  ring_analysis(Nphi,southvals);
+#endif
 }
 
 /*
@@ -593,6 +960,7 @@ void ring_analysis(long Nphi, float *ringvals)
 
 double *map2almRingTimesGlobal = NULL;
 long Nmap2almRingTimesGlobal = 0;
+static double *map2almRingCosts = NULL;
 
 void init_ringrange_map2alm_healpix_mpi(long order)
 {
@@ -603,12 +971,29 @@ void init_ringrange_map2alm_healpix_mpi(long order)
   const double c = 3.0*(-1.1734647);
   double gam = 2.0*(1.0 - (alpha/8 + beta/2 + c/24.0));
   long nside = order2nside(order);
+#ifndef STATIC_LOADBAL_SHT
+  char fname[2048];
+#endif
   
   assert(fabs(gam/2.0 + beta/2.0 + alpha/8.0 + c/24.0 - 1.0) < 1e-10); /* make sure integral of work is unity */
   
   Nmap2almRingTimesGlobal = 2*nside;
   map2almRingTimesGlobal = (double*)malloc(sizeof(double)*Nmap2almRingTimesGlobal);
   assert(map2almRingTimesGlobal != NULL);
+  map2almRingCosts = (double*)malloc(sizeof(double)*Nmap2almRingTimesGlobal);
+  assert(map2almRingCosts != NULL);
+  for(i=0;i<2*nside;++i)
+    map2almRingTimesGlobal[i] = 0.0;
+  
+#ifndef STATIC_LOADBAL_SHT
+  //start from the cost curve learned in an earlier run if there is one
+  if(strlen(shtLoadBalPath) > 0)
+    {
+      snprintf(fname,sizeof(fname),"%s/shtloadbal_ring.%ld",shtLoadBalPath,order);
+      if(read_loadbal_costs(fname,map2almRingCosts,Nmap2almRingTimesGlobal))
+	return;
+    }
+#endif
   
   integral = 0.0;
   dx = 1.0/2.0/nside;
@@ -617,12 +1002,14 @@ void init_ringrange_map2alm_healpix_mpi(long order)
     {
       x = x + dx;
       if (i+1 <= nside)
-	integral = integral + (alpha*x+beta+c*x*x)*dx;
+	map2almRingCosts[i] = (alpha*x+beta+c*x*x)*dx;
       else
-	integral = integral + gam*dx;
-      
-      map2almRingTimesGlobal[i] = integral;
+	map2almRingCosts[i] = gam*dx;
+      integral += map2almRingCosts[i];
     }
+  
+  for(i=0;i<2*nside;++i)
+    map2almRingCosts[i] /= integral;
 }
 
 void destroy_ringrange_map2alm_healpix_mpi(void)
@@ -630,6 +1017,9 @@ void destroy_ringrange_map2alm_healpix_mpi(void)
   if(map2almRingTimesGlobal != NULL)
     free(map2almRingTimesGlobal);
   map2almRingTimesGlobal = NULL;
+  if(map2almRingCosts != NULL)
+    free(map2almRingCosts);
+  map2almRingCosts = NULL;
   Nmap2almRingTimesGlobal = 0;
 }
 
@@ -638,64 +1028,36 @@ void get_ringrange_map2alm_healpix_mpi(int MyNTasks, long *firstRing, long *last
   long i,ring;
   double int_per_proc;
   long nside = order2nside(order);
-  
+  double *cumCosts;
 #ifndef STATIC_LOADBAL_SHT
-  static int initFlag = 1;
-  double totRingTimes;
-  double *localTimes;
-  long NlocalTimes;
+  char fname[2048];
 #endif
-
+  
 #ifdef STATIC_LOADBAL_SHT
-   destroy_ringrange_map2alm_healpix_mpi();
-   init_ringrange_map2alm_healpix_mpi(order);
+  destroy_ringrange_map2alm_healpix_mpi();
+  init_ringrange_map2alm_healpix_mpi(order);
 #else
-  if(initFlag)
-    {
-      init_ringrange_map2alm_healpix_mpi(order);
-      initFlag = 0;
-    }
-  else if(Nmap2almRingTimesGlobal != 2*nside)
+  if(Nmap2almRingTimesGlobal != 2*nside)
     {
       destroy_ringrange_map2alm_healpix_mpi();
       init_ringrange_map2alm_healpix_mpi(order);
     }
-  else if(map2almRingTimesGlobal == NULL || Nmap2almRingTimesGlobal == 0)
+  else if(update_loadbal_costs(map2almRingTimesGlobal,map2almRingCosts,Nmap2almRingTimesGlobal) && strlen(shtLoadBalPath) > 0)
     {
-      init_ringrange_map2alm_healpix_mpi(order);
-    }
-  else
-    {
-      NlocalTimes = 2*nside;
-      localTimes = (double*)malloc(sizeof(double)*NlocalTimes);
-      assert(localTimes != NULL);
-      for(i=0;i<Nmap2almRingTimesGlobal;++i)
-        localTimes[i] = 0.0;
-      for(i=0;i<Nmap2almRingTimesGlobal;++i)
-        localTimes[i] = map2almRingTimesGlobal[i];
-
-      MPI_Allreduce(localTimes,map2almRingTimesGlobal,(int) Nmap2almRingTimesGlobal,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-      free(localTimes);
-      
-      //compute normalized cumulative sum
-      totRingTimes = 0.0;
-      for(i=0;i<Nmap2almRingTimesGlobal;++i)
-	totRingTimes += map2almRingTimesGlobal[i];
-
-      for(i=0;i<Nmap2almRingTimesGlobal-1;++i)
-	map2almRingTimesGlobal[i+1] += map2almRingTimesGlobal[i];
-
-      for(i=0;i<Nmap2almRingTimesGlobal;++i)
-	map2almRingTimesGlobal[i] /= totRingTimes;
-      
-      if(totRingTimes == 0.0)
-	{
-	  destroy_ringrange_map2alm_healpix_mpi();
-	  init_ringrange_map2alm_healpix_mpi(order);
-	}
+      snprintf(fname,sizeof(fname),"%s/shtloadbal_ring.%ld",shtLoadBalPath,order);
+      write_loadbal_costs(fname,map2almRingCosts,Nmap2almRingTimesGlobal);
     }
 #endif
   
+  //compute normalized cumulative sum
+  cumCosts = (double*)malloc(sizeof(double)*Nmap2almRingTimesGlobal);
+  assert(cumCosts != NULL);
+  cumCosts[0] = map2almRingCosts[0];
+  for(i=0;i<Nmap2almRingTimesGlobal-1;++i)
+    cumCosts[i+1] = cumCosts[i] + map2almRingCosts[i+1];
+  for(i=0;i<Nmap2almRingTimesGlobal;++i)
+    cumCosts[i] /= cumCosts[Nmap2almRingTimesGlobal-1];
+  
   if(MyNTasks == 1)
     {
       firstRing[0] = 1;
@@ -729,7 +1091,7 @@ void get_ringrange_map2alm_healpix_mpi(int MyNTasks, long *firstRing, long *last
 
           firstRing[i] = ring;
           
-          while(map2almRingTimesGlobal[ring-1] < (i+1)*int_per_proc && ring <= Nmap2almRingTimesGlobal-1)
+	  while(cumCosts[ring-1] < (i+1)*int_per_proc && ring <= Nmap2almRingTimesGlobal-1)
 	    ++ring;
 	  
 	  if(ring == firstRing[i])
@@ -741,6 +1103,8 @@ void get_ringrange_map2alm_healpix_mpi(int MyNTasks, long *firstRing, long *last
       lastRing[MyNTasks-1] = 2*nside;
     }
   
+  free(cumCosts);
+  
   for(i=0;i<Nmap2almRingTimesGlobal;++i)
     map2almRingTimesGlobal[i] = 0.0;
 }
@@ -19,14 +19,43 @@
 #define HEALPIXSHT /* HEALPIXSHT */
 
 
-#define STATIC_LOADBAL_SHT /* define to turn off adaptive load balance functions */
+//#define STATIC_LOADBAL_SHT /* define to turn off adaptive load balance functions */
+#define SHT_LOADBAL_WEIGHT 0.5 /* weight of the latest timings when updating the SHT load balance cost curves */
 //#define OUTPUT_SHT_LOADBALANCE /* define to output a bunch of SHT load balance functions */
 
+#define SHT_PLMEPS 1e-30 /* plms smaller than this are treated as zero in the SHTs */
+
+/* timer for code which may run in OpenMP threads - only the master thread may call MPI with MPI_THREAD_FUNNELED */
+#ifdef USE_OPENMP
+#include <omp.h>
+#define SHT_WTIME() omp_get_wtime()
+#else
+#define SHT_WTIME() MPI_Wtime()
+#endif
+
 extern double *map2almRingTimesGlobal;
 extern long Nmap2almRingTimesGlobal;
 extern double *alm2mapMTimesGlobal;
 extern long Nalm2mapMTimesGlobal;
 
+/* define a structure for info in and out of program to make it thread safe */
+typedef struct
+{
+  double fsmall;
+  double fbig;
+  double eps;
+  double cth_crit;
+  long lmax;
+  long mmax;
+  long m_last;
+  long m_crit;
+  double *cf;
+  double *recfac;
+  double *mfac;
+  double *t1fac;
+  double *t2fac;
+} plmgen_data;
+
 typedef struct {
   long order;
   long *firstRingTasks;
@@ -42,6 +71,9 @@ typedef struct {
   long Nlm;
   double *ring_weights;
   double *window_function;
+  plmgen_data *plmdata;       /* plm recursion data kept with cached plans - NULL otherwise */
+  plmgen_data **plmdataThreads; /* plm recursion data for OpenMP threads 1,2,... kept with cached plans - NULL otherwise */
+  int NumPlmThreads;          /* # of entries in plmdataThreads - entry 0 is not used since thread 0 uses plmdata */
 } HEALPixSHTPlan;
 
 /* in healpix_shtrans.c */
@@ -51,14 +83,21 @@ long num_lms(long lmax);
 long order2lmax(long _order);
 HEALPixSHTPlan healpixsht_plan(long order);
 void healpixsht_destroy_plan(HEALPixSHTPlan plan);
+HEALPixSHTPlan healpixsht_get_cached_plan(long order, char *ringWeightPath);
+void healpixsht_destroy_cached_plans(void);
+void init_ring_fft_plans(long order);
+void destroy_ring_fft_plans(void);
 void ring_synthesis(long Nphi, long shifted, float *ringvals);
+void ring_synthesis_pair(long Nphi, long shifted, float *northvals, float *southvals);
 void get_mrange_alm2map_healpix_mpi(int MyNTasks, long *firstRing, long *lastRing, long order);
 void init_mrange_alm2map_healpix_mpi(long order);
 void destroy_mrange_alm2map_healpix_mpi(void);
 void ring_analysis(long Nphi, float *ringvals);
+void ring_analysis_pair(long Nphi, float *northvals, float *southvals);
 void init_ringrange_map2alm_healpix_mpi(long order);
 void destroy_ringrange_map2alm_healpix_mpi(void);
 void get_ringrange_map2alm_healpix_mpi(int MyNTasks, long *firstRing, long *lastRing, long order);
+void healpixsht_set_loadbal_path(char *path);
 void healpixsht_destroy_internaldata(void);
 void read_ring_weights(char *path, HEALPixSHTPlan *plan);
 void read_window_function(char *path, HEALPixSHTPlan *plan);
@@ -74,24 +113,6 @@ void alm2allmaps_mpi(double *alm_real, double *alm_imag, float *mapvec, float *m
 /* in alm2map_transpose_mpi.c */
 void alm2map_mpi(double *alm_real, double *alm_imag, float *mapvec, HEALPixSHTPlan plan);
 
-/* define a structure for info in and out of program to make it thread safe */
-typedef struct
-{
-  double fsmall;
-  double fbig;
-  double eps;
-  double cth_crit;
-  long lmax;
-  long mmax;
-  long m_last;
-  long m_crit;
-  double *cf;
-  double *recfac;
-  double *mfac;
-  double *t1fac;
-  double *t2fac;
-} plmgen_data;
-
 /* in healpix_plmgen.c */
 long plm2index(long l, long m);
 void index2plm(long plmindex, long*l, long *m);
@@ -99,6 +120,7 @@ long num_plms(long lmax);
 void plmgen(double cth, double sth, long m, double *vec, long *firstl, plmgen_data *plmdata);
 plmgen_data *plmgen_init(long lmax, double eps);
 void plmgen_destroy(plmgen_data *plmdata);
+void plmgen_reset(plmgen_data *plmdata);
 void plmgen_recalc_recfac(long m, plmgen_data *plmdata);
 
 #endif /* HEALPIXSHT */
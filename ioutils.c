@@ -66,6 +66,15 @@ void getPeanoIndsToReadFromFile(long HEALPixOrder, long *PeanoIndsToRead, long N
   long i,j,BaseNest,FileNest,OrderDiff,ind;
   long NinPix,Nextra=1000,*tmp;
   
+  /* no cells requested - tasks with no cells still join collective reads, so hand back an empty list */
+  if(NumPeanoIndsToRead <= 0)
+    {
+      *FilePeanoIndsToRead = (long*)malloc(sizeof(long));
+      assert(*FilePeanoIndsToRead != NULL);
+      *NumFilePeanoIndsToRead = 0;
+      return;
+    }
+  
   *FilePeanoIndsToRead = (long*)malloc(sizeof(long)*FileNPix);
   assert(*FilePeanoIndsToRead != NULL);
   *NumFilePeanoIndsToRead = FileNPix;
@@ -155,6 +164,69 @@ void getPeanoIndsToReadFromFile(long HEALPixOrder, long *PeanoIndsToRead, long N
   *FilePeanoIndsToRead = tmp;
 }
 
+/* keeps only the particles which are in the requested cells - used when the lens plane file cells are 
+   larger than the requested cells
+   - membership is a test against a bitmap of the requested cells built once per call
+   - the Peano indexes are computed in batches of CULL_BATCH particles before the particles are filtered
+*/
+#define CULL_BATCH 4096
+void cullLCPartsToPeanoInds(long HEALPixOrder, long *PeanoIndsToRead, long NumPeanoIndsToRead, Part **LCParts, long *NumLCParts)
+{
+  long NPix = order2npix(HEALPixOrder);
+  unsigned char *keep;
+  long i,j,n,ind,peano[CULL_BATCH];
+  double vec[3];
+  Part *parts = *LCParts;
+  
+  if(*NumLCParts <= 0)
+    return;
+  
+  keep = (unsigned char*)calloc((size_t) ((NPix+7)/8),sizeof(unsigned char));
+  assert(keep != NULL);
+  for(j=0;j<NumPeanoIndsToRead;++j)
+    keep[PeanoIndsToRead[j] >> 3] |= (unsigned char) (1 << (PeanoIndsToRead[j] & 7));
+  
+  ind = 0;
+  for(i=0;i<(*NumLCParts);i+=CULL_BATCH)
+    {
+      n = (*NumLCParts) - i;
+      if(n > CULL_BATCH)
+	n = CULL_BATCH;
+      
+      for(j=0;j<n;++j)
+	{
+	  vec[0] = (double) (parts[i+j].pos[0]);
+	  vec[1] = (double) (parts[i+j].pos[1]);
+	  vec[2] = (double) (parts[i+j].pos[2]);
+	  peano[j] = vec2nest(vec,HEALPixOrder);
+	}
+      for(j=0;j<n;++j)
+	peano[j] = nest2peano(peano[j],HEALPixOrder);
+      
+      for(j=0;j<n;++j)
+	{
+	  parts[ind] = parts[i+j];
+	  ind += (keep[peano[j] >> 3] >> (peano[j] & 7)) & 1;
+	}
+    }
+  
+  free(keep);
+  
+  *NumLCParts = ind;
+  if(*NumLCParts > 0)
+    {
+      *LCParts = (Part*)realloc(*LCParts,sizeof(Part)*(*NumLCParts));
+      assert(*LCParts != NULL);
+    }
+  else
+    {
+      free(*LCParts);
+      *NumLCParts = 0;
+      *LCParts = NULL;
+    }
+}
+#undef CULL_BATCH
+
 /*gets the number of lines in a file*/
 long fnumlines(FILE *fp)
 {
@@ -186,3 +258,124 @@ FILE *fopen_retry(const char *filename, const char *mode)
   //if we get to here, return NULL
   return NULL;
 }
+
+/* token passing I/O throttle
+   The tasks doing I/O form a chain and member i of the chain waits for a token from member 
+   i - NumFilesIOInParallel before touching the disk. When it is done, it passes the token on to member 
+   i + NumFilesIOInParallel. So at most NumFilesIOInParallel members do I/O at once, but there is no 
+   barrier between rounds and a slow reader only holds up the tasks which are waiting on it directly.
+   
+   The chain must be walked by every member in the same order, so these routines must be called 
+   in the same sequence on all tasks. The time spent waiting is logged under PROFILETAG_IOWAIT and 
+   can be summarized with io_throttle_report.
+*/
+static double ioThrottleWaitTime = 0.0;
+
+void io_throttle_wait(long prevTask)
+{
+  MPI_Status Stat;
+  char token;
+  double t;
+  
+  if(prevTask < 0)
+    return;
+  
+  logProfileTag(PROFILETAG_IOWAIT);
+  t = -MPI_Wtime();
+  MPI_Recv(&token,0,MPI_CHAR,(int) prevTask,TAG_IO_THROTTLE,MPI_COMM_WORLD,&Stat);
+  t += MPI_Wtime();
+  logProfileTag(PROFILETAG_IOWAIT);
+  
+  ioThrottleWaitTime += t;
+}
+
+void io_throttle_pass(long nextTask)
+{
+  char token = 0;
+  
+  if(nextTask < 0 || nextTask >= NTasks)
+    return;
+  
+  MPI_Send(&token,0,MPI_CHAR,(int) nextTask,TAG_IO_THROTTLE,MPI_COMM_WORLD);
+}
+
+/* chain over all tasks in rank order */
+void io_throttle_begin(void)
+{
+  io_throttle_wait(ThisTask - rayTraceData.NumFilesIOInParallel);
+}
+
+void io_throttle_end(void)
+{
+  io_throttle_pass(ThisTask + rayTraceData.NumFilesIOInParallel);
+}
+
+/* split version of the chain for I/O done by a thread which may not make MPI calls - the main thread posts 
+   the receive for the token with io_throttle_post, checks for it with io_throttle_test (waiting for it if 
+   block is set) and passes it on with io_throttle_pass_tag once the thread is done
+   - tag picks the chain, so a chain walked in the background does not swap tokens with the main one
+*/
+static char ioThrottleToken = 0;
+
+void io_throttle_post(int tag, MPI_Request *req)
+{
+  long prevTask = ThisTask - rayTraceData.NumFilesIOInParallel;
+  
+  if(prevTask < 0)
+    *req = MPI_REQUEST_NULL;
+  else
+    MPI_Irecv(&ioThrottleToken,0,MPI_CHAR,(int) prevTask,tag,MPI_COMM_WORLD,req);
+}
+
+int io_throttle_test(MPI_Request *req, int block)
+{
+  MPI_Status Stat;
+  int flag;
+  double t;
+  
+  if(!block)
+    {
+      MPI_Test(req,&flag,&Stat);
+      return flag;
+    }
+  
+  logProfileTag(PROFILETAG_IOWAIT);
+  t = -MPI_Wtime();
+  MPI_Wait(req,&Stat);
+  t += MPI_Wtime();
+  logProfileTag(PROFILETAG_IOWAIT);
+  
+  ioThrottleWaitTime += t;
+  
+  return 1;
+}
+
+void io_throttle_pass_tag(int tag)
+{
+  char token = 0;
+  long nextTask = ThisTask + rayTraceData.NumFilesIOInParallel;
+  
+  if(nextTask >= NTasks)
+    return;
+  
+  MPI_Send(&token,0,MPI_CHAR,(int) nextTask,tag,MPI_COMM_WORLD);
+}
+
+/* prints the min,max,avg time tasks spent waiting for the I/O token since the last report - collective */
+void io_throttle_report(const char *what)
+{
+  double minTime,maxTime,totTime;
+  
+  MPI_Reduce(&ioThrottleWaitTime,&minTime,1,MPI_DOUBLE,MPI_MIN,0,MPI_COMM_WORLD);
+  MPI_Reduce(&ioThrottleWaitTime,&maxTime,1,MPI_DOUBLE,MPI_MAX,0,MPI_COMM_WORLD);
+  MPI_Reduce(&ioThrottleWaitTime,&totTime,1,MPI_DOUBLE,MPI_SUM,0,MPI_COMM_WORLD);
+  
+  if(ThisTask == 0)
+    {
+      fprintf(stderr,"%s I/O throttle wait time max,min,avg = %lf|%lf|%lf seconds.\n",
+	      what,maxTime,minTime,totTime/((double) NTasks));
+      fflush(stderr);
+    }
+  
+  ioThrottleWaitTime = 0.0;
+}
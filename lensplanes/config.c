@@ -33,6 +33,7 @@ void read_config(char *filename)
   rayTraceData.LightConePartChunkFactor = -1.0;
   rayTraceData.partMass = -1.0;
   rayTraceData.galRadPointNFWTest = -1.0;
+  sprintf(rayTraceData.LensPlaneType,"HDF5");
   
   //make output dir
   mkdir(rayTraceData.OutputPath,02755);
@@ -112,6 +113,7 @@ void read_config(char *filename)
       
       ASSIGN_CONFIG_STR(LightConeFileList);
       ASSIGN_CONFIG_STR(LightConeFileType);
+      ASSIGN_CONFIG_STR(LensPlaneType);
       
       if(strcmp_caseinsens(tag,"LightConeOriginX") == 0)
 	readLightConeOrigin[0] = 1;
@@ -158,6 +160,15 @@ void read_config(char *filename)
   assert(readLightConeOrigin[2] == 1);
   assert(rayTraceData.MaxNumLensPlaneInMem > 0);
   assert(rayTraceData.LightConePartChunkFactor > 0);
+  if(strcmp_caseinsens(rayTraceData.LensPlaneType,"HDF5") == 0)
+    sprintf(rayTraceData.LensPlaneType,"HDF5");
+  else if(strcmp_caseinsens(rayTraceData.LensPlaneType,"PeanoPacked") == 0)
+    sprintf(rayTraceData.LensPlaneType,"PeanoPacked");
+  else
+    {
+      fprintf(stderr,"LensPlaneType '%s' must be one of HDF5 or PeanoPacked!\n",rayTraceData.LensPlaneType);
+      assert(0);
+    }
   
   //error check for point mass test
 #ifdef POINTMASSTEST
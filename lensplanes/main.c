@@ -51,13 +51,17 @@ int main(int argc, char **argv)
   MPI_Bcast(&rayTraceData,(int) (sizeof(RayTraceData)),MPI_BYTE,0,MPI_COMM_WORLD); 
   logProfileTag(PROFILETAG_INITEND_LOADBAL);
 
-  //even if the code is called with more than 1 MPI task, only task zero will make the lens planes
+  //all tasks cooperate to make the lens planes
+#ifdef POINTMASSTEST
   if(ThisTask == 0)
     {
-#ifdef POINTMASSTEST
       fprintf(stderr,"making lensing planes for a point mass or NFW test...\n");
       make_lensplanes_pointmass_test();
+    }
+  MPI_Bcast(&rayTraceData,(int) (sizeof(RayTraceData)),MPI_BYTE,0,MPI_COMM_WORLD);
 #else
+  if(ThisTask == 0)
+    {
       fprintf(stderr,"making lensing planes...\n");
       fprintf(stderr,"lens plane path/name: '%s/%s'\n",rayTraceData.LensPlanePath,rayTraceData.LensPlaneName);
       fprintf(stderr,"lens plane HEALPix order = %ld\n",rayTraceData.LensPlaneOrder);
@@ -69,9 +73,9 @@ int main(int argc, char **argv)
       fprintf(stderr,"partMass (may not be used) = %le\n",rayTraceData.partMass);
       fprintf(stderr,"mem. buff. size = %lf MB, max. # of planes in mem = %ld, plane chunk alloc. factor = %lf\n",
 	      rayTraceData.memBuffSizeInMB,rayTraceData.MaxNumLensPlaneInMem,rayTraceData.LightConePartChunkFactor);
-      makeRayTracingPlanesHDF5();
-#endif
     }
+#endif
+  makeRayTracingPlanesHDF5();
   
   ////////////////////////////
   MPI_Barrier(MPI_COMM_WORLD);
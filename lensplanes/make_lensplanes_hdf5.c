@@ -1,37 +1,69 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <string.h>
 #include <assert.h>
+#include <limits.h>
 #include <mpi.h>
-#include <gsl/gsl_sort_long.h>
 #include <hdf5.h>
 #include <hdf5_hl.h>
 
 #include "raytrace.h"
 
+/* The lens planes are made by all tasks at once.
+   1) The light cone files are split round robin over the tasks. Each task bins the particles
+      it reads into planes in a send buffer.
+   2) When any task's send buffer is full, all tasks send their binned particles to the tasks
+      which own the planes (plane % NTasks) with all-to-alls in rounds capped at MaxNumLCPartsSend 
+      particles per owner.
+   3) Owners keep the particles of their planes in memory. When they go over memBuffSizeInMB,
+      they move the planes which use the most memory to scratch files next to the lens planes.
+   4) Once all files are read, each owner sorts each of its planes by Peano index, a bin of Peano
+      cells holding at most memBuffSizeInMB of particles at a time, and writes it as one contiguous
+      dataset, /LCParts, with an index of the particle counts, /NumLCPartsInPix, and of the offsets,
+      /PeanoIndOffsets, of each Peano cell.
+   With LensPlaneType PeanoPacked, the particles go to /PackedParts instead and only keep px,py,pz and
+   mass. If all particles in the plane have the same mass, it is written once as /PartMass and dropped
+   from /PackedParts.
+*/
+
+#define PLANE_OWNER(j) ((int) ((j)%NTasks))
+
 static void fillWriteBuffData(WriteBuffData *wb, long NumRayTracingPlanes, long HEALPixOrder, long MAX_NPART);
 static void freeWriteBuffData(WriteBuffData *wb);
 static long needToWriteRayTracingPlanes(WriteBuffData *wb, long *RayTracingPlaneIdMaxNumLCParts, long *TotNumLCPartsNonZero);
+static void spillRayTracingPlane(long j, WriteBuffData *wb);
+static void addLCPartToRayTracingPlane(long j, LCParticle *LCPart, WriteBuffData *wb);
+static void exchangeLCParts(WriteBuffData *wb, MPI_Datatype MPI_LCPARTICLE);
+static void binLCParts(LCParticle *parts, long n, WriteBuffData *wb, long pstart, long pend, LCParticle *BinParts, long binOffset,
+		       int *withMass, float *PartMass);
+static void binRayTracingPlane(long j, WriteBuffData *wb, FILE *fp, long pstart, long pend, LCParticle *BinParts, long binOffset,
+			       int *withMass, float *PartMass);
 static void writeRayTracingPlane(long j, WriteBuffData *wb);
+static hid_t make_lcparticle_type(void);
+static hid_t make_packed_lcparticle_type(int withMass, int packed);
 
 static void fillWriteBuffData(WriteBuffData *wb, long NumRayTracingPlanes, long HEALPixOrder, long MAX_NPART)
 {
   long i;
   long NPix = order2npix(HEALPixOrder);
-  
+
   //fill in basic info
   wb->NumRayTracingPlanes = NumRayTracingPlanes;
   wb->HEALPixOrder = HEALPixOrder;
   wb->NPix = NPix;
   wb->MaxTotNumLCParts = MAX_NPART;
   wb->ChunkSizeLCParts = (long) (((double) MAX_NPART)/rayTraceData.LightConePartChunkFactor/NumRayTracingPlanes);
-  wb->NumLCPartWriteBuff = MAX_NPART + wb->ChunkSizeLCParts;
-  
+  if(wb->ChunkSizeLCParts < 1)
+    wb->ChunkSizeLCParts = 1;
+
   //alloc mem for I/O buffering
   wb->NumLCParts = (long*)malloc(sizeof(long)*NumRayTracingPlanes);
   assert(wb->NumLCParts != NULL);
   wb->NumLCPartsUsed = (long*)malloc(sizeof(long)*NumRayTracingPlanes);
-  assert(wb->NumLCParts != NULL);
+  assert(wb->NumLCPartsUsed != NULL);
+  wb->NumLCPartsSpilled = (long*)malloc(sizeof(long)*NumRayTracingPlanes);
+  assert(wb->NumLCPartsSpilled != NULL);
   wb->LCParts = (LCParticle**)malloc(sizeof(LCParticle*)*NumRayTracingPlanes);
   assert(wb->LCParts != NULL);
   wb->TotNumLCPartsInPlane = (long*)malloc(sizeof(long)*NumRayTracingPlanes);
@@ -41,32 +73,33 @@ static void fillWriteBuffData(WriteBuffData *wb, long NumRayTracingPlanes, long
       wb->LCParts[i] = NULL;
       wb->NumLCParts[i] = 0;
       wb->NumLCPartsUsed[i] = 0;
+      wb->NumLCPartsSpilled[i] = 0;
       wb->TotNumLCPartsInPlane[i] = 0;
     }
   wb->NumLCPartsInPix = (long*)malloc(sizeof(long)*NPix);
   assert(wb->NumLCPartsInPix != NULL);
-  wb->NumLCPartsInPixUpdate = (long*)malloc(sizeof(long)*NPix);
-  assert(wb->NumLCPartsInPixUpdate != NULL);
-  for(i=0;i<NPix;++i)
-    {
-      wb->NumLCPartsInPix[i] = 0;
-      wb->NumLCPartsInPixUpdate[i] = 0;
-    }
-  wb->LCPartWriteBuff = (LCParticle*)malloc(sizeof(LCParticle)*wb->NumLCPartWriteBuff);
-  assert(wb->LCPartWriteBuff != NULL);
-  wb->PeanoInds = (long*)malloc(sizeof(long)*wb->NumLCPartWriteBuff);
-  assert(wb->PeanoInds != NULL);
-  wb->PeanoSortInds = (size_t*)malloc(sizeof(size_t)*wb->NumLCPartWriteBuff);
-  assert(wb->PeanoSortInds != NULL);
+  wb->PeanoIndOffsets = (long*)malloc(sizeof(long)*NPix);
+  assert(wb->PeanoIndOffsets != NULL);
+
+  //send buffer is a quarter of the size of the plane buffers
+  wb->MaxNumLCPartsSend = MAX_NPART/4;
+  if(wb->MaxNumLCPartsSend < 1)
+    wb->MaxNumLCPartsSend = 1;
+  wb->NumLCPartsSend = 0;
+  wb->LCPartsSend = (LCParticle*)malloc(sizeof(LCParticle)*wb->MaxNumLCPartsSend);
+  assert(wb->LCPartsSend != NULL);
+  wb->PlaneIdsSend = (int*)malloc(sizeof(int)*wb->MaxNumLCPartsSend);
+  assert(wb->PlaneIdsSend != NULL);
 }
 
 static void freeWriteBuffData(WriteBuffData *wb)
 {
   long i;
-  
+
   //alloc mem for I/O buffering
   free(wb->NumLCParts);
   free(wb->NumLCPartsUsed);
+  free(wb->NumLCPartsSpilled);
   for(i=0;i<wb->NumRayTracingPlanes;++i)
     {
       if(wb->LCParts[i] != NULL)
@@ -75,10 +108,9 @@ static void freeWriteBuffData(WriteBuffData *wb)
   free(wb->LCParts);
   free(wb->TotNumLCPartsInPlane);
   free(wb->NumLCPartsInPix);
-  free(wb->NumLCPartsInPixUpdate);
-  free(wb->LCPartWriteBuff);
-  free(wb->PeanoInds);
-  free(wb->PeanoSortInds);
+  free(wb->PeanoIndOffsets);
+  free(wb->LCPartsSend);
+  free(wb->PlaneIdsSend);
 }
 
 static long needToWriteRayTracingPlanes(WriteBuffData *wb, long *RayTracingPlaneIdMaxNumLCParts, long *TotNumLCPartsNonZero)
@@ -88,7 +120,7 @@ static long needToWriteRayTracingPlanes(WriteBuffData *wb, long *RayTracingPlane
   long TotNumLCPartsUsed = 0;
   long j;
   long MaxNumLCParts;
-  
+
   //get total number of allocated particles
   //also test if we have planes with used particles
   *TotNumLCPartsNonZero = 0;
@@ -99,7 +131,7 @@ static long needToWriteRayTracingPlanes(WriteBuffData *wb, long *RayTracingPlane
       if(wb->NumLCPartsUsed[j] > 0)
 	*TotNumLCPartsNonZero = *TotNumLCPartsNonZero + 1;
     }
-  
+
   //test if need to write ray tracing planes
   //passes if either:
   // 1) more than ten planes have LCParticles in mem
@@ -110,7 +142,7 @@ static long needToWriteRayTracingPlanes(WriteBuffData *wb, long *RayTracingPlane
       //TotNumLCParts,wb->MaxTotNumLCParts,TotNumLCPartsUsed,*TotNumLCPartsNonZero);
 
       writeRayTracingPlanes = 1;
-      
+
       if(TotNumLCParts >= wb->MaxTotNumLCParts && *TotNumLCPartsNonZero > 0)
 	{
 	  //find plane that uses the most mem
@@ -131,402 +163,649 @@ static long needToWriteRayTracingPlanes(WriteBuffData *wb, long *RayTracingPlane
 	}
     }
   else
-    writeRayTracingPlanes = 0;    
-  
+    writeRayTracingPlanes = 0;
+
   return writeRayTracingPlanes;
 }
 
-static void writeRayTracingPlane(long j, WriteBuffData *wb)
+/* appends the particles of plane j in mem to its scratch file and frees them */
+static void spillRayTracingPlane(long j, WriteBuffData *wb)
 {
-  long k,LCPartWriteBuffInd;
-  double vec[3];
-  hid_t file_id,dataset_id;
-  herr_t status;
-  char tablename[MAX_FILENAME];
-  hsize_t chunk_size;
-  int *fill_data = NULL;
-  int compress = 0;
-  LCParticle LCPartRead;
   char file_name[MAX_FILENAME];
-  
-  hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
-  assert(fapl >= 0);
-  status = H5Pset_fclose_degree(fapl,H5F_CLOSE_STRONG);
-  assert(status >= 0);
-  
-  //define LCParticle type in HDF5 for table I/O
-  size_t dst_size = sizeof(LCParticle);
-  size_t dst_offset[NFIELDS_LCPARTICLE] = { HOFFSET(LCParticle,partid),
-					    HOFFSET(LCParticle,px),
-					    HOFFSET(LCParticle,py),
-					    HOFFSET(LCParticle,pz),
-					    HOFFSET(LCParticle,vx),
-					    HOFFSET(LCParticle,vy),
-					    HOFFSET(LCParticle,vz),
-					    HOFFSET(LCParticle,mass) };
-  size_t dst_sizes[NFIELDS_LCPARTICLE] = { sizeof(LCPartRead.partid),
-					   sizeof(LCPartRead.px),
-					   sizeof(LCPartRead.py),
-					   sizeof(LCPartRead.pz),
-					   sizeof(LCPartRead.vx),
-					   sizeof(LCPartRead.vy),
-					   sizeof(LCPartRead.vz),
-					   sizeof(LCPartRead.mass) };
-  const char *field_names[NFIELDS_LCPARTICLE] = { "partid",
-						  "px",
-						  "py",
-						  "pz",
-						  "vx",
-						  "vy",
-						  "vz",
-						  "mass" };
-  hid_t field_type[NFIELDS_LCPARTICLE] = { H5T_NATIVE_LONG, 
-					   H5T_NATIVE_FLOAT,
-					   H5T_NATIVE_FLOAT,
-					   H5T_NATIVE_FLOAT,
-					   H5T_NATIVE_FLOAT,
-					   H5T_NATIVE_FLOAT,
-					   H5T_NATIVE_FLOAT,
-					   H5T_NATIVE_FLOAT };
-  
-  //compute chunk size 
-  chunk_size = (size_t) (RHO_CRIT*rayTraceData.OmegaM*
-                         4.0/3.0*M_PI*(pow((j+1)*rayTraceData.maxComvDistance/rayTraceData.NumLensPlanes,3.0)-pow(j*rayTraceData.maxComvDistance/rayTraceData.NumLensPlanes,3.0))
-                         /wb->LCParts[j][0].mass/10.0/order2npix(rayTraceData.LensPlaneOrder));
-  if(chunk_size < 10)
-    chunk_size = 10;
-  if(chunk_size > 5000)
-    chunk_size = 5000;
-  
-  //write this plane to disk
-  fprintf(stderr,"\twriting to plane %ld: # of parts allocated = %ld, # of parts used = %ld (%.2f percent)\n",
-	  j,wb->NumLCParts[j],wb->NumLCPartsUsed[j],((double) (wb->NumLCPartsUsed[j]))/((double) (wb->MaxTotNumLCParts))*100.0);
-  
-  //get indexing vector to sort particles by peano index
-  for(k=0;k<wb->NumLCPartsUsed[j];++k)
+  FILE *fp;
+
+  fprintf(stderr,"%04d: moving plane %ld to scratch file: # of parts allocated = %ld, # of parts used = %ld (%.2f percent)\n",
+	  ThisTask,j,wb->NumLCParts[j],wb->NumLCPartsUsed[j],((double) (wb->NumLCPartsUsed[j]))/((double) (wb->MaxTotNumLCParts))*100.0);
+
+  sprintf(file_name,"%s/%s%04ld.h5.scratch",rayTraceData.LensPlanePath,rayTraceData.LensPlaneName,j);
+  fp = fopen(file_name,"ab");
+  if(fp == NULL)
     {
-      vec[0] = wb->LCParts[j][k].px;
-      vec[1] = wb->LCParts[j][k].py;
-      vec[2] = wb->LCParts[j][k].pz;
-      wb->PeanoInds[k] = nest2peano(vec2nest(vec,wb->HEALPixOrder),wb->HEALPixOrder);
+      fprintf(stderr,"%04d: could not open scratch file '%s' for plane %ld!\n",ThisTask,file_name,j);
+      MPI_Abort(MPI_COMM_WORLD,666);
     }
-  gsl_sort_long_index(wb->PeanoSortInds,wb->PeanoInds,(size_t) 1,(size_t) (wb->NumLCPartsUsed[j]));
+  if(fwrite(wb->LCParts[j],sizeof(LCParticle),(size_t) (wb->NumLCPartsUsed[j]),fp) != (size_t) (wb->NumLCPartsUsed[j]))
+    {
+      fprintf(stderr,"%04d: could not write scratch file '%s' for plane %ld!\n",ThisTask,file_name,j);
+      MPI_Abort(MPI_COMM_WORLD,666);
+    }
+  fclose(fp);
+
+  wb->NumLCPartsSpilled[j] += wb->NumLCPartsUsed[j];
+  wb->NumLCPartsUsed[j] = 0;
+  wb->NumLCParts[j] = 0;
+  free(wb->LCParts[j]);
+  wb->LCParts[j] = NULL;
+}
+
+static void addLCPartToRayTracingPlane(long j, LCParticle *LCPart, WriteBuffData *wb)
+{
+  //make sure we have mem
+  if(wb->LCParts[j] == NULL)
+    {
+      wb->NumLCParts[j] = wb->ChunkSizeLCParts;
+      wb->LCParts[j] = (LCParticle*)malloc(sizeof(LCParticle)*wb->NumLCParts[j]);
+      assert(wb->LCParts[j] != NULL);
+    }
+  else if(wb->NumLCPartsUsed[j] >= wb->NumLCParts[j])
+    {
+      wb->NumLCParts[j] += wb->ChunkSizeLCParts;
+      wb->LCParts[j] = (LCParticle*)realloc(wb->LCParts[j],sizeof(LCParticle)*wb->NumLCParts[j]);
+      assert(wb->LCParts[j] != NULL);
+    }
+
+  //fill into vecs
+  wb->LCParts[j][wb->NumLCPartsUsed[j]] = *LCPart;
+  wb->NumLCPartsUsed[j] += 1;
+  wb->TotNumLCPartsInPlane[j] += 1;
+}
+
+/* sends the binned particles in the send buffer to the owners of their planes - must be called by all tasks at once
+   - the particles go out in rounds where each task sends at most MaxNumLCPartsSend/NTasks particles to each owner,
+     so an owner never receives more than about MaxNumLCPartsSend particles at once
+   - owners move planes to scratch files after each round, so they stay near memBuffSizeInMB of particles
+   - the send buffer and a round both hold at most MaxNumLCPartsSend particles, so the int counts and offsets 
+     of the all-to-alls cannot overflow
+*/
+static void exchangeLCParts(WriteBuffData *wb, MPI_Datatype MPI_LCPARTICLE)
+{
+  int *Nsend,*sendOffset,*Nrecv,*recvOffset,*sendCurr;
+  long i,n,NrecvTot,RayTracingPlaneIdMaxNumLCParts,TotNumLCPartsNonZero,j;
+  long NsendCap,NrecvMax,Nleft,NleftAll;
+  LCParticle *sendParts,*recvParts;
+  int *sendPlaneIds,*recvPlaneIds,*sendEnd;
+
+  assert(wb->MaxNumLCPartsSend < INT_MAX);
   
-  //open the file and read its index
-  sprintf(file_name,"%s/%s%04ld.h5",rayTraceData.LensPlanePath,rayTraceData.LensPlaneName,j);
-  file_id = H5Fopen(file_name,H5F_ACC_RDWR,fapl);
-  assert(file_id >= 0);
-  status = H5LTread_dataset(file_id,"/NumLCPartsInPix",H5T_NATIVE_LONG,wb->NumLCPartsInPix);
+  Nsend = (int*)malloc(sizeof(int)*NTasks*6);
+  assert(Nsend != NULL);
+  sendOffset = Nsend + NTasks;
+  Nrecv = sendOffset + NTasks;
+  recvOffset = Nrecv + NTasks;
+  sendCurr = recvOffset + NTasks;
+  sendEnd = sendCurr + NTasks;
+
+  //all tasks have the same send buffer size, so they agree on the cap
+  NsendCap = wb->MaxNumLCPartsSend/NTasks;
+  if(NsendCap < 1)
+    NsendCap = 1;
+  NrecvMax = NsendCap*NTasks;
+  assert(NrecvMax < INT_MAX);
+
+  //bucket the send buffer by owner
+  for(n=0;n<NTasks;++n)
+    Nsend[n] = 0;
+  for(i=0;i<wb->NumLCPartsSend;++i)
+    Nsend[PLANE_OWNER(wb->PlaneIdsSend[i])] += 1;
+
+  sendCurr[0] = 0;
+  for(n=1;n<NTasks;++n)
+    sendCurr[n] = sendCurr[n-1] + Nsend[n-1];
+  for(n=0;n<NTasks;++n)
+    sendEnd[n] = sendCurr[n];
+
+  sendParts = (LCParticle*)malloc(sizeof(LCParticle)*(wb->NumLCPartsSend+1));
+  assert(sendParts != NULL);
+  sendPlaneIds = (int*)malloc(sizeof(int)*(wb->NumLCPartsSend+1));
+  assert(sendPlaneIds != NULL);
+  for(i=0;i<wb->NumLCPartsSend;++i)
+    {
+      n = PLANE_OWNER(wb->PlaneIdsSend[i]);
+      sendParts[sendEnd[n]] = wb->LCPartsSend[i];
+      sendPlaneIds[sendEnd[n]] = wb->PlaneIdsSend[i];
+      sendEnd[n] += 1;
+    }
+  wb->NumLCPartsSend = 0;
+
+  recvParts = (LCParticle*)malloc(sizeof(LCParticle)*NrecvMax);
+  assert(recvParts != NULL);
+  recvPlaneIds = (int*)malloc(sizeof(int)*NrecvMax);
+  assert(recvPlaneIds != NULL);
+
+  do
+    {
+      //next block of at most NsendCap particles for each owner
+      Nleft = 0;
+      for(n=0;n<NTasks;++n)
+	{
+	  sendOffset[n] = sendCurr[n];
+	  Nsend[n] = sendEnd[n] - sendCurr[n];
+	  if(Nsend[n] > NsendCap)
+	    Nsend[n] = (int) NsendCap;
+	  sendCurr[n] += Nsend[n];
+	  Nleft += sendEnd[n] - sendCurr[n];
+	}
+
+      MPI_Alltoall(Nsend,1,MPI_INT,Nrecv,1,MPI_INT,MPI_COMM_WORLD);
+
+      recvOffset[0] = 0;
+      for(n=1;n<NTasks;++n)
+	recvOffset[n] = recvOffset[n-1] + Nrecv[n-1];
+      NrecvTot = recvOffset[NTasks-1] + Nrecv[NTasks-1];
+      assert(NrecvTot <= NrecvMax);
+
+      MPI_Alltoallv(sendParts,Nsend,sendOffset,MPI_LCPARTICLE,recvParts,Nrecv,recvOffset,MPI_LCPARTICLE,MPI_COMM_WORLD);
+      MPI_Alltoallv(sendPlaneIds,Nsend,sendOffset,MPI_INT,recvPlaneIds,Nrecv,recvOffset,MPI_INT,MPI_COMM_WORLD);
+
+      //add them to my planes
+      for(i=0;i<NrecvTot;++i)
+	{
+	  assert(PLANE_OWNER(recvPlaneIds[i]) == ThisTask);
+	  addLCPartToRayTracingPlane((long) (recvPlaneIds[i]),recvParts+i,wb);
+	}
+
+      //move planes to scratch files until we are under the mem limit
+      while(needToWriteRayTracingPlanes(wb,&RayTracingPlaneIdMaxNumLCParts,&TotNumLCPartsNonZero))
+	{
+	  for(j=0;j<wb->NumRayTracingPlanes;++j)
+	    {
+	      if((j == RayTracingPlaneIdMaxNumLCParts || TotNumLCPartsNonZero > rayTraceData.MaxNumLensPlaneInMem) && wb->NumLCPartsUsed[j] > 0)
+		spillRayTracingPlane(j,wb);
+	    }
+	}
+
+      MPI_Allreduce(&Nleft,&NleftAll,1,MPI_LONG,MPI_MAX,MPI_COMM_WORLD);
+    }
+  while(NleftAll > 0);
+
+  free(recvParts);
+  free(recvPlaneIds);
+  free(sendParts);
+  free(sendPlaneIds);
+  free(Nsend);
+}
+
+/* HDF5 type of an LCParticle */
+static hid_t make_lcparticle_type(void)
+{
+  herr_t status;
+  hid_t type;
+
+  type = H5Tcreate(H5T_COMPOUND,sizeof(LCParticle));
+  assert(type >= 0);
+  status = H5Tinsert(type,"partid",HOFFSET(LCParticle,partid),H5T_NATIVE_LONG);
   assert(status >= 0);
-  for(k=0;k<wb->NPix;++k)
-    wb->NumLCPartsInPixUpdate[k] = wb->NumLCPartsInPix[k];
-		      
-  k = 0;
-  LCPartWriteBuffInd = 0;
-  wb->LCPartWriteBuff[LCPartWriteBuffInd] = wb->LCParts[j][wb->PeanoSortInds[k]];
-  wb->NumLCPartsInPixUpdate[wb->PeanoInds[wb->PeanoSortInds[k]]] += 1;
-  LCPartWriteBuffInd = 1;
-  k = 1;
-  while(k < wb->NumLCPartsUsed[j])
+  status = H5Tinsert(type,"px",HOFFSET(LCParticle,px),H5T_NATIVE_FLOAT);
+  assert(status >= 0);
+  status = H5Tinsert(type,"py",HOFFSET(LCParticle,py),H5T_NATIVE_FLOAT);
+  assert(status >= 0);
+  status = H5Tinsert(type,"pz",HOFFSET(LCParticle,pz),H5T_NATIVE_FLOAT);
+  assert(status >= 0);
+  status = H5Tinsert(type,"vx",HOFFSET(LCParticle,vx),H5T_NATIVE_FLOAT);
+  assert(status >= 0);
+  status = H5Tinsert(type,"vy",HOFFSET(LCParticle,vy),H5T_NATIVE_FLOAT);
+  assert(status >= 0);
+  status = H5Tinsert(type,"vz",HOFFSET(LCParticle,vz),H5T_NATIVE_FLOAT);
+  assert(status >= 0);
+  status = H5Tinsert(type,"mass",HOFFSET(LCParticle,mass),H5T_NATIVE_FLOAT);
+  assert(status >= 0);
+
+  return type;
+}
+
+/* HDF5 types for PeanoPacked planes - only px,py,pz and (if withMass) mass are kept
+   - if packed, the type is the packed file type, otherwise it is the matching memory type for an LCParticle
+*/
+static hid_t make_packed_lcparticle_type(int withMass, int packed)
+{
+  herr_t status;
+  hid_t type;
+  size_t fsize = sizeof(float);
+
+  if(packed)
     {
-      //if(k%100000 == 0)
-      //fprintf(stderr,"k = %ld of %ld\n",k,wb->NumLCPartsUsed[j]);
-      
-      //append previous LCPartWriteBuff if peano ind has changed
-      if(wb->PeanoInds[wb->PeanoSortInds[k]] != wb->PeanoInds[wb->PeanoSortInds[k-1]])
+      type = H5Tcreate(H5T_COMPOUND,fsize*(withMass ? 4 : 3));
+      assert(type >= 0);
+      status = H5Tinsert(type,"px",0,H5T_NATIVE_FLOAT);
+      assert(status >= 0);
+      status = H5Tinsert(type,"py",fsize,H5T_NATIVE_FLOAT);
+      assert(status >= 0);
+      status = H5Tinsert(type,"pz",2*fsize,H5T_NATIVE_FLOAT);
+      assert(status >= 0);
+      if(withMass)
 	{
-	  //make table if needed
-	  if(wb->NumLCPartsInPix[wb->PeanoInds[wb->PeanoSortInds[k-1]]] == 0)
+	  status = H5Tinsert(type,"mass",3*fsize,H5T_NATIVE_FLOAT);
+	  assert(status >= 0);
+	}
+    }
+  else
+    {
+      type = H5Tcreate(H5T_COMPOUND,sizeof(LCParticle));
+      assert(type >= 0);
+      status = H5Tinsert(type,"px",HOFFSET(LCParticle,px),H5T_NATIVE_FLOAT);
+      assert(status >= 0);
+      status = H5Tinsert(type,"py",HOFFSET(LCParticle,py),H5T_NATIVE_FLOAT);
+      assert(status >= 0);
+      status = H5Tinsert(type,"pz",HOFFSET(LCParticle,pz),H5T_NATIVE_FLOAT);
+      assert(status >= 0);
+      if(withMass)
+	{
+	  status = H5Tinsert(type,"mass",HOFFSET(LCParticle,mass),H5T_NATIVE_FLOAT);
+	  assert(status >= 0);
+	}
+    }
+
+  return type;
+}
+
+/* counts or bins particles of a plane by Peano index
+   - if BinParts is NULL, the particles are counted into wb->NumLCPartsInPix and withMass is set to 1 if they do not
+     all have the mass in PartMass (withMass < 0 means no particle has been seen yet)
+   - otherwise the particles in Peano cells [pstart,pend) are put into BinParts at wb->PeanoIndOffsets - binOffset
+     and the offsets of their cells are moved along by one
+*/
+static void binLCParts(LCParticle *parts, long n, WriteBuffData *wb, long pstart, long pend, LCParticle *BinParts, long binOffset,
+		       int *withMass, float *PartMass)
+{
+  long k,peano;
+  double vec[3];
+
+  for(k=0;k<n;++k)
+    {
+      vec[0] = parts[k].px;
+      vec[1] = parts[k].py;
+      vec[2] = parts[k].pz;
+      peano = nest2peano(vec2nest(vec,wb->HEALPixOrder),wb->HEALPixOrder);
+
+      if(BinParts == NULL)
+	{
+	  wb->NumLCPartsInPix[peano] += 1;
+	  if(*withMass < 0)
 	    {
-	      sprintf(tablename,"PeanoInd%ld",wb->PeanoInds[wb->PeanoSortInds[k-1]]);
-	      //fprintf(stderr,"\tmaking table '%s' with %ld particles\n",tablename,LCPartWriteBuffInd);
-	      status = H5TBmake_table(tablename,file_id,tablename,NFIELDS_LCPARTICLE,(hsize_t) LCPartWriteBuffInd,
-				      dst_size,field_names,dst_offset,field_type,
-				      chunk_size,fill_data,compress,wb->LCPartWriteBuff);
-	      assert(status >= 0);
+	      *PartMass = parts[k].mass;
+	      *withMass = 0;
 	    }
-	  else
+	  else if(parts[k].mass != *PartMass)
+	    *withMass = 1;
+	}
+      else if(peano >= pstart && peano < pend)
+	{
+	  BinParts[wb->PeanoIndOffsets[peano] - binOffset] = parts[k];
+	  wb->PeanoIndOffsets[peano] += 1;
+	}
+    }
+}
+
+/* runs binLCParts over all particles of plane j - the ones in the scratch file fp are read in chunks through the send buffer */
+static void binRayTracingPlane(long j, WriteBuffData *wb, FILE *fp, long pstart, long pend, LCParticle *BinParts, long binOffset,
+			       int *withMass, float *PartMass)
+{
+  long nleft,n;
+
+  if(fp != NULL)
+    {
+      rewind(fp);
+      nleft = wb->NumLCPartsSpilled[j];
+      while(nleft > 0)
+	{
+	  n = nleft;
+	  if(n > wb->MaxNumLCPartsSend)
+	    n = wb->MaxNumLCPartsSend;
+	  if(fread(wb->LCPartsSend,sizeof(LCParticle),(size_t) n,fp) != (size_t) n)
 	    {
-	      //append LCPartWriteBuff
-	      sprintf(tablename,"PeanoInd%ld",wb->PeanoInds[wb->PeanoSortInds[k-1]]);
-	      //fprintf(stderr,"\tappending table '%s' with %ld particles\n",tablename,LCPartWriteBuffInd);
-	      status = H5TBappend_records(file_id,tablename,(hsize_t) LCPartWriteBuffInd,dst_size,dst_offset,dst_sizes,wb->LCPartWriteBuff);
-	      assert(status >= 0);
+	      fprintf(stderr,"%04d: could not read scratch file for plane %ld!\n",ThisTask,j);
+	      MPI_Abort(MPI_COMM_WORLD,666);
 	    }
-	  
-	  //reset ind
-	  LCPartWriteBuffInd = 0;
+	  binLCParts(wb->LCPartsSend,n,wb,pstart,pend,BinParts,binOffset,withMass,PartMass);
+	  nleft -= n;
 	}
-			  
-      //add particle to LCPartWriteBuff 
-      assert(LCPartWriteBuffInd < wb->NumLCPartWriteBuff && LCPartWriteBuffInd >= 0);
-      wb->LCPartWriteBuff[LCPartWriteBuffInd] = wb->LCParts[j][wb->PeanoSortInds[k]];
-      ++LCPartWriteBuffInd;
-      
-      //add one to index vector
-      wb->NumLCPartsInPixUpdate[wb->PeanoInds[wb->PeanoSortInds[k]]] += 1;
-      
-      ++k;
-    };
-  
-  //append last set of particles
-  if(LCPartWriteBuffInd != 0)
+    }
+
+  binLCParts(wb->LCParts[j],wb->NumLCPartsUsed[j],wb,pstart,pend,BinParts,binOffset,withMass,PartMass);
+}
+
+/* sorts the particles of plane j by Peano index and writes the plane file
+   - the particles are counted per Peano cell first, which gives the index and the final offset of every particle
+   - then they are put in order and written in bins of consecutive Peano cells holding at most wb->MaxTotNumLCParts
+     particles, so the sort buffer never exceeds memBuffSizeInMB unless a single cell holds more particles than that
+   - the scratch file is read once per bin plus once for the counts
+*/
+static void writeRayTracingPlane(long j, WriteBuffData *wb)
+{
+  long k,NumParts,pstart,pend,binOffset,NumBinParts,NumBinPartsAlloc;
+  hid_t file_id,dataset_id,space_id,memspace_id,type_id,memtype_id;
+  herr_t status;
+  hsize_t dims[1],offset[1],count[1];
+  char file_name[MAX_FILENAME];
+  const char *dsetname;
+  int withMass;
+  float PartMass = 0.0;
+  LCParticle *BinParts;
+  FILE *fp = NULL;
+
+  hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+  assert(fapl >= 0);
+  status = H5Pset_fclose_degree(fapl,H5F_CLOSE_STRONG);
+  assert(status >= 0);
+
+  NumParts = wb->TotNumLCPartsInPlane[j];
+  assert(NumParts == wb->NumLCPartsSpilled[j] + wb->NumLCPartsUsed[j]);
+
+  fprintf(stderr,"%04d: writing plane %ld: # of parts = %ld, # of parts from scratch file = %ld\n",
+	  ThisTask,j,NumParts,wb->NumLCPartsSpilled[j]);
+
+  if(wb->NumLCPartsSpilled[j] > 0)
     {
-      //make table if needed                                                                                                                      
-      if(wb->NumLCPartsInPix[wb->PeanoInds[wb->PeanoSortInds[k-1]]] == 0)
+      snprintf(file_name,MAX_FILENAME,"%s/%s%04ld.h5.scratch",rayTraceData.LensPlanePath,rayTraceData.LensPlaneName,j);
+      fp = fopen(file_name,"rb");
+      if(fp == NULL)
 	{
-	  sprintf(tablename,"PeanoInd%ld",wb->PeanoInds[wb->PeanoSortInds[k-1]]);
-	  //fprintf(stderr,"\tmaking table '%s' with %ld particles\n",tablename,LCPartWriteBuffInd);
-	  status = H5TBmake_table(tablename,file_id,tablename,NFIELDS_LCPARTICLE,(hsize_t) LCPartWriteBuffInd,
-				  dst_size,field_names,dst_offset,field_type,
-				  chunk_size,fill_data,compress,wb->LCPartWriteBuff);
+	  fprintf(stderr,"%04d: could not open scratch file '%s' for plane %ld!\n",ThisTask,file_name,j);
+	  MPI_Abort(MPI_COMM_WORLD,666);
+	}
+    }
+
+  //count the particles in each Peano cell and build the index
+  for(k=0;k<wb->NPix;++k)
+    wb->NumLCPartsInPix[k] = 0;
+  withMass = -1;
+  binRayTracingPlane(j,wb,fp,0,wb->NPix,NULL,0,&withMass,&PartMass);
+
+  wb->PeanoIndOffsets[0] = 0;
+  for(k=1;k<wb->NPix;++k)
+    wb->PeanoIndOffsets[k] = wb->PeanoIndOffsets[k-1] + wb->NumLCPartsInPix[k-1];
+  assert(wb->PeanoIndOffsets[wb->NPix-1] + wb->NumLCPartsInPix[wb->NPix-1] == NumParts);
+
+  //make the file
+  snprintf(file_name,MAX_FILENAME,"%s/%s%04ld.h5",rayTraceData.LensPlanePath,rayTraceData.LensPlaneName,j);
+  file_id = H5Fcreate(file_name,H5F_ACC_TRUNC,H5P_DEFAULT,fapl);
+  assert(file_id >= 0);
+
+  //write # of planes
+  dims[0] = 1;
+  status = H5LTmake_dataset(file_id,"/NumLensPlanes",1,dims,H5T_NATIVE_LONG,&(rayTraceData.NumLensPlanes));
+  assert(status >= 0);
+
+  //write maxComvDistance
+  dims[0] = 1;
+  status = H5LTmake_dataset(file_id,"/MaxComvDistance",1,dims,H5T_NATIVE_DOUBLE,&(rayTraceData.maxComvDistance));
+  assert(status >= 0);
+
+  //write HEALPixOrder
+  dims[0] = 1;
+  status = H5LTmake_dataset(file_id,"/HEALPixOrder",1,dims,H5T_NATIVE_LONG,&(wb->HEALPixOrder));
+  assert(status >= 0);
+
+  //write index tables for particle numbers and offsets
+  //after this wb->PeanoIndOffsets is used as the fill position of each cell while binning
+  dims[0] = wb->NPix;
+  status = H5LTmake_dataset(file_id,"/NumLCPartsInPix",1,dims,H5T_NATIVE_LONG,wb->NumLCPartsInPix);
+  assert(status >= 0);
+  status = H5LTmake_dataset(file_id,"/PeanoIndOffsets",1,dims,H5T_NATIVE_LONG,wb->PeanoIndOffsets);
+  assert(status >= 0);
+
+  //make the particle dataset
+  if(strcmp(rayTraceData.LensPlaneType,"PeanoPacked") == 0)
+    {
+      //if all particles have the same mass, it is written once as /PartMass
+      if(withMass == 0)
+	{
+	  dims[0] = 1;
+	  status = H5LTmake_dataset(file_id,"/PartMass",1,dims,H5T_NATIVE_FLOAT,&PartMass);
 	  assert(status >= 0);
 	}
       else
+	withMass = 1;
+
+      type_id = make_packed_lcparticle_type(withMass,1);
+      memtype_id = make_packed_lcparticle_type(withMass,0);
+      dsetname = "/PackedParts";
+    }
+  else
+    {
+      type_id = make_lcparticle_type();
+      memtype_id = H5Tcopy(type_id);
+      assert(memtype_id >= 0);
+      dsetname = "/LCParts";
+    }
+  dims[0] = (hsize_t) NumParts;
+  space_id = H5Screate_simple(1,dims,NULL);
+  assert(space_id >= 0);
+  dataset_id = H5Dcreate(file_id,dsetname,type_id,space_id,H5P_DEFAULT,H5P_DEFAULT,H5P_DEFAULT);
+  assert(dataset_id >= 0);
+
+  //sort and write the particles a bin of Peano cells at a time
+  BinParts = NULL;
+  NumBinPartsAlloc = 0;
+  pstart = 0;
+  while(pstart < wb->NPix)
+    {
+      binOffset = wb->PeanoIndOffsets[pstart];
+      NumBinParts = 0;
+      pend = pstart;
+      while(pend < wb->NPix && (NumBinParts == 0 || NumBinParts + wb->NumLCPartsInPix[pend] <= wb->MaxTotNumLCParts))
 	{
-	  //append LCPartWriteBuff
-	  sprintf(tablename,"PeanoInd%ld",wb->PeanoInds[wb->PeanoSortInds[k-1]]);
-	  //fprintf(stderr,"\tappending table '%s' with %ld particles\n",tablename,LCPartWriteBuffInd);
-	  status = H5TBappend_records(file_id,tablename,(hsize_t) LCPartWriteBuffInd,dst_size,dst_offset,dst_sizes,wb->LCPartWriteBuff);
+	  NumBinParts += wb->NumLCPartsInPix[pend];
+	  ++pend;
+	}
+
+      if(NumBinParts > 0)
+	{
+	  if(NumBinParts > NumBinPartsAlloc)
+	    {
+	      NumBinPartsAlloc = NumBinParts;
+	      BinParts = (LCParticle*)realloc(BinParts,sizeof(LCParticle)*NumBinPartsAlloc);
+	      assert(BinParts != NULL);
+	    }
+
+	  binRayTracingPlane(j,wb,fp,pstart,pend,BinParts,binOffset,&withMass,&PartMass);
+
+	  offset[0] = (hsize_t) binOffset;
+	  count[0] = (hsize_t) NumBinParts;
+	  memspace_id = H5Screate_simple(1,count,NULL);
+	  assert(memspace_id >= 0);
+	  status = H5Sselect_hyperslab(space_id,H5S_SELECT_SET,offset,NULL,count,NULL);
+	  assert(status >= 0);
+	  status = H5Dwrite(dataset_id,memtype_id,memspace_id,space_id,H5P_DEFAULT,BinParts);
+	  assert(status >= 0);
+	  status = H5Sclose(memspace_id);
 	  assert(status >= 0);
 	}
+
+      pstart = pend;
     }
-  
-  //update index
-  dataset_id = H5Dopen(file_id,"/NumLCPartsInPix",H5P_DEFAULT);
-  assert(dataset_id >= 0);
-  status = H5Dwrite(dataset_id,H5T_NATIVE_LONG,H5S_ALL,H5S_ALL,H5P_DEFAULT,wb->NumLCPartsInPixUpdate);
-  assert(status >= 0);
+  if(BinParts != NULL)
+    free(BinParts);
+
   status = H5Dclose(dataset_id);
   assert(status >= 0);
-  
-  //flush it
-  status = H5Fflush(file_id,H5F_SCOPE_GLOBAL);
+  status = H5Sclose(space_id);
   assert(status >= 0);
-  
+  status = H5Tclose(type_id);
+  assert(status >= 0);
+  status = H5Tclose(memtype_id);
+  assert(status >= 0);
+
   //close the file
   status = H5Fclose(file_id);
   assert(status >= 0);
-  
+
   status = H5Pclose(fapl);
   assert(status >= 0);
-  
-  LCPartWriteBuffInd = 0;
-  for(k=0;k<wb->NPix;++k)
-    LCPartWriteBuffInd += wb->NumLCPartsInPixUpdate[k];
-  assert(LCPartWriteBuffInd == wb->TotNumLCPartsInPlane[j]);
-  
-  //reset count
-  wb->NumLCPartsUsed[j] = 0;
-  wb->NumLCParts[j] = 0;
-  free(wb->LCParts[j]);
+
+  //done with the particles of the plane
+  if(fp != NULL)
+    {
+      fclose(fp);
+      snprintf(file_name,MAX_FILENAME,"%s/%s%04ld.h5.scratch",rayTraceData.LensPlanePath,rayTraceData.LensPlaneName,j);
+      remove(file_name);
+    }
+  if(wb->LCParts[j] != NULL)
+    free(wb->LCParts[j]);
   wb->LCParts[j] = NULL;
+  wb->NumLCParts[j] = 0;
+  wb->NumLCPartsUsed[j] = 0;
+  wb->NumLCPartsSpilled[j] = 0;
 }
 
+/* makes the lens planes - must be called by all tasks at once */
 void makeRayTracingPlanesHDF5(void)
 {
   //vars
   long HEALPixOrder = rayTraceData.LensPlaneOrder;
   char *filelist = rayTraceData.LightConeFileList;
-  hid_t file_id;
   WriteBuffData wb;
-  hsize_t dims[1] = {1};
-  herr_t status;
   FILE *infp=NULL,*listfp;
   long i,j,MaxTotNumLCParts,RayTracingPlaneId,Np=0;
-  long Nlist,fileNum;
-  long RayTracingPlaneIdMaxNumLCParts,TotNumLCPartsNonZero;
+  long Nlist,fileNum,k;
   char filename[MAX_FILENAME];
   double dcomvd,rad;
-  long npplanetot=0,npplanetotcheck=0;
+  long npplanetot=0,npplanetotcheck=0,nptot[2],nptotall[2];
   LCParticle LCPartRead;
-  
-  hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
-  assert(fapl >= 0);
-  status = H5Pset_fclose_degree(fapl,H5F_CLOSE_STRONG);
-  assert(status >= 0);
-  
+  int done,alldone;
+  MPI_Datatype MPI_LCPARTICLE;
+
   //set parameters of read/write and ray planes
   MaxTotNumLCParts = (long) (((double) (rayTraceData.memBuffSizeInMB))*1024.0*1024.0/((double) (sizeof(LCParticle))));
   assert(MaxTotNumLCParts > 0);
   dcomvd = (double) (rayTraceData.maxComvDistance/((float) (rayTraceData.NumLensPlanes)));
   fillWriteBuffData(&wb,(long) (rayTraceData.NumLensPlanes),HEALPixOrder,MaxTotNumLCParts);
-    
+  assert(wb.NumRayTracingPlanes < INT_MAX);
+
+  MPI_Type_contiguous((int) (sizeof(LCParticle)),MPI_BYTE,&MPI_LCPARTICLE);
+  MPI_Type_commit(&MPI_LCPARTICLE);
+
   //info for the user...
-  fprintf(stderr,"size of LCParts buffer = %lf MB\n",((double) (sizeof(LCParticle)*wb.MaxTotNumLCParts))/1073741824.0*1024.0);
-  fprintf(stderr,"size of LCParticle chunk = %lf MB\n",((double) (sizeof(LCParticle)*wb.ChunkSizeLCParts))/1073741824.0*1024.0);
-  
-  //prep output files
-  fprintf(stderr,"preping ray tracing plane files %ld...\n",wb.NumRayTracingPlanes);
-  for(RayTracingPlaneId=0;RayTracingPlaneId<wb.NumRayTracingPlanes;++RayTracingPlaneId)
+  if(ThisTask == 0)
     {
-      if((wb.NumRayTracingPlanes/10) != 0)
+      fprintf(stderr,"making %ld lens planes of type '%s' with %d tasks\n",wb.NumRayTracingPlanes,rayTraceData.LensPlaneType,NTasks);
+      fprintf(stderr,"size of LCParts buffer = %lf MB\n",((double) (sizeof(LCParticle)*wb.MaxTotNumLCParts))/1073741824.0*1024.0);
+      fprintf(stderr,"size of LCParticle send buffer = %lf MB\n",((double) (sizeof(LCParticle)*wb.MaxNumLCPartsSend))/1073741824.0*1024.0);
+      fprintf(stderr,"size of LCParticle chunk = %lf MB\n",((double) (sizeof(LCParticle)*wb.ChunkSizeLCParts))/1073741824.0*1024.0);
+    }
+
+  //clear out any scratch files left from an earlier run
+  for(j=0;j<wb.NumRayTracingPlanes;++j)
+    {
+      if(PLANE_OWNER(j) == ThisTask)
 	{
-	  if(RayTracingPlaneId%(wb.NumRayTracingPlanes/10) == 0)
-	    fprintf(stderr,"\tRayTracingPlaneId = %ld of %ld\n",RayTracingPlaneId,wb.NumRayTracingPlanes);
+	  sprintf(filename,"%s/%s%04ld.h5.scratch",rayTraceData.LensPlanePath,rayTraceData.LensPlaneName,j);
+	  remove(filename);
 	}
-      else
-	fprintf(stderr,"\tRayTracingPlaneId = %ld of %ld\n",RayTracingPlaneId,wb.NumRayTracingPlanes);
-      
-      //open correct file and write HEALPixOrder to it
-      sprintf(filename,"%s/%s%04ld.h5",rayTraceData.LensPlanePath,rayTraceData.LensPlaneName,RayTracingPlaneId);
-      file_id = H5Fcreate(filename,H5F_ACC_TRUNC,H5P_DEFAULT,fapl);
-      assert(file_id >= 0);
-      
-      //write # of planes
-      dims[0] = 1;
-      status = H5LTmake_dataset(file_id,"/NumLensPlanes",1,dims,H5T_NATIVE_LONG,&(rayTraceData.NumLensPlanes));
-      assert(status >= 0);
-
-      //write maxComvDistance
-      dims[0] = 1;
-      status = H5LTmake_dataset(file_id,"/MaxComvDistance",1,dims,H5T_NATIVE_DOUBLE,&(rayTraceData.maxComvDistance));
-      assert(status >= 0);
-      
-      //write HEALPixOrder
-      dims[0] = 1;
-      status = H5LTmake_dataset(file_id,"/HEALPixOrder",1,dims,H5T_NATIVE_LONG,&(wb.HEALPixOrder));
-      assert(status >= 0);
-      
-      //write index table for particle numbers
-      dims[0] = wb.NPix;
-      status = H5LTmake_dataset(file_id,"/NumLCPartsInPix",1,dims,H5T_NATIVE_LONG,wb.NumLCPartsInPix);
-      assert(status >= 0);
-      
-      //close file
-      status = H5Fclose(file_id);
-      assert(status >= 0);
     }
 
   //open the list file
   listfp = fopen(filelist,"r");
   assert(listfp != NULL);
   Nlist = fnumlines(listfp);
-  
-  //loop through files and put parts in right spot
-  for(fileNum=0;fileNum<Nlist;++fileNum)
+
+  //read my files, fill the send buffer and send it to the plane owners whenever any task fills its buffer
+  fileNum = ThisTask;
+  k = -1;
+  i = 0;
+  done = 0;
+  alldone = 0;
+  while(!alldone)
     {
-      //get file name
-      fscanf(listfp,"%s\n",filename);
-      fprintf(stderr,"reading file (%ld of %ld): %s\n",fileNum+1,Nlist,filename);
-      
-      //open file and read parts
-      infp = fopen(filename,"rb");
-      assert(infp != NULL);
-      Np = getNumLCPartsFile(infp);
-      /*FIXME: comment out code below
-	long k;
-	k = 0;
-      */
-      for(i=0;i<Np;++i)
+      while(!done && wb.NumLCPartsSend < wb.MaxNumLCPartsSend)
 	{
-	  if(i%10000000 == 0)
-	    fprintf(stderr,"\t%ld of %ld (%.2f percent)\n",i,Np,((double) i)/((double) Np)*100.0);
-	  
-	  //check if I/O buff exceeds max
-	  if(needToWriteRayTracingPlanes(&wb,&RayTracingPlaneIdMaxNumLCParts,&TotNumLCPartsNonZero))
+	  //open the next file
+	  if(infp == NULL)
 	    {
-	      for(j=0;j<wb.NumRayTracingPlanes;++j)
+	      if(fileNum >= Nlist)
 		{
-		  //fprintf(stderr,"used = %ld, i = %ld, j = %ld\n",wb.NumLCPartsUsed[j],i,j);
-		  if((j == RayTracingPlaneIdMaxNumLCParts || TotNumLCPartsNonZero > rayTraceData.MaxNumLensPlaneInMem) && wb.NumLCPartsUsed[j] > 0)
-		    {
-		      //fprintf(stderr,"write\n");
-		      writeRayTracingPlane(j,&wb);
-		    }
+		  done = 1;
+		  break;
 		}
+
+	      //get file name
+	      while(k < fileNum)
+		{
+		  fscanf(listfp,"%s\n",filename);
+		  ++k;
+		}
+	      fprintf(stderr,"%04d: reading file (%ld of %ld): %s\n",ThisTask,fileNum+1,Nlist,filename);
+
+	      //open file
+	      infp = fopen(filename,"rb");
+	      assert(infp != NULL);
+	      Np = getNumLCPartsFile(infp);
+	      i = 0;
 	    }
-	  
+
+	  //close the file if we are done with it
+	  if(i >= Np)
+	    {
+	      LCPartRead = getLCPartFromFile(0,Np,infp,1);
+	      fclose(infp);
+	      infp = NULL;
+	      fileNum += NTasks;
+	      continue;
+	    }
+
+	  if(i%10000000 == 0)
+	    fprintf(stderr,"%04d: \t%ld of %ld (%.2f percent)\n",ThisTask,i,Np,((double) i)/((double) Np)*100.0);
+
 	  //read particle
 	  LCPartRead = getLCPartFromFile(i,Np,infp,0);
-	  
+	  ++i;
+
 	  //get radius and bin
 	  LCPartRead.px = (float) (LCPartRead.px - rayTraceData.LightConeOriginX);
 	  LCPartRead.py = (float) (LCPartRead.py - rayTraceData.LightConeOriginY);
 	  LCPartRead.pz = (float) (LCPartRead.pz - rayTraceData.LightConeOriginZ);
 	  rad = sqrt(LCPartRead.px*LCPartRead.px + LCPartRead.py*LCPartRead.py + LCPartRead.pz*LCPartRead.pz);
 	  RayTracingPlaneId = (long) (rad/dcomvd);
-	  
-	  ////////////////////////////////////////
-	  //FIXME: comment out of the code below
-	  /*if(k == 10 || npplanetot == 10*2)
-	    break;
-	    if(k < 10 && RayTracingPlaneId < wb.NumRayTracingPlanes && RayTracingPlaneId >= 0)
-	    {
-	    fprintf(stderr,"partid = %ld, pos = %f|%f|%f, vel = %f|%f|%f, mass = %le, rad = %lf, planeNum = %ld\n",LCPartRead.partid,
-	    LCPartRead.px,LCPartRead.py,LCPartRead.pz,
-	    LCPartRead.vx,LCPartRead.vy,LCPartRead.vz,
-	    LCPartRead.mass,rad,RayTracingPlaneId);
-	    ++k;
-	    //if(i == 1)
-	    //exit(1);
-	    }
-	  */
-	  //END of FIXME
-	  //////////////////////////////
-	  
+
 	  if(RayTracingPlaneId < wb.NumRayTracingPlanes && RayTracingPlaneId >= 0)
 	    {
-	      //make sure we have mem
-	      if(wb.LCParts[RayTracingPlaneId] == NULL)
-		{
-		  wb.NumLCParts[RayTracingPlaneId] = wb.ChunkSizeLCParts;
-		  //fprintf(stderr,"\tallocated mem planeid = %ld, mem frac = %lf\n",RayTracingPlaneId,
-		  //((double) (wb.NumLCParts[RayTracingPlaneId]))/((double) wb.MaxTotNumLCParts));
-		  wb.LCParts[RayTracingPlaneId] = (LCParticle*)malloc(sizeof(LCParticle)*wb.ChunkSizeLCParts);
-		  assert(wb.LCParts[RayTracingPlaneId] != NULL);
-		}
-	      else if(wb.NumLCPartsUsed[RayTracingPlaneId] >= wb.NumLCParts[RayTracingPlaneId])
-		{
-		  wb.NumLCParts[RayTracingPlaneId] += wb.ChunkSizeLCParts;
-		  //fprintf(stderr,"\treallocated mem planeid = %ld, mem frac = %lf\n",RayTracingPlaneId,
-		  //((double) (wb.NumLCParts[RayTracingPlaneId]))/((double) wb.MaxTotNumLCParts));
-		  wb.LCParts[RayTracingPlaneId] = (LCParticle*)realloc(wb.LCParts[RayTracingPlaneId],sizeof(LCParticle)*wb.NumLCParts[RayTracingPlaneId]);
-		  assert(wb.LCParts[RayTracingPlaneId] != NULL);
-		}
-	      
-	      //fill into vecs
-	      wb.LCParts[RayTracingPlaneId][wb.NumLCPartsUsed[RayTracingPlaneId]] = LCPartRead;
-	      wb.NumLCPartsUsed[RayTracingPlaneId] += 1;
-	      
+	      wb.LCPartsSend[wb.NumLCPartsSend] = LCPartRead;
+	      wb.PlaneIdsSend[wb.NumLCPartsSend] = (int) RayTracingPlaneId;
+	      wb.NumLCPartsSend += 1;
+
 	      //error check tot # parts
 	      ++npplanetot;
-	      wb.TotNumLCPartsInPlane[RayTracingPlaneId] += 1;
-	    }
-	  else
-	    {
-	      //fprintf(stderr,"weird planeid %ld: rad = %lf \n",RayTracingPlaneId,rad);
 	    }
 	}
-      
-      //close LC inputfile
-      LCPartRead = getLCPartFromFile(0,Np,infp,1);
-      fclose(infp);
+
+      exchangeLCParts(&wb,MPI_LCPARTICLE);
+      MPI_Allreduce(&done,&alldone,1,MPI_INT,MPI_MIN,MPI_COMM_WORLD);
     }
-  
+
   //close files
   fclose(listfp);
-  
-  //write last set of particles
-  fprintf(stderr,"writing last set of particles...\n");
+  MPI_Type_free(&MPI_LCPARTICLE);
+
+  //write my planes
+  if(ThisTask == 0)
+    fprintf(stderr,"writing lens planes...\n");
   for(j=0;j<wb.NumRayTracingPlanes;++j)
     {
-      if(wb.NumLCPartsUsed[j] > 0)
+      if(PLANE_OWNER(j) == ThisTask)
 	{
+	  npplanetotcheck += wb.TotNumLCPartsInPlane[j];
 	  writeRayTracingPlane(j,&wb);
 	}
     }
-  
-  //check number of parts  
-  npplanetotcheck = 0;
-  for(j=0;j<wb.NumRayTracingPlanes;++j)
-    npplanetotcheck += wb.TotNumLCPartsInPlane[j];
-  fprintf(stderr,"check total number of LC particles: TotNumLCParts = %ld, TotNumLCPartsCheck = %ld\n",npplanetotcheck,npplanetot);
-  assert(npplanetot == npplanetotcheck);
-  
+
+  //check number of parts
+  nptot[0] = npplanetot;
+  nptot[1] = npplanetotcheck;
+  MPI_Allreduce(nptot,nptotall,2,MPI_LONG,MPI_SUM,MPI_COMM_WORLD);
+  if(ThisTask == 0)
+    fprintf(stderr,"check total number of LC particles: TotNumLCParts = %ld, TotNumLCPartsCheck = %ld\n",nptotall[1],nptotall[0]);
+  assert(nptotall[0] == nptotall[1]);
+
   //free mem
   freeWriteBuffData(&wb);
-  
-  status = H5Pclose(fapl);
-  assert(status >= 0);
 }
@@ -239,9 +239,6 @@ void make_lensplanes_pointmass_test(void)
   if(ThisTask == 0)
     fprintf(stderr,"\n\nassuming galaxies at %lf radius for NFW test!\n\n\n",galRad);
 #endif
-  
-  //make them into HDF5 format
-  makeRayTracingPlanesHDF5();
 }
 
 /*3D NFW profile 
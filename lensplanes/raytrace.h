@@ -64,6 +64,7 @@ typedef struct {
   /* for making lens planes */
   char LightConeFileList[MAX_FILENAME]; 
   char LightConeFileType[MAX_FILENAME]; 
+  char LensPlaneType[MAX_FILENAME];     /* HDF5 (default) or PeanoPacked */
   double LightConeOriginX;  /* used to make lens planes from the light cone */
   double LightConeOriginY;
   double LightConeOriginZ;
@@ -115,14 +116,15 @@ typedef struct {
   long ChunkSizeLCParts;
   long *NumLCParts;
   long *NumLCPartsUsed;
+  long *NumLCPartsSpilled;
   LCParticle **LCParts;
   long *TotNumLCPartsInPlane;
   long *NumLCPartsInPix;
-  long *NumLCPartsInPixUpdate;
-  long NumLCPartWriteBuff;
-  LCParticle *LCPartWriteBuff;
-  long *PeanoInds;
-  size_t *PeanoSortInds;
+  long *PeanoIndOffsets;
+  long MaxNumLCPartsSend;
+  long NumLCPartsSend;
+  LCParticle *LCPartsSend;
+  int *PlaneIdsSend;
 } WriteBuffData;
 
 /* extern defs of global vars in globalvars.c */
@@ -27,8 +27,15 @@ int main(int argc, char **argv)
   /* vars */
   char name[MAX_FILENAME];
   
-  /* init MPI and get current tasks and number of tasks */
+  /* init MPI and get current tasks and number of tasks 
+     with USE_OPENMP or PREFETCH_LENSPLANES only the master thread makes MPI calls so we need MPI_THREAD_FUNNELED
+  */
+#if defined(USE_OPENMP) || defined(PREFETCH_LENSPLANES)
+  int provided;
+  int rc = MPI_Init_thread(&argc,&argv,MPI_THREAD_FUNNELED,&provided);
+#else
   int rc = MPI_Init(&argc,&argv);
+#endif
   if(rc != MPI_SUCCESS)
     {
       fprintf(stderr,"Error starting MPI program. Terminating.\n");
@@ -36,6 +43,14 @@ int main(int argc, char **argv)
     }
   MPI_Comm_size(MPI_COMM_WORLD,&NTasks);
   MPI_Comm_rank(MPI_COMM_WORLD,&ThisTask);
+#if defined(USE_OPENMP) || defined(PREFETCH_LENSPLANES)
+  if(provided < MPI_THREAD_FUNNELED)
+    {
+      if(ThisTask == 0)
+	fprintf(stderr,"MPI library does not support MPI_THREAD_FUNNELED needed for threads. Terminating.\n");
+      MPI_Abort(MPI_COMM_WORLD,1);
+    }
+#endif
   
   logProfileTag(PROFILETAG_TOTTIME);
   
@@ -78,6 +93,9 @@ int main(int argc, char **argv)
       fprintf(stderr,"----------------------------------------------------------------------------------------------------------------------\n");
       fprintf(stderr,"running version '%s'.\n",RAYTRACEVERSION);
       fprintf(stderr,"code called with %d tasks.\n",NTasks);
+#ifdef USE_OPENMP
+      fprintf(stderr,"using %d OpenMP threads per task.\n",omp_get_max_threads());
+#endif
       fprintf(stderr,"restart flag = %ld\n",rayTraceData.Restart);
       fprintf(stderr,"lensing plane path: %s\n",rayTraceData.LensPlanePath);
       fprintf(stderr,"Nplanes = %ld, omegam = %f, max_comvd = %f \n",rayTraceData.NumLensPlanes,rayTraceData.OmegaM,rayTraceData.maxComvDistance);
@@ -83,6 +83,7 @@ void map2alm_mpi(double *alm_real, double *alm_imag, float *mapvec, HEALPixSHTPl
 #endif
   
   fftwf_complex *mapvec_complex;
+  float *mapvec_south;
   long memTot = 0;
 
   double transTime,fftTime,sumTime,plmTime;
@@ -104,7 +105,7 @@ void map2alm_mpi(double *alm_real, double *alm_imag, float *mapvec, HEALPixSHTPl
   Nside = order2nside(plan.order);
   lmax = plan.lmax;
   Nrings = 2*Nside;
-  plmeps = 1e-30;
+  plmeps = SHT_PLMEPS;
   quadweight = 4.0*M_PI/Npix;
   
   //get ring_weights
@@ -150,6 +151,7 @@ void map2alm_mpi(double *alm_real, double *alm_imag, float *mapvec, HEALPixSHTPl
   
   //do FFT of rings in place first
   fftTime -= MPI_Wtime();
+  init_ring_fft_plans(plan.order);
   mapvec_complex = (fftwf_complex*) mapvec;
   for(nring=firstRing;nring<=lastRingLoop;++nring)
     {
@@ -160,12 +162,12 @@ void map2alm_mpi(double *alm_real, double *alm_imag, float *mapvec, HEALPixSHTPl
       mapvec = (float*) (mapvec_complex + plan.northStartIndMapvec[nring-firstRing]);
       for(i=0;i<ringpix;++i)
 	mapvec[i] = (float) (mapvec[i]*ring_weights[nring-1]);
-      ring_analysis(ringpix,mapvec);
       
-      mapvec = (float*) (mapvec_complex + plan.southStartIndMapvec[nring-firstRing]);
+      mapvec_south = (float*) (mapvec_complex + plan.southStartIndMapvec[nring-firstRing]);
       for(i=0;i<ringpix;++i)
-	mapvec[i] = (float) (mapvec[i]*ring_weights[nring-1]);
-      ring_analysis(ringpix,mapvec);
+	mapvec_south[i] = (float) (mapvec_south[i]*ring_weights[nring-1]);
+      
+      ring_analysis_pair(ringpix,mapvec,mapvec_south);
       
       ringTime[nring-firstRing] += MPI_Wtime();
     }
@@ -411,7 +413,13 @@ void map2alm_mpi(double *alm_real, double *alm_imag, float *mapvec, HEALPixSHTPl
   memTot += sizeof(double)*(lmax+1);
   assert(plm != NULL);
   plmTime -= MPI_Wtime();
-  plmdata = plmgen_init(lmax,plmeps);
+  if(plan.plmdata != NULL && plan.plmdata->lmax == lmax && plan.plmdata->eps == plmeps)
+    {
+      plmdata = plan.plmdata;
+      plmgen_reset(plmdata);
+    }
+  else
+    plmdata = plmgen_init(lmax,plmeps);
   plmTime += MPI_Wtime();
 
   //zero alms
@@ -543,7 +551,8 @@ void map2alm_mpi(double *alm_real, double *alm_imag, float *mapvec, HEALPixSHTPl
   memTot -= sizeof(int)*NTasks;
   free(plm);
   memTot -= sizeof(double)*(lmax+1);
-  plmgen_destroy(plmdata);
+  if(plmdata != plan.plmdata)
+    plmgen_destroy(plmdata);
   
   sumTime += MPI_Wtime();
   runTime += MPI_Wtime();
@@ -22,26 +22,59 @@
 #define MGDERIV_METRIC_FAC_AT_END /* define to compute metric factors for derivs on MG grid after interp to ray position */
 //#define SCALE_MGDENS              /* define to scale the density and potential by a constant factor before poisson solver runs */
 
+#ifdef MGFLOAT_REGRESSION
+#ifndef MGPOISSONSOLVE_FLOAT
+#error "MGFLOAT_REGRESSION needs MGPOISSONSOLVE_FLOAT!"
+#endif
+#ifdef SCALE_MGDENS
+#error "MGFLOAT_REGRESSION does not work with SCALE_MGDENS!"
+#endif
+#endif
+
+/* HEALPix interpolation stencil of the SHT potential at one MG grid point */
+typedef struct {
+  long nest[4];
+  double wgt[4];
+} MGInterpStencil;
+
 //prototypes
-static void mgpoissonsolve_bundlecell(long bundleCell, const double densfact, const double backdens);
+static void mgpoissonsolve_bundlecell(long bundleCell, const double densfact, const double backdens, MGGridSet *grids, long Nlev);
+static void get_size_mggrid(long *Nfinest, long *Nlev, double *L);
+static MGGridSet *alloc_pool_mggrids(long Nfinest, long Nlev, double L);
+static void free_pool_mggrids(MGGridSet *grids, long Nlev);
 static void fill_rho_mggrid(MGGrid rho, long bundleCell, const double densfact, const double backdens);
-static void fill_bcs_mggrid(MGGrid u);
-static void fill_u_mggrid(MGGrid u);
+static void fill_bcs_mggrid(MGGrid u, MGInterpStencil *st, int buildStencil);
+static void fill_u_mggrid(MGGrid u, MGInterpStencil *st, int buildStencil);
+static double fill_point_mggrid(MGGrid u, long i, long j, MGInterpStencil *st, int buildStencil);
+static void get_stencil_healpix_mggrid(double vec[3], double RmatPatchToSphere[3][3], MGInterpStencil *st);
+static double getval_stencil_healpix_mggrid(const MGInterpStencil *st);
+static double size_mg_stencils(long Nfinest, long Nlev);
+static void prep_mg_stencils(long Nfinest, long Nlev);
+static MGInterpStencil *get_mg_stencils(long bundleCell, MGGridSet *grids, long Nlev, int *buildStencil);
 static void fill_uderivs_rays(MGGrid u, long bundleCell);
 static void getderiv_mggrid_xtheta(MGGrid u, double *gx);
 static void getderiv_mggrid_xtheta_xtheta(MGGrid u, double *gxx);
 static void getderiv_mggrid_yphi(MGGrid u, double *gy);
 static void getderiv_mggrid_yphi_yphi(MGGrid u, double *gyy);
 static void getderiv_mggrid_xtheta_yphi(MGGrid u, double *gxy);
-static double getinterpval_healpix_mggrid(double vec[3], double RmatPatchToSphere[3][3]);
 static void get_rmats_bundlecell(long bundleCell, double RmatSphereToPatch[3][3], double RmatPatchToSphere[3][3]);
 static void rot_tangvectens(double _vec[3], double tvec[2], double ttens[2][2], double Rmat[3][3], double rvec[3], double rtvec[2], double rttens[2][2]);
+static void prep_mg_initguess(long Nfinest);
+static int add_prev_mgcorr(MGGrid u, long bundleCell);
+static void save_mgcorr(MGGrid u, MGGrid ushtguess, long bundleCell);
+#ifdef MGFLOAT_REGRESSION
+static double *get_rayvals_mgregression(long bundleCell);
+static void comp_rayvals_mgregression(long bundleCell, double *vals);
+#endif
 //static double sphdist_haversine(double t1, double p1, double t2, double p2);
 //static void getderiv_mggrid(MGGrid u, double **gx, double **gy, double **gxx, double **gxy, double **gyy);
 
 //timing variables
 #define NUMRUNTIMES 11
 static double runTimes[NUMRUNTIMES];
+#ifdef USE_OPENMP
+#pragma omp threadprivate(runTimes) /* each thread times its own patch solves - summed over threads at the end */
+#endif
 /* Timing variables
   runTimes[0] - total time to compute density
   runTimes[1] - total time to do MG solve
@@ -54,51 +87,189 @@ static double runTimes[NUMRUNTIMES];
   runTimes[8] - time to compute derivs of potential
   runTimes[9] - time to assign derivs to rays
   runTimes[10] - time to rot derivs back to global coords
+  With USE_OPENMP these are summed over threads.
 */
 
+/* outer MG cycle counts - 0 # of patches started from the SHT potential, 1 their cycles, 2 # of patches 
+   warm started from the previous plane, 3 their cycles */
+#define NUMMGCYCLECOUNTS 4
+static long mgCycleCounts[NUMMGCYCLECOUNTS];
+#ifdef USE_OPENMP
+#pragma omp threadprivate(mgCycleCounts)
+#endif
+
+/* MG solution minus the SHT potential guess in the interior of each patch for the previous plane, used to warm 
+   start the patch solves with MGInitGuess = 1 - indexed by bundle cell and NULL if the cell was not solved on 
+   this task for the previous plane */
+static float **prevMGCorr = NULL;
+static long NumPrevMGCorr = 0;     //# of bundle cells in prevMGCorr
+static long NfinestPrevMGCorr = 0; //finest MG grid size the corrections were made with
+
+/* HEALPix interpolation stencils for the BCs and initial guess of the MG patch of each bundle cell 
+   - the patch geometry of a bundle cell only changes with the MG grid sizes and the poisson order, so the 
+     stencils are built the first time a cell is solved and reused for later planes
+   - indexed by bundle cell, NULL if not built - at most MaxMGStencilMemMB per task are used, the other 
+     cells interpolate directly
+   - each entry holds the finest grid interior (in fill_u_mggrid order) and then the boundary of each level 
+     from the finest down (in fill_bcs_mggrid order) */
+static MGInterpStencil **mgStencils = NULL;
+static long NumMGStencils = 0;        //# of bundle cells in mgStencils
+static long NfinestMGStencils = 0;    //finest MG grid size, # of levels and poisson order of the stencils
+static long NlevMGStencils = 0;
+static long poissonOrderMGStencils = -1;
+static double memMGStencils = 0.0;    //bytes used by the stencils on this task
+
+#ifdef MGFLOAT_REGRESSION
+/* max over bundle cells of the max abs. diff. between the mixed precision and double ray values divided by the 
+   max abs. double value in the cell - 0 phi, 1 alpha, 2 U (convergence and shear) */
+#define NUMMGREGRESSION 3
+static double mgRegressionDiff[NUMMGREGRESSION];
+#ifdef USE_OPENMP
+#pragma omp threadprivate(mgRegressionDiff)
+#endif
+#endif
+
+/*
+  runs the MG solve for each active bundle cell
+  
+  the patch solves for different bundle cells are independent, so with USE_OPENMP they are split over threads 
+  each thread allocates one MG grid hierarchy and reuses it for all of its bundle cells
+  the result for each bundle cell does not depend on which thread did it or on the order of the cells
+*/
 void mgpoissonsolve(double densfact, double backdens)
 {
-  long i;
-    
-  for(i=0;i<NUMRUNTIMES;++i)
-    runTimes[i] = 0.0;
+  long i,n;
   double runTime,mintm,maxtm,avgtm,ptime;
   int pstart = 1,numd = 0,numt = lastRestrictedPeanoIndTasks[ThisTask] - firstRestrictedPeanoIndTasks[ThisTask] + 1;
-  double totTime;
+  double totTime,totRunTimes[NUMRUNTIMES];
+  long *activeCells,NumActiveCells;
+  long Nfinest,Nlev;
+  double L;
+  long totCycleCounts[NUMMGCYCLECOUNTS],sumCycleCounts[NUMMGCYCLECOUNTS];
+  double cycColdAvg,cycWarmAvg;
+#ifdef MGFLOAT_REGRESSION
+  double totRegressionDiff[NUMMGREGRESSION],maxRegressionDiff[NUMMGREGRESSION];
+  
+  for(n=0;n<NUMMGREGRESSION;++n)
+    totRegressionDiff[n] = 0.0;
+#endif
   
   logProfileTag(PROFILETAG_MG);
   
   totTime = -MPI_Wtime();
   runTime = -MPI_Wtime();
-  ptime = -MPI_Wtime();
+  ptime = -MGWTIME();
   
-  runTimes[7] -= MPI_Wtime();
+  for(n=0;n<NUMRUNTIMES;++n)
+    totRunTimes[n] = 0.0;
+  for(n=0;n<NUMMGCYCLECOUNTS;++n)
+    totCycleCounts[n] = 0;
   
-  //loop through active bundle cells and run MG solver
+  //list of active bundle cells
+  NumActiveCells = 0;
+  for(i=0;i<NbundleCells;++i)
+    if(ISSETBITFLAG(bundleCells[i].active,PRIMARY_BUNDLECELL))
+      ++NumActiveCells;
+  activeCells = (long*)malloc(sizeof(long)*(NumActiveCells+1));
+  assert(activeCells != NULL);
+  NumActiveCells = 0;
   for(i=0;i<NbundleCells;++i)
+    if(ISSETBITFLAG(bundleCells[i].active,PRIMARY_BUNDLECELL))
+      activeCells[NumActiveCells++] = i;
+  
+  get_size_mggrid(&Nfinest,&Nlev,&L);
+  prep_mg_initguess(Nfinest);
+  prep_mg_stencils(Nfinest,Nlev);
+  
+  //the kernel and HEALPix tables are built on first use - do it here before any threads start
+  spline_part_dens(1.0,1.0);
+  ring2nest(0l,rayTraceData.poissonOrder);
+  
+  //loop through active bundle cells and run MG solver
+#ifdef USE_OPENMP
+#pragma omp parallel private(i,n)
+#endif
+  {
+    long k;
+    int thread = 0,nd;
+    MGGridSet *grids;
+#ifdef USE_OPENMP
+    double t0 = MGWTIME();
+    
+    thread = omp_get_thread_num();
+#endif
+    
+    for(n=0;n<NUMRUNTIMES;++n)
+      runTimes[n] = 0.0;
+    for(n=0;n<NUMMGCYCLECOUNTS;++n)
+      mgCycleCounts[n] = 0;
+#ifdef MGFLOAT_REGRESSION
+    for(n=0;n<NUMMGREGRESSION;++n)
+      mgRegressionDiff[n] = 0.0;
+#endif
+    
+    runTimes[7] -= MGWTIME();
+    grids = alloc_pool_mggrids(Nfinest,Nlev,L);
+    
+#ifdef USE_OPENMP
+#pragma omp for schedule(dynamic,1)
+#endif
+    for(k=0;k<NumActiveCells;++k)
+      {
+	i = activeCells[k];
+	
+	runTimes[7] += MGWTIME();
+	bundleCells[i].cpuTime -= MGWTIME();
+	mgpoissonsolve_bundlecell(i,densfact,backdens,grids,Nlev);
+	bundleCells[i].cpuTime += MGWTIME();
+	runTimes[7] -= MGWTIME();
+	
+#ifdef USE_OPENMP
+#pragma omp atomic capture
+#endif
+	nd = ++numd;
+	
+	//only the master thread may make MPI calls
+	if(thread == 0)
+	  progress_lcparts_prefetch();
+	
+	//progress is reported with the times from thread 0 only
+	if(ThisTask == 0 && thread == 0 && ((ptime + MGWTIME()) > 60.0 || pstart))
+	  {
+	    fprintf(stderr,"%5d of %5d - multi-grid poisson solve times: dens,BCS+Ufill,solve = %lf|%lf|%lf sec, prep,norm,assign,BCS,Ufill = %lf|%lf|%lf|%lf|%lf\n",
+		    nd,numt,runTimes[0],runTimes[5]+runTimes[6],runTimes[1],runTimes[2],runTimes[3],runTimes[4],runTimes[5],runTimes[6]);
+	    ptime = -MGWTIME();
+	    pstart = 0;
+	  }
+      }
+    
+    free_pool_mggrids(grids,Nlev);
+    runTimes[7] += MGWTIME();
+    
+#ifdef USE_OPENMP
+    addThreadTimeProfileTag(PROFILETAG_MG,thread,MGWTIME()-t0);
+    addThreadTimeProfileTag(PROFILETAG_MGSOLVE,thread,runTimes[1]);
+#pragma omp critical (mgpoissonsolve_runtimes)
+#endif
     {
-      if(ISSETBITFLAG(bundleCells[i].active,PRIMARY_BUNDLECELL))
-        {
-	  runTimes[7] += MPI_Wtime();
-	  bundleCells[i].cpuTime -= MPI_Wtime();
-	  mgpoissonsolve_bundlecell(i,densfact,backdens);
-	  bundleCells[i].cpuTime += MPI_Wtime();
-	  runTimes[7] -= MPI_Wtime();
-	  
-	  if(ThisTask == 0 && ((ptime + MPI_Wtime()) > 60.0 || pstart))
-	    {
-	      fprintf(stderr,"%5d of %5d - multi-grid poisson solve times: dens,BCS+Ufill,solve = %lf|%lf|%lf sec, prep,norm,assign,BCS,Ufill = %lf|%lf|%lf|%lf|%lf\n",
-		      numd+1,numt,runTimes[0],runTimes[5]+runTimes[6],runTimes[1],runTimes[2],runTimes[3],runTimes[4],runTimes[5],runTimes[6]);
-	      ptime = -MPI_Wtime();
-	      pstart = 0;
-	    }
-	  
-	  ++numd;
-	}
+      for(n=0;n<NUMRUNTIMES;++n)
+	totRunTimes[n] += runTimes[n];
+      for(n=0;n<NUMMGCYCLECOUNTS;++n)
+	totCycleCounts[n] += mgCycleCounts[n];
+#ifdef MGFLOAT_REGRESSION
+      for(n=0;n<NUMMGREGRESSION;++n)
+	if(mgRegressionDiff[n] > totRegressionDiff[n])
+	  totRegressionDiff[n] = mgRegressionDiff[n];
+#endif
     }
+  }
+  
+  for(n=0;n<NUMRUNTIMES;++n)
+    runTimes[n] = totRunTimes[n];
+  free(activeCells);
   
+  runTimes[7] -= MPI_Wtime();
   free_mapcells();
-      
   runTimes[7] += MPI_Wtime();
   runTime += MPI_Wtime();
   
@@ -108,6 +279,14 @@ void mgpoissonsolve(double densfact, double backdens)
   MPI_Reduce(&runTime,&maxtm,1,MPI_DOUBLE,MPI_MAX,0,MPI_COMM_WORLD);
   MPI_Reduce(&runTime,&avgtm,1,MPI_DOUBLE,MPI_SUM,0,MPI_COMM_WORLD);
   avgtm = avgtm/NTasks;
+  MPI_Reduce(totCycleCounts,sumCycleCounts,NUMMGCYCLECOUNTS,MPI_LONG,MPI_SUM,0,MPI_COMM_WORLD);
+  
+#ifdef MGFLOAT_REGRESSION
+  MPI_Reduce(totRegressionDiff,maxRegressionDiff,NUMMGREGRESSION,MPI_DOUBLE,MPI_MAX,0,MPI_COMM_WORLD);
+  if(ThisTask == 0)
+    fprintf(stderr,"mixed precision MG regression: max rel. diff. to double solve of phi,alpha,U = %le|%le|%le\n",
+	    maxRegressionDiff[0],maxRegressionDiff[1],maxRegressionDiff[2]);
+#endif
     
   if(ThisTask == 0)
     {
@@ -119,59 +298,58 @@ void mgpoissonsolve(double densfact, double backdens)
 	      runTimes[0]+runTimes[5]+runTimes[6],runTimes[1],runTimes[7]);
       fprintf(stderr,"multi-grid poisson solve took %lf seconds (max,min,avg = %lf|%lf|%lf seconds, %.2f percent).\n",
 	      runTime,maxtm,mintm,avgtm,(maxtm-avgtm)/avgtm*100.0);
+      
+      //outer cycles per patch for cold (SHT potential) and warm (previous plane) starts
+      cycColdAvg = (sumCycleCounts[0] > 0) ? ((double) (sumCycleCounts[1]))/sumCycleCounts[0] : 0.0;
+      cycWarmAvg = (sumCycleCounts[2] > 0) ? ((double) (sumCycleCounts[3]))/sumCycleCounts[2] : 0.0;
+      fprintf(stderr,"MG outer cycles per patch - cold,warm start = %.2lf|%.2lf (%ld|%ld patches",
+	      cycColdAvg,cycWarmAvg,sumCycleCounts[0],sumCycleCounts[2]);
+      if(sumCycleCounts[0] > 0 && sumCycleCounts[2] > 0)
+	fprintf(stderr,", %.2lf fewer cycles per warm started patch",cycColdAvg-cycWarmAvg);
+      fprintf(stderr,").\n");
     }
 }
 
-//# of base grid sizes to test
-#define MGGRID_NTEST 4
-
-void mgpoissonsolve_bundlecell(long bundleCell, const double densfact, const double backdens)
+/* finds the most efficient grid hierarchy for the MG patches - the same for all bundle cells */
+static void get_size_mggrid(long *Nfinest, long *Nlev, double *L)
 {
-  long N,Nlev,lev,Nmin,j;
-  double L;
-  MGGrid u;
-  MGGridSet *grids;
-  long NumPreSmooth,NumPostSmooth,NumOuterCycles,NumInnerCycles;
-  long Nminv[MGGRID_NTEST] = {4,5,7,9};
+  long N,Nmin,j,lev;
+  long Nminv[MGGRID_NTEST] = MGGRID_BASE_SIZES;
   long Nmaxv[MGGRID_NTEST],Nlevv[MGGRID_NTEST];
-#ifdef PRINT_MGGRID
-  char fname[MAX_FILENAME];
-#endif
-  
-  runTimes[7] -= MPI_Wtime();
   
-  //setup
-  L = MGPATCH_SIZE_FAC*sqrt(4.0*M_PI/order2npix(rayTraceData.bundleOrder));
+  *L = MGPATCH_SIZE_FAC*sqrt(4.0*M_PI/order2npix(rayTraceData.bundleOrder));
   N = rayTraceData.NumMGPatch;
-  NumPreSmooth = 1;
-  NumPostSmooth = NumPreSmooth;
-  NumOuterCycles = 200;
-  NumInnerCycles = 2;
   
-  //find most efficient grid
   for(j=0;j<MGGRID_NTEST;++j)
     {
       Nmin = Nminv[j];
-      Nlev = 1;
+      lev = 1;
       while(Nmin < N)
 	{
 	  Nmin *= 2;
-	  ++Nlev;
+	  ++lev;
 	}
-      Nlevv[j] = Nlev;
+      Nlevv[j] = lev;
       Nmaxv[j] = Nmin;
     }
   
-  N = Nmaxv[0];
-  Nlev = Nlevv[0];
+  *Nfinest = Nmaxv[0];
+  *Nlev = Nlevv[0];
   for(j=1;j<MGGRID_NTEST;++j)
     {
-      if(Nmaxv[j] < N)
+      if(Nmaxv[j] < *Nfinest)
 	{
-	  N = Nmaxv[j];
-	  Nlev = Nlevv[j];
+	  *Nfinest = Nmaxv[j];
+	  *Nlev = Nlevv[j];
 	}
     }
+}
+
+/* allocs the grid hierarchy one thread uses for all of its MG patch solves */
+static MGGridSet *alloc_pool_mggrids(long Nfinest, long Nlev, double L)
+{
+  MGGridSet *grids;
+  long lev,N = Nfinest;
   
   grids = (MGGridSet*)malloc(sizeof(MGGridSet)*Nlev);
   assert(grids != NULL);
@@ -179,16 +357,59 @@ void mgpoissonsolve_bundlecell(long bundleCell, const double densfact, const dou
   for(lev=Nlev-1;lev>=0;--lev)
     {
       grids[lev].u = alloc_mggrid(N,L);
-      get_rmats_bundlecell(bundleCell,grids[lev].u->RmatSphereToPatch,grids[lev].u->RmatPatchToSphere);
       grids[lev].rho = copy_mggrid(grids[lev].u);
-      
       N /= 2;
     }
+  alloc_corr_mggrids(grids,Nlev);
   
-  runTimes[7] += MPI_Wtime();
+  return grids;
+}
+
+static void free_pool_mggrids(MGGridSet *grids, long Nlev)
+{
+  long lev;
+  
+  free_corr_mggrids(grids,Nlev);
+  for(lev=0;lev<Nlev;++lev)
+    {
+      free_mggrid(grids[lev].u);
+      free_mggrid(grids[lev].rho);
+    }
+  free(grids);
+}
+
+/* solves for the potential on the MG patch around a bundle cell and sets the derivs for its rays
+   - grids is a hierarchy from alloc_pool_mggrids that is reset here, so the result does not depend on what 
+     it was used for before */
+static void mgpoissonsolve_bundlecell(long bundleCell, const double densfact, const double backdens, MGGridSet *grids, long Nlev)
+{
+  long lev;
+  MGGrid u;
+#ifdef PRINT_MGGRID
+  char fname[MAX_FILENAME];
+#endif
+  
+  runTimes[7] -= MGWTIME();
+  
+  //setup
+  long NumPreSmooth = 1;
+  long NumPostSmooth = NumPreSmooth;
+  long NumOuterCycles = 200;
+  long NumInnerCycles = 2;
+  
+  for(lev=Nlev-1;lev>=0;--lev)
+    {
+      get_rmats_bundlecell(bundleCell,grids[lev].u->RmatSphereToPatch,grids[lev].u->RmatPatchToSphere);
+      memcpy(grids[lev].rho->RmatSphereToPatch,grids[lev].u->RmatSphereToPatch,sizeof(double)*9);
+      memcpy(grids[lev].rho->RmatPatchToSphere,grids[lev].u->RmatPatchToSphere,sizeof(double)*9);
+      zero_mggrid(grids[lev].u);
+      zero_mggrid(grids[lev].rho);
+    }
+  
+  runTimes[7] += MGWTIME();
   
   //get dens and BCS
-  runTimes[0] -= MPI_Wtime();
+  runTimes[0] -= MGWTIME();
   
   fill_rho_mggrid(grids[Nlev-1].rho,bundleCell,densfact,backdens);
   
@@ -197,19 +418,38 @@ void mgpoissonsolve_bundlecell(long bundleCell, const double densfact, const dou
   write_mggrid(fname,grids[Nlev-1].rho);
 #endif
   
-  runTimes[0] += MPI_Wtime();
+  runTimes[0] += MGWTIME();
+  
+  //interp stencils - the interior of the finest grid comes first, then the boundaries
+  int buildStencil;
+  MGInterpStencil *stencil,*st;
+  stencil = get_mg_stencils(bundleCell,grids,Nlev,&buildStencil);
   
-  runTimes[5] -= MPI_Wtime();
+  runTimes[5] -= MGWTIME();
+  st = (stencil != NULL) ? stencil + (grids[Nlev-1].u->N-2)*(grids[Nlev-1].u->N-2) : NULL;
   for(lev=Nlev-1;lev>=0;--lev)
-    fill_bcs_mggrid(grids[lev].u);
-  runTimes[5] += MPI_Wtime();
+    {
+      fill_bcs_mggrid(grids[lev].u,st,buildStencil);
+      if(st != NULL)
+	st += 4*(grids[lev].u->N-1);
+    }
+  runTimes[5] += MGWTIME();
   
-  runTimes[6] -= MPI_Wtime();
-  fill_u_mggrid(grids[Nlev-1].u);
-  runTimes[6] += MPI_Wtime();
+  runTimes[6] -= MGWTIME();
+  fill_u_mggrid(grids[Nlev-1].u,stencil,buildStencil);
+  
+  //warm start with the correction to the SHT potential from the previous plane
+  MGGrid ushtguess = NULL;
+  int warmStart = 0;
+  if(rayTraceData.MGInitGuess == 1)
+    {
+      ushtguess = copy_mggrid(grids[Nlev-1].u);
+      warmStart = add_prev_mgcorr(grids[Nlev-1].u,bundleCell);
+    }
+  runTimes[6] += MGWTIME();
   
 #ifdef SCALE_MGDENS
-  long i;
+  long i,j;
   double nfact = backdens;
   for(lev=Nlev-1;lev>=0;--lev)
     {
@@ -233,11 +473,14 @@ void mgpoissonsolve_bundlecell(long bundleCell, const double densfact, const dou
   //solve poisson equation
   double t,L1norm;
   t = runTimes[1];
-  runTimes[1] -= MPI_Wtime();
+  runTimes[1] -= MGWTIME();
   
+  //with threads the solve time is logged per thread in mgpoissonsolve
+#ifndef USE_OPENMP
   logProfileTag(PROFILETAG_MG);
   
   logProfileTag(PROFILETAG_MGSOLVE);
+#endif
   
   /*debugging code for pure relaxation method
     lev = Nlev-1;
@@ -253,32 +496,39 @@ void mgpoissonsolve_bundlecell(long bundleCell, const double densfact, const dou
     
     exit(1);
   */
-  L1norm = solve_fas_mggrid(grids,Nlev,NumPreSmooth,NumPostSmooth,NumOuterCycles,NumInnerCycles,rayTraceData.MGConvFact);
-      
+#ifdef MGFLOAT_REGRESSION
+  //solve in double first, keep the ray values and restart the mixed precision solve from the same guess
+  double *regressionVals;
+  MGGrid ustart = copy_mggrid(grids[Nlev-1].u);
+  solve_fas_double_mggrid(grids,Nlev,NumPreSmooth,NumPostSmooth,NumOuterCycles,NumInnerCycles,rayTraceData.MGConvFact,NULL);
+  fill_uderivs_rays(grids[Nlev-1].u,bundleCell);
+  regressionVals = get_rayvals_mgregression(bundleCell);
+  memcpy(grids[Nlev-1].u->grid,ustart->grid,sizeof(double)*(ustart->N)*(ustart->N));
+  free_mggrid(ustart);
+#endif
+  long NumCycles;
+  L1norm = solve_fas_mggrid(grids,Nlev,NumPreSmooth,NumPostSmooth,NumOuterCycles,NumInnerCycles,rayTraceData.MGConvFact,&NumCycles);
+  mgCycleCounts[2*warmStart] += 1;
+  mgCycleCounts[2*warmStart+1] += NumCycles;
+  
+#ifndef USE_OPENMP
   logProfileTag(PROFILETAG_MGSOLVE);
   
   logProfileTag(PROFILETAG_MG);
+#endif
   
-  runTimes[1] += MPI_Wtime();
+  runTimes[1] += MGWTIME();
+  
+  //fprintf(stderr,"bundle cell %ld took %lf seconds for a %ld cell sized grid with %ld levels w/ L1norm = %le.\n",bundleCell,runTimes[1]-t,grids[Nlev-1].u->N-2,Nlev,L1norm);
   
-  //fprintf(stderr,"bundle cell %ld took %lf seconds for a %ld cell sized grid with %ld levels w/ L1norm = %le.\n",bundleCell,runTimes[1]-t,N,Nlev,L1norm);
-
 #ifdef PRINT_MGGRID  
   sprintf(fname,"%s/mgpatch_u_bcell%ld.dat",rayTraceData.OutputPath,bundleCell);
   write_mggrid(fname,grids[Nlev-1].u);
 #endif  
   
-  runTimes[7] -= MPI_Wtime();
+  runTimes[7] -= MGWTIME();
   
-  //free some memory
   u = grids[Nlev-1].u;
-  free_mggrid(grids[Nlev-1].rho);
-  for(lev=Nlev-2;lev>=0;--lev)
-    {
-      free_mggrid(grids[lev].u);
-      free_mggrid(grids[lev].rho);
-    }
-  free(grids);
   
 #ifdef SCALE_MGDENS
   //scale pot back
@@ -287,15 +537,155 @@ void mgpoissonsolve_bundlecell(long bundleCell, const double densfact, const dou
       u->grid[j + (u->N)*i] = (u->grid[j + (u->N)*i])*nfact;
 #endif
   
+  //keep the correction to the SHT potential for the next plane
+  if(ushtguess != NULL)
+    {
+      save_mgcorr(u,ushtguess,bundleCell);
+      free_mggrid(ushtguess);
+    }
+  
   //get derivs for rays
   fill_uderivs_rays(u,bundleCell);
   
-  //clean up
-  free_mggrid(u);
+#ifdef MGFLOAT_REGRESSION
+  comp_rayvals_mgregression(bundleCell,regressionVals);
+#endif
   
-  runTimes[7] += MPI_Wtime();
+  runTimes[7] += MGWTIME();
+}
+
+/* gets the stored patch corrections ready for this plane - they are dropped if the MG grids changed size, 
+   for bundle cells this task does not solve, and if MGInitGuess is not 1 */
+static void prep_mg_initguess(long Nfinest)
+{
+  long i;
+  
+  if(rayTraceData.MGInitGuess != 1 || NumPrevMGCorr != NbundleCells)
+    destroy_mg_initguess();
+  if(rayTraceData.MGInitGuess != 1)
+    return;
+  
+  if(prevMGCorr == NULL)
+    {
+      prevMGCorr = (float**)malloc(sizeof(float*)*NbundleCells);
+      assert(prevMGCorr != NULL);
+      for(i=0;i<NbundleCells;++i)
+	prevMGCorr[i] = NULL;
+      NumPrevMGCorr = NbundleCells;
+    }
+  
+  for(i=0;i<NumPrevMGCorr;++i)
+    if(prevMGCorr[i] != NULL && (Nfinest != NfinestPrevMGCorr || !ISSETBITFLAG(bundleCells[i].active,PRIMARY_BUNDLECELL)))
+      {
+	free(prevMGCorr[i]);
+	prevMGCorr[i] = NULL;
+      }
+  NfinestPrevMGCorr = Nfinest;
 }
 
+void destroy_mg_initguess(void)
+{
+  long i;
+  
+  if(prevMGCorr != NULL)
+    {
+      for(i=0;i<NumPrevMGCorr;++i)
+	if(prevMGCorr[i] != NULL)
+	  free(prevMGCorr[i]);
+      free(prevMGCorr);
+    }
+  prevMGCorr = NULL;
+  NumPrevMGCorr = 0;
+  NfinestPrevMGCorr = 0;
+}
+
+/* adds the stored correction of the bundle cell to the interior of u - returns 1 if there was one and 0 if not */
+static int add_prev_mgcorr(MGGrid u, long bundleCell)
+{
+  long i,j,N = u->N;
+  float *corr = prevMGCorr[bundleCell];
+  
+  if(corr == NULL)
+    return 0;
+  
+  for(i=1;i<N-1;++i)
+    for(j=1;j<N-1;++j)
+      u->grid[i*N+j] += corr[(i-1)*(N-2)+j-1];
+  
+  return 1;
+}
+
+static void save_mgcorr(MGGrid u, MGGrid ushtguess, long bundleCell)
+{
+  long i,j,N = u->N;
+  
+  if(prevMGCorr[bundleCell] == NULL)
+    {
+      prevMGCorr[bundleCell] = (float*)malloc(sizeof(float)*(N-2)*(N-2));
+      assert(prevMGCorr[bundleCell] != NULL);
+    }
+  
+  for(i=1;i<N-1;++i)
+    for(j=1;j<N-1;++j)
+      prevMGCorr[bundleCell][(i-1)*(N-2)+j-1] = (float) (u->grid[i*N+j] - ushtguess->grid[i*N+j]);
+}
+
+#ifdef MGFLOAT_REGRESSION
+#define NUMMGREGRESSIONVALS 7
+/* copies phi, alpha and U of the rays in a bundle cell */
+static double *get_rayvals_mgregression(long bundleCell)
+{
+  long j,k;
+  double *vals;
+  
+  vals = (double*)malloc(sizeof(double)*NUMMGREGRESSIONVALS*(bundleCells[bundleCell].Nrays+1));
+  assert(vals != NULL);
+  
+  for(j=0;j<bundleCells[bundleCell].Nrays;++j)
+    {
+      vals[j*NUMMGREGRESSIONVALS] = RAY_PHI(bundleCells[bundleCell],j);
+      for(k=0;k<2;++k)
+	vals[j*NUMMGREGRESSIONVALS+1+k] = RAY_ALPHA(bundleCells[bundleCell],j,k);
+      for(k=0;k<4;++k)
+	vals[j*NUMMGREGRESSIONVALS+3+k] = RAY_U(bundleCells[bundleCell],j,k);
+    }
+  
+  return vals;
+}
+
+/* compares the ray values of the mixed precision solve to those from get_rayvals_mgregression, updates 
+   mgRegressionDiff and frees vals */
+static void comp_rayvals_mgregression(long bundleCell, double *vals)
+{
+  long j,k,n;
+  double *now,diff[NUMMGREGRESSION],scale[NUMMGREGRESSION];
+  const long first[NUMMGREGRESSION+1] = {0,1,3,NUMMGREGRESSIONVALS};
+  
+  now = get_rayvals_mgregression(bundleCell);
+  
+  for(n=0;n<NUMMGREGRESSION;++n)
+    {
+      diff[n] = 0.0;
+      scale[n] = 0.0;
+      for(j=0;j<bundleCells[bundleCell].Nrays;++j)
+	for(k=first[n];k<first[n+1];++k)
+	  {
+	    if(fabs(now[j*NUMMGREGRESSIONVALS+k] - vals[j*NUMMGREGRESSIONVALS+k]) > diff[n])
+	      diff[n] = fabs(now[j*NUMMGREGRESSIONVALS+k] - vals[j*NUMMGREGRESSIONVALS+k]);
+	    if(fabs(vals[j*NUMMGREGRESSIONVALS+k]) > scale[n])
+	      scale[n] = fabs(vals[j*NUMMGREGRESSIONVALS+k]);
+	  }
+      
+      if(scale[n] > 0.0 && diff[n]/scale[n] > mgRegressionDiff[n])
+	mgRegressionDiff[n] = diff[n]/scale[n];
+    }
+  
+  free(now);
+  free(vals);
+}
+#undef NUMMGREGRESSIONVALS
+#endif
+
 static void fill_rho_mggrid(MGGrid rho, long bundleCell, const double densfact, const double backdens)
 {
   double L,vecp[3],vec[3],rvec[3],disLim,cosDis,smoothingRad;
@@ -313,7 +703,7 @@ static void fill_rho_mggrid(MGGrid rho, long bundleCell, const double densfact,
   long *listpix,Nlistpix,NlistpixMax;
   double z,z0,xa,x,ysq,cosang,dphi;
       
-  runTimes[2] -= MPI_Wtime();
+  runTimes[2] -= MGWTIME();
   
   listpix = NULL;
   NlistpixMax = 0;
@@ -330,7 +720,7 @@ static void fill_rho_mggrid(MGGrid rho, long bundleCell, const double densfact,
   nest2ang(bundleCell,&theta,&phi,rayTraceData.bundleOrder);
   Nlistpix = query_disc_inclusive_nest_fast(theta,phi,disLim,&listpix,&NlistpixMax,rayTraceData.bundleOrder);
     
-  runTimes[2] += MPI_Wtime();
+  runTimes[2] += MGWTIME();
   
   //assign dens with parts
   for(b=0;b<Nlistpix;++b)
@@ -340,7 +730,7 @@ static void fill_rho_mggrid(MGGrid rho, long bundleCell, const double densfact,
 	{
 	  for(k=0;k<bundleCells[i].Nparts;++k)
             {
-	      runTimes[2] -= MPI_Wtime();
+	      runTimes[2] -= MGWTIME();
 	      	      
 	      //get part pos in patch coords
               vecp[0] = (double) (lensPlaneParts[k+bundleCells[i].firstPart].pos[0]);
@@ -386,7 +776,7 @@ static void fill_rho_mggrid(MGGrid rho, long bundleCell, const double densfact,
 	      pmin = (phip - rho->phiLoc - smoothingRad/sfac)/(rho->dL) - 2;
 	      pmax = (phip - rho->phiLoc + smoothingRad/sfac)/(rho->dL) + 2;
 	      
-	      runTimes[2] += MPI_Wtime();
+	      runTimes[2] += MGWTIME();
 	      
 	      if(((tmin >= 0 && tmin <= rho->N) || (tmax >= 0 && tmax <= rho->N) || 
 		  (0 >= tmin && 0 <= tmax) || (rho->N >= tmin && rho->N <= tmax))
@@ -394,7 +784,7 @@ static void fill_rho_mggrid(MGGrid rho, long bundleCell, const double densfact,
 		 ((pmin >= 0 && pmin <= rho->N) || (pmax >= 0 && pmax <= rho->N) ||
 		  (0 >= pmin && 0 <= pmax) || (rho->N >= pmin && rho->N <= pmax)))
 		{
-		  runTimes[3] -= MPI_Wtime();
+		  runTimes[3] -= MGWTIME();
 		  
 		  bdind = (tmax-tmin+1)*(pmax-pmin+1);
 		  if(bdind >= Nbd)
@@ -477,9 +867,9 @@ static void fill_rho_mggrid(MGGrid rho, long bundleCell, const double densfact,
 			}
 		    }
 		  
-		  runTimes[3] += MPI_Wtime();
+		  runTimes[3] += MGWTIME();
 		  
-		  runTimes[4] -= MPI_Wtime();
+		  runTimes[4] -= MGWTIME();
 		  
 		  //assign mass using only cells in grid
 		  if(totmass == 0.0) //make sure smoothing rad is not smaller than cell size
@@ -525,14 +915,14 @@ static void fill_rho_mggrid(MGGrid rho, long bundleCell, const double densfact,
 			}//for(j=0;j<bdind;++j)
 		    }//else ...
 		      
-		  runTimes[4] += MPI_Wtime();
+		  runTimes[4] += MGWTIME();
 		  
 		}//if((tmin >= 0 && tmin <= rho->N) || ...
 	    }//for(k=0;k<bundleCells[i].Nparts;++k)
 	}//if(bundleCells[i].Nparts > 0 && cosDis > cosDisLim)
     }//for(b=0;b<Nlistpix;++b)
   
-  runTimes[2] -= MPI_Wtime();
+  runTimes[2] -= MGWTIME();
   
   if(bd != NULL)
     free(bd);
@@ -592,18 +982,16 @@ static void fill_rho_mggrid(MGGrid rho, long bundleCell, const double densfact,
     }
 #endif
 
-  runTimes[2] += MPI_Wtime();
+  runTimes[2] += MGWTIME();
 }
 
-static void fill_u_mggrid(MGGrid u)
+static void fill_u_mggrid(MGGrid u, MGInterpStencil *st, int buildStencil)
 {
   long i,j;
+#ifdef NGP_FILL_U_MGGRID
   double vec[3],rvec[3],phiv;
   long bnest,offset,nest;
   long bundleMapShift = 2*(rayTraceData.poissonOrder - rayTraceData.bundleOrder);
-#ifndef NGP_FILL_U_MGGRID
-  double wgt[4],phi,theta;
-  long n,pix[4];
 #endif
   
   //not using this option - allows one to do fewer interps, but slows down MG convergence by same factor
@@ -615,30 +1003,15 @@ static void fill_u_mggrid(MGGrid u)
     {
       for(j=1;j<u->N-1;++j)
 	{
-	  //thetag = i*(u->dL) + u->thetaLoc + (numg - 1.0)*(u->dL)/2.0;
-	  //phig = j*(u->dL) + u->phiLoc + (numg - 1.0)*(u->dL)/2.0;
-	  
-	  //thetag = i*(u->dL) + u->thetaLoc;
-	  //phig = j*(u->dL) + u->phiLoc;
-	  //ang2vec(vec,thetag,phig);
-	  
+#ifdef NGP_FILL_U_MGGRID
 	  vec[0] = (u->sintheta[i])*(u->cosphi[j]);
 	  vec[1] = (u->sintheta[i])*(u->sinphi[j]);
 	  vec[2] = u->costheta[i];
-
-	  /* unrolled this
-	     rvec[0] = 0.0;
-	     rvec[1] = 0.0;
-	     rvec[2] = 0.0;
-	     for(n=0;n<3;++n)
-	     for(m=0;m<3;++m)
-	     rvec[n] += (u->RmatPatchToSphere[n][m])*vec[m];
-	  */
+	  
 	  rvec[0] = (u->RmatPatchToSphere[0][0])*vec[0] + (u->RmatPatchToSphere[0][1])*vec[1] + (u->RmatPatchToSphere[0][2])*vec[2];
 	  rvec[1] = (u->RmatPatchToSphere[1][0])*vec[0] + (u->RmatPatchToSphere[1][1])*vec[1] + (u->RmatPatchToSphere[1][2])*vec[2];
 	  rvec[2] = (u->RmatPatchToSphere[2][0])*vec[0] + (u->RmatPatchToSphere[2][1])*vec[1] + (u->RmatPatchToSphere[2][2])*vec[2];
 	  
-#ifdef NGP_FILL_U_MGGRID
 	  nest = vec2nest(rvec,rayTraceData.poissonOrder);
 	  bnest = nest >> bundleMapShift;
 	  offset = nest - (bnest << bundleMapShift);
@@ -654,93 +1027,69 @@ static void fill_u_mggrid(MGGrid u)
 	      fprintf(stderr,"%d: could not get map cell value in MG poisson solve Ufill!\n",ThisTask);
 	      MPI_Abort(MPI_COMM_WORLD,987);
 	    }
+	  
+	  u->grid[i*(u->N)+j] = phiv;
 #else
-	  vec2ang(rvec,&theta,&phi);
-	  get_interpol(theta,phi,pix,wgt,rayTraceData.poissonOrder);
-		  
-	  phiv = 0.0;
-	  for(n=0;n<4;++n)
-	    {
-	      nest = ring2nest(pix[n],rayTraceData.poissonOrder);
-	      bnest = nest >> bundleMapShift;
-	      offset = nest - (bnest << bundleMapShift);
-	      
-	      if((ISSETBITFLAG(bundleCells[bnest].active,PRIMARY_BUNDLECELL) || ISSETBITFLAG(bundleCells[bnest].active,MAPBUFF_BUNDLECELL))
-		 && bundleCells[bnest].firstMapCell >= 0)
-		{
-		  phiv += mapCells[bundleCells[bnest].firstMapCell + offset].val*wgt[n];
-		  assert(nest == mapCells[bundleCells[bnest].firstMapCell + offset].index);
-		}
-	      else
-		{
-		  fprintf(stderr,"%d: could not get map cell value in MG poisson solve Ufill!\n",ThisTask);
-		  MPI_Abort(MPI_COMM_WORLD,987);
-		}
-	    }
-#endif	  
+	  u->grid[i*(u->N)+j] = fill_point_mggrid(u,i,j,(st != NULL) ? st + (i-1)*(u->N-2) + j-1 : NULL,buildStencil);
+#endif
+	  
 	  //for(n=0;n<numg;++n)
 	  //for(m=0;m<numg;++m)
 	  //u->grid[(i+n)*(u->N)+j+m] = phiv;
-	  
-	  u->grid[i*(u->N)+j] = phiv;
-	  
-	  //u->grid[i*(u->N)+j] = getinterpval_healpix_mggrid(vec,u->RmatPatchToSphere);
 	}
     }
 }
 
-static void fill_bcs_mggrid(MGGrid u)
+static void fill_bcs_mggrid(MGGrid u, MGInterpStencil *st, int buildStencil)
 {
-  long i,j;
-  double vec[3];
+  long i,j,k = 0;
   
   i = 0;
-  for(j=0;j<u->N;++j)
-    {
-      vec[0] = (u->sintheta[i])*(u->cosphi[j]);
-      vec[1] = (u->sintheta[i])*(u->sinphi[j]);
-      vec[2] = u->costheta[i];
-      
-      u->grid[i*(u->N)+j] = getinterpval_healpix_mggrid(vec,u->RmatPatchToSphere);
-    }
+  for(j=0;j<u->N;++j,++k)
+    u->grid[i*(u->N)+j] = fill_point_mggrid(u,i,j,(st != NULL) ? st + k : NULL,buildStencil);
   
   i = u->N-1;
-  for(j=0;j<u->N;++j)
-    {
-      vec[0] = (u->sintheta[i])*(u->cosphi[j]);
-      vec[1] = (u->sintheta[i])*(u->sinphi[j]);
-      vec[2] = u->costheta[i];
-
-      u->grid[i*(u->N)+j] = getinterpval_healpix_mggrid(vec,u->RmatPatchToSphere);
-    }
+  for(j=0;j<u->N;++j,++k)
+    u->grid[i*(u->N)+j] = fill_point_mggrid(u,i,j,(st != NULL) ? st + k : NULL,buildStencil);
   
   j = 0;
-  for(i=1;i<u->N-1;++i)
-    {
-      vec[0] = (u->sintheta[i])*(u->cosphi[j]);
-      vec[1] = (u->sintheta[i])*(u->sinphi[j]);
-      vec[2] = u->costheta[i];
+  for(i=1;i<u->N-1;++i,++k)
+    u->grid[i*(u->N)+j] = fill_point_mggrid(u,i,j,(st != NULL) ? st + k : NULL,buildStencil);
+  
+  j = u->N-1;
+  for(i=1;i<u->N-1;++i,++k)
+    u->grid[i*(u->N)+j] = fill_point_mggrid(u,i,j,(st != NULL) ? st + k : NULL,buildStencil);
+}
 
-      u->grid[i*(u->N)+j] = getinterpval_healpix_mggrid(vec,u->RmatPatchToSphere);
+/* SHT potential at grid point i,j - the stencil st is filled first if buildStencil is set and is
+   only used for this point if st is NULL */
+static double fill_point_mggrid(MGGrid u, long i, long j, MGInterpStencil *st, int buildStencil)
+{
+  MGInterpStencil tmp;
+  double vec[3];
+  
+  if(st == NULL)
+    {
+      st = &tmp;
+      buildStencil = 1;
     }
   
-  j = u->N-1;
-  for(i=1;i<u->N-1;++i)
+  if(buildStencil)
     {
       vec[0] = (u->sintheta[i])*(u->cosphi[j]);
       vec[1] = (u->sintheta[i])*(u->sinphi[j]);
       vec[2] = u->costheta[i];
-
-      u->grid[i*(u->N)+j] = getinterpval_healpix_mggrid(vec,u->RmatPatchToSphere);
+      get_stencil_healpix_mggrid(vec,u->RmatPatchToSphere,st);
     }
+  
+  return getval_stencil_healpix_mggrid(st);
 }
 
-static double getinterpval_healpix_mggrid(double vec[3], double RmatPatchToSphere[3][3])
+static void get_stencil_healpix_mggrid(double vec[3], double RmatPatchToSphere[3][3], MGInterpStencil *st)
 {
-  double theta,phi,rvec[3],phiv,wgt[4];
-  long n,pix[4],bnest,offset,nest;
-  long bundleMapShift = 2*(rayTraceData.poissonOrder - rayTraceData.bundleOrder);
-    
+  double theta,phi,rvec[3];
+  long n,pix[4];
+  
   /* unrolled this
   rvec[0] = 0.0;
   rvec[1] = 0.0;
@@ -752,26 +1101,36 @@ static double getinterpval_healpix_mggrid(double vec[3], double RmatPatchToSpher
   rvec[0] = RmatPatchToSphere[0][0]*vec[0] + RmatPatchToSphere[0][1]*vec[1] + RmatPatchToSphere[0][2]*vec[2];
   rvec[1] = RmatPatchToSphere[1][0]*vec[0] + RmatPatchToSphere[1][1]*vec[1] + RmatPatchToSphere[1][2]*vec[2];
   rvec[2] = RmatPatchToSphere[2][0]*vec[0] + RmatPatchToSphere[2][1]*vec[1] + RmatPatchToSphere[2][2]*vec[2];
-
+  
   vec2ang(rvec,&theta,&phi);
-  get_interpol(theta,phi,pix,wgt,rayTraceData.poissonOrder);
+  get_interpol(theta,phi,pix,st->wgt,rayTraceData.poissonOrder);
+  
+  for(n=0;n<4;++n)
+    st->nest[n] = ring2nest(pix[n],rayTraceData.poissonOrder);
+}
+
+static double getval_stencil_healpix_mggrid(const MGInterpStencil *st)
+{
+  double phiv;
+  long n,bnest,offset,nest;
+  long bundleMapShift = 2*(rayTraceData.poissonOrder - rayTraceData.bundleOrder);
   
   phiv = 0.0;
   for(n=0;n<4;++n)
     {
-      nest = ring2nest(pix[n],rayTraceData.poissonOrder);
+      nest = st->nest[n];
       bnest = nest >> bundleMapShift;
       offset = nest - (bnest << bundleMapShift);
       
       if((ISSETBITFLAG(bundleCells[bnest].active,PRIMARY_BUNDLECELL) || ISSETBITFLAG(bundleCells[bnest].active,MAPBUFF_BUNDLECELL))
 	 && bundleCells[bnest].firstMapCell >= 0)
 	{
-	  phiv += mapCells[bundleCells[bnest].firstMapCell + offset].val*wgt[n];
+	  phiv += mapCells[bundleCells[bnest].firstMapCell + offset].val*(st->wgt[n]);
 	  assert(nest == mapCells[bundleCells[bnest].firstMapCell + offset].index);
 	}
       else
 	{
-	  fprintf(stderr,"%d: could not get map cell value in MG poisson solve BCs!\n",ThisTask);
+	  fprintf(stderr,"%d: could not get map cell value in MG poisson solve BCs or Ufill!\n",ThisTask);
 	  MPI_Abort(MPI_COMM_WORLD,987);
 	}
     }
@@ -779,6 +1138,102 @@ static double getinterpval_healpix_mggrid(double vec[3], double RmatPatchToSpher
   return phiv;
 }
 
+/* bytes of the interp stencils of one bundle cell - Nfinest is the # of cells on a side of the finest grid */
+static double size_mg_stencils(long Nfinest, long Nlev)
+{
+  long lev,N = Nfinest,Npts = Nfinest*Nfinest;
+  
+  for(lev=Nlev-1;lev>=0;--lev)
+    {
+      Npts += 4*(N+1);
+      N /= 2;
+    }
+  
+  return ((double) Npts)*sizeof(MGInterpStencil);
+}
+
+/* drops all of the interp stencils if the patch geometry changed and those of bundle cells this task does 
+   not solve */
+static void prep_mg_stencils(long Nfinest, long Nlev)
+{
+  long i;
+  
+  if(NumMGStencils != NbundleCells || NfinestMGStencils != Nfinest || NlevMGStencils != Nlev 
+     || poissonOrderMGStencils != rayTraceData.poissonOrder)
+    destroy_mg_stencils();
+  
+  if(mgStencils == NULL)
+    {
+      mgStencils = (MGInterpStencil**)malloc(sizeof(MGInterpStencil*)*NbundleCells);
+      assert(mgStencils != NULL);
+      for(i=0;i<NbundleCells;++i)
+	mgStencils[i] = NULL;
+      NumMGStencils = NbundleCells;
+      NfinestMGStencils = Nfinest;
+      NlevMGStencils = Nlev;
+      poissonOrderMGStencils = rayTraceData.poissonOrder;
+    }
+  
+  for(i=0;i<NumMGStencils;++i)
+    if(mgStencils[i] != NULL && !ISSETBITFLAG(bundleCells[i].active,PRIMARY_BUNDLECELL))
+      {
+	free(mgStencils[i]);
+	mgStencils[i] = NULL;
+	memMGStencils -= size_mg_stencils(Nfinest,Nlev);
+      }
+}
+
+void destroy_mg_stencils(void)
+{
+  long i;
+  
+  if(mgStencils != NULL)
+    {
+      for(i=0;i<NumMGStencils;++i)
+	if(mgStencils[i] != NULL)
+	  free(mgStencils[i]);
+      free(mgStencils);
+    }
+  mgStencils = NULL;
+  NumMGStencils = 0;
+  NfinestMGStencils = 0;
+  NlevMGStencils = 0;
+  poissonOrderMGStencils = -1;
+  memMGStencils = 0.0;
+}
+
+/* returns the interp stencils of a bundle cell - buildStencil is set to 1 if they still have to be filled 
+   - returns NULL if there is no room for them under MaxMGStencilMemMB */
+static MGInterpStencil *get_mg_stencils(long bundleCell, MGGridSet *grids, long Nlev, int *buildStencil)
+{
+  double mem = size_mg_stencils(grids[Nlev-1].u->N-2,Nlev);
+  int room = 0;
+  
+  *buildStencil = 0;
+  if(mgStencils[bundleCell] != NULL)
+    return mgStencils[bundleCell];
+  
+#ifdef USE_OPENMP
+#pragma omp critical (mgpoissonsolve_stencilmem)
+#endif
+  {
+    if(memMGStencils + mem <= rayTraceData.MaxMGStencilMemMB*1024.0*1024.0)
+      {
+	memMGStencils += mem;
+	room = 1;
+      }
+  }
+  
+  if(room)
+    {
+      mgStencils[bundleCell] = (MGInterpStencil*)malloc((size_t) mem);
+      assert(mgStencils[bundleCell] != NULL);
+      *buildStencil = 1;
+    }
+  
+  return mgStencils[bundleCell];
+}
+
 static void fill_uderivs_rays(MGGrid u, long bundleCell)
 {
   long j,n,m,xind,yind,xindp,yindp;
@@ -798,7 +1253,7 @@ static void fill_uderivs_rays(MGGrid u, long bundleCell)
   
   if(bundleCells[bundleCell].Nrays > 0)
     {
-      runTimes[8] -= MPI_Wtime();
+      runTimes[8] -= MGWTIME();
       thetap_vec = (double*)malloc(sizeof(double)*bundleCells[bundleCell].Nrays);
       assert(thetap_vec != NULL);
   
@@ -810,13 +1265,13 @@ static void fill_uderivs_rays(MGGrid u, long bundleCell)
       
       //theta deriv and phi value
       getderiv_mggrid_xtheta(u,deriv);
-      runTimes[8] += MPI_Wtime();
-      runTimes[9] -= MPI_Wtime();
+      runTimes[8] += MGWTIME();
+      runTimes[9] -= MGWTIME();
       for(j=0;j<bundleCells[bundleCell].Nrays;++j)
 	{
-	  vecp[0] = bundleCells[bundleCell].rays[j].n[0];
-	  vecp[1] = bundleCells[bundleCell].rays[j].n[1];
-	  vecp[2] = bundleCells[bundleCell].rays[j].n[2];
+	  vecp[0] = RAY_N(bundleCells[bundleCell],j,0);
+	  vecp[1] = RAY_N(bundleCells[bundleCell],j,1);
+	  vecp[2] = RAY_N(bundleCells[bundleCell],j,2);
 	  norm = sqrt(vecp[0]*vecp[0] + vecp[1]*vecp[1] + vecp[2]*vecp[2]);
 	  vecp[0] /= norm;
 	  vecp[1] /= norm;
@@ -882,8 +1337,8 @@ static void fill_uderivs_rays(MGGrid u, long bundleCell)
 	      if(notFinite)
 		MPI_Abort(MPI_COMM_WORLD,999);
 	      
-	      bundleCells[bundleCell].rays[j].phi = phiv;
-	      bundleCells[bundleCell].rays[j].alpha[0] = tvec[0];
+	      RAY_PHI(bundleCells[bundleCell],j) = phiv;
+	      RAY_ALPHA(bundleCells[bundleCell],j,0) = tvec[0];
 	    }
 	  else
 	    {
@@ -891,13 +1346,13 @@ static void fill_uderivs_rays(MGGrid u, long bundleCell)
 	      MPI_Abort(MPI_COMM_WORLD,987);
 	    }
 	}
-      runTimes[9] += MPI_Wtime();
+      runTimes[9] += MGWTIME();
       
       //phi deriv
-      runTimes[8] -= MPI_Wtime();
+      runTimes[8] -= MGWTIME();
       getderiv_mggrid_yphi(u,deriv);     
-      runTimes[8] += MPI_Wtime();
-      runTimes[9] -= MPI_Wtime();
+      runTimes[8] += MGWTIME();
+      runTimes[9] -= MGWTIME();
       for(j=0;j<bundleCells[bundleCell].Nrays;++j)
 	{
 	  thetap = thetap_vec[j];
@@ -932,7 +1387,7 @@ static void fill_uderivs_rays(MGGrid u, long bundleCell)
 	      if(notFinite)
 		MPI_Abort(MPI_COMM_WORLD,999);
 	      
-	      bundleCells[bundleCell].rays[j].alpha[1] = tvec[1];
+	      RAY_ALPHA(bundleCells[bundleCell],j,1) = tvec[1];
 	    }
 	  else
 	    {
@@ -940,13 +1395,13 @@ static void fill_uderivs_rays(MGGrid u, long bundleCell)
 	      MPI_Abort(MPI_COMM_WORLD,987);
 	    }
 	}
-      runTimes[9] += MPI_Wtime();
+      runTimes[9] += MGWTIME();
       
       //theta-theta deriv
-      runTimes[8] -= MPI_Wtime();
+      runTimes[8] -= MGWTIME();
       getderiv_mggrid_xtheta_xtheta(u,deriv);     
-      runTimes[8] += MPI_Wtime();
-      runTimes[9] -= MPI_Wtime();
+      runTimes[8] += MGWTIME();
+      runTimes[9] -= MGWTIME();
       for(j=0;j<bundleCells[bundleCell].Nrays;++j)
 	{
 	  thetap = thetap_vec[j];
@@ -981,7 +1436,7 @@ static void fill_uderivs_rays(MGGrid u, long bundleCell)
 	      if(notFinite)
 		MPI_Abort(MPI_COMM_WORLD,999);
 	      
-	      bundleCells[bundleCell].rays[j].U[0] = ttens[0][0];
+	      RAY_U(bundleCells[bundleCell],j,0) = ttens[0][0];
 	    }
 	  else
 	    {
@@ -989,13 +1444,13 @@ static void fill_uderivs_rays(MGGrid u, long bundleCell)
 	      MPI_Abort(MPI_COMM_WORLD,987);
 	    }
 	}
-      runTimes[9] += MPI_Wtime();
+      runTimes[9] += MGWTIME();
       
       //phi-phi deriv
-      runTimes[8] -= MPI_Wtime();
+      runTimes[8] -= MGWTIME();
       getderiv_mggrid_yphi_yphi(u,deriv);     
-      runTimes[8] += MPI_Wtime();
-      runTimes[9] -= MPI_Wtime();
+      runTimes[8] += MGWTIME();
+      runTimes[9] -= MGWTIME();
       for(j=0;j<bundleCells[bundleCell].Nrays;++j)
 	{
 	  thetap = thetap_vec[j];
@@ -1030,7 +1485,7 @@ static void fill_uderivs_rays(MGGrid u, long bundleCell)
 	      if(notFinite)
 		MPI_Abort(MPI_COMM_WORLD,999);
 	      
-	      bundleCells[bundleCell].rays[j].U[3] = ttens[1][1];
+	      RAY_U(bundleCells[bundleCell],j,3) = ttens[1][1];
 	    }
 	  else
 	    {
@@ -1038,13 +1493,13 @@ static void fill_uderivs_rays(MGGrid u, long bundleCell)
 	      MPI_Abort(MPI_COMM_WORLD,987);
 	    }
 	}
-      runTimes[9] += MPI_Wtime();
+      runTimes[9] += MGWTIME();
       
       //theta-phi deriv
-      runTimes[8] -= MPI_Wtime();
+      runTimes[8] -= MGWTIME();
       getderiv_mggrid_xtheta_yphi(u,deriv);     
-      runTimes[8] += MPI_Wtime();
-      runTimes[9] -= MPI_Wtime();
+      runTimes[8] += MGWTIME();
+      runTimes[9] -= MGWTIME();
       for(j=0;j<bundleCells[bundleCell].Nrays;++j)
 	{
 	  thetap = thetap_vec[j];
@@ -1079,7 +1534,7 @@ static void fill_uderivs_rays(MGGrid u, long bundleCell)
 	      if(notFinite)
 		MPI_Abort(MPI_COMM_WORLD,999);
 	      
-	      bundleCells[bundleCell].rays[j].U[1] = ttens[0][1];
+	      RAY_U(bundleCells[bundleCell],j,1) = ttens[0][1];
 	    }
 	  else
 	    {
@@ -1087,20 +1542,20 @@ static void fill_uderivs_rays(MGGrid u, long bundleCell)
 	      MPI_Abort(MPI_COMM_WORLD,987);
 	    }
 	}
-      runTimes[9] += MPI_Wtime();
+      runTimes[9] += MGWTIME();
       
       //free mem
-      runTimes[8] -= MPI_Wtime();
+      runTimes[8] -= MGWTIME();
       free(deriv);
-      runTimes[8] += MPI_Wtime();
+      runTimes[8] += MGWTIME();
       
       //now rotate back to global coords
-      runTimes[10] -= MPI_Wtime();
+      runTimes[10] -= MGWTIME();
       for(j=0;j<bundleCells[bundleCell].Nrays;++j)
 	{
-	  vecp[0] = bundleCells[bundleCell].rays[j].n[0];
-	  vecp[1] = bundleCells[bundleCell].rays[j].n[1];
-	  vecp[2] = bundleCells[bundleCell].rays[j].n[2];
+	  vecp[0] = RAY_N(bundleCells[bundleCell],j,0);
+	  vecp[1] = RAY_N(bundleCells[bundleCell],j,1);
+	  vecp[2] = RAY_N(bundleCells[bundleCell],j,2);
 	  norm = sqrt(vecp[0]*vecp[0] + vecp[1]*vecp[1] + vecp[2]*vecp[2]);
 	  vecp[0] /= norm;
 	  vecp[1] /= norm;
@@ -1114,13 +1569,13 @@ static void fill_uderivs_rays(MGGrid u, long bundleCell)
 	      rvec[n] += (u->RmatSphereToPatch[n][m])*vecp[m];
 	  
 	  //rot comps
-	  tvec[0] = bundleCells[bundleCell].rays[j].alpha[0];
-	  tvec[1] = bundleCells[bundleCell].rays[j].alpha[1];
+	  tvec[0] = RAY_ALPHA(bundleCells[bundleCell],j,0);
+	  tvec[1] = RAY_ALPHA(bundleCells[bundleCell],j,1);
 	  
-	  ttens[0][0] = bundleCells[bundleCell].rays[j].U[0];
-	  ttens[0][1] = bundleCells[bundleCell].rays[j].U[1];
+	  ttens[0][0] = RAY_U(bundleCells[bundleCell],j,0);
+	  ttens[0][1] = RAY_U(bundleCells[bundleCell],j,1);
 	  ttens[1][0] = ttens[0][1];
-	  ttens[1][1] = bundleCells[bundleCell].rays[j].U[3];
+	  ttens[1][1] = RAY_U(bundleCells[bundleCell],j,3);
 	  
 #ifdef MGDERIV_METRIC_FAC_AT_END
 	  sint = sin(thetap_vec[j]);
@@ -1139,20 +1594,20 @@ static void fill_uderivs_rays(MGGrid u, long bundleCell)
 	  rot_tangvectens(rvec,tvec,ttens,u->RmatPatchToSphere,vec,rtvec,rttens);
 	  
 	  //fill in comps
-	  bundleCells[bundleCell].rays[j].alpha[0] = -1.0*rtvec[0];
-	  bundleCells[bundleCell].rays[j].alpha[1] = -1.0*rtvec[1];
+	  RAY_ALPHA(bundleCells[bundleCell],j,0) = -1.0*rtvec[0];
+	  RAY_ALPHA(bundleCells[bundleCell],j,1) = -1.0*rtvec[1];
 	  
-	  bundleCells[bundleCell].rays[j].U[0] = rttens[0][0];
-	  bundleCells[bundleCell].rays[j].U[1] = rttens[0][1];
-	  bundleCells[bundleCell].rays[j].U[2] = rttens[1][0];
-	  bundleCells[bundleCell].rays[j].U[3] = rttens[1][1];
+	  RAY_U(bundleCells[bundleCell],j,0) = rttens[0][0];
+	  RAY_U(bundleCells[bundleCell],j,1) = rttens[0][1];
+	  RAY_U(bundleCells[bundleCell],j,2) = rttens[1][0];
+	  RAY_U(bundleCells[bundleCell],j,3) = rttens[1][1];
 	}
-      runTimes[10] += MPI_Wtime();
+      runTimes[10] += MGWTIME();
       
-      runTimes[8] -= MPI_Wtime();
+      runTimes[8] -= MGWTIME();
       free(thetap_vec);
       free(phip_vec);
-      runTimes[8] += MPI_Wtime();
+      runTimes[8] += MGWTIME();
     }//if(bundleCells[bundleCell].Nrays > 0)
 
   /* OLD CODE - not using since it uses too much memory
@@ -1162,9 +1617,9 @@ static void fill_uderivs_rays(MGGrid u, long bundleCell)
   //interp to rays and rot back
   for(j=0;j<bundleCells[bundleCell].Nrays;++j)
     {
-      vecp[0] = bundleCells[bundleCell].rays[j].n[0];
-      vecp[1] = bundleCells[bundleCell].rays[j].n[1];
-      vecp[2] = bundleCells[bundleCell].rays[j].n[2];
+      vecp[0] = RAY_N(bundleCells[bundleCell],j,0);
+      vecp[1] = RAY_N(bundleCells[bundleCell],j,1);
+      vecp[2] = RAY_N(bundleCells[bundleCell],j,2);
       norm = sqrt(vecp[0]*vecp[0] + vecp[1]*vecp[1] + vecp[2]*vecp[2]);
       vecp[0] /= norm;
       vecp[1] /= norm;
@@ -1267,16 +1722,16 @@ static void fill_uderivs_rays(MGGrid u, long bundleCell)
 	  if(notFinite)
 	    MPI_Abort(MPI_COMM_WORLD,999);
 	  
-	  bundleCells[bundleCell].rays[j].phi = phiv;
+	  RAY_PHI(bundleCells[bundleCell],j) = phiv;
 	  
-	  bundleCells[bundleCell].rays[j].alpha[0] = -1.0*rtvec[0];
-	  bundleCells[bundleCell].rays[j].alpha[1] = -1.0*rtvec[1];
+	  RAY_ALPHA(bundleCells[bundleCell],j,0) = -1.0*rtvec[0];
+	  RAY_ALPHA(bundleCells[bundleCell],j,1) = -1.0*rtvec[1];
 	  
 	  
-	  bundleCells[bundleCell].rays[j].U[0] = rttens[0][0];
-	  bundleCells[bundleCell].rays[j].U[1] = rttens[0][1];
-	  bundleCells[bundleCell].rays[j].U[2] = rttens[1][0];
-	  bundleCells[bundleCell].rays[j].U[3] = rttens[1][1];
+	  RAY_U(bundleCells[bundleCell],j,0) = rttens[0][0];
+	  RAY_U(bundleCells[bundleCell],j,1) = rttens[0][1];
+	  RAY_U(bundleCells[bundleCell],j,2) = rttens[1][0];
+	  RAY_U(bundleCells[bundleCell],j,3) = rttens[1][1];
 	}
       else
 	{
@@ -1452,7 +1907,7 @@ static double sphdist_haversine(double t1, double p1, double t2, double p2)
 static void getderiv_mggrid_xtheta(MGGrid u, double *gx)
 {
   long Nf = u->N;
-  mgfloat *phi = u->grid;
+  double *phi = u->grid;
   double df = u->dL;
   long i,j;
   double fac = 1.0/12.0/df;
@@ -1524,7 +1979,7 @@ static void getderiv_mggrid_xtheta(MGGrid u, double *gx)
 static void getderiv_mggrid_xtheta_xtheta(MGGrid u, double *gxx)
 {
   long Nf = u->N;
-  mgfloat *phi = u->grid;
+  double *phi = u->grid;
   double df = u->dL;
   long i,j;
   double fac = 1.0/12.0/df/df;
@@ -1602,7 +2057,7 @@ static void getderiv_mggrid_xtheta_xtheta(MGGrid u, double *gxx)
 static void getderiv_mggrid_yphi(MGGrid u, double *gy)
 {
   long Nf = u->N;
-  mgfloat *phi = u->grid;
+  double *phi = u->grid;
   double df = u->dL;
   long i,j;
   double fac = 1.0/12.0/df;
@@ -1709,7 +2164,7 @@ static void getderiv_mggrid_yphi(MGGrid u, double *gy)
 static void getderiv_mggrid_yphi_yphi(MGGrid u, double *gyy)
 {
   long Nf = u->N;
-  mgfloat *phi = u->grid;
+  double *phi = u->grid;
   double df = u->dL;
   long i,j;
   double fac = 1.0/12.0/df/df;
@@ -1911,7 +2366,7 @@ static void getderiv_mggrid_yphi_yphi(MGGrid u, double *gyy)
 static void getderiv_mggrid_xtheta_yphi(MGGrid u, double *gxy)
 {
   long Nf = u->N;
-  mgfloat *phi = u->grid;
+  double *phi = u->grid;
   double df = u->dL;
   long i,j,n,nstart,nend;
   double yderivs[5];
@@ -2308,7 +2763,7 @@ static void getderiv_mggrid_xtheta_yphi(MGGrid u, double *gxy)
 static void getderiv_mggrid(MGGrid u, double **gx, double **gy, double **gxx, double **gxy, double **gyy)
 {
   long Nf = u->N;
-  mgfloat *phi = u->grid;
+  double *phi = u->grid;
   double df = u->dL;
   long i,j,xind,yind;
   
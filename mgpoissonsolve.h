@@ -19,8 +19,23 @@
 #ifndef _MGPOISSONSOLVE_
 #define _MGPOISSONSOLVE_
 
-//use to only use float for poisson solver
-//#define MGPOISSONSOLVE_FLOAT - does not work! DO NOT USE!
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+/* wall clock for the MG timers - patch solves run in threads with USE_OPENMP and only the master thread 
+   may make MPI calls with MPI_THREAD_FUNNELED */
+#ifdef USE_OPENMP
+#define MGWTIME() omp_get_wtime()
+#else
+#define MGWTIME() MPI_Wtime()
+#endif
+
+/* MGPOISSONSOLVE_FLOAT (set in the Makefile) - mixed precision MG solve
+   the potential and density grids always hold doubles, but the FAS solve is done as a defect correction: 
+   the residual of the double solution is computed in double on the finest grid, the correction is found 
+   with a multigrid cycle (smoothing, restriction and interpolation) on grids of mgfloats and is added 
+   back to the double solution */
 #ifdef MGPOISSONSOLVE_FLOAT
 typedef float mgfloat;
 #else
@@ -28,7 +43,7 @@ typedef double mgfloat;
 #endif
 
 typedef struct {
-  mgfloat *grid;
+  double *grid;
   double *sinfacs;
   double *cosfacs;
   double *sintheta;
@@ -48,12 +63,23 @@ typedef struct {
 typedef struct {
   MGGrid u;
   MGGrid rho;
+  mgfloat *ucorr;   //correction and its rhs for the mixed precision solve - same layout as u->grid
+  mgfloat *rhocorr; //NULL unless MGPOISSONSOLVE_FLOAT is defined
 } MGGridSet;
 
+//base grid sizes tested to find the most efficient MG grid hierarchy for a patch
+#define MGGRID_NTEST 4
+#define MGGRID_BASE_SIZES {4,5,7,9}
+
 // mgpoissonsolve_utils.c
-double solve_fas_mggrid(MGGridSet *grids, long Nlev, long NumPreSmooth, long NumPostSmooth, long NumOuterCycles, long NumInnerCycles, double convFact);
+double solve_fas_mggrid(MGGridSet *grids, long Nlev, long NumPreSmooth, long NumPostSmooth, long NumOuterCycles, long NumInnerCycles, double convFact, long *NumCycles);
+double solve_fas_double_mggrid(MGGridSet *grids, long Nlev, long NumPreSmooth, long NumPostSmooth, long NumOuterCycles, long NumInnerCycles, double convFact, long *NumCycles);
+#ifdef MGPOISSONSOLVE_FLOAT
+double solve_fas_mixed_mggrid(MGGridSet *grids, long Nlev, long NumPreSmooth, long NumPostSmooth, long NumOuterCycles, long NumInnerCycles, double convFact, long *NumCycles);
+#endif
 void cycle_fas_mggrid(MGGridSet *grids, long lev, long NumPreSmooth, long NumPostSmooth, long NumInnerCycles);
 void smooth_mggrid(MGGrid u, MGGrid rhs, long Nsmooth);
+void smooth_mggrid_tempblock(MGGrid u, MGGrid rhs, long Nsmooth);
 MGGrid lop_mggrid(MGGrid g);
 void lop_mggrid_plusequal(MGGrid g, MGGrid pg);
 MGGrid resid_mggrid(MGGrid u, MGGrid rhs);
@@ -70,9 +96,12 @@ void zero_mggrid(MGGrid u);
 MGGrid alloc_mggrid(long N, double L);
 MGGrid copy_mggrid(MGGrid u);
 void free_mggrid(MGGrid u);
+void alloc_corr_mggrids(MGGridSet *grids, long Nlev);
+void free_corr_mggrids(MGGridSet *grids, long Nlev);
 void write_mggrid(char fname[], MGGrid u);
 void print_runtimes_mgsteps(void);
 void reset_runtimes_mgsteps(void);
+void test_mgsmooth_speed(long Nmax, long NsmoothBlock);
 
 #endif /* _MGPOISSONSOLVE_ */
 
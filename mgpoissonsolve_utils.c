@@ -21,15 +21,14 @@
  */
 #define NumRunTimesMGSteps 5
 static double runTimesMGSteps[NumRunTimesMGSteps] = {0.0, 0.0, 0.0, 0.0, 0.0};
+#ifdef USE_OPENMP
+#pragma omp threadprivate(runTimesMGSteps) /* each thread times its own patch solves */
+#endif
 
 //convergence criterion
-#ifdef MGPOISSONSOLVE_FLOAT
-#define MGEPS_EXACT 1e-4 //level of L1norm for exact solve at smallest level
-#define MGALPHA     1.0 //convergence param from NR in C - ratio of residual to truncation error
-#else
 #define MGEPS_EXACT 1e-12 //level of L1norm for exact solve at smallest level
 #define MGALPHA     0.1 //convergence param from NR in C - ratio of residual to truncation error
-#endif
+#define MGEPS_EXACT_CORR 1e-5 //reduction of the abs. L1norm of the correction residual for the exact solve at the smallest level (float)
 #define MGEPS       1e-8 //level of L1norm for exact solve at smallest level
 #define MGFRACEPS   1e-8 //frac error to terminate FAS cycles
 #define MGMAXITR    100
@@ -38,10 +37,19 @@ static double runTimesMGSteps[NumRunTimesMGSteps] = {0.0, 0.0, 0.0, 0.0, 0.0};
 //#define USE_BNDWGT
 #define BNDWGT     0.00
 
-//prototypes
-static void smooth_mggrid_tempblock(MGGrid u, MGGrid rhs, long Nsmooth);
+/* solves the poisson eqn on the finest grid of the hierarchy to the MGALPHA (or convFact) ratio of residual to 
+   truncation error - in mixed precision with MGPOISSONSOLVE_FLOAT and all in double otherwise
+   the number of outer cycles done is put in NumCycles if it is not NULL */
+double solve_fas_mggrid(MGGridSet *grids, long Nlev, long NumPreSmooth, long NumPostSmooth, long NumOuterCycles, long NumInnerCycles, double convFact, long *NumCycles)
+{
+#ifdef MGPOISSONSOLVE_FLOAT
+  return solve_fas_mixed_mggrid(grids,Nlev,NumPreSmooth,NumPostSmooth,NumOuterCycles,NumInnerCycles,convFact,NumCycles);
+#else
+  return solve_fas_double_mggrid(grids,Nlev,NumPreSmooth,NumPostSmooth,NumOuterCycles,NumInnerCycles,convFact,NumCycles);
+#endif
+}
 
-double solve_fas_mggrid(MGGridSet *grids, long Nlev, long NumPreSmooth, long NumPostSmooth, long NumOuterCycles, long NumInnerCycles, double convFact)
+double solve_fas_double_mggrid(MGGridSet *grids, long Nlev, long NumPreSmooth, long NumPostSmooth, long NumOuterCycles, long NumInnerCycles, double convFact, long *NumCycles)
 {
   //double FracL1norm,L1norm;
   long itr;
@@ -82,7 +90,10 @@ double solve_fas_mggrid(MGGridSet *grids, long Nlev, long NumPreSmooth, long Num
   
   //free mem
   //free_mggrid(uold);
-    
+  
+  if(NumCycles != NULL)
+    *NumCycles = itr;
+  
   //return FracL1norm;
   return resid/trunc;
 }
@@ -100,7 +111,7 @@ void cycle_fas_mggrid(MGGridSet *grids, long lev, long NumPreSmooth, long NumPos
   if(lev == 0) //run smooth until convergence
     {
       //fprintf(stderr,"exact solve at level %ld\n",lev);
-      runTimesMGSteps[2] -= MPI_Wtime();
+      runTimesMGSteps[2] -= MGWTIME();
       itr = 0;
       do 
 	{
@@ -108,7 +119,7 @@ void cycle_fas_mggrid(MGGridSet *grids, long lev, long NumPreSmooth, long NumPos
 	  L1norm = L1norm_mggrid(grids[lev].u,grids[lev].rho);
 	  ++itr;
 	} while(L1norm > MGEPS_EXACT && itr < MGMAXITR);
-      runTimesMGSteps[2] += MPI_Wtime();
+      runTimesMGSteps[2] += MGWTIME();
       
 #ifdef PRINT_FASGRIDS
       sprintf(fname,"./outputs/fasgrid_ulev%ld.dat",lev);
@@ -121,36 +132,36 @@ void cycle_fas_mggrid(MGGridSet *grids, long lev, long NumPreSmooth, long NumPos
       //fprintf(stderr,"down at level %ld\n",lev);
       
       //pre-smooth
-      runTimesMGSteps[0] -= MPI_Wtime();
+      runTimesMGSteps[0] -= MGWTIME();
 #ifndef MGCACHEOPT
       smooth_mggrid(grids[lev].u,grids[lev].rho,NumPreSmooth);
 #else      
       smooth_mggrid_tempblock(grids[lev].u,grids[lev].rho,NumPreSmooth);
 #endif
-      runTimesMGSteps[0] += MPI_Wtime();
+      runTimesMGSteps[0] += MGWTIME();
 
       //get tau correction
-      runTimesMGSteps[1] -= MPI_Wtime();
+      runTimesMGSteps[1] -= MGWTIME();
       resid_restrict_mggrid(grids[lev-1].rho,grids[lev].u,grids[lev].rho);
-      runTimesMGSteps[1] += MPI_Wtime();
+      runTimesMGSteps[1] += MGWTIME();
       
 #ifdef PRINT_FASGRIDS      
       sprintf(fname,"./outputs/fasgrid_reslevm1%ld.dat",lev);
       //write_mggrid(fname,rulm1);
       write_mggrid(fname,grids[lev-1].rho);
 #endif
-      runTimesMGSteps[1] -= MPI_Wtime();
+      runTimesMGSteps[1] -= MGWTIME();
       restrict_mggrid(grids[lev-1].u,grids[lev].u);
-      runTimesMGSteps[1] += MPI_Wtime();
+      runTimesMGSteps[1] += MGWTIME();
       
 #ifdef PRINT_FASGRIDS      
       sprintf(fname,"./outputs/fasgrid_ulevm1%ld.dat",lev);
       write_mggrid(fname,grids[lev-1].u);
 #endif
       
-      runTimesMGSteps[1] -= MPI_Wtime();
+      runTimesMGSteps[1] -= MGWTIME();
       lop_mggrid_plusequal(grids[lev-1].u,grids[lev-1].rho);
-      runTimesMGSteps[1] += MPI_Wtime();
+      runTimesMGSteps[1] += MGWTIME();
       
 #ifdef PRINT_FASGRIDS
       sprintf(fname,"./outputs/fasgrid_resrho%ld.dat",lev);
@@ -172,101 +183,96 @@ void cycle_fas_mggrid(MGGridSet *grids, long lev, long NumPreSmooth, long NumPos
       //fprintf(stderr,"up at level %ld\n",lev);
       
       //apply tau correction
-      runTimesMGSteps[3] -= MPI_Wtime();
+      runTimesMGSteps[3] -= MGWTIME();
       restrict_mggrid_minusequal(grids[lev-1].u,grids[lev].u); 
       interp_mggrid_plusequal(grids[lev].u,grids[lev-1].u);  
-      runTimesMGSteps[3] += MPI_Wtime();
+      runTimesMGSteps[3] += MGWTIME();
       
       //post-smoothing
-      runTimesMGSteps[4] -= MPI_Wtime();
+      runTimesMGSteps[4] -= MGWTIME();
 #ifndef MGCACHEOPT
       smooth_mggrid(grids[lev].u,grids[lev].rho,NumPostSmooth);
 #else      
       smooth_mggrid_tempblock(grids[lev].u,grids[lev].rho,NumPostSmooth);
 #endif
-      runTimesMGSteps[4] += MPI_Wtime();
+      runTimesMGSteps[4] += MGWTIME();
     }
 }
 
 //define to use red-black ordering
 #define REDBLACK
 
-static void smooth_mggrid_tempblock(MGGrid u, MGGrid rhs, long Nsmooth)
+#ifdef REDBLACK
+/* relaxes the cells j = jstart,jstart+2,... of row i of the grid
+   the left and right nbrs of these cells are not touched and the top and bottom nbrs are in other rows, 
+   so the cells are independent and the loop runs in SIMD lanes 
+   the metric factors are loaded once per row and the arithmetic is the same as in the old scalar loops */
+static inline void relax_row_mggrid(MGGrid u, MGGrid rhs, long i, long jstart, double h2)
 {
-  long i,j,itr,N,n;
-  double diag,h2;
-  double fac1;
-  
-  //fprintf(stderr,"using new GS rouitnes!\n");
+  long j,N = u->N;
+  double *restrict g = u->grid + i*N;
+  const double *restrict gt = u->grid + (i-1)*N;
+  const double *restrict gb = u->grid + (i+1)*N;
+  const double *restrict r = rhs->grid + i*N;
+  double sft = u->sinfacs[2*i];
+  double sfc = u->sinfacs[2*i+1];
+  double sfb = u->sinfacs[2*i+2];
+  double d = u->diag[i];
+  double fac1 = h2*sfc;
+  
+#pragma omp simd
+  for(j=jstart;j<N-1;j+=2)
+    g[j] = (sft*gt[j]    //top
+	    + sfb*gb[j]  //bottom
+	    + g[j-1]/sfc //left
+	    + g[j+1]/sfc //right
+	    - fac1*r[j])/d;
+}
+#endif
+
+/* red-black smoother used in the FAS cycles
+   
+   A sweep is done in steps i = 1,...,N-1. Step i relaxes the red (odd j) cells of row i and then the black 
+   (even j) cells of row i-1 (the first and last steps only have one of these). Each of these is one call 
+   to relax_row_mggrid. 
+   
+   The Nsmooth sweeps are done in one pass over the grid as a wavefront - sweep s does step i right after 
+   sweep s-1 has done step i+1. This is the earliest point at which all of the nbrs sweep s needs are ready 
+   and none that sweep s-1 still needs are overwritten, so the result is exactly that of Nsmooth sweeps done 
+   one after the other, but only the Nsmooth+2 rows around the front have to stay in cache.
+*/
+void smooth_mggrid_tempblock(MGGrid u, MGGrid rhs, long Nsmooth)
+{
+  long i,N;
+  double h2;
   
   h2 = u->dL;
   h2 *= h2;
   N = u->N;
 
 #ifdef REDBLACK
-  double sf2nm2,sf2nm1,sf2n,sf2np1,sf2np2;
-  double dm1,d;
-  //fused loop red-black relaxation
-  for(itr=0;itr<Nsmooth;++itr)
-    {
-      //do first row - red cells
-      i = 1;
-      d = u->diag[i]; //u->sinfacs[2*i] + u->sinfacs[2*i+2] + 2.0/(u->sinfacs[2*i+1]);
-      sf2n = u->sinfacs[2*i];
-      sf2np1 = u->sinfacs[2*i+1];
-      sf2np2 = u->sinfacs[2*i+2];
-      fac1 = h2*sf2np1;
-      for(j=1;j<N-1;j+=2)
-	u->grid[i*N+j] = (sf2n*(u->grid[(i-1)*N+j]) //top
-			  + sf2np2*(u->grid[(i+1)*N+j])  //bottom
-			  + (u->grid[i*N + j-1])/sf2np1  //left
-			  + (u->grid[i*N + j+1])/sf2np1 //right
-			  - (fac1)*(rhs->grid[i*N + j]))/d;
-      
-      //now do rest of rows 
-      //do i row red cells, then go back and do i-1 row black cells
-      for(i=2;i<N-1;++i)
-	{
-	  dm1 = d;
-	  sf2nm2 = sf2n;
-	  sf2nm1 = sf2np1;
-	  sf2n = sf2np2;
-	  
-	  d = u->diag[i];
-	  sf2n = u->sinfacs[2*i];
-	  sf2np1 = u->sinfacs[2*i+1];
-	  sf2np2 = u->sinfacs[2*i+2];
-	  
-	  //row i red cells
-	  fac1 = h2*sf2np1;
-	  for(j=1;j<N-1;j+=2)
-	    u->grid[i*N+j] = (sf2n*(u->grid[(i-1)*N+j]) //top
-			      + sf2np2*(u->grid[(i+1)*N+j])  //bottom
-			      + (u->grid[i*N + j-1])/sf2np1  //left
-			      + (u->grid[i*N + j+1])/sf2np1 //right
-			      - (fac1)*(rhs->grid[i*N + j]))/d;
-
-	  //row i-1 black cells
-	  fac1 = h2*sf2nm1; //(u->sinfacs[2*(n-1)+1]);
-	  for(j=2;j<N-1;j+=2)
-	    u->grid[(i-1)*N+j] = (sf2nm2*(u->grid[((i-1)-1)*N+j]) //top
-				  + sf2n*(u->grid[((i-1)+1)*N+j])  //bottom
-				  + (u->grid[(i-1)*N + j-1])/sf2nm1  //left
-				  + (u->grid[(i-1)*N + j+1])/sf2nm1 //right
-				  - (fac1)*(rhs->grid[(i-1)*N + j]))/dm1;
-	}
-      
-      //do last row black cells
-      i = N-2;
-      fac1 = h2*sf2np1;
-      for(j=2;j<N-1;j+=2)
-	u->grid[i*N+j] = (sf2n*(u->grid[(i-1)*N+j]) //top
-			  + sf2np2*(u->grid[(i+1)*N+j])  //bottom
-			  + (u->grid[i*N + j-1])/sf2np1  //left
-			  + (u->grid[i*N + j+1])/sf2np1 //right
-			  - (fac1)*(rhs->grid[i*N + j]))/d;
-    }
+  long t,s;
+  for(t=1;t<N-1+Nsmooth;++t)
+    for(s=0;s<Nsmooth;++s)
+      {
+	i = t - s;
+	if(i < 1)
+	  break;
+	if(i > N-1)
+	  continue;
+	
+	//row i red cells
+	if(i < N-1)
+	  relax_row_mggrid(u,rhs,i,1,h2);
+	
+	//row i-1 black cells
+	if(i > 1)
+	  relax_row_mggrid(u,rhs,i-1,2,h2);
+      }
 #else
+  long j,n;
+  double diag,fac1;
+  
   //natural ordering moving window/temporal blocking scheme
   
   //init window
@@ -561,7 +567,7 @@ MGGrid lop_mggrid(MGGrid g)
   long i,j,tind,bind,lind,rind,N;
   double sinef,sinefdown,sinefup,vol;
   double h2;
-  mgfloat *u,*lop;
+  double *u,*lop;
       
   lopg = copy_mggrid(g);
   zero_mggrid(lopg);
@@ -626,7 +632,7 @@ void lop_mggrid_plusequal(MGGrid g, MGGrid pg)
   long i,j,tind,bind,lind,rind,N;
   double sinef,sinefdown,sinefup,vol;
   double h2;
-  mgfloat *u;
+  double *u;
   double lop;
   
   h2 = g->dL;
@@ -1141,7 +1147,7 @@ void resid_restrict_mggrid(MGGrid uc, MGGrid uf, MGGrid rhof)
   long tind,bind,lind,rind,N;
   double sinef,sinefdown,sinefup,vol;
   double h2;
-  mgfloat *u;
+  double *u;
   double lop,resid;
   double volc;
   
@@ -1223,7 +1229,7 @@ static void lop_mggrid_into_grid(MGGrid g, MGGrid lopg)
   long i,j,tind,bind,lind,rind,N;
   double sinef,sinefdown,sinefup,vol;
   double h2;
-  mgfloat *u,*lop;
+  double *u,*lop;
       
   //lopg = copy_mggrid(g);
   //zero_mggrid(lopg);
@@ -1290,7 +1296,7 @@ double truncErr_mggrid(MGGrid uf, MGGrid uc, MGGrid lopc)
   long tind,bind,lind,rind,N;
   double sinef,sinefdown,sinefup,vol;
   double h2;
-  mgfloat *u;
+  double *u;
   double lop;
   double volc;
   double norm = 0.0;
@@ -1404,6 +1410,305 @@ double truncErr_mggrid(MGGrid uf, MGGrid uc, MGGrid lopc)
   return norm;
 }
 
+#ifdef MGPOISSONSOLVE_FLOAT
+/* mixed precision MG solve
+   
+   The outer cycles of solve_fas_mixed_mggrid are done in double: the residual rho - L u of the finest grid is 
+   computed in double and stored as mgfloats in rhocorr, the correction scheme cycle cycle_corr_mggrid solves 
+   L e = rhocorr on the mgfloat ucorr grids, and e is added back to u in double. The eqn for e is linear, so 
+   the correction scheme does the same steps as a FAS cycle without carrying the full solution on the coarse 
+   grids. The float round off only limits how well each correction is found, so the outer cycles still reach 
+   the same ratio of residual to truncation error as the double solve. 
+   
+   The corrections are zero on the boundaries and the metric factors of each level are read from the double 
+   grid grids[lev].u. USE_BNDWGT is not supported here.
+*/
+static inline void relax_row_corr_mggrid(MGGrid g, mgfloat *e, const mgfloat *rhs, long i, long jstart, mgfloat h2)
+{
+  long j,N = g->N;
+  mgfloat *restrict ec = e + i*N;
+  const mgfloat *restrict et = e + (i-1)*N;
+  const mgfloat *restrict eb = e + (i+1)*N;
+  const mgfloat *restrict r = rhs + i*N;
+  mgfloat sft = g->sinfacs[2*i];
+  mgfloat sfb = g->sinfacs[2*i+2];
+  mgfloat isfc = 1.0/g->sinfacs[2*i+1];
+  mgfloat id = 1.0/g->diag[i];
+  mgfloat fac1 = h2*g->sinfacs[2*i+1];
+  
+#pragma omp simd
+  for(j=jstart;j<N-1;j+=2)
+    ec[j] = (sft*et[j] + sfb*eb[j] + (ec[j-1] + ec[j+1])*isfc - fac1*r[j])*id;
+}
+
+//same red-black wavefront as smooth_mggrid_tempblock
+static void smooth_corr_mggrid(MGGrid g, mgfloat *e, const mgfloat *rhs, long Nsmooth)
+{
+  long i,t,s,N = g->N;
+  mgfloat h2 = (g->dL)*(g->dL);
+  
+  for(t=1;t<N-1+Nsmooth;++t)
+    for(s=0;s<Nsmooth;++s)
+      {
+	i = t - s;
+	if(i < 1)
+	  break;
+	if(i > N-1)
+	  continue;
+	
+	if(i < N-1)
+	  relax_row_corr_mggrid(g,e,rhs,i,1,h2);
+	if(i > 1)
+	  relax_row_corr_mggrid(g,e,rhs,i-1,2,h2);
+      }
+}
+
+//mean abs. residual of the correction eqn
+static double L1norm_corr_mggrid(MGGrid g, const mgfloat *e, const mgfloat *rhs)
+{
+  long i,j,N = g->N;
+  mgfloat sinefup,sinefdown,isinef,ivol,lop;
+  double norm = 0.0;
+  
+  for(i=1;i<N-1;++i)
+    {
+      sinefup = g->sinfacs[2*i];
+      sinefdown = g->sinfacs[2*i+2];
+      isinef = 1.0/g->sinfacs[2*i+1];
+      ivol = 1.0/((g->dL)*(g->dL)*(g->sinfacs[2*i+1]));
+      
+      for(j=1;j<N-1;++j)
+	{
+	  lop = (sinefup*(e[(i-1)*N + j] - e[i*N + j])
+		 + sinefdown*(e[(i+1)*N + j] - e[i*N + j])
+		 + isinef*(e[i*N + j-1] + e[i*N + j+1] - 2.0f*e[i*N + j]))*ivol;
+	  norm += fabs(rhs[i*N + j] - lop);
+	}
+    }
+  
+  norm /= N;
+  norm /= N;
+  
+  return norm;
+}
+
+//rhs of the correction eqn on the finest grid - done in double and then stored as mgfloats
+static void resid_corr_mggrid(MGGrid u, MGGrid rho, mgfloat *r)
+{
+  long i,j,N = u->N;
+  double sinefup,sinefdown,sinef,vol,lop;
+  double h2 = (u->dL)*(u->dL);
+  
+  for(j=0;j<N;++j)
+    {
+      r[j] = 0.0;
+      r[(N-1)*N + j] = 0.0;
+    }
+  
+  for(i=1;i<N-1;++i)
+    {
+      sinefup = u->sinfacs[2*i];
+      sinefdown = u->sinfacs[2*i+2];
+      sinef = u->sinfacs[2*i+1];
+      vol = h2*sinef;
+      
+      r[i*N] = 0.0;
+      r[i*N + N-1] = 0.0;
+      for(j=1;j<N-1;++j)
+	{
+	  lop = (sinefup*(u->grid[(i-1)*N + j] - u->grid[i*N + j])
+		 + sinefdown*(u->grid[(i+1)*N + j] - u->grid[i*N + j])
+		 + 1.0/sinef*(u->grid[i*N + j-1] - u->grid[i*N + j])
+		 + 1.0/sinef*(u->grid[i*N + j+1] - u->grid[i*N + j]))/vol;
+	  r[i*N + j] = (mgfloat) (rho->grid[i*N + j] - lop);
+	}
+    }
+}
+
+//same as resid_restrict_mggrid for the correction eqn
+static void resid_restrict_corr_mggrid(MGGrid gc, mgfloat *rc, MGGrid gf, const mgfloat *ef, const mgfloat *rf)
+{
+  long i,j,n,m,ifn,jfn,N = gf->N,Nc = gc->N;
+  mgfloat sinefup,sinefdown,isinef,ivol,lop,mass,ivolc;
+  
+  for(i=1;i<Nc-1;++i)
+    {
+      ivolc = 1.0/(2.0*(gc->cosfacs[i]));
+      
+      for(j=1;j<Nc-1;++j)
+	{
+	  mass = 0.0;
+	  for(n=0;n<2;++n)
+	    {
+	      ifn = 2*(i-1) + n + 1;
+	      sinefup = gf->sinfacs[2*ifn];
+	      sinefdown = gf->sinfacs[2*ifn+2];
+	      isinef = 1.0/gf->sinfacs[2*ifn+1];
+	      ivol = 1.0/((gf->dL)*(gf->dL)*(gf->sinfacs[2*ifn+1]));
+	      
+	      for(m=0;m<2;++m)
+		{
+		  jfn = 2*(j-1) + m + 1;
+		  lop = (sinefup*(ef[(ifn-1)*N + jfn] - ef[ifn*N + jfn])
+			 + sinefdown*(ef[(ifn+1)*N + jfn] - ef[ifn*N + jfn])
+			 + isinef*(ef[ifn*N + jfn-1] + ef[ifn*N + jfn+1] - 2.0f*ef[ifn*N + jfn]))*ivol;
+		  mass += (rf[ifn*N + jfn] - lop)*((mgfloat) (gf->cosfacs[ifn]));
+		}
+	    }
+	  
+	  rc[i*Nc + j] = mass*ivolc;
+	}
+    }
+}
+
+//same as interp_mggrid_plusequal for the corrections
+static void interp_plusequal_corr_mggrid(MGGrid gf, mgfloat *ef, MGGrid gc, const mgfloat *ec)
+{
+  long i,j,ifn,jfn,N = gf->N,Nc = gc->N;
+  long xind,yind,xindp,yindp,xmod,ymod;
+  mgfloat wx,wy;
+  
+  //do boundaries first, revert to diect injection for stability
+  i = 1;
+  ifn = (i-1)/2 + 1;
+  for(j=1;j<N-1;++j)
+    ef[i*N + j] += ec[ifn*Nc + ((j-1)/2 + 1)];
+  
+  i = N-2;
+  ifn = (i-1)/2 + 1;
+  for(j=1;j<N-1;++j)
+    ef[i*N + j] += ec[ifn*Nc + ((j-1)/2 + 1)];
+  
+  j = 1;
+  jfn = (j-1)/2 + 1;
+  for(i=2;i<N-2;++i)
+    ef[i*N + j] += ec[((i-1)/2 + 1)*Nc + jfn];
+  
+  j = N-2;
+  jfn = (j-1)/2 + 1;
+  for(i=2;i<N-2;++i)
+    ef[i*N + j] += ec[((i-1)/2 + 1)*Nc + jfn];
+  
+  //do linear interp in middle
+  xmod = 1;
+  wx = 0.75;
+  for(ifn=2;ifn<N-2;++ifn)
+    {
+      xind = (ifn-1)/2 + xmod;
+      xindp = xind + 1;
+      wx = 1.0 - wx;
+      xmod = 1 - xmod;
+      
+      ymod = 1;
+      wy = 0.75;
+      for(jfn=2;jfn<N-2;++jfn)
+	{
+	  yind = (jfn-1)/2 + ymod;
+	  yindp = yind + 1;
+	  wy = 1.0 - wy;
+	  ymod = 1 - ymod;
+	  
+	  ef[ifn*N + jfn] += (ec[xind*Nc + yind]*(1.0f - wx)*(1.0f - wy)
+			      + ec[xind*Nc + yindp]*(1.0f - wx)*wy
+			      + ec[xindp*Nc + yind]*wx*(1.0f - wy)
+			      + ec[xindp*Nc + yindp]*wx*wy);
+	}
+    }
+}
+
+static void cycle_corr_mggrid(MGGridSet *grids, long lev, long NumPreSmooth, long NumPostSmooth, long NumInnerCycles)
+{
+  double L1norm,L1norm0;
+  long itr,N;
+  
+  if(lev == 0) //run smooth until convergence
+    {
+      runTimesMGSteps[2] -= MGWTIME();
+      L1norm0 = L1norm_corr_mggrid(grids[lev].u,grids[lev].ucorr,grids[lev].rhocorr);
+      itr = 0;
+      if(L1norm0 > 0.0)
+	do
+	  {
+	    smooth_corr_mggrid(grids[lev].u,grids[lev].ucorr,grids[lev].rhocorr,10l);
+	    L1norm = L1norm_corr_mggrid(grids[lev].u,grids[lev].ucorr,grids[lev].rhocorr);
+	    ++itr;
+	  } while(L1norm > MGEPS_EXACT_CORR*L1norm0 && itr < MGMAXITR);
+      runTimesMGSteps[2] += MGWTIME();
+    }
+  else //do multigrid steps
+    {
+      //pre-smooth
+      runTimesMGSteps[0] -= MGWTIME();
+      smooth_corr_mggrid(grids[lev].u,grids[lev].ucorr,grids[lev].rhocorr,NumPreSmooth);
+      runTimesMGSteps[0] += MGWTIME();
+      
+      //restrict residual, coarse correction starts at zero
+      runTimesMGSteps[1] -= MGWTIME();
+      resid_restrict_corr_mggrid(grids[lev-1].u,grids[lev-1].rhocorr,grids[lev].u,grids[lev].ucorr,grids[lev].rhocorr);
+      N = grids[lev-1].u->N;
+      memset(grids[lev-1].ucorr,0,sizeof(mgfloat)*N*N);
+      runTimesMGSteps[1] += MGWTIME();
+      
+      //recursive call - do once for base grid, but NumInnerCycles for any other grid
+      if(lev == 1)
+	{
+	  cycle_corr_mggrid(grids,lev-1,NumPreSmooth,NumPostSmooth,NumInnerCycles);
+	}
+      else
+	{
+	  for(itr=0;itr<NumInnerCycles;++itr)
+	    cycle_corr_mggrid(grids,lev-1,NumPreSmooth,NumPostSmooth,NumInnerCycles);
+	}
+      
+      //apply coarse correction
+      runTimesMGSteps[3] -= MGWTIME();
+      interp_plusequal_corr_mggrid(grids[lev].u,grids[lev].ucorr,grids[lev-1].u,grids[lev-1].ucorr);
+      runTimesMGSteps[3] += MGWTIME();
+      
+      //post-smoothing
+      runTimesMGSteps[4] -= MGWTIME();
+      smooth_corr_mggrid(grids[lev].u,grids[lev].ucorr,grids[lev].rhocorr,NumPostSmooth);
+      runTimesMGSteps[4] += MGWTIME();
+    }
+}
+
+double solve_fas_mixed_mggrid(MGGridSet *grids, long Nlev, long NumPreSmooth, long NumPostSmooth, long NumOuterCycles, long NumInnerCycles, double convFact, long *NumCycles)
+{
+  long itr,k,N;
+  double resid,trunc;
+  double alpha = MGALPHA;
+  MGGrid u = grids[Nlev-1].u;
+  mgfloat *e = grids[Nlev-1].ucorr;
+  
+  if(convFact > 0.0)
+    alpha = convFact;
+  
+  N = u->N;
+  itr = 0;
+  do {
+    //defect in double
+    resid_corr_mggrid(u,grids[Nlev-1].rho,grids[Nlev-1].rhocorr);
+    
+    //correction in float - zero on the boundaries, so adding all of it leaves the BCs of u alone
+    memset(e,0,sizeof(mgfloat)*N*N);
+    cycle_corr_mggrid(grids,Nlev-1,NumPreSmooth,NumPostSmooth,NumInnerCycles);
+    for(k=0;k<N*N;++k)
+      u->grid[k] += e[k];
+    
+    //comp norm
+    resid = L2norm_mggrid(u,grids[Nlev-1].rho);
+    trunc = truncErr_mggrid(u,grids[Nlev-2].u,grids[Nlev-2].rho); //the lower level grids are just used as extra storage - BCs are not clobbered 
+    
+    ++itr;
+  } while(resid > trunc*alpha && itr < NumOuterCycles);
+  
+  if(NumCycles != NULL)
+    *NumCycles = itr;
+  
+  return resid/trunc;
+}
+#endif /* MGPOISSONSOLVE_FLOAT */
+
 void zero_mggrid(MGGrid u)
 {
   long i,j;
@@ -1420,10 +1725,10 @@ MGGrid alloc_mggrid(long N, double L)
   
   //do mem alloc
   long Ntot = N+2;
-  u = (MGGrid)malloc(sizeof(_MGGrid) + Ntot*Ntot*sizeof(mgfloat) + (2*Ntot+1)*sizeof(double) + Ntot*sizeof(double) + 5*Ntot*sizeof(double));
+  u = (MGGrid)malloc(sizeof(_MGGrid) + Ntot*Ntot*sizeof(double) + (2*Ntot+1)*sizeof(double) + Ntot*sizeof(double) + 5*Ntot*sizeof(double));
   assert(u != NULL);
   
-  u->grid = (mgfloat*)(u + 1);
+  u->grid = (double*)(u + 1);
   u->sinfacs = (double*)(u->grid + Ntot*Ntot);
   u->cosfacs = u->sinfacs + 2*Ntot+1;
   u->sintheta = u->cosfacs + Ntot;
@@ -1471,11 +1776,11 @@ MGGrid copy_mggrid(MGGrid u)
   long N = u->N;
   
   //do mem alloc
-  c = (MGGrid)malloc(sizeof(_MGGrid) + N*N*sizeof(mgfloat) + (2*N+1)*sizeof(double) + N*sizeof(double) + 5*N*sizeof(double));
+  c = (MGGrid)malloc(sizeof(_MGGrid) + N*N*sizeof(double) + (2*N+1)*sizeof(double) + N*sizeof(double) + 5*N*sizeof(double));
   assert(c != NULL);
   *c = *u;
   
-  c->grid = (mgfloat*)(c + 1);
+  c->grid = (double*)(c + 1);
   c->sinfacs = (double*)(c->grid + N*N);
   c->cosfacs = c->sinfacs + 2*N+1;
   c->sintheta = c->cosfacs + N;
@@ -1484,7 +1789,7 @@ MGGrid copy_mggrid(MGGrid u)
   c->cosphi = c->sinphi + N;
   c->diag = c->cosphi + N;
   
-  memcpy(c->grid,u->grid,sizeof(mgfloat)*N*N);
+  memcpy(c->grid,u->grid,sizeof(double)*N*N);
   memcpy(c->sinfacs,u->sinfacs,sizeof(double)*(2*N+1));
   memcpy(c->cosfacs,u->cosfacs,sizeof(double)*N);
   
@@ -1504,6 +1809,38 @@ void free_mggrid(MGGrid u)
   free(u);
 }
 
+/* allocs the mgfloat correction grids for the mixed precision solve - the grids must already have their u */
+void alloc_corr_mggrids(MGGridSet *grids, long Nlev)
+{
+  long lev;
+  
+  for(lev=0;lev<Nlev;++lev)
+    {
+#ifdef MGPOISSONSOLVE_FLOAT
+      long N = grids[lev].u->N;
+      grids[lev].ucorr = (mgfloat*)malloc(sizeof(mgfloat)*N*N*2);
+      assert(grids[lev].ucorr != NULL);
+      grids[lev].rhocorr = grids[lev].ucorr + N*N;
+#else
+      grids[lev].ucorr = NULL;
+      grids[lev].rhocorr = NULL;
+#endif
+    }
+}
+
+void free_corr_mggrids(MGGridSet *grids, long Nlev)
+{
+  long lev;
+  
+  for(lev=0;lev<Nlev;++lev)
+    {
+      if(grids[lev].ucorr != NULL)
+	free(grids[lev].ucorr);
+      grids[lev].ucorr = NULL;
+      grids[lev].rhocorr = NULL;
+    }
+}
+
 void write_mggrid(char fname[], MGGrid u)
 {
   FILE *fp;
@@ -1511,10 +1848,84 @@ void write_mggrid(char fname[], MGGrid u)
   fp = fopen(fname,"w");
   fwrite(&(u->N),sizeof(long),(size_t) 1,fp);
   fwrite(&(u->L),sizeof(double),(size_t) 1,fp);
-  fwrite(u->grid,(size_t) ((u->N)*(u->N)),sizeof(mgfloat),fp);
+  fwrite(u->grid,(size_t) ((u->N)*(u->N)),sizeof(double),fp);
   fclose(fp);
 }
 
+static void fill_bench_mggrids(MGGrid u, MGGrid rhs)
+{
+  long k;
+  
+  for(k=0;k<(u->N)*(u->N);++k)
+    {
+      u->grid[k] = sin(0.37*k);
+      rhs->grid[k] = cos(0.11*k);
+    }
+}
+
+/* times the smoothers on the grid sizes that the MG patches can use - each base size in MGGRID_BASE_SIZES is 
+   doubled up to at most Nmax cells on a side 
+   smooth_mggrid_tempblock is timed with one sweep per call (as in the FAS cycles) and with NsmoothBlock 
+   sweeps per call, which must give exactly the same grid as NsmoothBlock single sweeps */
+void test_mgsmooth_speed(long Nmax, long NsmoothBlock)
+{
+  MGGrid u,rhs,ublock;
+  long Nbase[MGGRID_NTEST] = MGGRID_BASE_SIZES;
+  long b,N,n,Nsweeps;
+  double t,tsingle,tblock,tlev0;
+  int exact;
+  const double minTime = 0.25;
+  
+  fprintf(stderr,"MG smoother benchmark: sweeps/second for one sweep per call, %ld sweeps per call, and the lev 0 smoother\n",NsmoothBlock);
+  
+  for(b=0;b<MGGRID_NTEST;++b)
+    {
+      for(N=Nbase[b];N<=Nmax;N*=2)
+	{
+	  u = alloc_mggrid(N,0.1);
+	  rhs = copy_mggrid(u);
+	  fill_bench_mggrids(u,rhs);
+	  ublock = copy_mggrid(u);
+	  
+	  //check blocked sweeps against single sweeps
+	  for(n=0;n<NsmoothBlock;++n)
+	    smooth_mggrid_tempblock(u,rhs,1l);
+	  smooth_mggrid_tempblock(ublock,rhs,NsmoothBlock);
+	  exact = (memcmp(u->grid,ublock->grid,sizeof(double)*(u->N)*(u->N)) == 0);
+	  
+	  Nsweeps = NsmoothBlock;
+	  do {
+	    Nsweeps *= 2;
+	    t = -MGWTIME();
+	    for(n=0;n<Nsweeps;++n)
+	      smooth_mggrid_tempblock(u,rhs,1l);
+	    t += MGWTIME();
+	  } while(t < minTime);
+	  tsingle = Nsweeps/t;
+	  
+	  t = -MGWTIME();
+	  for(n=0;n<Nsweeps;n+=NsmoothBlock)
+	    smooth_mggrid_tempblock(ublock,rhs,NsmoothBlock);
+	  t += MGWTIME();
+	  tblock = Nsweeps/t;
+	  
+	  t = -MGWTIME();
+	  for(n=0;n<Nsweeps;++n)
+	    smooth_mggrid(u,rhs,1l);
+	  t += MGWTIME();
+	  tlev0 = Nsweeps/t;
+	  
+	  fprintf(stderr,"MG smoother benchmark: N = %5ld (base %ld): %12.1f|%12.1f|%12.1f sweeps/s, blocked sweeps exact = %d\n",
+		  N,Nbase[b],tsingle,tblock,tlev0,exact);
+	  
+	  free_mggrid(u);
+	  free_mggrid(rhs);
+	  free_mggrid(ublock);
+	}
+    }
+  fflush(stderr);
+}
+
 void print_runtimes_mgsteps(void)
 {
   fprintf(stderr,"MG run times - pre-smooth,down,exact,up,post-smooth = %lf|%lf|%lf|%lf|%lf\n",
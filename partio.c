@@ -1,6 +1,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <string.h>
+#include <limits.h>
 #include <assert.h>
 #include <fftw3.h>
 #include <mpi.h>
@@ -8,21 +10,14 @@
 #include <gsl/gsl_sort_long.h>
 #include <fitsio.h>
 #include <unistd.h>
+#ifdef PREFETCH_LENSPLANES
+#include <pthread.h>
+#endif
 
 #include "raytrace.h"
 #include "read_lensplanes_hdf5.h"
 #include "read_lensplanes_pixLC.h"
 
-static int compPartNest(const void *a, const void *b)
-{
-  if(((const Part*)a)->nest > ((const Part*)b)->nest)
-    return 1;
-  else if(((const Part*)a)->nest < ((const Part*)b)->nest)
-    return -1;
-  else
-    return 0;
-}
-
 struct nctg {
   long nest;
   long task;
@@ -43,7 +38,7 @@ void readRayTracingPlaneAtPeanoInds(long planeNum, long HEALPixOrder, long *Pean
 {
   void (*read_lens_plane)(long, long, long *, long, Part **, long *) = NULL;
   
-  if(strcmp_caseinsens(rayTraceData.LensPlaneType,"HDF5") == 0)
+  if(strcmp_caseinsens(rayTraceData.LensPlaneType,"HDF5") == 0 || strcmp_caseinsens(rayTraceData.LensPlaneType,"PeanoPacked") == 0)
     {
       read_lens_plane = &readRayTracingPlaneAtPeanoInds_HDF5;
     } 
@@ -60,6 +55,331 @@ void readRayTracingPlaneAtPeanoInds(long planeNum, long HEALPixOrder, long *Pean
   read_lens_plane(planeNum,HEALPixOrder,PeanoIndsToRead,NumPeanoIndsToRead,LCParts,NumLCParts);
 }
 
+/* sets up anything the lens plane reads share across planes - must be called by all tasks at once */
+void prep_lens_plane_reads(void)
+{
+  if(strcmp_caseinsens(rayTraceData.LensPlaneType,"pixLC") == 0)
+    prep_pixLC_manifests();
+}
+
+void destroy_lens_plane_reads(void)
+{
+  if(strcmp_caseinsens(rayTraceData.LensPlaneType,"pixLC") == 0)
+    destroy_pixLC_manifests();
+}
+
+/* with USE_PARALLEL_HDF5, HDF5 and PeanoPacked lens planes are read by all tasks at once through MPI-IO 
+   instead of task by task under the I/O token */
+static int collective_lens_plane_reads(void)
+{
+#ifdef USE_PARALLEL_HDF5
+  if(strcmp_caseinsens(rayTraceData.LensPlaneType,"HDF5") == 0 || strcmp_caseinsens(rayTraceData.LensPlaneType,"PeanoPacked") == 0)
+    return 1;
+#endif
+  return 0;
+}
+
+/* reads the cells on all tasks at once if the lens planes support it - returns 1 if the read was done */
+static int readRayTracingPlaneAtPeanoIndsCollective(long planeNum, long HEALPixOrder, long *PeanoIndsToRead, long NumPeanoIndsToRead, 
+						    Part **LCParts, long *NumLCParts)
+{
+  if(!collective_lens_plane_reads())
+    return 0;
+  
+#ifdef USE_PARALLEL_HDF5
+  readRayTracingPlaneAtPeanoInds_HDF5_MPIO(planeNum,HEALPixOrder,PeanoIndsToRead,NumPeanoIndsToRead,LCParts,NumLCParts);
+#endif
+  return 1;
+}
+
+/* lens plane prefetch
+   
+   - with PREFETCH_LENSPLANES defined, start_lcparts_prefetch starts a background thread which reads the particles 
+     in the current primary bundle cells for a given plane while the current plane is being solved
+   - the next read_lcparts_at_planenum for that plane uses the prefetched particles, drops those in cells which 
+     are no longer primary after load balancing and reads any new primary cells synchronously
+   - the prefetch is skipped (and the read is synchronous) if the particles are expected to need more than 
+     MaxPrefetchMemMB of memory on a task
+   - the thread makes no MPI calls and is the only thing touching the lens plane files until it is joined
+   - the prefetch reads are throttled by their own I/O token chain (tag TAG_IO_THROTTLE_PF), so they can overlap 
+     the main thread I/O without swapping tokens with it - the main thread receives the token for the thread
+     and passes it on when the thread is done, either in progress_lcparts_prefetch or when the thread is joined
+*/
+#ifdef PREFETCH_LENSPLANES
+typedef struct {
+  int active;
+  long planeNum;
+  long *PeanoIndsToRead;
+  long NumPeanoIndsToRead;
+  Part *LCParts;
+  long NumLCParts;
+  pthread_t thread;
+  int threadStarted;
+  MPI_Request tokenReq;
+  int tokenGranted;
+  int tokenPassed;
+  int done;
+} LCPartsPrefetch;
+
+static LCPartsPrefetch lcPartsPrefetch = {0,-1,NULL,0,NULL,0};
+static pthread_mutex_t lcPartsPrefetchLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t lcPartsPrefetchCond = PTHREAD_COND_INITIALIZER;
+
+static void *prefetch_lcparts_thread(void *arg)
+{
+  LCPartsPrefetch *pf = (LCPartsPrefetch*)arg;
+  
+  //wait for the main thread to get the I/O token
+  pthread_mutex_lock(&lcPartsPrefetchLock);
+  while(!pf->tokenGranted)
+    pthread_cond_wait(&lcPartsPrefetchCond,&lcPartsPrefetchLock);
+  pthread_mutex_unlock(&lcPartsPrefetchLock);
+  
+  readRayTracingPlaneAtPeanoInds(pf->planeNum,rayTraceData.bundleOrder,pf->PeanoIndsToRead,pf->NumPeanoIndsToRead,&(pf->LCParts),&(pf->NumLCParts));
+  
+  pthread_mutex_lock(&lcPartsPrefetchLock);
+  pf->done = 1;
+  pthread_mutex_unlock(&lcPartsPrefetchLock);
+  
+  return NULL;
+}
+
+/* hands the I/O token to the prefetch thread once the main thread has it - waits for it if block is set */
+static void grant_lcparts_prefetch_token(int block)
+{
+  if(lcPartsPrefetch.tokenGranted || !io_throttle_test(&(lcPartsPrefetch.tokenReq),block))
+    return;
+  
+  pthread_mutex_lock(&lcPartsPrefetchLock);
+  lcPartsPrefetch.tokenGranted = 1;
+  pthread_cond_signal(&lcPartsPrefetchCond);
+  pthread_mutex_unlock(&lcPartsPrefetchLock);
+}
+#endif
+
+/* moves the prefetch I/O token along without blocking - called from the main thread at convenient points while 
+   the prefetch thread runs so that the tasks waiting on this one can start their prefetch reads */
+void progress_lcparts_prefetch(void)
+{
+#ifdef PREFETCH_LENSPLANES
+  int done;
+  
+  if(!lcPartsPrefetch.active || lcPartsPrefetch.tokenPassed)
+    return;
+  
+  grant_lcparts_prefetch_token(0);
+  if(!lcPartsPrefetch.tokenGranted)
+    return;
+  
+  pthread_mutex_lock(&lcPartsPrefetchLock);
+  done = lcPartsPrefetch.done;
+  pthread_mutex_unlock(&lcPartsPrefetchLock);
+  if(done || !lcPartsPrefetch.threadStarted)
+    {
+      io_throttle_pass_tag(TAG_IO_THROTTLE_PF);
+      lcPartsPrefetch.tokenPassed = 1;
+    }
+#endif
+}
+
+/* waits for the prefetch thread (if any) to finish - must be called before anything else reads a lens plane */
+static void wait_lcparts_prefetch(void)
+{
+#ifdef PREFETCH_LENSPLANES
+  if(lcPartsPrefetch.active)
+    {
+      grant_lcparts_prefetch_token(1);
+      if(lcPartsPrefetch.threadStarted)
+	pthread_join(lcPartsPrefetch.thread,NULL);
+      if(!lcPartsPrefetch.tokenPassed)
+	io_throttle_pass_tag(TAG_IO_THROTTLE_PF);
+      lcPartsPrefetch.active = 0;
+    }
+#endif
+}
+
+void start_lcparts_prefetch(long planeNum)
+{
+#ifdef PREFETCH_LENSPLANES
+  long i,n;
+  double memEst,radFact;
+  int doPrefetch,doPrefetchGlobal;
+  
+  destroy_lcparts_prefetch();
+  
+  if(planeNum >= rayTraceData.NumLensPlanes || collective_lens_plane_reads())
+    return;
+  
+  /* the # of parts in a plane grows like its volume ~ r^2 dr */
+  radFact = 1.0;
+  if(planeNum > rayTraceData.CurrentPlaneNum && rayTraceData.planeRad > 0.0)
+    radFact = (rayTraceData.planeRadPlus1/rayTraceData.planeRad)*(rayTraceData.planeRadPlus1/rayTraceData.planeRad);
+  memEst = ((double) NlensPlaneParts)*radFact*sizeof(Part)/1024.0/1024.0;
+  doPrefetch = (memEst <= rayTraceData.MaxPrefetchMemMB);
+  MPI_Allreduce(&doPrefetch,&doPrefetchGlobal,1,MPI_INT,MPI_MIN,MPI_COMM_WORLD);
+  if(!doPrefetchGlobal)
+    {
+      if(ThisTask == 0)
+	fprintf(stderr,"not prefetching lens plane %ld - over memory limit of %lg MB.\n",planeNum,rayTraceData.MaxPrefetchMemMB);
+      return;
+    }
+  
+  lcPartsPrefetch.NumPeanoIndsToRead = 0;
+  for(i=0;i<NbundleCells;++i)
+    if(ISSETBITFLAG(bundleCells[i].active,PRIMARY_BUNDLECELL))
+      ++lcPartsPrefetch.NumPeanoIndsToRead;
+  lcPartsPrefetch.PeanoIndsToRead = (long*)malloc(sizeof(long)*lcPartsPrefetch.NumPeanoIndsToRead);
+  assert(lcPartsPrefetch.PeanoIndsToRead != NULL);
+  n = 0;
+  for(i=0;i<NbundleCells;++i)
+    if(ISSETBITFLAG(bundleCells[i].active,PRIMARY_BUNDLECELL))
+      {
+	lcPartsPrefetch.PeanoIndsToRead[n] = nest2peano(i,rayTraceData.bundleOrder);
+	++n;
+      }
+  
+  lcPartsPrefetch.planeNum = planeNum;
+  lcPartsPrefetch.LCParts = NULL;
+  lcPartsPrefetch.NumLCParts = 0;
+  lcPartsPrefetch.tokenGranted = 0;
+  lcPartsPrefetch.tokenPassed = 0;
+  lcPartsPrefetch.done = 0;
+  
+  //all tasks walk the token chain for this prefetch even if their thread does not start
+  io_throttle_post(TAG_IO_THROTTLE_PF,&(lcPartsPrefetch.tokenReq));
+  lcPartsPrefetch.active = 1;
+  lcPartsPrefetch.threadStarted = 1;
+  if(pthread_create(&(lcPartsPrefetch.thread),NULL,prefetch_lcparts_thread,&lcPartsPrefetch) != 0)
+    {
+      fprintf(stderr,"%d: could not start prefetch thread for lens plane %ld - will read it synchronously!\n",ThisTask,planeNum);
+      free(lcPartsPrefetch.PeanoIndsToRead);
+      lcPartsPrefetch.PeanoIndsToRead = NULL;
+      lcPartsPrefetch.NumPeanoIndsToRead = 0;
+      lcPartsPrefetch.threadStarted = 0;
+    }
+  
+  progress_lcparts_prefetch();
+#endif
+}
+
+void destroy_lcparts_prefetch(void)
+{
+#ifdef PREFETCH_LENSPLANES
+  wait_lcparts_prefetch();
+  
+  if(lcPartsPrefetch.PeanoIndsToRead != NULL)
+    free(lcPartsPrefetch.PeanoIndsToRead);
+  lcPartsPrefetch.PeanoIndsToRead = NULL;
+  lcPartsPrefetch.NumPeanoIndsToRead = 0;
+  
+  if(lcPartsPrefetch.LCParts != NULL)
+    free(lcPartsPrefetch.LCParts);
+  lcPartsPrefetch.LCParts = NULL;
+  lcPartsPrefetch.NumLCParts = 0;
+  lcPartsPrefetch.planeNum = -1;
+#endif
+}
+
+/* gets the parts for the given Peano inds from the prefetched plane if there is one, otherwise reads them */
+static void read_lcparts_prefetched(long planeNum, long *PeanoIndsToRead, long NumPeanoIndsToRead, Part **LCParts, long *NumLCParts)
+{
+#ifdef PREFETCH_LENSPLANES
+  long i,n,nest,NumMissingPeanoInds,NumMissingLCParts;
+  long *MissingPeanoInds;
+  Part *MissingLCParts,*tmpPart;
+  char *prefetchedCell;
+  double vec[3];
+  
+  wait_lcparts_prefetch();
+  
+  if(lcPartsPrefetch.PeanoIndsToRead == NULL || lcPartsPrefetch.planeNum != planeNum)
+    {
+      destroy_lcparts_prefetch();
+      readRayTracingPlaneAtPeanoInds(planeNum,rayTraceData.bundleOrder,PeanoIndsToRead,NumPeanoIndsToRead,LCParts,NumLCParts);
+      return;
+    }
+  
+  /* keep only parts in cells which are still wanted */
+  prefetchedCell = (char*)malloc(sizeof(char)*NbundleCells);
+  assert(prefetchedCell != NULL);
+  for(i=0;i<NbundleCells;++i)
+    prefetchedCell[i] = 0;
+  for(i=0;i<lcPartsPrefetch.NumPeanoIndsToRead;++i)
+    prefetchedCell[peano2nest(lcPartsPrefetch.PeanoIndsToRead[i],rayTraceData.bundleOrder)] = 1;
+  for(i=0;i<NumPeanoIndsToRead;++i)
+    {
+      nest = peano2nest(PeanoIndsToRead[i],rayTraceData.bundleOrder);
+      if(prefetchedCell[nest])
+	prefetchedCell[nest] = 2;
+    }
+  
+  n = 0;
+  for(i=0;i<lcPartsPrefetch.NumLCParts;++i)
+    {
+      vec[0] = (double) (lcPartsPrefetch.LCParts[i].pos[0]);
+      vec[1] = (double) (lcPartsPrefetch.LCParts[i].pos[1]);
+      vec[2] = (double) (lcPartsPrefetch.LCParts[i].pos[2]);
+      nest = vec2nest(vec,rayTraceData.bundleOrder);
+      
+      if(prefetchedCell[nest] == 2)
+	{
+	  lcPartsPrefetch.LCParts[n] = lcPartsPrefetch.LCParts[i];
+	  ++n;
+	}
+    }
+  
+  /* read cells which were not prefetched */
+  NumMissingPeanoInds = 0;
+  for(i=0;i<NumPeanoIndsToRead;++i)
+    if(prefetchedCell[peano2nest(PeanoIndsToRead[i],rayTraceData.bundleOrder)] == 0)
+      ++NumMissingPeanoInds;
+  
+  if(NumMissingPeanoInds > 0)
+    {
+      MissingPeanoInds = (long*)malloc(sizeof(long)*NumMissingPeanoInds);
+      assert(MissingPeanoInds != NULL);
+      NumMissingPeanoInds = 0;
+      for(i=0;i<NumPeanoIndsToRead;++i)
+	if(prefetchedCell[peano2nest(PeanoIndsToRead[i],rayTraceData.bundleOrder)] == 0)
+	  {
+	    MissingPeanoInds[NumMissingPeanoInds] = PeanoIndsToRead[i];
+	    ++NumMissingPeanoInds;
+	  }
+      
+      MissingLCParts = NULL;
+      readRayTracingPlaneAtPeanoInds(planeNum,rayTraceData.bundleOrder,MissingPeanoInds,NumMissingPeanoInds,&MissingLCParts,&NumMissingLCParts);
+      free(MissingPeanoInds);
+      
+      if(NumMissingLCParts > 0)
+	{
+	  tmpPart = (Part*)realloc(lcPartsPrefetch.LCParts,sizeof(Part)*(n + NumMissingLCParts));
+	  assert(tmpPart != NULL);
+	  lcPartsPrefetch.LCParts = tmpPart;
+	  for(i=0;i<NumMissingLCParts;++i)
+	    lcPartsPrefetch.LCParts[n+i] = MissingLCParts[i];
+	  n += NumMissingLCParts;
+	}
+      if(MissingLCParts != NULL)
+	free(MissingLCParts);
+    }
+  free(prefetchedCell);
+  
+  /* hand parts to caller */
+  if(n == 0 && lcPartsPrefetch.LCParts != NULL)
+    {
+      free(lcPartsPrefetch.LCParts);
+      lcPartsPrefetch.LCParts = NULL;
+    }
+  *LCParts = lcPartsPrefetch.LCParts;
+  *NumLCParts = n;
+  lcPartsPrefetch.LCParts = NULL;
+  lcPartsPrefetch.NumLCParts = 0;
+  destroy_lcparts_prefetch();
+#else
+  readRayTracingPlaneAtPeanoInds(planeNum,rayTraceData.bundleOrder,PeanoIndsToRead,NumPeanoIndsToRead,LCParts,NumLCParts);
+#endif
+}
+
 /* reads light cone particles into bundleCells for the given planeNum */
 void read_lcparts_at_planenum(long planeNum)
 {
@@ -68,10 +388,8 @@ void read_lcparts_at_planenum(long planeNum)
   long NumPeanoIndsToRead;
     
   long bundleNest;
-  double vec[3];
   
   long shift;
-  long NumGroups,myGroup,currGroup,readFromPlane;
 
   double t0;
   
@@ -103,84 +421,66 @@ void read_lcparts_at_planenum(long planeNum)
   /* read particles from lens plane
      1) uses peano inds computed above
      2) init bundle cells and numPartsAlloc for allocating particle mem
-     3) read in groups to limit I/O usage
+     3) pass an I/O token between tasks to limit I/O usage
   */
-  NumGroups = NTasks/rayTraceData.NumFilesIOInParallel;
-  if(NTasks - NumGroups*rayTraceData.NumFilesIOInParallel > 0)
-    ++NumGroups;
-  myGroup = ThisTask/rayTraceData.NumFilesIOInParallel;
-  readFromPlane = 0;
-  
   t0 = -MPI_Wtime();
-  for(currGroup=0;currGroup<NumGroups;++currGroup)
+  wait_lcparts_prefetch();
+  if(!readRayTracingPlaneAtPeanoIndsCollective(planeNum,rayTraceData.bundleOrder,PeanoIndsToRead,NumPeanoIndsToRead,&lensPlaneParts,&NlensPlaneParts))
     {
-      if(currGroup == myGroup)
+      io_throttle_begin();
+      read_lcparts_prefetched(planeNum,PeanoIndsToRead,NumPeanoIndsToRead,&lensPlaneParts,&NlensPlaneParts);
+      io_throttle_end();
+    }
+  free(PeanoIndsToRead);
+  
+  if(NlensPlaneParts > 0)
+    {
+      /* reorder parts and build indexing for bundleCells */
+      sort_parts_bundlenest(lensPlaneParts,NlensPlaneParts,1);
+      
+      /* now fill in index vals in bundleCells */
+      for(i=0;i<NlensPlaneParts;++i)
 	{
-	  readFromPlane = 1;
+	  bundleNest = lensPlaneParts[i].nest >> shift;
 	  
-	  readRayTracingPlaneAtPeanoInds(planeNum,rayTraceData.bundleOrder,PeanoIndsToRead,NumPeanoIndsToRead,&lensPlaneParts,&NlensPlaneParts);
-	  free(PeanoIndsToRead);
-	  
-	  if(NlensPlaneParts > 0)
-	    {
-	      /* reorder parts and build indexing for bundleCells */
-	      for(i=0;i<NlensPlaneParts;++i)
-		{
-		  vec[0] = (double) (lensPlaneParts[i].pos[0]);
-		  vec[1] = (double) (lensPlaneParts[i].pos[1]);
-		  vec[2] = (double) (lensPlaneParts[i].pos[2]);
-		  
-		  lensPlaneParts[i].nest = vec2nest(vec,HEALPIX_UTILS_MAXORDER);
-		}
-	      
-	      qsort(lensPlaneParts,(size_t) NlensPlaneParts,sizeof(Part),compPartNest);
-	      	      
-	      /* now fill in index vals in bundleCells */
-	      for(i=0;i<NlensPlaneParts;++i)
-		{
-		  bundleNest = lensPlaneParts[i].nest >> shift;
-		  
-		  if(bundleCells[bundleNest].Nparts == 0)
-		    bundleCells[bundleNest].firstPart = i;
-		  bundleCells[bundleNest].Nparts += 1;
-		}
-	    }
+	  if(bundleCells[bundleNest].Nparts == 0)
+	    bundleCells[bundleNest].firstPart = i;
+	  bundleCells[bundleNest].Nparts += 1;
 	}
-      
-      //////////////////////////////
-      MPI_Barrier(MPI_COMM_WORLD);
-      //////////////////////////////
     }
   
-  assert(readFromPlane == 1);
-  
   t0 += MPI_Wtime();
   if(ThisTask == 0) 
     {
       fprintf(stderr,"read parts in %f seconds\n",t0);
       fflush(stderr);
     }
-  
-  //now do an exchange to get buffer parts
-  long j,log2NTasks;
-  long level,sendTask,recvTask;
-  long Nsend,Nrecv;
-  long NumBufferCells = 0,NumPartsAlloc,NumBufferParts;
-  Part *tmpPart;
+  io_throttle_report("lens plane particle");
+  
+  /* now do an exchange to get buffer parts
+     1) each task asks the tasks which have its buffer cells as primary cells for their parts - one MPI_Alltoall
+	for the # of cells and then Isend/Irecv only between tasks which share cells
+     2) the # of parts each task gets is exchanged with a second MPI_Alltoall, so the parts are received
+	straight into lensPlaneParts with all of the receives posted at once
+     3) with USE_FULLSKY_PARTDIST, the buffer cells outside of the domain are read from disk while the
+	parts are in flight
+  */
+  long j,k;
+  long NumBufferCells = 0,NumPartsAlloc,NumBufferParts,NumCellsToSend,NumPartsToSend;
+  Part *tmpPart,*sendParts;
   long rpInd;
-  struct nctg *nestCellsToGet, *nestCellsToSend=NULL, *tmpNCTG;
-  long NnestCellsToSend = 0;
-  long firstNestCellForRecvTask,NnestCellsForRecvTask;
-  MPI_Status Stat;
-  int count,NnestCellsToSendAlloc=0;
-  MPI_Request requestSend,requestRecv;
-  int didSend,didRecv;
-
+  struct nctg *nestCellsToGet;
+  long *nestCellsToGetList,*nestCellsToSend;
+  int *NcellsGet,*NcellsSend,*NpartsSend,*NpartsRecv;
+  long *cellsGetOffset,*cellsSendOffset,*partsSendOffset,*partsRecvOffset;
+  MPI_Request *requests;
+  int Nrequests;
+  MPI_Datatype MPI_PART;
+  
   t0 = -MPI_Wtime();
   
-  log2NTasks = 0;
-  while(NTasks > (1 << log2NTasks))
-    ++log2NTasks;
+  MPI_Type_contiguous((int) (sizeof(Part)),MPI_BYTE,&MPI_PART);
+  MPI_Type_commit(&MPI_PART);
   
   //get the bundle cells for which parts are needed and which task they are on
   for(i=0;i<NbundleCells;++i)
@@ -220,187 +520,141 @@ void read_lcparts_at_planenum(long planeNum)
   //sort by task
   qsort(nestCellsToGet,(size_t) NumBufferCells,sizeof(struct nctg),compNCTGTask);
   
-  //make extra room for incoming parts
-  NumPartsAlloc = NlensPlaneParts; 
-  NumBufferParts = NlensPlaneParts*((double) NumBufferCells)/((double) NumPeanoIndsToRead)*1.1;
-  if(NumBufferParts*sizeof(Part)/1024.0/1024.0 > 100.0)
-    NumBufferParts = (100.0*1024.0*1024.0)/sizeof(Part);
-  tmpPart = (Part*)realloc(lensPlaneParts,sizeof(Part)*(NlensPlaneParts + NumBufferParts));
+  //count cells to get from each task - never need parts from ourselves since part buffer cells are not primary cells on same task
+  NcellsGet = (int*)malloc(sizeof(int)*NTasks*4);
+  assert(NcellsGet != NULL);
+  NcellsSend = NcellsGet + NTasks;
+  NpartsSend = NcellsSend + NTasks;
+  NpartsRecv = NpartsSend + NTasks;
+  cellsGetOffset = (long*)malloc(sizeof(long)*NTasks*4);
+  assert(cellsGetOffset != NULL);
+  cellsSendOffset = cellsGetOffset + NTasks;
+  partsSendOffset = cellsSendOffset + NTasks;
+  partsRecvOffset = partsSendOffset + NTasks;
+  requests = (MPI_Request*)malloc(sizeof(MPI_Request)*NTasks*2);
+  assert(requests != NULL);
+  
+  for(j=0;j<NTasks;++j)
+    NcellsGet[j] = 0;
+  nestCellsToGetList = (long*)malloc(sizeof(long)*(NumBufferCells+1));
+  assert(nestCellsToGetList != NULL);
+  n = 0;
+  for(i=0;i<NumBufferCells;++i)
+    {
+      if(nestCellsToGet[i].task >= 0 && nestCellsToGet[i].task != ThisTask)
+	{
+	  NcellsGet[nestCellsToGet[i].task] += 1;
+	  nestCellsToGetList[n] = nestCellsToGet[i].nest;
+	  ++n;
+	}
+    }
+  free(nestCellsToGet);
+  
+  MPI_Alltoall(NcellsGet,1,MPI_INT,NcellsSend,1,MPI_INT,MPI_COMM_WORLD);
+  
+  cellsGetOffset[0] = 0;
+  cellsSendOffset[0] = 0;
+  for(j=1;j<NTasks;++j)
+    {
+      cellsGetOffset[j] = cellsGetOffset[j-1] + NcellsGet[j-1];
+      cellsSendOffset[j] = cellsSendOffset[j-1] + NcellsSend[j-1];
+    }
+  NumCellsToSend = cellsSendOffset[NTasks-1] + NcellsSend[NTasks-1];
+  
+  //get the cells other tasks want from us
+  nestCellsToSend = (long*)malloc(sizeof(long)*(NumCellsToSend+1));
+  assert(nestCellsToSend != NULL);
+  Nrequests = 0;
+  for(j=0;j<NTasks;++j)
+    {
+      if(NcellsSend[j] > 0)
+	{
+	  MPI_Irecv(nestCellsToSend+cellsSendOffset[j],NcellsSend[j],MPI_LONG,(int) j,TAG_BUFF_PIO,MPI_COMM_WORLD,requests+Nrequests);
+	  ++Nrequests;
+	}
+      if(NcellsGet[j] > 0)
+	{
+	  MPI_Isend(nestCellsToGetList+cellsGetOffset[j],NcellsGet[j],MPI_LONG,(int) j,TAG_BUFF_PIO,MPI_COMM_WORLD,requests+Nrequests);
+	  ++Nrequests;
+	}
+    }
+  MPI_Waitall(Nrequests,requests,MPI_STATUSES_IGNORE);
+  free(nestCellsToGetList);
+  
+  //pack the parts to send back
+  NumPartsToSend = 0;
+  for(j=0;j<NTasks;++j)
+    {
+      partsSendOffset[j] = NumPartsToSend;
+      for(i=cellsSendOffset[j];i<cellsSendOffset[j]+NcellsSend[j];++i)
+	if(ISSETBITFLAG(bundleCells[nestCellsToSend[i]].active,PRIMARY_BUNDLECELL))
+	  NumPartsToSend += bundleCells[nestCellsToSend[i]].Nparts;
+      assert(NumPartsToSend - partsSendOffset[j] < INT_MAX);
+      NpartsSend[j] = (int) (NumPartsToSend - partsSendOffset[j]);
+    }
+  sendParts = (Part*)malloc(sizeof(Part)*(NumPartsToSend+1));
+  assert(sendParts != NULL);
+  k = 0;
+  for(i=0;i<NumCellsToSend;++i)
+    {
+      if(ISSETBITFLAG(bundleCells[nestCellsToSend[i]].active,PRIMARY_BUNDLECELL) && bundleCells[nestCellsToSend[i]].Nparts > 0)
+	{
+	  memcpy(sendParts+k,lensPlaneParts+bundleCells[nestCellsToSend[i]].firstPart,sizeof(Part)*bundleCells[nestCellsToSend[i]].Nparts);
+	  k += bundleCells[nestCellsToSend[i]].Nparts;
+	}
+    }
+  assert(k == NumPartsToSend);
+  free(nestCellsToSend);
+  
+  MPI_Alltoall(NpartsSend,1,MPI_INT,NpartsRecv,1,MPI_INT,MPI_COMM_WORLD);
+  
+  //make exactly enough room for incoming parts
+  NumBufferParts = 0;
+  for(j=0;j<NTasks;++j)
+    {
+      partsRecvOffset[j] = NlensPlaneParts + NumBufferParts;
+      NumBufferParts += NpartsRecv[j];
+    }
+  NumPartsAlloc = NlensPlaneParts + NumBufferParts;
+  tmpPart = (Part*)realloc(lensPlaneParts,sizeof(Part)*(NumPartsAlloc+1));
   if(tmpPart != NULL)
     {
       lensPlaneParts = tmpPart;
-      NumPartsAlloc = NlensPlaneParts + NumBufferParts;
     }
   else
     {
       fprintf(stderr,"%d: could not realloc lensPlaneParts for getting buffer regions! - wanted %lg MB extra for %lf MB total.\n",
-	      ThisTask,NumBufferParts*sizeof(Part)/1024.0/1024.0,(NlensPlaneParts + NumBufferParts)*sizeof(Part)/1024.0/1024.0);
+	      ThisTask,NumBufferParts*sizeof(Part)/1024.0/1024.0,NumPartsAlloc*sizeof(Part)/1024.0/1024.0);
       MPI_Abort(MPI_COMM_WORLD,123);
     }
-  NumBufferParts = 0;
   
-  /*algorithm to loop through pairs of tasks linearly
-    -lifted from Gadget-2 under GPL (http://www.gnu.org/copyleft/gpl.html)
-    -see pm_periodic.c from Gadget-2 at http://www.mpa-garching.mpg.de/gadget/
-  */
-  for(level = 0; level < (1 << log2NTasks); level++) /* note: for level=0, target is the same task */
-    {
-      sendTask = ThisTask;
-      recvTask = ThisTask ^ level;
-      if(recvTask < NTasks && sendTask != recvTask)  //never need to give parts to ourselves since part buffer cells are not primary cells on same task
-        {
-	  //first see if we need to get any bundle cells parts from recvTask
-	  firstNestCellForRecvTask = -1;
-	  NnestCellsForRecvTask = 0;
-	  for(j=0;j<NumBufferCells;++j)
-	    {
-	      if(nestCellsToGet[j].task == recvTask)
-		{
-		  if(firstNestCellForRecvTask == -1)
-		    firstNestCellForRecvTask = j;
-		  
-		  ++NnestCellsForRecvTask;
-		}
-	    }
-	  
-	  if(NnestCellsForRecvTask == 0)
-	    firstNestCellForRecvTask = 0;
-	  
-	  Nsend = NnestCellsForRecvTask;
-	  MPI_Sendrecv(&Nsend,1,MPI_LONG,(int) recvTask,TAG_NUMBUFF_PIO,
-		       &Nrecv,1,MPI_LONG,(int) recvTask,TAG_NUMBUFF_PIO,
-		       MPI_COMM_WORLD,&Stat);
-	  NnestCellsToSend = Nrecv;
-	  
-	  if(Nsend > 0 || Nrecv > 0) //there is overlap between tasks so they may need to send stuff
-	    {
-	      //get bundle cells for which parts should be sent back
-	      if(NnestCellsToSendAlloc < NnestCellsToSend)
-		{
-		  tmpNCTG = (struct nctg*)realloc(nestCellsToSend,sizeof(struct nctg)*NnestCellsToSend);
-		  if(tmpNCTG != NULL)
-		    {
-		      nestCellsToSend = tmpNCTG;
-		      NnestCellsToSendAlloc = NnestCellsToSend;
-		    }
-		  else
-		    {
-		      fprintf(stderr,"%d: could not realloc nestCellsToSend!\n",ThisTask);
-		      MPI_Abort(MPI_COMM_WORLD,123);
-		    }
-		}
-	      
-	      MPI_Sendrecv(nestCellsToGet+firstNestCellForRecvTask,(int) (Nsend*sizeof(struct nctg)),MPI_BYTE,(int) recvTask,TAG_BUFF_PIO,
-			   nestCellsToSend,(int) (NnestCellsToSend*sizeof(struct nctg)),MPI_BYTE,(int) recvTask,TAG_BUFF_PIO,
-			   MPI_COMM_WORLD,&Stat);
-	      
-	      //get # of parts to send back
-	      Nsend = 0;
-	      for(i=0;i<NnestCellsToSend;++i)
-		if(ISSETBITFLAG(bundleCells[nestCellsToSend[i].nest].active,PRIMARY_BUNDLECELL))
-		  Nsend += bundleCells[nestCellsToSend[i].nest].Nparts;
-	      
-	      //get # of parts to recv and make sure have room
-	      MPI_Sendrecv(&Nsend,1,MPI_LONG,(int) recvTask,TAG_NUMPBUFF_PIO,
-			   &Nrecv,1,MPI_LONG,(int) recvTask,TAG_NUMPBUFF_PIO,
-			   MPI_COMM_WORLD,&Stat);
-	      
-	      if(NlensPlaneParts+NumBufferParts+Nrecv > NumPartsAlloc)
-		{
-		  tmpPart = (Part*)realloc(lensPlaneParts,sizeof(Part)*(NumPartsAlloc+Nrecv*4));
-		  if(tmpPart != NULL)
-		    {
-		      lensPlaneParts = tmpPart;
-		      NumPartsAlloc += Nrecv*4;
-		    }
-		  else
-		    {
-		      fprintf(stderr,"%d: could not realloc lensPlaneParts for getting buffer regions in loop! - wanted %lg MB extra for %lf MB total.\n",
-			      ThisTask,Nrecv*4*sizeof(Part)/1024.0/1024.0,(NumPartsAlloc+Nrecv*4)*sizeof(Part)/1024.0/1024.0);
-		      MPI_Abort(MPI_COMM_WORLD,123);
-		    }
-		}
-	      
-	      //if have parts to send or recv, do it
-	      if(Nsend > 0 || Nrecv > 0)
-		{
-		  i = 0;
-		  while(Nsend > 0 || Nrecv > 0)
-		    {
-		      if(Nrecv > 0) //recv parts
-			{
-			  MPI_Irecv(lensPlaneParts+NlensPlaneParts+NumBufferParts,
-				    (int) (sizeof(Part)*(NumPartsAlloc-(NlensPlaneParts+NumBufferParts))),MPI_BYTE,
-				    (int) recvTask,TAG_PBUFF_PIO,MPI_COMM_WORLD,&requestRecv);
-			  didRecv = 1;
-			}
-		      else
-			didRecv = 0;
-		      
-		      if(Nsend > 0)
-			{
-			  while(i < NnestCellsToSend && !(ISSETBITFLAG(bundleCells[nestCellsToSend[i].nest].active,PRIMARY_BUNDLECELL) && bundleCells[nestCellsToSend[i].nest].Nparts > 0))
-			    ++i;
-			  
-			  if(i >= NnestCellsToSend)
-			    {
-			      fprintf(stderr,"%d: out of nest cells in while Nsend, Nrecv loop\n",ThisTask);
-			      MPI_Abort(MPI_COMM_WORLD,123);
-			    }
-			  
-			  MPI_Issend(lensPlaneParts+bundleCells[nestCellsToSend[i].nest].firstPart,
-				     (int) (sizeof(Part)*bundleCells[nestCellsToSend[i].nest].Nparts),MPI_BYTE,
-				     (int) recvTask,TAG_PBUFF_PIO,MPI_COMM_WORLD,&requestSend);
-			  
-			  Nsend -= bundleCells[nestCellsToSend[i].nest].Nparts;
-			  didSend = 1;
-			  ++i;
-			}
-		      else
-			didSend = 0;
-		      
-		      if(didRecv)
-			{
-			  MPI_Wait(&requestRecv,&Stat);
-			  
-			  MPI_Get_count(&Stat,MPI_BYTE,&count);
-			  count /= sizeof(Part);
-			  NumBufferParts += count;			  
-			  Nrecv -= count;
-			}
-		      
-		      if(didSend)
-			MPI_Wait(&requestSend,&Stat);
-		    }
-		}
-	    }
+  //post all of the part transfers
+  Nrequests = 0;
+  for(j=0;j<NTasks;++j)
+    {
+      if(NpartsRecv[j] > 0)
+	{
+	  MPI_Irecv(lensPlaneParts+partsRecvOffset[j],NpartsRecv[j],MPI_PART,(int) j,TAG_PBUFF_PIO,MPI_COMM_WORLD,requests+Nrequests);
+	  ++Nrequests;
+	}
+      if(NpartsSend[j] > 0)
+	{
+	  MPI_Isend(sendParts+partsSendOffset[j],NpartsSend[j],MPI_PART,(int) j,TAG_PBUFF_PIO,MPI_COMM_WORLD,requests+Nrequests);
+	  ++Nrequests;
 	}
     }
   
-  //update total number of parts
-  NlensPlaneParts += NumBufferParts; 
-
-  //clean up
-  if(NnestCellsToSendAlloc > 0)
-    free(nestCellsToSend);
-  free(nestCellsToGet);
-  
-  t0 += MPI_Wtime();
-  if(ThisTask == 0) 
-    {
-      fprintf(stderr,"got buffer parts in %f seconds\n",t0);
-      fflush(stderr);
-    }
-
   //if using the full light cone part distribution,
   //need to read in buffer parts which are not primary cells in the domain
+  //this is done while the parts from other tasks are in flight, so they go to their own buffer for now
 #ifdef USE_FULLSKY_PARTDIST
-  Part *buffParts = NULL;
-  long NumBuffParts = 0;
+  Part *buffParts = NULL,*fullskyBuffParts = NULL;
+  long NumBuffParts = 0,NumFullskyBuffParts = 0;
   long peanoInd;
+  double t1,vec[3];
+  
+  t1 = -MPI_Wtime();
   
-  t0 = -MPI_Wtime();
-
   NumPeanoIndsToRead = 1;
   for(i=0;i<NbundleCells;++i)
     {
@@ -408,39 +662,33 @@ void read_lcparts_at_planenum(long planeNum)
 	{
 	  //read parts from file
 	  peanoInd = nest2peano(i,rayTraceData.bundleOrder);	  
-          readRayTracingPlaneAtPeanoInds(planeNum,rayTraceData.bundleOrder,&peanoInd,NumPeanoIndsToRead,&buffParts,&NumBuffParts);
+	  readRayTracingPlaneAtPeanoInds(planeNum,rayTraceData.bundleOrder,&peanoInd,NumPeanoIndsToRead,&buffParts,&NumBuffParts);
 	  
-	  //now add to current parts vector if needed
+	  //now add to fullsky buffer parts if needed
 	  if(NumBuffParts > 0)
 	    {
-	      //make sure have mem
-	      if(NlensPlaneParts+NumBuffParts > NumPartsAlloc)
+	      tmpPart = (Part*)realloc(fullskyBuffParts,sizeof(Part)*(NumFullskyBuffParts+NumBuffParts));
+	      if(tmpPart != NULL)
 		{
-		  tmpPart = (Part*)realloc(lensPlaneParts,sizeof(Part)*(NumPartsAlloc+NumBuffParts*4));
-		  if(tmpPart != NULL)
-		    {
-		      lensPlaneParts = tmpPart;
-		      NumPartsAlloc += NumBuffParts*4;
-		    }
-		  else
-		    {
-		      fprintf(stderr,"%d: could not realloc lensPlaneParts for getting USE_FULLSKY_PARTDIST buffer regions in loop! - wanted %lg MB extra for %lf MB total.\n",
-			      ThisTask,NumBuffParts*4*sizeof(Part)/1024.0/1024.0,(NumPartsAlloc+NumBuffParts*4)*sizeof(Part)/1024.0/1024.0);
-		      MPI_Abort(MPI_COMM_WORLD,123);
-		    }
+		  fullskyBuffParts = tmpPart;
+		}
+	      else
+		{
+		  fprintf(stderr,"%d: could not realloc fullskyBuffParts for getting USE_FULLSKY_PARTDIST buffer regions in loop! - wanted %lg MB extra for %lf MB total.\n",
+			  ThisTask,NumBuffParts*sizeof(Part)/1024.0/1024.0,(NumFullskyBuffParts+NumBuffParts)*sizeof(Part)/1024.0/1024.0);
+		  MPI_Abort(MPI_COMM_WORLD,123);
 		}
 	      
-	      //add to code
 	      for(j=0;j<NumBuffParts;++j)
-                {
-                  vec[0] = (double) (buffParts[j].pos[0]);
-                  vec[1] = (double) (buffParts[j].pos[1]);
-                  vec[2] = (double) (buffParts[j].pos[2]);
+		{
+		  vec[0] = (double) (buffParts[j].pos[0]);
+		  vec[1] = (double) (buffParts[j].pos[1]);
+		  vec[2] = (double) (buffParts[j].pos[2]);
 		  buffParts[j].nest = vec2nest(vec,HEALPIX_UTILS_MAXORDER);
 		  
-		  lensPlaneParts[NlensPlaneParts+j] = buffParts[j];
-                }
-              NlensPlaneParts += NumBuffParts;
+		  fullskyBuffParts[NumFullskyBuffParts+j] = buffParts[j];
+		}
+	      NumFullskyBuffParts += NumBuffParts;
 	      
 	      //clean up
 	      free(buffParts);
@@ -450,12 +698,52 @@ void read_lcparts_at_planenum(long planeNum)
 	}
     }
   
+  t1 += MPI_Wtime();
+  if(ThisTask == 0) 
+    {
+      fprintf(stderr,"got fullsky buffer parts in %f seconds\n",t1);
+      fflush(stderr);
+    }
+#endif
+  
+  //finish the part transfers
+  MPI_Waitall(Nrequests,requests,MPI_STATUSES_IGNORE);
+  NlensPlaneParts += NumBufferParts;
+  
+  //clean up
+  free(sendParts);
+  free(requests);
+  free(NcellsGet);
+  free(cellsGetOffset);
+  MPI_Type_free(&MPI_PART);
+  
   t0 += MPI_Wtime();
   if(ThisTask == 0) 
     {
-      fprintf(stderr,"got fullsky buffer parts in %f seconds\n",t0);
+      fprintf(stderr,"got buffer parts in %f seconds\n",t0);
       fflush(stderr);
     }
+  
+#ifdef USE_FULLSKY_PARTDIST
+  //add the fullsky buffer parts
+  if(NumFullskyBuffParts > 0)
+    {
+      tmpPart = (Part*)realloc(lensPlaneParts,sizeof(Part)*(NlensPlaneParts+NumFullskyBuffParts));
+      if(tmpPart != NULL)
+	{
+	  lensPlaneParts = tmpPart;
+	  NumPartsAlloc = NlensPlaneParts+NumFullskyBuffParts;
+	}
+      else
+	{
+	  fprintf(stderr,"%d: could not realloc lensPlaneParts for adding USE_FULLSKY_PARTDIST buffer regions! - wanted %lg MB extra for %lf MB total.\n",
+		  ThisTask,NumFullskyBuffParts*sizeof(Part)/1024.0/1024.0,(NlensPlaneParts+NumFullskyBuffParts)*sizeof(Part)/1024.0/1024.0);
+	  MPI_Abort(MPI_COMM_WORLD,123);
+	}
+      memcpy(lensPlaneParts+NlensPlaneParts,fullskyBuffParts,sizeof(Part)*NumFullskyBuffParts);
+      NlensPlaneParts += NumFullskyBuffParts;
+      free(fullskyBuffParts);
+    }
 #endif
   
   //free extra mem
@@ -480,7 +768,7 @@ void read_lcparts_at_planenum(long planeNum)
       bundleCells[i].Nparts = 0;
       bundleCells[i].firstPart = -1;
     }
-  qsort(lensPlaneParts,(size_t) NlensPlaneParts,sizeof(Part),compPartNest);
+  sort_parts_bundlenest(lensPlaneParts,NlensPlaneParts,0);
   shift = 2*(HEALPIX_UTILS_MAXORDER-rayTraceData.bundleOrder);
   for(i=0;i<NlensPlaneParts;++i)
     {
@@ -500,10 +788,8 @@ void read_lcparts_at_planenum_fullsky_partdist(long planeNum)
   long NumPeanoIndsToRead;
     
   long bundleNest;
-  double vec[3];
   
   long shift;
-  long NumGroups,myGroup,currGroup,readFromPlane;
   
   double t0;
   
@@ -531,67 +817,45 @@ void read_lcparts_at_planenum_fullsky_partdist(long planeNum)
     
   /* init and free old parts if needed */
   destroy_parts();
+  wait_lcparts_prefetch();
   
   /* read particles from lens plane
      1) uses peano inds computed above
      2) init bundle cells and numPartsAlloc for allocating particle mem
-     3) read in groups to limit I/O usage
+     3) pass an I/O token between tasks to limit I/O usage
   */
-  NumGroups = NTasks/rayTraceData.NumFilesIOInParallel;
-  if(NTasks - NumGroups*rayTraceData.NumFilesIOInParallel > 0)
-    ++NumGroups;
-  myGroup = ThisTask/rayTraceData.NumFilesIOInParallel;
-  readFromPlane = 0;
-  
   t0 = -MPI_Wtime();
-  for(currGroup=0;currGroup<NumGroups;++currGroup)
+  if(!readRayTracingPlaneAtPeanoIndsCollective(planeNum,rayTraceData.bundleOrder,PeanoIndsToRead,NumPeanoIndsToRead,&lensPlaneParts,&NlensPlaneParts))
     {
-      if(currGroup == myGroup)
-	{
-	  readFromPlane = 1;
-	  
-	  readRayTracingPlaneAtPeanoInds(planeNum,rayTraceData.bundleOrder,PeanoIndsToRead,NumPeanoIndsToRead,&lensPlaneParts,&NlensPlaneParts);
-	  free(PeanoIndsToRead);
-	  
-	  if(NlensPlaneParts > 0)
-	    {
-	      /* reorder parts and build indexing for bundleCells */
-	      for(i=0;i<NlensPlaneParts;++i)
-		{
-		  vec[0] = (double) (lensPlaneParts[i].pos[0]);
-		  vec[1] = (double) (lensPlaneParts[i].pos[1]);
-		  vec[2] = (double) (lensPlaneParts[i].pos[2]);
-		
-		  lensPlaneParts[i].nest = vec2nest(vec,HEALPIX_UTILS_MAXORDER);
-                }
-
-              qsort(lensPlaneParts,(size_t) NlensPlaneParts,sizeof(Part),compPartNest);
+      io_throttle_begin();
+      readRayTracingPlaneAtPeanoInds(planeNum,rayTraceData.bundleOrder,PeanoIndsToRead,NumPeanoIndsToRead,&lensPlaneParts,&NlensPlaneParts);
+      io_throttle_end();
+    }
+  free(PeanoIndsToRead);
+  
+  if(NlensPlaneParts > 0)
+    {
+      /* reorder parts and build indexing for bundleCells */
+      sort_parts_bundlenest(lensPlaneParts,NlensPlaneParts,1);
 
-              /* now fill in index vals in bundleCells */
-              for(i=0;i<NlensPlaneParts;++i)
-                {
-                  bundleNest = lensPlaneParts[i].nest >> shift;
+      /* now fill in index vals in bundleCells */
+      for(i=0;i<NlensPlaneParts;++i)
+	{
+	  bundleNest = lensPlaneParts[i].nest >> shift;
 
-                  if(bundleCells[bundleNest].Nparts == 0)
-                    bundleCells[bundleNest].firstPart = i;
-                  bundleCells[bundleNest].Nparts += 1;
-                }
-	    }
+	  if(bundleCells[bundleNest].Nparts == 0)
+	    bundleCells[bundleNest].firstPart = i;
+	  bundleCells[bundleNest].Nparts += 1;
 	}
-      
-      //////////////////////////////
-      MPI_Barrier(MPI_COMM_WORLD);
-      //////////////////////////////
     }
   
-  assert(readFromPlane == 1);
-  
   t0 += MPI_Wtime();
   if(ThisTask == 0) 
     {
       fprintf(stderr,"read parts in %f seconds\n",t0);
       fflush(stderr);
     }
+  io_throttle_report("lens plane particle");
 }
 
 /* reads light cone particles into bundleCells for the given planeNum */
@@ -602,10 +866,8 @@ void read_lcparts_at_planenum_all(long planeNum)
   long NumPeanoIndsToRead;
     
   long bundleNest;
-  double vec[3];
   
   long shift;
-  long NumGroups,myGroup,currGroup,readFromPlane;
   
   double t0;
   
@@ -629,65 +891,43 @@ void read_lcparts_at_planenum_all(long planeNum)
   
   /* init and free old parts if needed */
   destroy_parts();
+  wait_lcparts_prefetch();
     
   /* read particles from lens plane
      1) uses peano inds computed above
      2) init bundle cells and numPartsAlloc for allocating particle mem
-     3) read in groups to limit I/O usage
+     3) pass an I/O token between tasks to limit I/O usage
   */
-  NumGroups = NTasks/rayTraceData.NumFilesIOInParallel;
-  if(NTasks - NumGroups*rayTraceData.NumFilesIOInParallel > 0)
-    ++NumGroups;
-  myGroup = ThisTask/rayTraceData.NumFilesIOInParallel;
-  readFromPlane = 0;
-  
   t0 = -MPI_Wtime();
-  for(currGroup=0;currGroup<NumGroups;++currGroup)
+  if(!readRayTracingPlaneAtPeanoIndsCollective(planeNum,rayTraceData.bundleOrder,PeanoIndsToRead,NumPeanoIndsToRead,&lensPlaneParts,&NlensPlaneParts))
     {
-      if(currGroup == myGroup)
-	{
-	  readFromPlane = 1;
-	  
-	  readRayTracingPlaneAtPeanoInds(planeNum,rayTraceData.bundleOrder,PeanoIndsToRead,NumPeanoIndsToRead,&lensPlaneParts,&NlensPlaneParts);
-	  free(PeanoIndsToRead);
-	  
-	  if(NlensPlaneParts > 0)
-	    {
-	      /* reorder parts and build indexing for bundleCells */
-	      for(i=0;i<NlensPlaneParts;++i)
-		{
-		  vec[0] = (double) (lensPlaneParts[i].pos[0]);
-		  vec[1] = (double) (lensPlaneParts[i].pos[1]);
-		  vec[2] = (double) (lensPlaneParts[i].pos[2]);
-		
-		  lensPlaneParts[i].nest = vec2nest(vec,HEALPIX_UTILS_MAXORDER);
-                }
-
-              qsort(lensPlaneParts,(size_t) NlensPlaneParts,sizeof(Part),compPartNest);
+      io_throttle_begin();
+      readRayTracingPlaneAtPeanoInds(planeNum,rayTraceData.bundleOrder,PeanoIndsToRead,NumPeanoIndsToRead,&lensPlaneParts,&NlensPlaneParts);
+      io_throttle_end();
+    }
+  free(PeanoIndsToRead);
+  
+  if(NlensPlaneParts > 0)
+    {
+      /* reorder parts and build indexing for bundleCells */
+      sort_parts_bundlenest(lensPlaneParts,NlensPlaneParts,1);
 
-              /* now fill in index vals in bundleCells */
-              for(i=0;i<NlensPlaneParts;++i)
-                {
-                  bundleNest = lensPlaneParts[i].nest >> shift;
+      /* now fill in index vals in bundleCells */
+      for(i=0;i<NlensPlaneParts;++i)
+	{
+	  bundleNest = lensPlaneParts[i].nest >> shift;
 
-                  if(bundleCells[bundleNest].Nparts == 0)
-                    bundleCells[bundleNest].firstPart = i;
-                  bundleCells[bundleNest].Nparts += 1;
-                }
-	    }
+	  if(bundleCells[bundleNest].Nparts == 0)
+	    bundleCells[bundleNest].firstPart = i;
+	  bundleCells[bundleNest].Nparts += 1;
 	}
-      
-      //////////////////////////////
-      MPI_Barrier(MPI_COMM_WORLD);
-      //////////////////////////////
     }
   
-  assert(readFromPlane == 1);
-  
   t0 += MPI_Wtime();
   if(ThisTask == 0) 
     {
       fprintf(stderr,"read parts in %f seconds\n",t0);
       fflush(stderr);
     }
+  io_throttle_report("lens plane particle");
 }
@@ -88,7 +88,10 @@ double spline_part_dens(double cosr, double sigma)
   static int init = 1;
   static double svec[NSVEC],nvec[NSVEC];
   static gsl_spline *spline;
-  static gsl_interp_accel *accel;
+  static gsl_interp_accel *accel = NULL; //the accel caches the last index so each thread has its own
+#ifdef USE_OPENMP
+#pragma omp threadprivate(accel)
+#endif
   double dens,norm,rs;
   int i;
   
@@ -108,10 +111,12 @@ double spline_part_dens(double cosr, double sigma)
       
       spline = gsl_spline_alloc(gsl_interp_cspline,(size_t) (NSVEC));
       gsl_spline_init(spline,svec,nvec,(size_t) (NSVEC));
-      accel = gsl_interp_accel_alloc();
     }
 #undef NSVEC
   
+  if(accel == NULL)
+    accel = gsl_interp_accel_alloc();
+  
   //error check cosr
   if(cosr >= 1.0)
     {
@@ -25,7 +25,12 @@ void fullsky_partdist_poissondriver(void)
       
       read_lcparts_at_planenum_fullsky_partdist(rayTraceData.CurrentPlaneNum);
       get_smoothing_lengths();
-
+      
+#ifndef SHTONLY
+      //start reading the parts for the MG step while the SHT step runs
+      start_lcparts_prefetch(rayTraceData.CurrentPlaneNum);
+#endif
+      
       logProfileTag(PROFILETAG_PARTIO);
       time += MPI_Wtime();
 
@@ -94,7 +99,10 @@ void cutsky_partdist_poissondriver(void)
 
       read_lcparts_at_planenum(rayTraceData.CurrentPlaneNum);
       get_smoothing_lengths();
-
+      
+      //start reading the next plane while this one is solved
+      start_lcparts_prefetch(rayTraceData.CurrentPlaneNum+1);
+      
       logProfileTag(PROFILETAG_PARTIO);
       time += MPI_Wtime();
 
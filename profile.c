@@ -17,6 +17,9 @@ static double GlobalMinTimeBase;
 static int isRunningProfileTag[NUM_PROFILE_TAGS];
 static int ProfileInitFlag = 1;
 
+/* per-thread times - each thread only ever touches its own slot so no locking is needed */
+static double GlobalProfileThreadTime[NUM_PROFILE_TAGS][PROFILE_MAX_THREADS];
+
 #ifdef PROFILE_TIMESERIES
 static double *GlobalProfileStartTime[NUM_PROFILE_TAGS];
 static double *GlobalProfileStopTime[NUM_PROFILE_TAGS];
@@ -137,6 +140,34 @@ double getPrevTimeProfileTagSeries(int tag, long NumPrev)
 }
 #endif
 
+/* adds time to the per-thread timer of a tag 
+   this is safe to call from inside a threaded region as long as each thread passes its own thread number
+   NOTE: the profiler must have been initialized by a call to logProfileTag from the master thread first
+*/
+void addThreadTimeProfileTag(int tag, int thread, double time)
+{
+  assert(thread >= 0 && thread < PROFILE_MAX_THREADS);
+  GlobalProfileThreadTime[tag][thread] += time;
+}
+
+double getThreadTimeProfileTag(int tag, int thread)
+{
+  assert(thread >= 0 && thread < PROFILE_MAX_THREADS);
+  return GlobalProfileThreadTime[tag][thread];
+}
+
+/* returns one plus the largest thread number which has logged time for this tag */
+int getNumThreadsProfileTag(int tag)
+{
+  int i;
+  
+  for(i=PROFILE_MAX_THREADS-1;i>=0;--i)
+    if(GlobalProfileThreadTime[tag][i] != 0.0)
+      return i+1;
+  
+  return 0;
+}
+
 double getTotTimeProfileTag(int tag)
 {
   double time = 0.0;
@@ -147,7 +178,7 @@ double getTotTimeProfileTag(int tag)
 
 void logProfileTag(int tag)
 {
-  long i;
+  long i,j;
   double time;
 #ifdef PROFILE_TIMESERIES
   double *tmp;
@@ -162,6 +193,9 @@ void logProfileTag(int tag)
 	  GlobalProfileTotTime[i] = 0.0;
 	  GlobalProfileCurrTime[i] = 0.0;
 	  
+	  for(j=0;j<PROFILE_MAX_THREADS;++j)
+	    GlobalProfileThreadTime[i][j] = 0.0;
+	  
 #ifdef PROFILE_TIMESERIES
 	  NGlobalProfileStartStopTime[i] = 0;
 	  NGlobalProfileStartStopTimeBase[i] = NProfileAdd;
@@ -231,6 +265,7 @@ void printProfileInfo(const char name[], const char *ProfileTagNames[])
   FILE *fp = NULL;
   long i,j,len;
   double Glbmin;
+  int hasThreadTimes,globalHasThreadTimes,Nthreads;
   
   const int totlen = 21;
   
@@ -259,7 +294,41 @@ void printProfileInfo(const char name[], const char *ProfileTagNames[])
 	}
     }
 #endif  
-
+  
+  /* print per-thread times - only done if some task logged per-thread time */
+  hasThreadTimes = 0;
+  for(i=0;i<NUM_PROFILE_TAGS;++i)
+    if(getNumThreadsProfileTag((int) i) > 0)
+      hasThreadTimes = 1;
+  MPI_Allreduce(&hasThreadTimes,&globalHasThreadTimes,1,MPI_INT,MPI_MAX,MPI_COMM_WORLD);
+  
+  if(globalHasThreadTimes)
+    {
+      sprintf(fname,"%s.threads",name);
+      if(ThisTask == 0)
+	remove(fname);
+      for(len=0;len<NTasks;++len)
+	{
+	  /*\\\\\\\\\\\\\\*/
+	  MPI_Barrier(MPI_COMM_WORLD);
+	  /*\\\\\\\\\\\\\\*/
+	  
+	  if(ThisTask == len && hasThreadTimes)
+	    {
+	      fp = fopen(fname,"a");
+	      assert(fp != NULL);
+	      for(i=0;i<NUM_PROFILE_TAGS;++i)
+		{
+		  Nthreads = getNumThreadsProfileTag((int) i);
+		  for(j=0;j<Nthreads;++j)
+		    fprintf(fp,"%d \t %ld \t %ld \t %.10e \n",ThisTask,i,j,GlobalProfileThreadTime[i][j]);
+		}
+	      fflush(fp);
+	      fclose(fp);
+	    }
+	}
+    }
+  
   /* print total times out to file name */
   for(j=0;j<NUM_PROFILE_TAGS;++j) //make sure times have stopped
     {
@@ -39,8 +39,13 @@
 #define PROFILETAG_GRIDSEARCH_GALMOVE                15  //this tag is a subset of GRIDSEARCH
 #define PROFILETAG_GRIDSEARCH_GALGRIDSEARCH          16  //this tag is a subset of GRIDSEARCH
 #define PROFILETAG_GRIDSEARCH_IMAGEGALIO             17  //this tag is NOT a subset of GRIDSEARCH, but is a subset of GALIO
+#define PROFILETAG_SHTSETUP                          18  //this tag is a subset of SHT
+#define PROFILETAG_IOWAIT                            19  //this tag is a subset of whichever I/O tag is running
 
-#define NUM_PROFILE_TAGS          18
+#define NUM_PROFILE_TAGS          20
+
+/* max # of threads per task which can be tracked by the per-thread timers */
+#define PROFILE_MAX_THREADS       256
 
 void logProfileTag(int tag);
 void printProfileInfo(const char name[], const char *ProfileTagNames[]);
@@ -48,6 +53,9 @@ double getTimeProfileTag(int tag);
 double getTotTimeProfileTag(int tag);
 void resetProfiler(void);
 void printStepTimesProfileTags(FILE *fp, long stepNum, const char *ProfileTagNames[]);
+void addThreadTimeProfileTag(int tag, int thread, double time);
+double getThreadTimeProfileTag(int tag, int thread);
+int getNumThreadsProfileTag(int tag);
 
 #ifdef PROFILE_TIMESERIES
 double getTimeProfileTagSeries(int tag);
@@ -0,0 +1,219 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+#include "raytrace.h"
+
+/* stable LSD radix sort of integer keys into an index, plus an in-place gather of records by that index
+
+   Keys are sorted RADIX_BITS at a time from the lowest bits up. Each pass counts the digits, turns the
+   counts into offsets and scatters the keys and indexes into the other buffer. With USE_OPENMP the counts
+   and the scatter are split into one contiguous block of keys per thread and the offsets are laid out
+   digit by digit and then thread by thread, so the sort stays stable. A pass is skipped if all keys have
+   the same digit, which is the common case for the top digits of bundle cell keys.
+*/
+
+#define RADIX_BITS 8
+#define RADIX_SIZE (1l << RADIX_BITS)
+#define RADIX_MASK (RADIX_SIZE - 1)
+
+static void radix_count(const unsigned long *keys, long lo, long hi, int shift, long *hist)
+{
+  long i;
+
+  for(i=0;i<RADIX_SIZE;++i)
+    hist[i] = 0;
+  for(i=lo;i<hi;++i)
+    hist[(keys[i] >> shift) & RADIX_MASK] += 1;
+}
+
+/* turns the per thread counts into offsets - returns 1 if all keys have the same digit */
+static int radix_offsets(long *hist, int nthreads, long N)
+{
+  long d,off,tmp;
+  int t;
+
+  for(d=0;d<RADIX_SIZE;++d)
+    {
+      tmp = 0;
+      for(t=0;t<nthreads;++t)
+	tmp += hist[t*RADIX_SIZE+d];
+      if(tmp == N)
+	return 1;
+    }
+
+  off = 0;
+  for(d=0;d<RADIX_SIZE;++d)
+    for(t=0;t<nthreads;++t)
+      {
+	tmp = hist[t*RADIX_SIZE+d];
+	hist[t*RADIX_SIZE+d] = off;
+	off += tmp;
+      }
+
+  return 0;
+}
+
+static void radix_scatter(const unsigned long *keys, const long *inds, long lo, long hi, int shift, long *hist,
+			  unsigned long *keysOut, long *indsOut)
+{
+  long i,pos;
+
+  for(i=lo;i<hi;++i)
+    {
+      pos = hist[(keys[i] >> shift) & RADIX_MASK]++;
+      keysOut[pos] = keys[i];
+      indsOut[pos] = inds[i];
+    }
+}
+
+/* fills order so that keys[order[0]] <= keys[order[1]] <= ... - keys must be less than 2^nbits and
+   equal keys keep their input order */
+void radix_sort_index(const unsigned long *keys, long N, int nbits, long *order)
+{
+  unsigned long *k0,*k1,*ktmp;
+  long *i0,*i1,*itmp,*ibuff,*hist;
+  long i;
+  int shift,maxthreads = 1,nthreads = 1,skip = 0;
+
+  for(i=0;i<N;++i)
+    order[i] = i;
+  if(N <= 1)
+    return;
+
+#ifdef USE_OPENMP
+  maxthreads = omp_get_max_threads();
+#endif
+
+  k0 = (unsigned long*)malloc(sizeof(unsigned long)*N);
+  assert(k0 != NULL);
+  k1 = (unsigned long*)malloc(sizeof(unsigned long)*N);
+  assert(k1 != NULL);
+  ibuff = (long*)malloc(sizeof(long)*N);
+  assert(ibuff != NULL);
+  hist = (long*)malloc(sizeof(long)*RADIX_SIZE*maxthreads);
+  assert(hist != NULL);
+  memcpy(k0,keys,sizeof(unsigned long)*N);
+  i0 = order;
+  i1 = ibuff;
+
+  for(shift=0;shift<nbits;shift+=RADIX_BITS)
+    {
+#ifdef USE_OPENMP
+#pragma omp parallel default(none) shared(k0,k1,i0,i1,hist,N,shift,nthreads,skip)
+      {
+	int t = omp_get_thread_num();
+	int nt = omp_get_num_threads();
+	long lo = N*t/nt,hi = N*(t+1)/nt;
+
+	radix_count(k0,lo,hi,shift,hist+t*RADIX_SIZE);
+#pragma omp barrier
+#pragma omp single
+	{
+	  nthreads = nt;
+	  skip = radix_offsets(hist,nthreads,N);
+	}
+	if(!skip)
+	  radix_scatter(k0,i0,lo,hi,shift,hist+t*RADIX_SIZE,k1,i1);
+      }
+#else
+      radix_count(k0,0,N,shift,hist);
+      skip = radix_offsets(hist,nthreads,N);
+      if(!skip)
+	radix_scatter(k0,i0,0,N,shift,hist,k1,i1);
+#endif
+
+      if(!skip)
+	{
+	  ktmp = k0;
+	  k0 = k1;
+	  k1 = ktmp;
+	  itmp = i0;
+	  i0 = i1;
+	  i1 = itmp;
+	}
+    }
+
+  if(i0 != order)
+    memcpy(order,i0,sizeof(long)*N);
+
+  free(k0);
+  free(k1);
+  free(ibuff);
+  free(hist);
+}
+
+/* moves records so that the new base[i] is the old base[order[i]] without a second copy of the records
+   - follows the cycles of the permutation - destroys order */
+void reorder_by_index(void *base, size_t size, long N, long *order)
+{
+  char *b = (char*)base;
+  char *tmp;
+  long i,j,k;
+
+  tmp = (char*)malloc(size);
+  assert(tmp != NULL);
+
+  for(i=0;i<N;++i)
+    {
+      if(order[i] == i)
+	continue;
+
+      memcpy(tmp,b+i*size,size);
+      j = i;
+      while(order[j] != i)
+	{
+	  k = order[j];
+	  memcpy(b+j*size,b+k*size,size);
+	  order[j] = j;
+	  j = k;
+	}
+      memcpy(b+j*size,tmp,size);
+      order[j] = j;
+    }
+
+  free(tmp);
+}
+
+/* sorts the particles by bundle cell (keeping their order within each cell) and sets the nest index of each
+   particle at HEALPIX_UTILS_MAXORDER if setNest is 1 - returns the particles ready for building firstPart/Nparts */
+void sort_parts_bundlenest(Part *parts, long Nparts, int setNest)
+{
+  long i,*order;
+  unsigned long *keys;
+  double vec[3];
+  long shift = 2*(HEALPIX_UTILS_MAXORDER - rayTraceData.bundleOrder);
+
+  if(Nparts <= 0)
+    return;
+
+  keys = (unsigned long*)malloc(sizeof(unsigned long)*Nparts);
+  assert(keys != NULL);
+  order = (long*)malloc(sizeof(long)*Nparts);
+  assert(order != NULL);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for default(none) shared(parts,Nparts,keys,shift,setNest) private(vec)
+#endif
+  for(i=0;i<Nparts;++i)
+    {
+      if(setNest)
+	{
+	  vec[0] = (double) (parts[i].pos[0]);
+	  vec[1] = (double) (parts[i].pos[1]);
+	  vec[2] = (double) (parts[i].pos[2]);
+	  parts[i].nest = vec2nest(vec,HEALPIX_UTILS_MAXORDER);
+	}
+      keys[i] = (unsigned long) (parts[i].nest >> shift);
+    }
+
+  radix_sort_index(keys,Nparts,2*((int) (rayTraceData.bundleOrder))+4,order);
+  free(keys);
+
+  reorder_by_index(parts,sizeof(Part),Nparts,order);
+  free(order);
+}
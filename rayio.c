@@ -254,12 +254,13 @@ static void get_ray_iodecomp(long *firstTaskFiles, long *lastTaskFiles, long *fi
 */
 void write_rays(void)
 {
-  long group,NumGroups,i,j;
+  long i,j;
   long *firstTaskFiles,*lastTaskFiles,fileNum=-1;
   MPI_Comm fileComm;
   MPI_Group worldGroup,fileGroup;
   int *ranks,Nranks;
   double t;
+  HEALPixRay ray;
   
   t = -MPI_Wtime();
   
@@ -303,35 +304,30 @@ void write_rays(void)
 	{
 	  for(j=0;j<bundleCells[i].Nrays;++j)
 	    {
-	      paratrans_ray_curr2obs(&(bundleCells[i].rays[j]));
-	      rot_ray_ang2radec(&(bundleCells[i].rays[j]));
+	      get_ray(&(bundleCells[i]),j,&ray);
+	      paratrans_ray_curr2obs(&ray);
+	      rot_ray_ang2radec(&ray);
+	      set_ray(&(bundleCells[i]),j,&ray);
 	    }
 	}
     }
   
-  NumGroups = rayTraceData.NumRayOutputFiles/rayTraceData.NumFilesIOInParallel;
-  if(rayTraceData.NumRayOutputFiles - NumGroups*rayTraceData.NumFilesIOInParallel > 0)
-    ++NumGroups;
-  for(group=0;group<NumGroups;++group)
-    {
-      if(fileNum/rayTraceData.NumFilesIOInParallel == group)
-	{
+  /* the first task of each file passes an I/O token to the first task of the file NumFilesIOInParallel
+     files ahead, the other tasks of the file just block in the collectives on fileComm */
+  if(ThisTask == firstTaskFiles[fileNum] && fileNum >= rayTraceData.NumFilesIOInParallel)
+    io_throttle_wait(firstTaskFiles[fileNum-rayTraceData.NumFilesIOInParallel]);
 #ifdef DEBUG
 #if DEBUG_LEVEL > 1
-	  fprintf(stderr,"%d: doing write - group = %ld, fileNum = %ld, my group = %ld\n",ThisTask,group,fileNum,fileNum/rayTraceData.NumFilesIOInParallel);
+  fprintf(stderr,"%d: doing write - fileNum = %ld, first,last = %ld|%ld\n",ThisTask,fileNum,firstTaskFiles[fileNum],lastTaskFiles[fileNum]);
 #endif
 #endif
 #ifdef USE_FITS_RAYOUT
-	  file_write_rays2fits(fileNum,firstTaskFiles[fileNum],lastTaskFiles[fileNum],fileComm);
+  file_write_rays2fits(fileNum,firstTaskFiles[fileNum],lastTaskFiles[fileNum],fileComm);
 #else
-	  file_write_rays2bin(fileNum,firstTaskFiles[fileNum],lastTaskFiles[fileNum],fileComm);
+  file_write_rays2bin(fileNum,firstTaskFiles[fileNum],lastTaskFiles[fileNum],fileComm);
 #endif  
-	}
-      
-      /*\\\\\\\\\\\\\\\\\\\\\\\\\\*/
-      MPI_Barrier(MPI_COMM_WORLD);
-      /*\\\\\\\\\\\\\\\\\\\\\\\\\\*/
-    }
+  if(ThisTask == firstTaskFiles[fileNum] && fileNum + rayTraceData.NumFilesIOInParallel < rayTraceData.NumRayOutputFiles)
+    io_throttle_pass(firstTaskFiles[fileNum+rayTraceData.NumFilesIOInParallel]);
   
   /* convert all rays back to theta-phi basis*/
   for(i=0;i<NbundleCells;++i)
@@ -340,8 +336,10 @@ void write_rays(void)
 	{
 	  for(j=0;j<bundleCells[i].Nrays;++j)
 	    {
-	      rot_ray_radec2ang(&(bundleCells[i].rays[j]));
-	      paratrans_ray_obs2curr(&(bundleCells[i].rays[j]));
+	      get_ray(&(bundleCells[i]),j,&ray);
+	      rot_ray_radec2ang(&ray);
+	      paratrans_ray_obs2curr(&ray);
+	      set_ray(&(bundleCells[i]),j,&ray);
 	    }
 	}
     }
@@ -357,6 +355,7 @@ void write_rays(void)
   
   if(ThisTask == 0)
     fprintf(stderr,"writing rays to disk took %lf seconds.\n",t);
+  io_throttle_report("ray output");
 }
 
 #ifdef USE_FITS_RAYOUT
@@ -399,7 +398,7 @@ static void file_write_rays2fits(long fileNum, long firstTask, long lastTask, MP
   double *darr;
   long *larr;
   char *buff;
-  double ra,dec;
+  double ra,dec,rvec[3];
   
   long nwc=0,NtotToRecv,nw=0,nwg=0,rpeano,rowloc;
   MPI_Status mpistatus;
@@ -549,13 +548,16 @@ static void file_write_rays2fits(long fileNum, long firstTask, long lastTask, MP
 			  colnum = TAG_RAYIO_CHUNKDATA+1;
 			  
 			  for(k=firstInd;k<=lastInd;++k)
-			    larr[k-firstInd] = bundleCells[j].rays[k].nest;
+			    larr[k-firstInd] = RAY_NEST(bundleCells[j],k);
 			  MPI_Ssend(larr,(int) NumRaysInChunk,MPI_LONG,(int) firstTask,colnum,MPI_COMM_WORLD);
 			  ++colnum;
 			  
 			  for(k=firstInd;k<=lastInd;++k)
 			    {
-			      vec2radec(bundleCells[j].rays[k].n,&ra,&dec);
+			      rvec[0] = RAY_N(bundleCells[j],k,0);
+			      rvec[1] = RAY_N(bundleCells[j],k,1);
+			      rvec[2] = RAY_N(bundleCells[j],k,2);
+			      vec2radec(rvec,&ra,&dec);
 			      darr[k-firstInd] = ra;
 			    }
 			  MPI_Ssend(darr,(int) NumRaysInChunk,MPI_DOUBLE,(int) firstTask,colnum,MPI_COMM_WORLD);
@@ -563,46 +565,49 @@ static void file_write_rays2fits(long fileNum, long firstTask, long lastTask, MP
 			  
 			  for(k=firstInd;k<=lastInd;++k)
 			    {
-			      vec2radec(bundleCells[j].rays[k].n,&ra,&dec);
+			      rvec[0] = RAY_N(bundleCells[j],k,0);
+			      rvec[1] = RAY_N(bundleCells[j],k,1);
+			      rvec[2] = RAY_N(bundleCells[j],k,2);
+			      vec2radec(rvec,&ra,&dec);
 			      darr[k-firstInd] = dec;
 			    }
 			  MPI_Ssend(darr,(int) NumRaysInChunk,MPI_DOUBLE,(int) firstTask,colnum,MPI_COMM_WORLD);
 			  ++colnum;
 			  
 			  for(k=firstInd;k<=lastInd;++k)
-			    darr[k-firstInd] = bundleCells[j].rays[k].A[2*0+0];
+			    darr[k-firstInd] = RAY_A(bundleCells[j],k,2*0+0);
 			  MPI_Ssend(darr,(int) NumRaysInChunk,MPI_DOUBLE,(int) firstTask,colnum,MPI_COMM_WORLD);
                           ++colnum;
 			  			  
 			  for(k=firstInd;k<=lastInd;++k)
-			    darr[k-firstInd] = bundleCells[j].rays[k].A[2*0+1];
+			    darr[k-firstInd] = RAY_A(bundleCells[j],k,2*0+1);
 			  MPI_Ssend(darr,(int) NumRaysInChunk,MPI_DOUBLE,(int) firstTask,colnum,MPI_COMM_WORLD);
 			  ++colnum;
 			  
 			  for(k=firstInd;k<=lastInd;++k)
-			    darr[k-firstInd] = bundleCells[j].rays[k].A[2*1+0];
+			    darr[k-firstInd] = RAY_A(bundleCells[j],k,2*1+0);
 			  MPI_Ssend(darr,(int) NumRaysInChunk,MPI_DOUBLE,(int) firstTask,colnum,MPI_COMM_WORLD);
 			  ++colnum;
 			  
 			  for(k=firstInd;k<=lastInd;++k)
-			    darr[k-firstInd] = bundleCells[j].rays[k].A[2*1+1];
+			    darr[k-firstInd] = RAY_A(bundleCells[j],k,2*1+1);
 			  MPI_Ssend(darr,(int) NumRaysInChunk,MPI_DOUBLE,(int) firstTask,colnum,MPI_COMM_WORLD);
 			  ++colnum;
 			  
 #ifdef OUTPUTRAYDEFLECTIONS
 			  for(k=firstInd;k<=lastInd;++k)
-			    darr[k-firstInd] = bundleCells[j].rays[k].alpha[0];
+			    darr[k-firstInd] = RAY_ALPHA(bundleCells[j],k,0);
 			  MPI_Ssend(darr,(int) NumRaysInChunk,MPI_DOUBLE,(int) firstTask,colnum,MPI_COMM_WORLD);
 			  ++colnum;
 			  
 			  for(k=firstInd;k<=lastInd;++k)
-			    darr[k-firstInd] = bundleCells[j].rays[k].alpha[1];
+			    darr[k-firstInd] = RAY_ALPHA(bundleCells[j],k,1);
 			  MPI_Ssend(darr,(int) NumRaysInChunk,MPI_DOUBLE,(int) firstTask,colnum,MPI_COMM_WORLD);
 			  ++colnum;
 #endif
 #ifdef OUTPUTPHI
 			  for(k=firstInd;k<=lastInd;++k)
-			    darr[k-firstInd] = bundleCells[j].rays[k].phi;
+			    darr[k-firstInd] = RAY_PHI(bundleCells[j],k);
 			  MPI_Ssend(darr,(int) NumRaysInChunk,MPI_DOUBLE,(int) firstTask,colnum,MPI_COMM_WORLD);
 			  ++colnum;
 #endif
@@ -612,7 +617,7 @@ static void file_write_rays2fits(long fileNum, long firstTask, long lastTask, MP
 			{
 			  colnum = 1;
 			  for(k=firstInd;k<=lastInd;++k)
-			    larr[k-firstInd] = bundleCells[j].rays[k].nest;
+			    larr[k-firstInd] = RAY_NEST(bundleCells[j],k);
 			  fits_write_col(fptr,TLONG,colnum,firstrow,firstelem,nelements,larr,&status);
 			  if(status)
 			    fits_report_error(stderr,status);
@@ -620,7 +625,10 @@ static void file_write_rays2fits(long fileNum, long firstTask, long lastTask, MP
 			  
 			  for(k=firstInd;k<=lastInd;++k)
 			    {
-			      vec2radec(bundleCells[j].rays[k].n,&ra,&dec);
+			      rvec[0] = RAY_N(bundleCells[j],k,0);
+			      rvec[1] = RAY_N(bundleCells[j],k,1);
+			      rvec[2] = RAY_N(bundleCells[j],k,2);
+			      vec2radec(rvec,&ra,&dec);
 			      darr[k-firstInd] = ra;
 			    }
 			  fits_write_col(fptr,TDOUBLE,colnum,firstrow,firstelem,nelements,darr,&status);
@@ -630,7 +638,10 @@ static void file_write_rays2fits(long fileNum, long firstTask, long lastTask, MP
 			  
 			  for(k=firstInd;k<=lastInd;++k)
 			    {
-			      vec2radec(bundleCells[j].rays[k].n,&ra,&dec);
+			      rvec[0] = RAY_N(bundleCells[j],k,0);
+			      rvec[1] = RAY_N(bundleCells[j],k,1);
+			      rvec[2] = RAY_N(bundleCells[j],k,2);
+			      vec2radec(rvec,&ra,&dec);
 			      darr[k-firstInd] = dec;
 			    }
 			  fits_write_col(fptr,TDOUBLE,colnum,firstrow,firstelem,nelements,darr,&status);
@@ -639,28 +650,28 @@ static void file_write_rays2fits(long fileNum, long firstTask, long lastTask, MP
 			  ++colnum;
 			  
 			  for(k=firstInd;k<=lastInd;++k)
-			    darr[k-firstInd] = bundleCells[j].rays[k].A[2*0+0];
+			    darr[k-firstInd] = RAY_A(bundleCells[j],k,2*0+0);
 			  fits_write_col(fptr,TDOUBLE,colnum,firstrow,firstelem,nelements,darr,&status);
 			  if(status)
 			    fits_report_error(stderr,status);
 			  ++colnum;
 			  
 			  for(k=firstInd;k<=lastInd;++k)
-			    darr[k-firstInd] = bundleCells[j].rays[k].A[2*0+1];
+			    darr[k-firstInd] = RAY_A(bundleCells[j],k,2*0+1);
 			  fits_write_col(fptr,TDOUBLE,colnum,firstrow,firstelem,nelements,darr,&status);
 			  if(status)
 			    fits_report_error(stderr,status);
 			  ++colnum;
 			  
 			  for(k=firstInd;k<=lastInd;++k)
-			    darr[k-firstInd] = bundleCells[j].rays[k].A[2*1+0];
+			    darr[k-firstInd] = RAY_A(bundleCells[j],k,2*1+0);
 			  fits_write_col(fptr,TDOUBLE,colnum,firstrow,firstelem,nelements,darr,&status);
 			  if(status)
 			    fits_report_error(stderr,status);
 			  ++colnum;
 			  
 			  for(k=firstInd;k<=lastInd;++k)
-			    darr[k-firstInd] = bundleCells[j].rays[k].A[2*1+1];
+			    darr[k-firstInd] = RAY_A(bundleCells[j],k,2*1+1);
 			  fits_write_col(fptr,TDOUBLE,colnum,firstrow,firstelem,nelements,darr,&status);
 			  if(status)
 			    fits_report_error(stderr,status);
@@ -668,14 +679,14 @@ static void file_write_rays2fits(long fileNum, long firstTask, long lastTask, MP
 			  
 #ifdef OUTPUTRAYDEFLECTIONS
 			  for(k=firstInd;k<=lastInd;++k)
-			    darr[k-firstInd] = bundleCells[j].rays[k].alpha[0];
+			    darr[k-firstInd] = RAY_ALPHA(bundleCells[j],k,0);
 			  fits_write_col(fptr,TDOUBLE,colnum,firstrow,firstelem,nelements,darr,&status);
 			  if(status)
 			    fits_report_error(stderr,status);
 			  ++colnum;
 			  
 			  for(k=firstInd;k<=lastInd;++k)
-			    darr[k-firstInd] = bundleCells[j].rays[k].alpha[1];
+			    darr[k-firstInd] = RAY_ALPHA(bundleCells[j],k,1);
 			  fits_write_col(fptr,TDOUBLE,colnum,firstrow,firstelem,nelements,darr,&status);
 			  if(status)
 			    fits_report_error(stderr,status);
@@ -683,7 +694,7 @@ static void file_write_rays2fits(long fileNum, long firstTask, long lastTask, MP
 #endif
 #ifdef OUTPUTPHI
 			  for(k=firstInd;k<=lastInd;++k)
-			    darr[k-firstInd] = bundleCells[j].rays[k].phi;
+			    darr[k-firstInd] = RAY_PHI(bundleCells[j],k);
 			  fits_write_col(fptr,TDOUBLE,colnum,firstrow,firstelem,nelements,darr,&status);
 			  if(status)
 			    fits_report_error(stderr,status);
@@ -835,7 +846,7 @@ static void file_write_rays2bin(long fileNum, long firstTask, long lastTask, MPI
   
   char *chunkRays;
   long k,chunkInd,firstInd,lastInd,NumRaysInChunkBase,NumRaysInChunk,NumChunks;
-  double ra,dec;
+  double ra,dec,rvec[3];
   long nw=0,nwg=0,nwc=0,NtotToRecv;
   
   struct IOheader {
@@ -982,22 +993,25 @@ static void file_write_rays2bin(long fileNum, long firstTask, long lastTask, MPI
 		      for(k=firstInd;k<=lastInd;++k)
 			{
 			  ++nw;
-			  vec2radec(bundleCells[j].rays[k].n,&ra,&dec);
+			  rvec[0] = RAY_N(bundleCells[j],k,0);
+			  rvec[1] = RAY_N(bundleCells[j],k,1);
+			  rvec[2] = RAY_N(bundleCells[j],k,2);
+			  vec2radec(rvec,&ra,&dec);
 			  
-			  *((long*) (&(chunkRays[(k-firstInd)*rays]))) = bundleCells[j].rays[k].nest;
+			  *((long*) (&(chunkRays[(k-firstInd)*rays]))) = RAY_NEST(bundleCells[j],k);
 			  *((double*) (&(chunkRays[(k-firstInd)*rays + sizeof(long)]))) = ra;
 			  *((double*) (&(chunkRays[(k-firstInd)*rays + sizeof(long) + sizeof(double)]))) = dec;
-			  *((double*) (&(chunkRays[(k-firstInd)*rays + sizeof(long) + 2*sizeof(double)]))) = bundleCells[j].rays[k].A[0];
-			  *((double*) (&(chunkRays[(k-firstInd)*rays + sizeof(long) + 2*sizeof(double) + sizeof(double)]))) = bundleCells[j].rays[k].A[1];
-			  *((double*) (&(chunkRays[(k-firstInd)*rays + sizeof(long) + 2*sizeof(double) + 2*sizeof(double)]))) = bundleCells[j].rays[k].A[2];
-			  *((double*) (&(chunkRays[(k-firstInd)*rays + sizeof(long) + 2*sizeof(double) + 3*sizeof(double)]))) = bundleCells[j].rays[k].A[3];
+			  *((double*) (&(chunkRays[(k-firstInd)*rays + sizeof(long) + 2*sizeof(double)]))) = RAY_A(bundleCells[j],k,0);
+			  *((double*) (&(chunkRays[(k-firstInd)*rays + sizeof(long) + 2*sizeof(double) + sizeof(double)]))) = RAY_A(bundleCells[j],k,1);
+			  *((double*) (&(chunkRays[(k-firstInd)*rays + sizeof(long) + 2*sizeof(double) + 2*sizeof(double)]))) = RAY_A(bundleCells[j],k,2);
+			  *((double*) (&(chunkRays[(k-firstInd)*rays + sizeof(long) + 2*sizeof(double) + 3*sizeof(double)]))) = RAY_A(bundleCells[j],k,3);
 			  
 #ifdef OUTPUTRAYDEFLECTIONS
-			  *((double*) (&(chunkRays[(k-firstInd)*rays + sizeof(long) + 2*sizeof(double) + 4*sizeof(double)]))) = bundleCells[j].rays[k].alpha[0];
-			  *((double*) (&(chunkRays[(k-firstInd)*rays + sizeof(long) + 2*sizeof(double) + 4*sizeof(double) + sizeof(double)]))) = bundleCells[j].rays[k].alpha[1];
+			  *((double*) (&(chunkRays[(k-firstInd)*rays + sizeof(long) + 2*sizeof(double) + 4*sizeof(double)]))) = RAY_ALPHA(bundleCells[j],k,0);
+			  *((double*) (&(chunkRays[(k-firstInd)*rays + sizeof(long) + 2*sizeof(double) + 4*sizeof(double) + sizeof(double)]))) = RAY_ALPHA(bundleCells[j],k,1);
 #endif
 #ifdef OUTPUTPHI
-			  *((double*) (&(chunkRays[(k-firstInd)*rays + sizeof(long) + 2*sizeof(double) + 4*sizeof(double) + 2*sizeof(double)]))) = bundleCells[j].rays[k].phi;
+			  *((double*) (&(chunkRays[(k-firstInd)*rays + sizeof(long) + 2*sizeof(double) + 4*sizeof(double) + 2*sizeof(double)]))) = RAY_PHI(bundleCells[j],k);
 #endif
 			}
 		      
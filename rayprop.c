@@ -12,13 +12,119 @@
 
 #include "raytrace.h"
 
+/* # of rays handed to a thread at once when propagating rays in threads */
+#define RAYPROP_BLOCKSIZE 4096
+
+typedef struct {
+  HEALPixBundleCell *bc;
+  long firstRay;
+  long Nrays;
+} RayPropBlock;
+
+static void rayprop_sphere_rays(double wp, double wpm1, double wpm2, HEALPixBundleCell *bc, long firstRay, long Nrays);
+
+/* the non-Born ray propagation is done RAYPROP_NLANES rays at a time with the batched kernel below
+   
+   All of the math for a batch (deflection rotation, step to the next plane, parallel transport of A and Aprev) 
+   is inlined and written as plain loops over the lanes in a batch so that the compiler can turn them into 
+   SIMD instructions. Set -march (e.g., -mavx2 or -march=native) in OPTIMIZE to get AVX2/AVX-512 code. Rays left 
+   over at the end of a block are done with the scalar code. Define SCALAR_RAYPROP to always use the scalar code.
+   
+   The kernel does the same floating point operations in the same order as the scalar code, so the two agree 
+   bit-for-bit unless the compiler contracts operations into FMAs differently for the two paths 
+   (i.e. -ffp-contract=fast, the gcc default, with FMA hardware). In that case ray positions and directions 
+   agree to a relative tolerance of ~1e-15 and components of A and Aprev agree to ~1e-15 relative to the 
+   norm of the matrix (small off-diagonal terms can differ by more than this in a relative sense).
+*/
+#if !defined(BORNAPPRX) && !defined(SCALAR_RAYPROP)
+#ifndef RAYPROP_NLANES
+#define RAYPROP_NLANES 8
+#endif
+static void rayprop_sphere_rays_batch(double wp, double wpm1, double wpm2, HEALPixBundleCell *bc, long firstRay);
+#endif
+
+/*
+  propagates rays in all active bundle cells for this task
+  
+  work is split into blocks of at most RAYPROP_BLOCKSIZE rays so that large bundle cells 
+  can be spread over more than one thread when USE_OPENMP is defined
+  the per-thread time is logged to PROFILETAG_RAYPROP
+*/
+void rayprop_sphere_bundlecells(double wp, double wpm1, double wpm2)
+{
+  long i,j,NumBlocks;
+  RayPropBlock *blocks;
+  
+  NumBlocks = 0;
+  for(i=0;i<NbundleCells;++i)
+    if(ISSETBITFLAG(bundleCells[i].active,PRIMARY_BUNDLECELL))
+      NumBlocks += (bundleCells[i].Nrays + RAYPROP_BLOCKSIZE - 1)/RAYPROP_BLOCKSIZE;
+  
+  if(NumBlocks == 0)
+    return;
+  
+  blocks = (RayPropBlock*)malloc(sizeof(RayPropBlock)*NumBlocks);
+  assert(blocks != NULL);
+  
+  NumBlocks = 0;
+  for(i=0;i<NbundleCells;++i)
+    {
+      if(ISSETBITFLAG(bundleCells[i].active,PRIMARY_BUNDLECELL))
+	{
+	  for(j=0;j<bundleCells[i].Nrays;j+=RAYPROP_BLOCKSIZE)
+	    {
+	      blocks[NumBlocks].bc = &(bundleCells[i]);
+	      blocks[NumBlocks].firstRay = j;
+	      if(bundleCells[i].Nrays - j < RAYPROP_BLOCKSIZE)
+		blocks[NumBlocks].Nrays = bundleCells[i].Nrays - j;
+	      else
+		blocks[NumBlocks].Nrays = RAYPROP_BLOCKSIZE;
+	      ++NumBlocks;
+	    }
+	}
+    }
+  
+#ifdef USE_OPENMP
+#pragma omp parallel default(none) shared(blocks,NumBlocks,wp,wpm1,wpm2)
+  {
+    long k;
+    double t0 = omp_get_wtime();
+    
+#pragma omp for schedule(dynamic,1)
+    for(k=0;k<NumBlocks;++k)
+      rayprop_sphere_rays(wp,wpm1,wpm2,blocks[k].bc,blocks[k].firstRay,blocks[k].Nrays);
+    
+    addThreadTimeProfileTag(PROFILETAG_RAYPROP,omp_get_thread_num(),omp_get_wtime()-t0);
+  }
+#else
+  double t0 = MPI_Wtime();
+  for(i=0;i<NumBlocks;++i)
+    rayprop_sphere_rays(wp,wpm1,wpm2,blocks[i].bc,blocks[i].firstRay,blocks[i].Nrays);
+  addThreadTimeProfileTag(PROFILETAG_RAYPROP,0,MPI_Wtime()-t0);
+#endif
+  
+  free(blocks);
+}
+
 /*
   propagates rays using lensing potential phi 
 */
 void rayprop_sphere(double wp, double wpm1, double wpm2, long bundleCellInd)
+{
+  rayprop_sphere_rays(wp,wpm1,wpm2,&(bundleCells[bundleCellInd]),0,bundleCells[bundleCellInd].Nrays);
+}
+
+/*
+  propagates rays firstRay to firstRay+Nrays-1 of a bundle cell using lensing potential phi 
+  this routine only touches the rays passed to it so it can be called from threads
+*/
+static void rayprop_sphere_rays(double wp, double wpm1, double wpm2, HEALPixBundleCell *bc, long firstRay, long Nrays)
 {
   long i,n,m;
   HEALPixRay *ray;
+#ifdef RAYS_SOA
+  HEALPixRay rayloc;
+#endif
   double Ap[4],r;
   
 #ifndef BORNAPPRX
@@ -32,10 +138,21 @@ void rayprop_sphere(double wp, double wpm1, double wpm2, long bundleCellInd)
   double ttensor[2][2];
   double rttensor[2][2];
 #endif
-
-  for(i=0;i<bundleCells[bundleCellInd].Nrays;++i)
+  
+  i = firstRay;
+#if !defined(BORNAPPRX) && !defined(SCALAR_RAYPROP)
+  for(i=firstRay;i+RAYPROP_NLANES<=firstRay+Nrays;i+=RAYPROP_NLANES)
+    rayprop_sphere_rays_batch(wp,wpm1,wpm2,bc,i);
+#endif
+  
+  for(;i<firstRay+Nrays;++i)
     {
-      ray = &(bundleCells[bundleCellInd].rays[i]);
+#ifdef RAYS_SOA
+      get_ray(bc,i,&rayloc);
+      ray = &rayloc;
+#else
+      ray = &(bc->rays[i]);
+#endif
       
 #ifdef BORNAPPRX
       //change pos
@@ -185,5 +302,310 @@ void rayprop_sphere(double wp, double wpm1, double wpm2, long bundleCellInd)
       ray->n[0] *= r;
       ray->n[1] *= r;
       ray->n[2] *= r;
+      
+#ifdef RAYS_SOA
+      set_ray(bc,i,ray);
+#endif
+    }
+}
+
+#if !defined(BORNAPPRX) && !defined(SCALAR_RAYPROP)
+/*
+  propagates rays firstRay to firstRay+RAYPROP_NLANES-1 of a bundle cell using lensing potential phi - see the comments at the top of the file
+  
+  this is the same computation as the non-Born branch of rayprop_sphere_rays with 
+  generate_rotmat_axis_angle_countercw and paratrans_tangtensor written out explicitly
+  the rotation angle psi for the parallel transport is computed once and used for both A and Aprev
+  rays with no deflection take the same steps as the others and then have their results replaced
+*/
+static void rayprop_sphere_rays_batch(double wp, double wpm1, double wpm2, HEALPixBundleCell *bc, long firstRay)
+{
+  long l;
+  struct {
+    HEALPixRay *rays;
+    long Nrays;
+  } cell;
+  double n0[RAYPROP_NLANES],n1[RAYPROP_NLANES],n2[RAYPROP_NLANES];
+  double b0[RAYPROP_NLANES],b1[RAYPROP_NLANES],b2[RAYPROP_NLANES];
+  double np0[RAYPROP_NLANES],np1[RAYPROP_NLANES],np2[RAYPROP_NLANES];
+  double bp0[RAYPROP_NLANES],bp1[RAYPROP_NLANES],bp2[RAYPROP_NLANES];
+  double ax0[RAYPROP_NLANES],ax1[RAYPROP_NLANES],ax2[RAYPROP_NLANES];
+  double A0[RAYPROP_NLANES],A1[RAYPROP_NLANES],A2[RAYPROP_NLANES],A3[RAYPROP_NLANES];
+  double Aprev0[RAYPROP_NLANES],Aprev1[RAYPROP_NLANES],Aprev2[RAYPROP_NLANES],Aprev3[RAYPROP_NLANES];
+  double U0[RAYPROP_NLANES],U1[RAYPROP_NLANES],U2[RAYPROP_NLANES],U3[RAYPROP_NLANES];
+  double alpha0[RAYPROP_NLANES],alpha1[RAYPROP_NLANES],alpha[RAYPROP_NLANES];
+  double cosalpha[RAYPROP_NLANES],sinalpha[RAYPROP_NLANES];
+  double cospsi[RAYPROP_NLANES],sinpsi[RAYPROP_NLANES];
+  
+  //these are the same expressions used in the scalar code so the values are identical
+  const double cAprev = (1.0 - wpm1*(wp - wpm2)/wp/(wpm1-wpm2));
+  const double cA = (wpm1*(wp - wpm2)/wp/(wpm1-wpm2));
+  const double cU = ((wp-wpm1)/wp);
+  
+  //the ray stores below could alias *bc, so keep the ray pointer and count in a local copy
+  cell.rays = bc->rays;
+  cell.Nrays = bc->Nrays;
+  
+  //gather ray info into lanes
+  for(l=0;l<RAYPROP_NLANES;++l)
+    {
+      n0[l] = RAY_N(cell,firstRay+l,0);
+      n1[l] = RAY_N(cell,firstRay+l,1);
+      n2[l] = RAY_N(cell,firstRay+l,2);
+      b0[l] = RAY_BETA(cell,firstRay+l,0);
+      b1[l] = RAY_BETA(cell,firstRay+l,1);
+      b2[l] = RAY_BETA(cell,firstRay+l,2);
+      alpha0[l] = RAY_ALPHA(cell,firstRay+l,0);
+      alpha1[l] = RAY_ALPHA(cell,firstRay+l,1);
+      A0[l] = RAY_A(cell,firstRay+l,0);
+      A1[l] = RAY_A(cell,firstRay+l,1);
+      A2[l] = RAY_A(cell,firstRay+l,2);
+      A3[l] = RAY_A(cell,firstRay+l,3);
+      Aprev0[l] = RAY_APREV(cell,firstRay+l,0);
+      Aprev1[l] = RAY_APREV(cell,firstRay+l,1);
+      Aprev2[l] = RAY_APREV(cell,firstRay+l,2);
+      Aprev3[l] = RAY_APREV(cell,firstRay+l,3);
+      U0[l] = RAY_U(cell,firstRay+l,0);
+      U1[l] = RAY_U(cell,firstRay+l,1);
+      U2[l] = RAY_U(cell,firstRay+l,2);
+      U3[l] = RAY_U(cell,firstRay+l,3);
+    }
+  
+  //get rotation axis n x a for beta
+  for(l=0;l<RAYPROP_NLANES;++l)
+    {
+      double phihat0,phihat1,phihat2,thetahat0,thetahat1,thetahat2;
+      double a0,a1,a2,norm;
+      
+      alpha[l] = sqrt(alpha0[l]*alpha0[l] + alpha1[l]*alpha1[l]);
+      
+      //get theta-phi unit vectors at ray location
+      phihat0 = -1.0*n1[l];
+      phihat1 = n0[l];
+      phihat2 = 0.0;
+      norm = sqrt(phihat0*phihat0 + phihat1*phihat1);
+      phihat0 /= norm;
+      phihat1 /= norm;
+      
+      thetahat0 = n2[l]*n0[l];
+      thetahat1 = n2[l]*n1[l];
+      thetahat2 = -1.0*(n0[l]*n0[l] + n1[l]*n1[l]);
+      norm = sqrt(thetahat0*thetahat0 + thetahat1*thetahat1 + thetahat2*thetahat2);
+      thetahat0 /= norm;
+      thetahat1 /= norm;
+      thetahat2 /= norm;
+      
+      //get alpha in vector form
+      a0 = alpha0[l]*thetahat0 + alpha1[l]*phihat0;
+      a1 = alpha0[l]*thetahat1 + alpha1[l]*phihat1;
+      a2 = alpha0[l]*thetahat2 + alpha1[l]*phihat2;
+      
+      //compute nxa and norm of a
+      ax0[l] = n1[l]*a2 - n2[l]*a1;
+      ax1[l] = n2[l]*a0 - n0[l]*a2;
+      ax2[l] = n0[l]*a1 - n1[l]*a0;
+      norm = sqrt(ax0[l]*ax0[l] + ax1[l]*ax1[l] + ax2[l]*ax2[l]);
+      ax0[l] /= norm;
+      ax1[l] /= norm;
+      ax2[l] /= norm;
+    }
+  
+  //trig functions are kept in their own loop so that the loops around them can still be vectorized
+  for(l=0;l<RAYPROP_NLANES;++l)
+    {
+      sinalpha[l] = sin(alpha[l]);
+      cosalpha[l] = cos(alpha[l]);
+    }
+  
+  //rot beta and step to next plane
+  for(l=0;l<RAYPROP_NLANES;++l)
+    {
+      double R00,R01,R02,R10,R11,R12,R20,R21,R22;
+      double c,s,omc,rb0,rb1,rb2;
+      double q,qa,qb,qc,lambda;
+      
+      c = cosalpha[l];
+      s = sinalpha[l];
+      omc = (1.0 - c);
+      
+      R00 = c + ax0[l]*ax0[l]*omc;
+      R01 = ax0[l]*ax1[l]*omc - ax2[l]*s;
+      R02 = ax0[l]*ax2[l]*omc + ax1[l]*s;
+      R10 = ax1[l]*ax0[l]*omc + ax2[l]*s;
+      R11 = c + ax1[l]*ax1[l]*omc;
+      R12 = ax1[l]*ax2[l]*omc - ax0[l]*s;
+      R20 = ax2[l]*ax0[l]*omc - ax1[l]*s;
+      R21 = ax2[l]*ax1[l]*omc + ax0[l]*s;
+      R22 = c + ax2[l]*ax2[l]*omc;
+      
+      rb0 = R00*b0[l];
+      rb0 += R01*b1[l];
+      rb0 += R02*b2[l];
+      rb1 = R10*b0[l];
+      rb1 += R11*b1[l];
+      rb1 += R12*b2[l];
+      rb2 = R20*b0[l];
+      rb2 += R21*b1[l];
+      rb2 += R22*b2[l];
+      
+      //get lambda
+      qa = 1.0;
+      qb = 2.0*(n0[l]*rb0 + n1[l]*rb1 + n2[l]*rb2);
+      qc = wpm1*wpm1 - wp*wp;
+      q = -0.5*(qb + qb/fabs(qb)*sqrt(qb*qb - 4.0*qa*qc));
+      lambda = qc/q;
+      lambda = (lambda < 0.0) ? q/qa : lambda;
+      
+      //get new ray loc - rays w/o a deflection just move radially
+      if(alpha[l] > 0.0)
+	{
+	  bp0[l] = rb0;
+	  bp1[l] = rb1;
+	  bp2[l] = rb2;
+	  np0[l] = n0[l] + rb0*lambda;
+	  np1[l] = n1[l] + rb1*lambda;
+	  np2[l] = n2[l] + rb2*lambda;
+	}
+      else
+	{
+	  bp0[l] = b0[l];
+	  bp1[l] = b1[l];
+	  bp2[l] = b2[l];
+	  np0[l] = n0[l]/wpm1*wp;
+	  np1[l] = n1[l]/wpm1*wp;
+	  np2[l] = n2[l]/wpm1*wp;
+	}
+    }
+  
+  //get parallel transport angle psi from n to np
+  for(l=0;l<RAYPROP_NLANES;++l)
+    {
+      double v0,v1,v2,rv0,rv1,rv2,norm;
+      double a0,a1,a2,cosangle,sinangle;
+      double p0,p1,p2,axisdotvec,axiscrossvec0,axiscrossvec1,axiscrossvec2;
+      double rephi0,rephi1,rephi2,ephi0,ephi1,ephi2,etheta0,etheta1,etheta2;
+      
+      norm = sqrt(n0[l]*n0[l] + n1[l]*n1[l] + n2[l]*n2[l]);
+      v0 = n0[l]/norm;
+      v1 = n1[l]/norm;
+      v2 = n2[l]/norm;
+      
+      norm = sqrt(np0[l]*np0[l] + np1[l]*np1[l] + np2[l]*np2[l]);
+      rv0 = np0[l]/norm;
+      rv1 = np1[l]/norm;
+      rv2 = np2[l]/norm;
+      
+      a0 = v1*rv2 - v2*rv1;
+      a1 = v2*rv0 - v0*rv2;
+      a2 = v0*rv1 - v1*rv0;
+      cosangle = v0*rv0 + v1*rv1 + v2*rv2;
+      sinangle = sqrt(a0*a0 + a1*a1 + a2*a2);
+      if(sinangle != 0.0)
+	{
+	  a0 /= sinangle;
+	  a1 /= sinangle;
+	  a2 /= sinangle;
+	}
+      else
+	{
+	  a0 = 1.0;
+	  a1 = 0.0;
+	  a2 = 0.0;
+	}
+      
+      //rotate phi unit vector at n to np
+      p0 = -v1;
+      p1 = v0;
+      p2 = 0.0;
+      axisdotvec = a0*p0 + a1*p1 + a2*p2;
+      axiscrossvec0 = a1*p2 - a2*p1;
+      axiscrossvec1 = a2*p0 - a0*p2;
+      axiscrossvec2 = a0*p1 - a1*p0;
+      rephi0 = p0*cosangle + a0*axisdotvec*(1.0 - cosangle) + axiscrossvec0*sinangle;
+      rephi1 = p1*cosangle + a1*axisdotvec*(1.0 - cosangle) + axiscrossvec1*sinangle;
+      rephi2 = p2*cosangle + a2*axisdotvec*(1.0 - cosangle) + axiscrossvec2*sinangle;
+      
+      ephi0 = -rv1;
+      ephi1 = rv0;
+      ephi2 = 0.0;
+      
+      etheta0 = rv2*rv0;
+      etheta1 = rv2*rv1;
+      etheta2 = -1.0*(rv0*rv0 + rv1*rv1);
+      
+      norm = sqrt((1.0 - rv2)*(1.0 + rv2)*(1.0 - v2)*(1.0 + v2));
+      
+      sinpsi[l] = (rephi0*etheta0 + rephi1*etheta1 + rephi2*etheta2)/norm;
+      cospsi[l] = (rephi0*ephi0 + rephi1*ephi1 + rephi2*ephi2)/norm;
+    }
+  
+  //update A, shift ray info and parallel transport tensors
+  for(l=0;l<RAYPROP_NLANES;++l)
+    {
+      double Ap0,Ap1,Ap2,Ap3;
+      double c,s,ms,t00,t01,t10,t11;
+      
+      Ap0 = cAprev*Aprev0[l] + cA*A0[l] - cU*(U0[l]*A0[l] + U1[l]*A2[l]);
+      Ap1 = cAprev*Aprev1[l] + cA*A1[l] - cU*(U0[l]*A1[l] + U1[l]*A3[l]);
+      Ap2 = cAprev*Aprev2[l] + cA*A2[l] - cU*(U2[l]*A0[l] + U3[l]*A2[l]);
+      Ap3 = cAprev*Aprev3[l] + cA*A3[l] - cU*(U2[l]*A1[l] + U3[l]*A3[l]);
+      
+      /* T' = R x T x Transpose(R) with
+	 R = |  cos(psi) sin(psi) |
+	     | -sin(psi) cos(psi) |
+      */
+      c = cospsi[l];
+      s = sinpsi[l];
+      ms = -1.0*s;
+      
+      //old A becomes Aprev
+      t00 = A0[l]*c + A1[l]*s;
+      t01 = A0[l]*ms + A1[l]*c;
+      t10 = A2[l]*c + A3[l]*s;
+      t11 = A2[l]*ms + A3[l]*c;
+      Aprev0[l] = c*t00 + s*t10;
+      Aprev1[l] = c*t01 + s*t11;
+      Aprev2[l] = ms*t00 + c*t10;
+      Aprev3[l] = ms*t01 + c*t11;
+      
+      t00 = Ap0*c + Ap1*s;
+      t01 = Ap0*ms + Ap1*c;
+      t10 = Ap2*c + Ap3*s;
+      t11 = Ap2*ms + Ap3*c;
+      A0[l] = c*t00 + s*t10;
+      A1[l] = c*t01 + s*t11;
+      A2[l] = ms*t00 + c*t10;
+      A3[l] = ms*t01 + c*t11;
+    }
+  
+  //make sure ray loc is properly normalized and scatter back to rays
+  for(l=0;l<RAYPROP_NLANES;++l)
+    {
+      double r;
+      
+      r = sqrt(np0[l]*np0[l] + np1[l]*np1[l] + np2[l]*np2[l]);
+      r = wp/r;
+      np0[l] *= r;
+      np1[l] *= r;
+      np2[l] *= r;
+    }
+  
+  for(l=0;l<RAYPROP_NLANES;++l)
+    {
+      RAY_N(cell,firstRay+l,0) = np0[l];
+      RAY_N(cell,firstRay+l,1) = np1[l];
+      RAY_N(cell,firstRay+l,2) = np2[l];
+      RAY_BETA(cell,firstRay+l,0) = bp0[l];
+      RAY_BETA(cell,firstRay+l,1) = bp1[l];
+      RAY_BETA(cell,firstRay+l,2) = bp2[l];
+      RAY_A(cell,firstRay+l,0) = A0[l];
+      RAY_A(cell,firstRay+l,1) = A1[l];
+      RAY_A(cell,firstRay+l,2) = A2[l];
+      RAY_A(cell,firstRay+l,3) = A3[l];
+      RAY_APREV(cell,firstRay+l,0) = Aprev0[l];
+      RAY_APREV(cell,firstRay+l,1) = Aprev1[l];
+      RAY_APREV(cell,firstRay+l,2) = Aprev2[l];
+      RAY_APREV(cell,firstRay+l,3) = Aprev3[l];
     }
 }
+#endif
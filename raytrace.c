@@ -89,6 +89,9 @@ void raytrace(void)
       logProfileTag(PROFILETAG_GALIO);
     }
   
+  //lens plane file layout
+  prep_lens_plane_reads();
+  
   //timers for restart 
   restTime = MPI_Wtime();
   startTime = MPI_Wtime();
@@ -170,15 +173,15 @@ void raytrace(void)
 	    {
 	      for(j=0;j<bundleCells[i].Nrays;++j)
 		{
-		  bundleCells[i].rays[j].phi = 0.0;
+		  RAY_PHI(bundleCells[i],j) = 0.0;
 		  
-		  bundleCells[i].rays[j].alpha[0] = 0.0;
-		  bundleCells[i].rays[j].alpha[1] = 0.0;
+		  RAY_ALPHA(bundleCells[i],j,0) = 0.0;
+		  RAY_ALPHA(bundleCells[i],j,1) = 0.0;
 		  
-		  bundleCells[i].rays[j].U[0] = 0.0;
-		  bundleCells[i].rays[j].U[1] = 0.0;
-		  bundleCells[i].rays[j].U[2] = 0.0;
-		  bundleCells[i].rays[j].U[3] = 0.0;
+		  RAY_U(bundleCells[i],j,0) = 0.0;
+		  RAY_U(bundleCells[i],j,1) = 0.0;
+		  RAY_U(bundleCells[i],j,2) = 0.0;
+		  RAY_U(bundleCells[i],j,3) = 0.0;
 		}
 	    }
 	}
@@ -202,17 +205,10 @@ void raytrace(void)
 	  logProfileTag(PROFILETAG_RAYIO);
 	}
       
-      //ray propagation is done for each active (bit 0 set) bundleCell
-      for(i=0;i<NbundleCells;++i)
-	{
-	  if(ISSETBITFLAG(bundleCells[i].active,PRIMARY_BUNDLECELL))
-	    {
-	      //do ray propagation
-	      logProfileTag(PROFILETAG_RAYPROP);
-	      rayprop_sphere(rayTraceData.planeRadPlus1,rayTraceData.planeRad,rayTraceData.planeRadMinus1,i);
-	      logProfileTag(PROFILETAG_RAYPROP);
-	    }
-	}
+      //ray propagation is done for each active (bit 0 set) bundleCell - threaded over blocks of rays if USE_OPENMP is defined
+      logProfileTag(PROFILETAG_RAYPROP);
+      rayprop_sphere_bundlecells(rayTraceData.planeRadPlus1,rayTraceData.planeRad,rayTraceData.planeRadMinus1);
+      logProfileTag(PROFILETAG_RAYPROP);
       
       logProfileTag(PROFILETAG_STEPTIME);
       stepTime += MPI_Wtime();
@@ -259,6 +255,10 @@ void raytrace(void)
   destroy_rays();
   if(strlen(rayTraceData.GalsFileList) > 0)
     destroy_gals();
+  destroy_lcparts_prefetch();
+  destroy_lens_plane_reads();
+  destroy_mg_initguess();
+  destroy_mg_stencils();
   destroy_bundlecells();
   logProfileTag(PROFILETAG_INITEND_LOADBAL);
 }
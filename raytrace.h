@@ -1,6 +1,9 @@
 #include <fftw3.h>
 #include <mpi.h>
 #include <hdf5.h>
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
 
 #include "profile.h"
 #include "healpix_utils.h"
@@ -94,6 +97,9 @@
 #define TAG_POTCELL_IDS       61
 #define TAG_POTCELL_VALS      62
 
+#define TAG_IO_THROTTLE       63
+#define TAG_IO_THROTTLE_PF    64
+
 //constants
 #define RHO_CRIT 2.77519737e11  /* Critial mass density in h^2 M_sun/Mpc^3 with H_{0} = h 100 km/s/Mpc*/
 #define CSOL 299792.458         /* velocity of light in km/s */
@@ -156,6 +162,7 @@ typedef struct {
   double maxRayMemImbalance; /* controls max mem imbalance when trying to load balance CPU time for rays */
   char HEALPixRingWeightPath[MAX_FILENAME];
   char HEALPixWindowFunctionPath[MAX_FILENAME];
+  char SHTLoadBalancePath[MAX_FILENAME];
   long SHTOrder;
   double ComvSmoothingScale;
   double partMass;
@@ -163,6 +170,9 @@ typedef struct {
   long MaxNFFT;
   char ThreeDPotSnapList[MAX_FILENAME];
   double LengthConvFact;
+  double MaxPrefetchMemMB; /* max memory in MB per task for prefetching the next lens plane */
+  double MaxMGStencilMemMB; /* max memory in MB per task for caching the HEALPix interp stencils of the MG patches */
+  long MGInitGuess; /* initial guess for the MG patch solves - 0 SHT potential, 1 SHT potential plus the MG correction of the previous plane */
   
   /* for doing gals image search */
   char GalsFileList[MAX_FILENAME]; 
@@ -284,6 +294,48 @@ typedef struct {
   double cpuTime;
 } HEALPixBundleCell;
 
+/* ray field accessors
+   
+   By default the rays of a bundle cell are an array of HEALPixRay structs. If RAYS_SOA is defined, the 
+   block of memory holding the rays of each primary bundle cell is instead laid out field by field (all of the 
+   nest values, then all of the n[0] values, and so on) so that loops which only need a few fields stream 
+   through memory and can be vectorized. The block has the same size in both cases, so whole bundle cells can 
+   still be moved between tasks as raw bytes (see loadbalance.c). This requires sizeof(long) == sizeof(double).
+   
+   Code which works on the rays of primary bundle cells should use the macros below (bc is a 
+   HEALPixBundleCell, j is the ray index and k is the component) or get_ray/set_ray to copy a whole ray.
+   Rays written to restart files and the rays used by the grid search are always HEALPixRay structs.
+*/
+#ifdef RAYS_SOA
+#define RAYSOA_NEST     0
+#define RAYSOA_N        1
+#define RAYSOA_BETA     4
+#define RAYSOA_ALPHA    7
+#define RAYSOA_A        9
+#define RAYSOA_APREV    13
+#define RAYSOA_U        17
+#define RAYSOA_PHI      21
+#define RAYSOA_NFIELDS  22
+#define RAYSOA_FIELD(bc,f,j)   (((double*)((bc).rays))[(f)*((bc).Nrays) + (j)])
+#define RAY_NEST(bc,j)         (((long*)((bc).rays))[RAYSOA_NEST*((bc).Nrays) + (j)])
+#define RAY_N(bc,j,k)          RAYSOA_FIELD(bc,RAYSOA_N+(k),j)
+#define RAY_BETA(bc,j,k)       RAYSOA_FIELD(bc,RAYSOA_BETA+(k),j)
+#define RAY_ALPHA(bc,j,k)      RAYSOA_FIELD(bc,RAYSOA_ALPHA+(k),j)
+#define RAY_A(bc,j,k)          RAYSOA_FIELD(bc,RAYSOA_A+(k),j)
+#define RAY_APREV(bc,j,k)      RAYSOA_FIELD(bc,RAYSOA_APREV+(k),j)
+#define RAY_U(bc,j,k)          RAYSOA_FIELD(bc,RAYSOA_U+(k),j)
+#define RAY_PHI(bc,j)          RAYSOA_FIELD(bc,RAYSOA_PHI,j)
+#else
+#define RAY_NEST(bc,j)         ((bc).rays[(j)].nest)
+#define RAY_N(bc,j,k)          ((bc).rays[(j)].n[(k)])
+#define RAY_BETA(bc,j,k)       ((bc).rays[(j)].beta[(k)])
+#define RAY_ALPHA(bc,j,k)      ((bc).rays[(j)].alpha[(k)])
+#define RAY_A(bc,j,k)          ((bc).rays[(j)].A[(k)])
+#define RAY_APREV(bc,j,k)      ((bc).rays[(j)].Aprev[(k)])
+#define RAY_U(bc,j,k)          ((bc).rays[(j)].U[(k)])
+#define RAY_PHI(bc,j)          ((bc).rays[(j)].phi)
+#endif
+
 /* extern defs of global vars in globalvars.c */
 extern const char *ProfileTagNames[];
 extern RayTraceData rayTraceData;                        /* global struct with all vars from config file */
@@ -323,6 +375,8 @@ void cutsky_partdist_poissondriver(void);
 
 /* in mgpoissonsolve.c */
 void mgpoissonsolve(double densfact, double backdens);
+void destroy_mg_initguess(void);
+void destroy_mg_stencils(void);
 
 /* loadbalance.c */
 void load_balance_tasks(void);
@@ -358,9 +412,14 @@ void write_rays(void);
 /* in partio.c */
 /* in read_lensplanes_hdf5.c */
 void readRayTracingPlaneAtPeanoInds(long planeNum, long HEALPixOrder, long *PeanoIndsToRead, long NumPeanoIndsToRead, Part **LCParts, long *NumLCParts);
+void prep_lens_plane_reads(void);
+void destroy_lens_plane_reads(void);
 void read_lcparts_at_planenum_all(long planeNum);
 void read_lcparts_at_planenum_fullsky_partdist(long planeNum);
 void read_lcparts_at_planenum(long planeNum);
+void start_lcparts_prefetch(long planeNum);
+void progress_lcparts_prefetch(void);
+void destroy_lcparts_prefetch(void);
 
 /* in cosmocalc.h - distances - assumes flat lambda */
 void init_cosmocalc(void);
@@ -389,20 +448,43 @@ int test_vaccell(double ra, double dec);
 void alloc_rays(void);
 void init_rays(void);
 void destroy_rays(void);
+void get_ray(HEALPixBundleCell *bc, long j, HEALPixRay *ray);
+void set_ray(HEALPixBundleCell *bc, long j, HEALPixRay *ray);
+#ifdef RAYS_SOA
+void rays_aos2soa(HEALPixRay *rays, long Nrays);
+void rays_soa2aos(HEALPixRay *rays, long Nrays);
+void bundlecells_rays_aos2soa(void);
+void bundlecells_rays_soa2aos(void);
+#endif
 void init_bundlecells(void);
 void destroy_bundlecells(void);
 void destroy_gals(void);
 void destroy_parts(void);
 
+/* in radixsort.c */
+void radix_sort_index(const unsigned long *keys, long N, int nbits, long *order);
+void reorder_by_index(void *base, size_t size, long N, long *order);
+void sort_parts_bundlenest(Part *parts, long Nparts, int setNest);
+
 /* in ioutils.c */
 int strcmp_caseinsens(const char *s1, const char *s2);
 void getPeanoIndsToReadFromFile(long HEALPixOrder, long *PeanoIndsToRead, long NumPeanoIndsToRead,
                                 long FileHEALPixOrder, long **FilePeanoIndsToRead, long *NumFilePeanoIndsToRead);
+void cullLCPartsToPeanoInds(long HEALPixOrder, long *PeanoIndsToRead, long NumPeanoIndsToRead, Part **LCParts, long *NumLCParts);
 long fnumlines(FILE *fp);
 FILE *fopen_retry(const char *filename, const char *mode);
+void io_throttle_wait(long prevTask);
+void io_throttle_pass(long nextTask);
+void io_throttle_begin(void);
+void io_throttle_end(void);
+void io_throttle_post(int tag, MPI_Request *req);
+int io_throttle_test(MPI_Request *req, int block);
+void io_throttle_pass_tag(int tag);
+void io_throttle_report(const char *what);
 
 /* in rayprop.c */
 void rayprop_sphere(double wp, double wpm1, double wpm2, long bundleCellInd);
+void rayprop_sphere_bundlecells(double wp, double wpm1, double wpm2);
 
 /* in gridsearch.c */
 void gridsearch(double wpm1, double wpm2);
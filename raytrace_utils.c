@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <math.h>
 #include <assert.h>
+#include <string.h>
 #include <fftw3.h>
 #include <mpi.h>
 #include <hdf5.h>
@@ -32,7 +33,6 @@ void write_bundlecells2ascii(char fname_base[MAX_FILENAME])
   FILE *fp;
   long i,ring,npix;
   char fname[MAX_FILENAME];
-  long mygroup,currgroup,Ngroups;
   
   //first make dir for files
   if(ThisTask == 0)
@@ -48,29 +48,16 @@ void write_bundlecells2ascii(char fname_base[MAX_FILENAME])
   //now output the files to 6
   npix = order2npix(rayTraceData.bundleOrder);
   sprintf(fname,"%s/%s/%s.%04d",rayTraceData.OutputPath,fname_base,fname_base,ThisTask);  
-  mygroup = ThisTask/rayTraceData.NumFilesIOInParallel;
-  Ngroups = NTasks/rayTraceData.NumFilesIOInParallel;
-  if(Ngroups*rayTraceData.NumFilesIOInParallel != NTasks)
-    ++Ngroups;
-  
-  for(currgroup=0;currgroup<Ngroups;++currgroup)
+  io_throttle_begin();
+  fp = fopen(fname,"w");
+  fprintf(fp,"# nest nside dflags nparts nrays cpuTime\n");
+  for(i=0;i<npix;++i)
     {
-      if(mygroup == currgroup)
-        {
-	  fp = fopen(fname,"w");
-	  fprintf(fp,"# nest nside dflags nparts nrays cpuTime\n");
-	  for(i=0;i<npix;++i)
-	    {
-	      fprintf(fp,"%ld %ld %u %ld %ld %le\n",bundleCells[i].nest,order2nside(rayTraceData.bundleOrder),bundleCells[i].active,
-		      bundleCells[i].Nparts,bundleCells[i].Nrays,bundleCells[i].cpuTime);
-	    }
-	  fclose(fp);
-	}
-      
-      //////////////////////////////
-      MPI_Barrier(MPI_COMM_WORLD);
-      //////////////////////////////
+      fprintf(fp,"%ld %ld %u %ld %ld %le\n",bundleCells[i].nest,order2nside(rayTraceData.bundleOrder),bundleCells[i].active,
+	      bundleCells[i].Nparts,bundleCells[i].Nrays,bundleCells[i].cpuTime);
     }
+  fclose(fp);
+  io_throttle_end();
 }
 
 /* makes map cells and creates and index through the bundle cells for searching */
@@ -277,6 +264,9 @@ void alloc_rays(void)
     NumBuff = 10;
   MaxNumAllRaysGlobal = ((long) ((1.0 + rayTraceData.maxRayMemImbalance)*NrestrictedPeanoInd/NTasks))*NraysPerBundleCell 
     + NumBuff*NraysPerBundleCell;
+#ifdef RAYS_SOA
+  assert(sizeof(HEALPixRay) == RAYSOA_NFIELDS*sizeof(double) && sizeof(long) == sizeof(double));
+#endif
   AllRaysGlobal = (HEALPixRay*)malloc(sizeof(HEALPixRay)*MaxNumAllRaysGlobal);
   assert(AllRaysGlobal != NULL);
   NumAllRaysGlobal = 0;
@@ -303,6 +293,7 @@ void init_rays(void)
 {
   long i,shift,j,NraysPerBundleCell,rayNest;
   double binL_2 = rayTraceData.maxComvDistance/rayTraceData.NumLensPlanes/2.0;
+  HEALPixRay ray;
   
   shift = rayTraceData.rayOrder - rayTraceData.bundleOrder;
   shift = 2*shift;
@@ -317,32 +308,34 @@ void init_rays(void)
 	  rayNest = (bundleCells[i].nest << shift);
 	  for(j=0;j<NraysPerBundleCell;++j)
 	    {
-	      bundleCells[i].rays[j].nest = rayNest + j;
+	      ray.nest = rayNest + j;
 	      
-	      nest2vec(bundleCells[i].rays[j].nest,bundleCells[i].rays[j].beta,rayTraceData.rayOrder);
+	      nest2vec(ray.nest,ray.beta,rayTraceData.rayOrder);
 	      
-	      bundleCells[i].rays[j].n[0] = bundleCells[i].rays[j].beta[0]*binL_2;
-	      bundleCells[i].rays[j].n[1] = bundleCells[i].rays[j].beta[1]*binL_2;
-	      bundleCells[i].rays[j].n[2] = bundleCells[i].rays[j].beta[2]*binL_2;
+	      ray.n[0] = ray.beta[0]*binL_2;
+	      ray.n[1] = ray.beta[1]*binL_2;
+	      ray.n[2] = ray.beta[2]*binL_2;
 	      
-	      bundleCells[i].rays[j].A[0] = 1.0; //0+2*0
-	      bundleCells[i].rays[j].A[1] = 0.0; //1+2*0
-	      bundleCells[i].rays[j].A[2] = 0.0; //0+2*1
-	      bundleCells[i].rays[j].A[3] = 1.0; //1+2*1
-	      bundleCells[i].rays[j].Aprev[0] = 1.0; //0+2*0
-	      bundleCells[i].rays[j].Aprev[1] = 0.0; //1+2*0
-	      bundleCells[i].rays[j].Aprev[2] = 0.0; //0+2*1
-	      bundleCells[i].rays[j].Aprev[3] = 1.0; //1+2*1
+	      ray.A[0] = 1.0; //0+2*0
+	      ray.A[1] = 0.0; //1+2*0
+	      ray.A[2] = 0.0; //0+2*1
+	      ray.A[3] = 1.0; //1+2*1
+	      ray.Aprev[0] = 1.0; //0+2*0
+	      ray.Aprev[1] = 0.0; //1+2*0
+	      ray.Aprev[2] = 0.0; //0+2*1
+	      ray.Aprev[3] = 1.0; //1+2*1
 
-	      bundleCells[i].rays[j].phi = 0.0;
+	      ray.phi = 0.0;
 	      
-	      bundleCells[i].rays[j].alpha[0] = 0.0;
-	      bundleCells[i].rays[j].alpha[1] = 0.0;
+	      ray.alpha[0] = 0.0;
+	      ray.alpha[1] = 0.0;
 	      	      
-	      bundleCells[i].rays[j].U[0] = 0.0;
-	      bundleCells[i].rays[j].U[1] = 0.0;
-	      bundleCells[i].rays[j].U[2] = 0.0;
-	      bundleCells[i].rays[j].U[3] = 0.0;
+	      ray.U[0] = 0.0;
+	      ray.U[1] = 0.0;
+	      ray.U[2] = 0.0;
+	      ray.U[3] = 0.0;
+	      
+	      set_ray(&(bundleCells[i]),j,&ray);
 	    }
 	}
     }
@@ -355,6 +348,118 @@ void destroy_rays(void)
   NumAllRaysGlobal = 0;
 }
 
+/* copies ray j of a primary bundle cell into ray */
+void get_ray(HEALPixBundleCell *bc, long j, HEALPixRay *ray)
+{
+#ifdef RAYS_SOA
+  long k;
+  
+  ray->nest = RAY_NEST(*bc,j);
+  for(k=0;k<3;++k)
+    {
+      ray->n[k] = RAY_N(*bc,j,k);
+      ray->beta[k] = RAY_BETA(*bc,j,k);
+    }
+  ray->alpha[0] = RAY_ALPHA(*bc,j,0);
+  ray->alpha[1] = RAY_ALPHA(*bc,j,1);
+  for(k=0;k<4;++k)
+    {
+      ray->A[k] = RAY_A(*bc,j,k);
+      ray->Aprev[k] = RAY_APREV(*bc,j,k);
+      ray->U[k] = RAY_U(*bc,j,k);
+    }
+  ray->phi = RAY_PHI(*bc,j);
+#else
+  *ray = bc->rays[j];
+#endif
+}
+
+/* copies ray into ray j of a primary bundle cell */
+void set_ray(HEALPixBundleCell *bc, long j, HEALPixRay *ray)
+{
+#ifdef RAYS_SOA
+  long k;
+  
+  RAY_NEST(*bc,j) = ray->nest;
+  for(k=0;k<3;++k)
+    {
+      RAY_N(*bc,j,k) = ray->n[k];
+      RAY_BETA(*bc,j,k) = ray->beta[k];
+    }
+  RAY_ALPHA(*bc,j,0) = ray->alpha[0];
+  RAY_ALPHA(*bc,j,1) = ray->alpha[1];
+  for(k=0;k<4;++k)
+    {
+      RAY_A(*bc,j,k) = ray->A[k];
+      RAY_APREV(*bc,j,k) = ray->Aprev[k];
+      RAY_U(*bc,j,k) = ray->U[k];
+    }
+  RAY_PHI(*bc,j) = ray->phi;
+#else
+  bc->rays[j] = *ray;
+#endif
+}
+
+#ifdef RAYS_SOA
+/* converts a block of Nrays rays in place from an array of HEALPixRay structs to the field by field layout */
+void rays_aos2soa(HEALPixRay *rays, long Nrays)
+{
+  long j;
+  HEALPixRay *tmp;
+  HEALPixBundleCell bc;
+  
+  tmp = (HEALPixRay*)malloc(sizeof(HEALPixRay)*Nrays);
+  assert(tmp != NULL);
+  memcpy(tmp,rays,sizeof(HEALPixRay)*Nrays);
+  
+  bc.rays = rays;
+  bc.Nrays = Nrays;
+  for(j=0;j<Nrays;++j)
+    set_ray(&bc,j,&(tmp[j]));
+  
+  free(tmp);
+}
+
+/* converts a block of Nrays rays in place from the field by field layout to an array of HEALPixRay structs */
+void rays_soa2aos(HEALPixRay *rays, long Nrays)
+{
+  long j;
+  HEALPixRay *tmp;
+  HEALPixBundleCell bc;
+  
+  tmp = (HEALPixRay*)malloc(sizeof(HEALPixRay)*Nrays);
+  assert(tmp != NULL);
+  
+  bc.rays = rays;
+  bc.Nrays = Nrays;
+  for(j=0;j<Nrays;++j)
+    get_ray(&bc,j,&(tmp[j]));
+  
+  memcpy(rays,tmp,sizeof(HEALPixRay)*Nrays);
+  free(tmp);
+}
+
+/* converts the rays of all primary bundle cells to the field by field layout */
+void bundlecells_rays_aos2soa(void)
+{
+  long i;
+  
+  for(i=0;i<NbundleCells;++i)
+    if(ISSETBITFLAG(bundleCells[i].active,PRIMARY_BUNDLECELL) && bundleCells[i].Nrays > 0)
+      rays_aos2soa(bundleCells[i].rays,bundleCells[i].Nrays);
+}
+
+/* converts the rays of all primary bundle cells to arrays of HEALPixRay structs */
+void bundlecells_rays_soa2aos(void)
+{
+  long i;
+  
+  for(i=0;i<NbundleCells;++i)
+    if(ISSETBITFLAG(bundleCells[i].active,PRIMARY_BUNDLECELL) && bundleCells[i].Nrays > 0)
+      rays_soa2aos(bundleCells[i].rays,bundleCells[i].Nrays);
+}
+#endif
+
 void destroy_gals(void)
 {
   if(NumSourceGalsGlobal > 0)
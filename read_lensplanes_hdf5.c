@@ -11,46 +11,82 @@
 #include "raytrace.h"
 #include "read_lensplanes_hdf5.h"
 
-void readRayTracingPlaneAtPeanoInds_HDF5(long planeNum, long HEALPixOrder, long *PeanoIndsToRead, long NumPeanoIndsToRead, Part **LCParts, long *NumLCParts)
+/* memory type which converts the px,py,pz(,mass) fields of the lens plane tables straight into Parts */
+static hid_t make_part_memtype(int withMass)
 {
   herr_t status;
-  char file_name[MAX_FILENAME];
-  char tablename[MAX_FILENAME];
-  long i,ind,j,FileHEALPixOrder,*NumLCPartsInPix,FileNPix;
-  long *PeanoIndsToReadFromFile,NumPeanoIndsToReadFromFile;
-  long KeepLCPart,LCPartPeanoInd;
-  double vec[3];
-  Part LCPartRead;
-  hid_t file_id;
-
-  /* define LCParticle type in HDF5 for table I/O */
-  size_t dst_size = sizeof(Part);
-  size_t dst_sizes[4] = { sizeof(LCPartRead.pos[0]),
-			  sizeof(LCPartRead.pos[1]),
-			  sizeof(LCPartRead.pos[2]),
-			  sizeof(LCPartRead.mass) };
-  size_t field_offset[4] = { HOFFSET(Part,pos[0]),
-			     HOFFSET(Part,pos[1]),
-			     HOFFSET(Part,pos[2]),
-			     HOFFSET(Part,mass) };
-
-  /* open file */
-  sprintf(file_name,"%s/%s%04ld.h5",rayTraceData.LensPlanePath,rayTraceData.LensPlaneName,planeNum);
-
-  if(ThisTask == 0)
-    fprintf(stderr,"reading parts from '%s'\n",file_name);
+  hid_t memtype;
+  
+  memtype = H5Tcreate(H5T_COMPOUND,sizeof(Part));
+  assert(memtype >= 0);
+  status = H5Tinsert(memtype,"px",HOFFSET(Part,pos[0]),H5T_NATIVE_FLOAT);
+  assert(status >= 0);
+  status = H5Tinsert(memtype,"py",HOFFSET(Part,pos[1]),H5T_NATIVE_FLOAT);
+  assert(status >= 0);
+  status = H5Tinsert(memtype,"pz",HOFFSET(Part,pos[2]),H5T_NATIVE_FLOAT);
+  assert(status >= 0);
+  if(withMass)
+    {
+      status = H5Tinsert(memtype,"mass",HOFFSET(Part,mass),H5T_NATIVE_FLOAT);
+      assert(status >= 0);
+    }
+  
+  return memtype;
+}
 
-  file_id = H5Fopen(file_name,H5F_ACC_RDONLY,H5P_DEFAULT);
-  if(file_id < 0)
+#ifdef KEEP_RAND_FRAC 
+/* keeps a random fraction of the particles of cells first to last of PeanoInds which start at LCParts+rd - the kept particles
+   are moved to LCParts+(*ind) and *ind is moved along */
+static void keep_rand_frac_cells(Part *LCParts, long *NumLCPartsInPix, long *PeanoInds, long first, long last, long rd, long *ind, gsl_rng *rng)
+{
+  long k,m;
+  
+  for(m=first;m<=last;++m)
     {
-      fprintf(stderr,"%d: lens plane '%s' could not be opened!\n",ThisTask,file_name);
-      assert(0);
+      gsl_rng_set(rng,(unsigned long) (PeanoInds[m]));
+      for(k=0;k<NumLCPartsInPix[PeanoInds[m]];++k)
+	{
+	  if(gsl_rng_uniform(rng) < RAND_FRAC_TO_KEEP)
+	    {
+	      LCParts[*ind] = LCParts[rd+k];
+	      LCParts[*ind].mass = LCParts[*ind].mass/RAND_FRAC_TO_KEEP;
+	      *ind = *ind + 1;
+	    }
+	}
+      rd += NumLCPartsInPix[PeanoInds[m]];
     }
+}
+#endif
 
+/* reads the cells of an open lens plane file
+   - dxpl is the data transfer property list used for the reads
+   - planes with a contiguous /LCParts or /PackedParts (PeanoPacked) dataset are read with one hyperslab 
+     per run of consecutive cells
+   - if dxplColl >= 0, the function is called by all tasks at once and contiguous planes are read instead with 
+     one collective H5Dread of the union of the runs of each task through dxplColl (tasks with no cells 
+     select nothing) 
+   - PeanoPacked planes with a /PartMass dataset have no mass field and all particles get that mass
+   - older planes with one PeanoInd%ld table per cell are read with one H5Dread per table
+   - both use a memory type built once per call which converts straight into Parts
+*/
+static void read_hdf5_plane_cells(hid_t file_id, hid_t dxpl, hid_t dxplColl, long FileHEALPixOrder, long *NumLCPartsInPix,
+				  long HEALPixOrder, long *PeanoIndsToRead, long NumPeanoIndsToRead, Part **LCParts, long *NumLCParts)
+{
+  herr_t status;
+  char tablename[MAX_FILENAME];
+  long i,ind,j,n,NumRun,FileNPix;
+  long *PeanoIndsToReadFromFile,NumPeanoIndsToReadFromFile;
+  long *PeanoIndOffsets = NULL;
+  hid_t memtype,dataset_id,filespace_id=-1,memspace_id;
+  hsize_t start[1],count[1];
+  const char *dsetname = NULL;
+  int withMass = 1;
+  float PartMass = 0.0;
+  Part dummyPart;
 #ifdef KEEP_RAND_FRAC 
   if(ThisTask == 0)
     {
-      fprintf(stderr,"keeping only 1 of %lg of particles.\n",ThisTask,1.0/RAND_FRAC_TO_KEEP);
+      fprintf(stderr,"keeping only 1 of %lg of particles.\n",1.0/RAND_FRAC_TO_KEEP);
       fflush(stderr);
     }
   
@@ -58,54 +94,208 @@ void readRayTracingPlaneAtPeanoInds_HDF5(long planeNum, long HEALPixOrder, long
   rng = gsl_rng_alloc(gsl_rng_ranlxd2);
 #endif
   
-  /* read info about file */
-  status = H5LTread_dataset(file_id,"/HEALPixOrder",H5T_NATIVE_LONG,&FileHEALPixOrder);
-  assert(status >= 0);
-  FileNPix = order2npix(FileHEALPixOrder);
-  NumLCPartsInPix = (long*)malloc(sizeof(long)*FileNPix);
-  status = H5LTread_dataset(file_id,"/NumLCPartsInPix",H5T_NATIVE_LONG,NumLCPartsInPix);
-  assert(status >= 0);
-  
   getPeanoIndsToReadFromFile(HEALPixOrder,PeanoIndsToRead,NumPeanoIndsToRead,FileHEALPixOrder,&PeanoIndsToReadFromFile,&NumPeanoIndsToReadFromFile);
   
   *NumLCParts = 0;
   for(i=0;i<NumPeanoIndsToReadFromFile;++i)
     *NumLCParts = *NumLCParts + NumLCPartsInPix[PeanoIndsToReadFromFile[i]];
-  
+  *LCParts = NULL;
   if(*NumLCParts > 0)
     {
       *LCParts = (Part*)malloc(sizeof(Part)*(*NumLCParts));
       assert(*LCParts != NULL);
+    }
+  
+  //find the layout - in collective reads all tasks do this since they all have to open the dataset
+  if(*NumLCParts > 0 || dxplColl >= 0)
+    {
+      if(H5Lexists(file_id,"/PackedParts",H5P_DEFAULT) > 0)
+	{
+	  dsetname = "/PackedParts";
+	  if(H5Lexists(file_id,"/PartMass",H5P_DEFAULT) > 0)
+	    {
+	      status = H5LTread_dataset(file_id,"/PartMass",H5T_NATIVE_FLOAT,&PartMass);
+	      assert(status >= 0);
+	      withMass = 0;
+	    }
+	}
+      else if(H5Lexists(file_id,"/LCParts",H5P_DEFAULT) > 0)
+	dsetname = "/LCParts";
+    }
+  
+  //the PeanoInd tables of older planes are read independently
+  if(dsetname == NULL)
+    dxplColl = -1;
+  
+  if(dxplColl >= 0)
+    {
+      memtype = make_part_memtype(withMass);
       
-      ind = 0;
+      //contiguous planes - cells are stored in Peano order, so offsets are the running sum of the counts
+      FileNPix = order2npix(FileHEALPixOrder);
+      PeanoIndOffsets = (long*)malloc(sizeof(long)*FileNPix);
+      assert(PeanoIndOffsets != NULL);
+      PeanoIndOffsets[0] = 0;
+      for(i=1;i<FileNPix;++i)
+	PeanoIndOffsets[i] = PeanoIndOffsets[i-1] + NumLCPartsInPix[i-1];
+      
+      dataset_id = H5Dopen(file_id,dsetname,H5P_DEFAULT);
+      assert(dataset_id >= 0);
+      filespace_id = H5Dget_space(dataset_id);
+      assert(filespace_id >= 0);
+      
+      //union of the runs of consecutive cells - the cells are sorted, so the selection is in the order of the cells
+      status = H5Sselect_none(filespace_id);
+      assert(status >= 0);
       for(i=0;i<NumPeanoIndsToReadFromFile;++i)
 	{
-	  if(NumLCPartsInPix[PeanoIndsToReadFromFile[i]] > 0)
+	  n = i;
+	  NumRun = NumLCPartsInPix[PeanoIndsToReadFromFile[i]];
+	  while(n+1 < NumPeanoIndsToReadFromFile && PeanoIndsToReadFromFile[n+1] == PeanoIndsToReadFromFile[n]+1)
 	    {
-	      sprintf(tablename,"PeanoInd%ld",PeanoIndsToReadFromFile[i]);
-	      status = H5TBread_fields_name(file_id,tablename,"px,py,pz,mass",0,NumLCPartsInPix[PeanoIndsToReadFromFile[i]], 
-					    dst_size,field_offset,dst_sizes,*LCParts+ind);
+	      ++n;
+	      NumRun += NumLCPartsInPix[PeanoIndsToReadFromFile[n]];
+	    }
+	  
+	  if(NumRun > 0)
+	    {
+	      start[0] = (hsize_t) (PeanoIndOffsets[PeanoIndsToReadFromFile[i]]);
+	      count[0] = (hsize_t) NumRun;
+	      status = H5Sselect_hyperslab(filespace_id,H5S_SELECT_OR,start,NULL,count,NULL);
 	      assert(status >= 0);
-	      
+	    }
+	  i = n;
+	}
+      
+      if(*NumLCParts > 0)
+	{
+	  count[0] = (hsize_t) (*NumLCParts);
+	  memspace_id = H5Screate_simple(1,count,NULL);
+	  assert(memspace_id >= 0);
+	  status = H5Dread(dataset_id,memtype,memspace_id,filespace_id,dxplColl,*LCParts);
+	  assert(status >= 0);
+	}
+      else
+	{
+	  count[0] = 1;
+	  memspace_id = H5Screate_simple(1,count,NULL);
+	  assert(memspace_id >= 0);
+	  status = H5Sselect_none(memspace_id);
+	  assert(status >= 0);
+	  status = H5Dread(dataset_id,memtype,memspace_id,filespace_id,dxplColl,&dummyPart);
+	  assert(status >= 0);
+	}
+      status = H5Sclose(memspace_id);
+      assert(status >= 0);
+      
+      if(!withMass)
+	for(j=0;j<*NumLCParts;++j)
+	  (*LCParts)[j].mass = PartMass;
+      
 #ifdef KEEP_RAND_FRAC 
-	      gsl_rng_set(rng,(unsigned long) (PeanoIndsToReadFromFile[i]));
-	      j = 0;
-	      for(k=0;k<NumLCPartsInPix[PeanoIndsToReadFromFile[i]];++k)
+      ind = 0;
+      keep_rand_frac_cells(*LCParts,NumLCPartsInPix,PeanoIndsToReadFromFile,0,NumPeanoIndsToReadFromFile-1,0,&ind,rng);
+#else
+      ind = *NumLCParts;
+#endif
+      
+      status = H5Sclose(filespace_id);
+      assert(status >= 0);
+      status = H5Dclose(dataset_id);
+      assert(status >= 0);
+      free(PeanoIndOffsets);
+      status = H5Tclose(memtype);
+      assert(status >= 0);
+    }
+  else if(*NumLCParts > 0)
+    {
+      memtype = make_part_memtype(withMass);
+      
+      if(dsetname != NULL)
+	{
+	  FileNPix = order2npix(FileHEALPixOrder);
+	  PeanoIndOffsets = (long*)malloc(sizeof(long)*FileNPix);
+	  assert(PeanoIndOffsets != NULL);
+	  PeanoIndOffsets[0] = 0;
+	  for(i=1;i<FileNPix;++i)
+	    PeanoIndOffsets[i] = PeanoIndOffsets[i-1] + NumLCPartsInPix[i-1];
+	  
+	  dataset_id = H5Dopen(file_id,dsetname,H5P_DEFAULT);
+	  assert(dataset_id >= 0);
+	  filespace_id = H5Dget_space(dataset_id);
+	  assert(filespace_id >= 0);
+	}
+      else
+	dataset_id = -1;
+      
+      ind = 0;
+      for(i=0;i<NumPeanoIndsToReadFromFile;++i)
+	{
+	  //cells i through n are read at once
+	  n = i;
+	  NumRun = NumLCPartsInPix[PeanoIndsToReadFromFile[i]];
+	  if(PeanoIndOffsets != NULL)
+	    {
+	      while(n+1 < NumPeanoIndsToReadFromFile && PeanoIndsToReadFromFile[n+1] == PeanoIndsToReadFromFile[n]+1)
+		{
+		  ++n;
+		  NumRun += NumLCPartsInPix[PeanoIndsToReadFromFile[n]];
+		}
+	      
+	      if(NumRun > 0)
 		{
-		  if(gsl_rng_uniform(rng) < RAND_FRAC_TO_KEEP)
-		    {
-		      (*LCParts)[ind+j] = (*LCParts)[ind+k];
-		      (*LCParts)[ind+j].mass = (*LCParts)[ind+j].mass/RAND_FRAC_TO_KEEP;
-		      ++j;
-		    }
+		  start[0] = (hsize_t) (PeanoIndOffsets[PeanoIndsToReadFromFile[i]]);
+		  count[0] = (hsize_t) NumRun;
+		  status = H5Sselect_hyperslab(filespace_id,H5S_SELECT_SET,start,NULL,count,NULL);
+		  assert(status >= 0);
+		  memspace_id = H5Screate_simple(1,count,NULL);
+		  assert(memspace_id >= 0);
+		  status = H5Dread(dataset_id,memtype,memspace_id,filespace_id,dxpl,*LCParts+ind);
+		  assert(status >= 0);
+		  status = H5Sclose(memspace_id);
+		  assert(status >= 0);
+		  
+		  if(!withMass)
+		    for(j=ind;j<ind+NumRun;++j)
+		      (*LCParts)[j].mass = PartMass;
 		}
-	      ind += j;
+	    }
+	  else if(NumRun > 0)
+	    {
+	      sprintf(tablename,"PeanoInd%ld",PeanoIndsToReadFromFile[i]);
+	      dataset_id = H5Dopen(file_id,tablename,H5P_DEFAULT);
+	      assert(dataset_id >= 0);
+	      status = H5Dread(dataset_id,memtype,H5S_ALL,H5S_ALL,dxpl,*LCParts+ind);
+	      assert(status >= 0);
+	      status = H5Dclose(dataset_id);
+	      assert(status >= 0);
+	    }
+	  
+#ifdef KEEP_RAND_FRAC 
+	  keep_rand_frac_cells(*LCParts,NumLCPartsInPix,PeanoIndsToReadFromFile,i,n,ind,&ind,rng);
 #else
-	      ind += NumLCPartsInPix[PeanoIndsToReadFromFile[i]];
+	  ind += NumRun;
 #endif
-	    }
+	  i = n;
+	}
+      
+      if(PeanoIndOffsets != NULL)
+	{
+	  status = H5Sclose(filespace_id);
+	  assert(status >= 0);
+	  status = H5Dclose(dataset_id);
+	  assert(status >= 0);
+	  free(PeanoIndOffsets);
 	}
       
+      status = H5Tclose(memtype);
+      assert(status >= 0);
+    }
+  else
+    ind = 0;
+  
+  if(*NumLCParts > 0)
+    {
 #ifdef KEEP_RAND_FRAC 
       *NumLCParts = ind;
       if(*NumLCParts > 0)
@@ -123,45 +313,7 @@ void readRayTracingPlaneAtPeanoInds_HDF5(long planeNum, long HEALPixOrder, long
       
       /* if file cells are larger than requested cells, cull extra particles */
       if(FileHEALPixOrder < HEALPixOrder && (*NumLCParts) > 0)
-	{
-	  ind = 0;
-	  for(i=0;i<(*NumLCParts);++i)
-	    {
-	      vec[0] = (double) ((*LCParts)[i].pos[0]);
-	      vec[1] = (double) ((*LCParts)[i].pos[1]);
-	      vec[2] = (double) ((*LCParts)[i].pos[2]);
-	      LCPartPeanoInd = nest2peano(vec2nest(vec,HEALPixOrder),HEALPixOrder);
-	      
-	      KeepLCPart = 0;
-	      for(j=0;j<NumPeanoIndsToRead;++j)
-		{
-		  if(LCPartPeanoInd == PeanoIndsToRead[j])
-		    {
-		      KeepLCPart = 1;
-		      break;
-		    }
-		}
-
-	      if(KeepLCPart)
-		{
-		  (*LCParts)[ind] = (*LCParts)[i];
-		  ++ind;
-		}
-	    }
-	  
-	  *NumLCParts = ind;
-	  if(*NumLCParts > 0)
-	    {
-	      *LCParts = (Part*)realloc(*LCParts,sizeof(Part)*(*NumLCParts));
-	      assert(*LCParts != NULL);
-	    }
-	  else
-	    {
-	      free(*LCParts);
-	      *NumLCParts = 0;
-	      *LCParts = NULL;
-	    }
-	}
+	cullLCPartsToPeanoInds(HEALPixOrder,PeanoIndsToRead,NumPeanoIndsToRead,LCParts,NumLCParts);
     }
   else
     {
@@ -169,14 +321,128 @@ void readRayTracingPlaneAtPeanoInds_HDF5(long planeNum, long HEALPixOrder, long
       *LCParts = NULL;
     }
   
-  /* free mem */
   free(PeanoIndsToReadFromFile);
-  free(NumLCPartsInPix);
 #ifdef KEEP_RAND_FRAC 
   gsl_rng_free(rng);
 #endif
+}
+
+void readRayTracingPlaneAtPeanoInds_HDF5(long planeNum, long HEALPixOrder, long *PeanoIndsToRead, long NumPeanoIndsToRead, Part **LCParts, long *NumLCParts)
+{
+  herr_t status;
+  char file_name[MAX_FILENAME];
+  long FileHEALPixOrder,*NumLCPartsInPix,FileNPix;
+  hid_t file_id;
+  
+  /* open file */
+  sprintf(file_name,"%s/%s%04ld.h5",rayTraceData.LensPlanePath,rayTraceData.LensPlaneName,planeNum);
+
+  if(ThisTask == 0)
+    fprintf(stderr,"reading parts from '%s'\n",file_name);
+
+  file_id = H5Fopen(file_name,H5F_ACC_RDONLY,H5P_DEFAULT);
+  if(file_id < 0)
+    {
+      fprintf(stderr,"%d: lens plane '%s' could not be opened!\n",ThisTask,file_name);
+      assert(0);
+    }
+  
+  /* read info about file */
+  status = H5LTread_dataset(file_id,"/HEALPixOrder",H5T_NATIVE_LONG,&FileHEALPixOrder);
+  assert(status >= 0);
+  FileNPix = order2npix(FileHEALPixOrder);
+  NumLCPartsInPix = (long*)malloc(sizeof(long)*FileNPix);
+  assert(NumLCPartsInPix != NULL);
+  status = H5LTread_dataset(file_id,"/NumLCPartsInPix",H5T_NATIVE_LONG,NumLCPartsInPix);
+  assert(status >= 0);
+  
+  read_hdf5_plane_cells(file_id,H5P_DEFAULT,-1,FileHEALPixOrder,NumLCPartsInPix,
+			HEALPixOrder,PeanoIndsToRead,NumPeanoIndsToRead,LCParts,NumLCParts);
+  
+  /* free mem */
+  free(NumLCPartsInPix);
   
   /* close file */
   status = H5Fclose(file_id);
   assert(status >= 0);
 }
+
+#ifdef USE_PARALLEL_HDF5
+#ifndef H5_HAVE_PARALLEL
+#error "USE_PARALLEL_HDF5 requires an HDF5 library built with parallel (MPI-IO) support!"
+#endif
+/* collective version of readRayTracingPlaneAtPeanoInds_HDF5 - must be called by all tasks at once
+   - the file is opened once through the MPI-IO driver on MPI_COMM_WORLD instead of once per task
+   - task 0 reads the file header and broadcasts it
+   - planes with a contiguous dataset are read with one collective H5Dread of the union of the runs
+     of cells of each task; tasks with no cells still take part in it with an empty selection
+   - older planes with one PeanoInd%ld table per cell need a different number of reads on each task, 
+     so these transfers are independent
+*/
+void readRayTracingPlaneAtPeanoInds_HDF5_MPIO(long planeNum, long HEALPixOrder, long *PeanoIndsToRead, long NumPeanoIndsToRead, Part **LCParts, long *NumLCParts)
+{
+  herr_t status;
+  char file_name[MAX_FILENAME];
+  long FileHEALPixOrder,*NumLCPartsInPix,FileNPix;
+  hid_t file_id,fapl,dxpl,dxplColl;
+  
+  /* open file */
+  sprintf(file_name,"%s/%s%04ld.h5",rayTraceData.LensPlanePath,rayTraceData.LensPlaneName,planeNum);
+  
+  if(ThisTask == 0)
+    fprintf(stderr,"reading parts from '%s' w/ MPI-IO\n",file_name);
+  
+  fapl = H5Pcreate(H5P_FILE_ACCESS);
+  assert(fapl >= 0);
+  status = H5Pset_fapl_mpio(fapl,MPI_COMM_WORLD,MPI_INFO_NULL);
+  assert(status >= 0);
+  file_id = H5Fopen(file_name,H5F_ACC_RDONLY,fapl);
+  if(file_id < 0)
+    {
+      fprintf(stderr,"%d: lens plane '%s' could not be opened!\n",ThisTask,file_name);
+      MPI_Abort(MPI_COMM_WORLD,666);
+    }
+  
+  dxpl = H5Pcreate(H5P_DATASET_XFER);
+  assert(dxpl >= 0);
+  status = H5Pset_dxpl_mpio(dxpl,H5FD_MPIO_INDEPENDENT);
+  assert(status >= 0);
+  dxplColl = H5Pcreate(H5P_DATASET_XFER);
+  assert(dxplColl >= 0);
+  status = H5Pset_dxpl_mpio(dxplColl,H5FD_MPIO_COLLECTIVE);
+  assert(status >= 0);
+  
+  /* read info about file */
+  if(ThisTask == 0)
+    {
+      status = H5LTread_dataset(file_id,"/HEALPixOrder",H5T_NATIVE_LONG,&FileHEALPixOrder);
+      assert(status >= 0);
+    }
+  MPI_Bcast(&FileHEALPixOrder,1,MPI_LONG,0,MPI_COMM_WORLD);
+  FileNPix = order2npix(FileHEALPixOrder);
+  NumLCPartsInPix = (long*)malloc(sizeof(long)*FileNPix);
+  assert(NumLCPartsInPix != NULL);
+  if(ThisTask == 0)
+    {
+      status = H5LTread_dataset(file_id,"/NumLCPartsInPix",H5T_NATIVE_LONG,NumLCPartsInPix);
+      assert(status >= 0);
+    }
+  MPI_Bcast(NumLCPartsInPix,(int) FileNPix,MPI_LONG,0,MPI_COMM_WORLD);
+  
+  read_hdf5_plane_cells(file_id,dxpl,dxplColl,FileHEALPixOrder,NumLCPartsInPix,
+			HEALPixOrder,PeanoIndsToRead,NumPeanoIndsToRead,LCParts,NumLCParts);
+  
+  /* free mem */
+  free(NumLCPartsInPix);
+  
+  /* close file - collective */
+  status = H5Pclose(dxpl);
+  assert(status >= 0);
+  status = H5Pclose(dxplColl);
+  assert(status >= 0);
+  status = H5Fclose(file_id);
+  assert(status >= 0);
+  status = H5Pclose(fapl);
+  assert(status >= 0);
+}
+#endif /* USE_PARALLEL_HDF5 */
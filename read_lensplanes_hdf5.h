@@ -14,5 +14,8 @@
 #define _PARTIO_HDF5_
 
 void readRayTracingPlaneAtPeanoInds_HDF5(long planeNum, long HEALPixOrder, long *PeanoIndsToRead, long NumPeanoIndsToRead, Part **LCParts, long *NumLCParts);
+#ifdef USE_PARALLEL_HDF5
+void readRayTracingPlaneAtPeanoInds_HDF5_MPIO(long planeNum, long HEALPixOrder, long *PeanoIndsToRead, long NumPeanoIndsToRead, Part **LCParts, long *NumLCParts);
+#endif
 
 #endif /* _PARTIO_HDF5_ */
@@ -1,11 +1,19 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
+#include <limits.h>
 #include <assert.h>
 #include <mpi.h>
 #include <gsl/gsl_sort_long.h>
 #include <gsl/gsl_rng.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <utime.h>
 
 #include "raytrace.h"
 #include "read_lensplanes_pixLC.h"
@@ -24,232 +32,489 @@ struct pixLCheader {
   double hubbleparam;       // little 'h'
 };
 
-void readRayTracingPlaneAtPeanoInds_pixLC(long planeNum, long HEALPixOrder, long *PeanoIndsToRead, long NumPeanoIndsToRead, Part **LCParts, long *NumLCParts)
+/* list of the files of a pixLC lens plane
+
+   - the manifest file <LensPlanePath>/<LensPlaneName>_<plane>_manifest has the file HEALPix nside
+     on its first line and then one line per existing file with its nest index, size in bytes and
+     number of particles
+   - if it does not exist or is older than the lens plane directory (so files were added or removed
+     after it was written), it is made from one scan of the lens plane directory
+   - prep_pixLC_manifests gets the manifests of all planes on task 0 (writing any it had to make, if the
+     directory is writable) and broadcasts them, so the reads never touch the directory or the manifest
+     files - without it each read loads or makes the manifest of its plane on its own
+*/
+typedef struct {
+  long FileHEALPixOrder;
+  long FileNPix;
+  long *FileSize;  // size in bytes of the file for each nest index or -1 if it does not exist
+  long *FileNPart; // # of particles in the file for each nest index
+} PixLCManifest;
+
+static PixLCManifest *pixLCManifests = NULL;
+
+static void alloc_pixLC_manifest(PixLCManifest *man, long FileHEALPixOrder)
+{
+  long i;
+
+  man->FileHEALPixOrder = FileHEALPixOrder;
+  man->FileNPix = order2npix(FileHEALPixOrder);
+  man->FileSize = (long*)malloc(sizeof(long)*man->FileNPix);
+  assert(man->FileSize != NULL);
+  man->FileNPart = (long*)malloc(sizeof(long)*man->FileNPix);
+  assert(man->FileNPart != NULL);
+  for(i=0;i<man->FileNPix;++i)
+    {
+      man->FileSize[i] = -1;
+      man->FileNPart[i] = 0;
+    }
+}
+
+static void free_pixLC_manifest(PixLCManifest *man)
+{
+  free(man->FileSize);
+  free(man->FileNPart);
+}
+
+static void read_pixLC_header(char *file_name, struct pixLCheader *head)
+{
+  FILE *fp;
+
+  fp = fopen(file_name,"r");
+  if(fp == NULL)
+    {
+      fprintf(stderr,"%d: lens plane '%s' could not be opened!\n",ThisTask,file_name);
+      assert(0);
+    }
+  if(fread(head,sizeof(struct pixLCheader),(size_t) 1,fp) != 1)
+    {
+      fprintf(stderr,"%d: could not read header for lens plane '%s'!\n",ThisTask,file_name);
+      assert(0);
+    }
+  fclose(fp);
+}
+
+/* makes the manifest from one scan of the lens plane directory */
+static void make_pixLC_manifest(long planeNum, PixLCManifest *man)
+{
+  char file_name[MAX_FILENAME],prefix[MAX_FILENAME];
+  DIR *dp;
+  struct dirent *ep;
+  struct stat st;
+  struct pixLCheader head;
+  long i,NumFiles,NumFilesAlloc,*nests,*sizes,nest;
+  char *endp;
+  size_t plen;
+
+  snprintf(prefix,MAX_FILENAME,"%s_%ld_",rayTraceData.LensPlaneName,planeNum);
+  plen = strlen(prefix);
+
+  dp = opendir(rayTraceData.LensPlanePath);
+  if(dp == NULL)
+    {
+      fprintf(stderr,"%d: could not open lens plane directory '%s'!\n",ThisTask,rayTraceData.LensPlanePath);
+      assert(0);
+    }
+
+  NumFiles = 0;
+  NumFilesAlloc = 1024;
+  nests = (long*)malloc(sizeof(long)*NumFilesAlloc);
+  assert(nests != NULL);
+  sizes = (long*)malloc(sizeof(long)*NumFilesAlloc);
+  assert(sizes != NULL);
+
+  while((ep = readdir(dp)) != NULL)
+    {
+      if(strncmp(ep->d_name,prefix,plen) != 0 || ep->d_name[plen] == '\0')
+	continue;
+      nest = strtol(ep->d_name+plen,&endp,10);
+      if(*endp != '\0' || nest < 0)
+	continue;
+
+      snprintf(file_name,MAX_FILENAME,"%s/%s",rayTraceData.LensPlanePath,ep->d_name);
+      if(stat(file_name,&st) != 0)
+	continue;
+
+      if(NumFiles >= NumFilesAlloc)
+	{
+	  NumFilesAlloc *= 2;
+	  nests = (long*)realloc(nests,sizeof(long)*NumFilesAlloc);
+	  assert(nests != NULL);
+	  sizes = (long*)realloc(sizes,sizeof(long)*NumFilesAlloc);
+	  assert(sizes != NULL);
+	}
+      nests[NumFiles] = nest;
+      sizes[NumFiles] = (long) (st.st_size);
+      ++NumFiles;
+    }
+  closedir(dp);
+
+  if(NumFiles == 0)
+    {
+      fprintf(stderr,"%d: could not get healpix order for lens plane %04ld!\n",ThisTask,planeNum);
+      assert(0);
+    }
+
+  // get order from the first file and # of parts from all of them
+  snprintf(file_name,MAX_FILENAME,"%s/%s%ld",rayTraceData.LensPlanePath,prefix,nests[0]);
+  read_pixLC_header(file_name,&head);
+  alloc_pixLC_manifest(man,nside2order((long) (head.filenside)));
+  for(i=0;i<NumFiles;++i)
+    {
+      if(nests[i] >= man->FileNPix)
+	{
+	  fprintf(stderr,"%d: nest index %ld of lens plane %04ld is out of range for nside %u!\n",ThisTask,nests[i],planeNum,head.filenside);
+	  assert(0);
+	}
+      snprintf(file_name,MAX_FILENAME,"%s/%s%ld",rayTraceData.LensPlanePath,prefix,nests[i]);
+      read_pixLC_header(file_name,&head);
+      man->FileSize[nests[i]] = sizes[i];
+      man->FileNPart[nests[i]] = (long) (head.npart);
+    }
+  free(nests);
+  free(sizes);
+}
+
+/* writes the manifest for next time through a temp file which is renamed - returns 1 if it was written */
+static int write_pixLC_manifest(long planeNum, PixLCManifest *man)
+{
+  char man_name[MAX_FILENAME],tmp_name[MAX_FILENAME];
+  FILE *fp;
+  long i;
+
+  snprintf(man_name,MAX_FILENAME,"%s/%s_%ld_manifest",rayTraceData.LensPlanePath,rayTraceData.LensPlaneName,planeNum);
+  snprintf(tmp_name,MAX_FILENAME,"%s.%d",man_name,ThisTask);
+  fp = fopen(tmp_name,"w");
+  if(fp == NULL)
+    return 0;
+
+  fprintf(fp,"%ld\n",order2nside(man->FileHEALPixOrder));
+  for(i=0;i<man->FileNPix;++i)
+    if(man->FileSize[i] >= 0)
+      fprintf(fp,"%ld %ld %ld\n",i,man->FileSize[i],man->FileNPart[i]);
+  fclose(fp);
+  if(rename(tmp_name,man_name) != 0)
+    {
+      remove(tmp_name);
+      return 0;
+    }
+
+  return 1;
+}
+
+/* reads the manifest file of a plane - returns 0 if there is none or if it is older than the lens plane directory */
+static int read_pixLC_manifest(long planeNum, PixLCManifest *man)
+{
+  char man_name[MAX_FILENAME];
+  FILE *fp;
+  long nside,nest,size,npart;
+  struct stat dst,mst;
+
+  snprintf(man_name,MAX_FILENAME,"%s/%s_%ld_manifest",rayTraceData.LensPlanePath,rayTraceData.LensPlaneName,planeNum);
+  fp = fopen(man_name,"r");
+  if(fp == NULL)
+    return 0;
+
+  if(stat(rayTraceData.LensPlanePath,&dst) != 0 || fstat(fileno(fp),&mst) != 0 || dst.st_mtime > mst.st_mtime)
+    {
+      fclose(fp);
+      return 0;
+    }
+
+  if(fscanf(fp,"%ld",&nside) != 1)
+    {
+      fprintf(stderr,"%d: could not read nside from lens plane manifest '%s'!\n",ThisTask,man_name);
+      assert(0);
+    }
+  alloc_pixLC_manifest(man,nside2order(nside));
+  while(fscanf(fp,"%ld %ld %ld",&nest,&size,&npart) == 3)
+    {
+      if(nest < 0 || nest >= man->FileNPix)
+	{
+	  fprintf(stderr,"%d: nest index %ld in lens plane manifest '%s' is out of range!\n",ThisTask,nest,man_name);
+	  assert(0);
+	}
+      man->FileSize[nest] = size;
+      man->FileNPart[nest] = npart;
+    }
+  fclose(fp);
+
+  return 1;
+}
+
+static void load_pixLC_manifest(long planeNum, PixLCManifest *man)
+{
+  if(!read_pixLC_manifest(planeNum,man))
+    make_pixLC_manifest(planeNum,man);
+}
+
+/* gets the manifests of all lens planes on task 0 and sends them to all tasks - must be called by all tasks at once */
+void prep_pixLC_manifests(void)
+{
+  char man_name[MAX_FILENAME];
+  long planeNum,FileHEALPixOrder;
+  PixLCManifest man;
+  int *written;
+
+  if(pixLCManifests != NULL)
+    return;
+
+  pixLCManifests = (PixLCManifest*)malloc(sizeof(PixLCManifest)*rayTraceData.NumLensPlanes);
+  assert(pixLCManifests != NULL);
+  written = (int*)malloc(sizeof(int)*rayTraceData.NumLensPlanes);
+  assert(written != NULL);
+
+  for(planeNum=0;planeNum<rayTraceData.NumLensPlanes;++planeNum)
+    {
+      written[planeNum] = 0;
+      if(ThisTask == 0)
+	{
+	  if(!read_pixLC_manifest(planeNum,&man))
+	    {
+	      make_pixLC_manifest(planeNum,&man);
+	      written[planeNum] = write_pixLC_manifest(planeNum,&man);
+	    }
+	  FileHEALPixOrder = man.FileHEALPixOrder;
+	}
+      MPI_Bcast(&FileHEALPixOrder,1,MPI_LONG,0,MPI_COMM_WORLD);
+      if(ThisTask != 0)
+	alloc_pixLC_manifest(&man,FileHEALPixOrder);
+      assert(man.FileNPix < INT_MAX);
+      MPI_Bcast(man.FileSize,(int) (man.FileNPix),MPI_LONG,0,MPI_COMM_WORLD);
+      MPI_Bcast(man.FileNPart,(int) (man.FileNPix),MPI_LONG,0,MPI_COMM_WORLD);
+      pixLCManifests[planeNum] = man;
+    }
+
+  // writing the manifests changes the mtime of the directory, so they are touched once all are in place
+  if(ThisTask == 0)
+    {
+      for(planeNum=0;planeNum<rayTraceData.NumLensPlanes;++planeNum)
+	{
+	  if(!written[planeNum])
+	    continue;
+	  snprintf(man_name,MAX_FILENAME,"%s/%s_%ld_manifest",rayTraceData.LensPlanePath,rayTraceData.LensPlaneName,planeNum);
+	  utime(man_name,NULL);
+	}
+    }
+  free(written);
+}
+
+void destroy_pixLC_manifests(void)
+{
+  long planeNum;
+
+  if(pixLCManifests == NULL)
+    return;
+
+  for(planeNum=0;planeNum<rayTraceData.NumLensPlanes;++planeNum)
+    free_pixLC_manifest(&(pixLCManifests[planeNum]));
+  free(pixLCManifests);
+  pixLCManifests = NULL;
+}
+
+/* maps a lens plane file read only - returns NULL if it does not exist */
+static void *map_pixLC_file(long planeNum, long nest, PixLCManifest *man)
 {
   char file_name[MAX_FILENAME];
-  long i,ind,j,k,FileHEALPixOrder,nest;
+  int fd;
+  struct stat st;
+  void *map;
+
+  if(man->FileSize[nest] < 0)
+    return NULL;
+
+  snprintf(file_name,MAX_FILENAME,"%s/%s_%ld_%ld",rayTraceData.LensPlanePath,rayTraceData.LensPlaneName,planeNum,nest);
+  fd = open(file_name,O_RDONLY);
+  if(fd == -1)
+    {
+      fprintf(stderr,"%d: lens plane '%s' could not be opened!\n",ThisTask,file_name);
+      assert(0);
+    }
+  if(fstat(fd,&st) != 0 || ((long) (st.st_size)) != man->FileSize[nest])
+    {
+      fprintf(stderr,"%d: size of lens plane '%s' does not match its manifest - delete '%s/%s_%ld_manifest' and try again!\n",
+	      ThisTask,file_name,rayTraceData.LensPlanePath,rayTraceData.LensPlaneName,planeNum);
+      assert(0);
+    }
+  map = mmap(NULL,(size_t) (man->FileSize[nest]),PROT_READ,MAP_PRIVATE,fd,0);
+  if(map == MAP_FAILED)
+    {
+      fprintf(stderr,"%d: could not mmap lens plane '%s'!\n",ThisTask,file_name);
+      assert(0);
+    }
+  close(fd);
+
+  return map;
+}
+
+/* reads the cells of a pixLC lens plane
+   - the files of the plane are found from its manifest, so only existing files are touched
+   - the Part array is allocated once from the # of particles in the manifest
+   - each file is mmapped and the positions are copied straight from the mapping into the Parts; the
+     next file is mapped with MADV_WILLNEED while the current one is being copied
+*/
+void readRayTracingPlaneAtPeanoInds_pixLC(long planeNum, long HEALPixOrder, long *PeanoIndsToRead, long NumPeanoIndsToRead, Part **LCParts, long *NumLCParts)
+{
+  long i,ind,j,k,FileHEALPixOrder,nest,nextNest,NumLCPartsAlloc;
   long *PeanoIndsToReadFromFile,NumPeanoIndsToReadFromFile;
-  long KeepLCPart,LCPartPeanoInd;
-  double vec[3];
   struct pixLCheader head;
-  FILE *fp;
-  float *pos = NULL;
-  long npos = 0;
-  
+  PixLCManifest man;
+  void *map,*nextMap;
+  const float *pos;
+  float mass;
+  size_t posOffset;
+
   if(ThisTask == 0)
     fprintf(stderr,"reading parts from lens plane '%s/%s_%ld_NESTIND'\n",
 	    rayTraceData.LensPlanePath,rayTraceData.LensPlaneName,planeNum);
-  
-#ifdef KEEP_RAND_FRAC 
+
+#ifdef KEEP_RAND_FRAC
   if(ThisTask == 0)
     {
-      fprintf(stderr,"keeping only 1 of %lg of particles.\n",ThisTask,1.0/RAND_FRAC_TO_KEEP);
+      fprintf(stderr,"keeping only 1 of %lg of particles.\n",1.0/RAND_FRAC_TO_KEEP);
       fflush(stderr);
     }
-  
+
   gsl_rng *rng;
   rng = gsl_rng_alloc(gsl_rng_ranlxd2);
 #endif
-  
+
   // get file layout
-  FileHEALPixOrder = -1;
-  for(i=0;i<1000000000;++i) 
+  if(pixLCManifests != NULL)
+    man = pixLCManifests[planeNum];
+  else
+    load_pixLC_manifest(planeNum,&man);
+  FileHEALPixOrder = man.FileHEALPixOrder;
+
+  // get peano inds to read from file
+  getPeanoIndsToReadFromFile(HEALPixOrder,PeanoIndsToRead,NumPeanoIndsToRead,FileHEALPixOrder,&PeanoIndsToReadFromFile,&NumPeanoIndsToReadFromFile);
+
+  // alloc outputs once
+  NumLCPartsAlloc = 0;
+  for(i=0;i<NumPeanoIndsToReadFromFile;++i)
     {
-      // try to read file name
-      sprintf(file_name,"%s/%s_%ld_%ld",rayTraceData.LensPlanePath,rayTraceData.LensPlaneName,planeNum,i);
-      fp = fopen(file_name,"r");
-      if(fp == NULL)
-	continue;
-      
-      // read header
-      j = fread(&head,sizeof(struct pixLCheader),(size_t) 1,fp);
-      if(j < 1)
-	{
-	  fprintf(stderr,"%d: could not read header for lens plane '%s'!\n",ThisTask,file_name);
-	  assert(0);	  
-	}
-      
-      // close file
-      fclose(fp);
-      
-      // get order
-      FileHEALPixOrder = head.filenside;
-      FileHEALPixOrder = nside2order(FileHEALPixOrder);
-      break;
+      nest = peano2nest(PeanoIndsToReadFromFile[i],FileHEALPixOrder);
+      if(man.FileSize[nest] >= 0)
+	NumLCPartsAlloc += man.FileNPart[nest];
     }
-  
-  // if we get here, could not find a file
-  if(FileHEALPixOrder == -1) 
+  *LCParts = NULL;
+  if(NumLCPartsAlloc > 0)
     {
-      fprintf(stderr,"%d: could not get healpix order for lens plane %04ld!\n",ThisTask,planeNum);
-      assert(0);      
+      *LCParts = (Part*)malloc(sizeof(Part)*NumLCPartsAlloc);
+      assert(*LCParts != NULL);
     }
-  
-  // get peano inds to read from file
-  getPeanoIndsToReadFromFile(HEALPixOrder,PeanoIndsToRead,NumPeanoIndsToRead,FileHEALPixOrder,&PeanoIndsToReadFromFile,&NumPeanoIndsToReadFromFile);
-  
-  // FIXME stub
-  *NumLCParts = 0;
-  *LCParts = NULL;
-  
+
   ind = 0;
+  nextMap = NULL;
+  nextNest = -1;
   for(i=0;i<NumPeanoIndsToReadFromFile;++i)
     {
-      // get file name
       nest = peano2nest(PeanoIndsToReadFromFile[i],FileHEALPixOrder);
-      sprintf(file_name,"%s/%s_%ld_%ld",rayTraceData.LensPlanePath,rayTraceData.LensPlaneName,planeNum,nest);
-      
+
+      // use the read ahead mapping if this is its file
+      // a pending read ahead is kept until its file comes up since the cells in between are missing or empty
+      if(nest == nextNest)
+	{
+	  map = nextMap;
+	  nextMap = NULL;
+	  nextNest = -1;
+	}
+      else
+	map = map_pixLC_file(planeNum,nest,&man);
+
       // file does not exist, move on
-      if(access(file_name,F_OK) == -1)
+      if(map == NULL)
 	continue;
 
-      // open file to read
-      fp = fopen(file_name,"r");
-      if(fp == NULL)
+      // start read ahead of the next file
+      for(j=i+1;nextMap == NULL && j<NumPeanoIndsToReadFromFile;++j)
 	{
-	  fprintf(stderr,"%d: lens plane '%s' could not be opened!\n",ThisTask,file_name);
-	  assert(0);
+	  k = peano2nest(PeanoIndsToReadFromFile[j],FileHEALPixOrder);
+	  if(man.FileSize[k] >= 0 && man.FileNPart[k] > 0)
+	    {
+	      nextNest = k;
+	      nextMap = map_pixLC_file(planeNum,nextNest,&man);
+#ifdef MADV_WILLNEED
+	      madvise(nextMap,(size_t) (man.FileSize[nextNest]),MADV_WILLNEED);
+#endif
+	      break;
+	    }
 	}
 
       // read header
-      j = fread(&head,sizeof(struct pixLCheader),(size_t) 1,fp);
-      if(j < 1)
+      if(man.FileSize[nest] < (long) sizeof(struct pixLCheader))
 	{
-	  fprintf(stderr,"%d: could not read header for lens plane '%s'!\n",ThisTask,file_name);
-	  assert(0);	  
+	  fprintf(stderr,"%d: could not read header for lens plane %04ld, nest %ld!\n",ThisTask,planeNum,nest);
+	  assert(0);
 	}
-      
+      memcpy(&head,map,sizeof(struct pixLCheader));
+
       if(head.npart > 0)
 	{
-	  // realloc
-	  if(head.npart > npos)
-	    {
-	      pos = (float*)realloc(pos,3*head.npart*sizeof(float));
-	      if(pos == NULL)
-		{
-		  fprintf(stderr,"%d: could not realloc pos array for lens plane '%s'!\n",ThisTask,file_name);
-		  assert(0);
-		}
-	    }
-	  
 	  // skip indexes
-	  j = fseek(fp,sizeof(long)*nside2npix(head.indexnside),SEEK_CUR);
-	  if(j != 0) 
+	  posOffset = sizeof(struct pixLCheader) + sizeof(long)*nside2npix(head.indexnside);
+	  if(((long) (head.npart)) != man.FileNPart[nest] || posOffset + 3*head.npart*sizeof(float) > (size_t) (man.FileSize[nest]))
 	    {
-	      fprintf(stderr,"%d: could not seek past idx array for lens plane '%s'!\n",ThisTask,file_name);
+	      fprintf(stderr,"%d: could not read pos array for lens plane %04ld, nest %ld!\n",ThisTask,planeNum,nest);
 	      assert(0);
 	    }
-	  
-	  // read data
-	  j = fread(pos,3*head.npart*sizeof(float),(size_t) 1,fp);
-	  if(j != 1)
-	    {
-	      fprintf(stderr,"%d: could not read pos array for lens plane '%s'!\n",ThisTask,file_name);
-	      assert(0);	  
-	    }
-	  
-	  // realloc output parts
-	  if(head.npart + ind > *NumLCParts) 
-	    {
-	      *NumLCParts = (*NumLCParts) + head.npart*3; // a little buffer
-	      *LCParts = (Part*)realloc(*LCParts,sizeof(Part)*(*NumLCParts));
-	      assert(*LCParts != NULL);
-	    }
-	  
+	  pos = (const float*) (((const char*) map) + posOffset);
+
 	  // put in outputs
-#ifdef KEEP_RAND_FRAC 
+#ifdef KEEP_RAND_FRAC
 	  gsl_rng_set(rng,(unsigned long) (PeanoIndsToReadFromFile[i]));
+	  mass = (float) (head.mass/RAND_FRAC_TO_KEEP*1e10);
+#else
+	  mass = (float) (head.mass*1e10);
 #endif
 	  j = 0;
-	  for(k=0;k<head.npart;++k)
+	  for(k=0;k<(long) (head.npart);++k)
 	    {
 #ifdef KEEP_RAND_FRAC
 	      if(gsl_rng_uniform(rng) >= RAND_FRAC_TO_KEEP)
 		continue;
-#endif	      
+#endif
 	      (*LCParts)[ind+j].pos[0] = pos[3*k+0];
 	      (*LCParts)[ind+j].pos[1] = pos[3*k+1];
 	      (*LCParts)[ind+j].pos[2] = pos[3*k+2];
-#ifdef KEEP_RAND_FRAC 
-	      (*LCParts)[ind+j].mass = head.mass/RAND_FRAC_TO_KEEP*1e10;
-#else
-	      (*LCParts)[ind+j].mass = head.mass*1e10;
-#endif	      
+	      (*LCParts)[ind+j].mass = mass;
 	      ++j;
 	    }
 	  ind += j;
-	  
+
 	} // if(head.npart > 0)
 
-      // close the file
-      fclose(fp);
-    }  
-  
+      // unmap the file
+      munmap(map,(size_t) (man.FileSize[nest]));
+    }
+  if(nextMap != NULL)
+    munmap(nextMap,(size_t) (man.FileSize[nextNest]));
+
   // do final realloc
   *NumLCParts = ind;
   if(*NumLCParts > 0)
     {
-      *LCParts = (Part*)realloc(*LCParts,sizeof(Part)*(*NumLCParts));
-      assert(*LCParts != NULL);
-    }
-  else
-    {
-      free(*LCParts);
-      *NumLCParts = 0;
-      *LCParts = NULL;
-    }
-  
-  // if file cells are larger than requested cells, cull extra particles
-  if(FileHEALPixOrder < HEALPixOrder && (*NumLCParts) > 0)
-    {
-      ind = 0;
-      for(i=0;i<(*NumLCParts);++i)
-	{
-	  vec[0] = (double) ((*LCParts)[i].pos[0]);
-	  vec[1] = (double) ((*LCParts)[i].pos[1]);
-	  vec[2] = (double) ((*LCParts)[i].pos[2]);
-	  LCPartPeanoInd = nest2peano(vec2nest(vec,HEALPixOrder),HEALPixOrder);
-	      
-	  KeepLCPart = 0;
-	  for(j=0;j<NumPeanoIndsToRead;++j)
-	    {
-	      if(LCPartPeanoInd == PeanoIndsToRead[j])
-		{
-		  KeepLCPart = 1;
-		  break;
-		}
-	    }
-
-	  if(KeepLCPart)
-	    {
-	      (*LCParts)[ind] = (*LCParts)[i];
-	      ++ind;
-	    }
-	}
-      
-      *NumLCParts = ind;
-      if(*NumLCParts > 0)
+      if(*NumLCParts < NumLCPartsAlloc)
 	{
 	  *LCParts = (Part*)realloc(*LCParts,sizeof(Part)*(*NumLCParts));
 	  assert(*LCParts != NULL);
 	}
-      else
-	{
-	  free(*LCParts);
-	  *NumLCParts = 0;
-	  *LCParts = NULL;
-	}
     }
   else
     {
+      free(*LCParts);
       *NumLCParts = 0;
       *LCParts = NULL;
     }
 
+  // if file cells are larger than requested cells, cull extra particles
+  if(FileHEALPixOrder < HEALPixOrder && (*NumLCParts) > 0)
+    cullLCPartsToPeanoInds(HEALPixOrder,PeanoIndsToRead,NumPeanoIndsToRead,LCParts,NumLCParts);
+
   // free mem
-  free(pos);
+  if(pixLCManifests == NULL)
+    free_pixLC_manifest(&man);
   free(PeanoIndsToReadFromFile);
-#ifdef KEEP_RAND_FRAC 
+#ifdef KEEP_RAND_FRAC
   gsl_rng_free(rng);
 #endif
 }
@@ -12,5 +12,7 @@
 #define _PARTIO_PIXLC_
 
 void readRayTracingPlaneAtPeanoInds_pixLC(long planeNum, long HEALPixOrder, long *PeanoIndsToRead, long NumPeanoIndsToRead, Part **LCParts, long *NumLCParts);
+void prep_pixLC_manifests(void);
+void destroy_pixLC_manifests(void);
 
 #endif /* _PARTIO_PIXLC_ */
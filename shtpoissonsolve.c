@@ -35,6 +35,31 @@ static void write_localmap(char name[], HEALPixMapCell *localMapCells, long NumL
 
 #define MASS_SCALE 1e10
 
+#ifndef USE_FULLSKY_PARTDIST
+/* mask of the ray tracing domain for the rings of a task
+   - the map pixels in the domain (test_vaccell == 0) are stored as runs [start,end) of pixel indexes within 
+     each ring, since they are contiguous in phi (at most two runs when minRa > maxRa)
+   - runs for ring nring and hemisphere h (0 north, 1 south) are runs[2*ringRunStart[s]] to 
+     runs[2*(ringRunStart[s]+ringNumRuns[s])] with s = 2*(nring-1) + h
+   - the runs of a ring only depend on the ray tracing domain and poissonOrder, so they are kept by global 
+     ring index from plane to plane and made the first time a task gets the ring - the load balancing 
+     of the SHT moves the ring range of a task around, but only the newly seen rings cost anything
+*/
+typedef struct {
+  long order;
+  long *ringRunStart; // -1 if the runs of the ring have not been made yet
+  long *ringNumRuns;
+  long Nruns;
+  long NrunsAlloc;
+  long *runs;
+} CutSkyMask;
+
+static CutSkyMask cutSkyMask = {-1,NULL,NULL,0,0,NULL};
+
+static void get_cutsky_mask(HEALPixSHTPlan plan);
+#endif
+static void scale_subtract_ring(float *ringvec, long ringpix, float fac, float backdens, long *runs, long Nruns);
+
 void do_healpix_sht_poisson_solve(double densfact, double backdens)
 {
   long i,j,k,n;
@@ -53,10 +78,6 @@ void do_healpix_sht_poisson_solve(double densfact, double backdens)
   long l,m;
   double poissonHEALPixArea;
   double mapbuffrad;
-#ifndef USE_FULLSKY_PARTDIST
-  double ra,dec;
-  long ring;
-#endif
   double smoothingRad;
   long *listpix=NULL,Nlistpix=0,Ntotmass;
   double totmass,r,cosdis,nvec[3];
@@ -313,14 +334,12 @@ void do_healpix_sht_poisson_solve(double densfact, double backdens)
 #endif
       
   /* step 2  - get map rings on correct nodes */
-  plan = healpixsht_plan(rayTraceData.poissonOrder);
-  if(strlen(rayTraceData.HEALPixRingWeightPath) > 0)
-    {
-      read_ring_weights(rayTraceData.HEALPixRingWeightPath,&plan);
-      
-      if(ThisTask == 0)
-	fprintf(stderr,"using ring weights!\n");
-    }
+  logProfileTag(PROFILETAG_SHTSETUP);
+  healpixsht_set_loadbal_path(rayTraceData.SHTLoadBalancePath);
+  plan = healpixsht_get_cached_plan(rayTraceData.poissonOrder,rayTraceData.HEALPixRingWeightPath);
+  logProfileTag(PROFILETAG_SHTSETUP);
+  if(plan.ring_weights != NULL && ThisTask == 0)
+    fprintf(stderr,"using ring weights!\n");
   /*
   if(strlen(rayTraceData.HEALPixWindowFunctionPath) > 0)
     {
@@ -345,69 +364,58 @@ void do_healpix_sht_poisson_solve(double densfact, double backdens)
       
       logProfileTag(PROFILETAG_PARTIO);
       
-      //read maps now if needed
-      j = NTasks/rayTraceData.NumFilesIOInParallel;
-      if(j*rayTraceData.NumFilesIOInParallel < NTasks)
-	++j;
-      k = ThisTask/rayTraceData.NumFilesIOInParallel;
-      for(i=0;i<j;++i)
+      //read maps now if needed - an I/O token is passed between tasks to limit I/O usage
+      io_throttle_begin();
+      firstRing = plan.firstRingTasks[ThisTask];
+      lastRing = plan.lastRingTasks[ThisTask];
+      mapvec_complex = (fftwf_complex*) mapvec;
+      
+      sprintf(fname,"%s/%s.%ld",rayTraceData.HEALPixLensPlaneMapPath,
+	      rayTraceData.HEALPixLensPlaneMapName,rayTraceData.CurrentPlaneNum);
+      
+      fp = fopen(fname,"r");
+      assert(fp != NULL);
+      fseek(fp,plan.northStartIndGlobalMap[0]*sizeof(float),SEEK_SET);
+      
+      //read all of the northern rings
+      for(nring=firstRing;nring<=lastRing;++nring)
 	{
-	  if(i == k)
+	  if(nring < Nside)
+	    ringpix = 4*nring;
+	  else
+	    ringpix = 4*Nside;
+	  
+	  mapvec = (float*) (mapvec_complex+plan.northStartIndMapvec[nring-firstRing]);
+	  fread(mapvec,(size_t) ringpix,sizeof(float),fp);
+	}
+      
+      //now read southern rings - they are opposite order since HEALPix reflects
+      // over the equator
+      fseek(fp,plan.southStartIndGlobalMap[lastRing-firstRing]*sizeof(float),SEEK_SET);
+      for(nring=lastRing;nring>=firstRing;nring--)
+	{
+	  if(nring < Nside)
+	    ringpix = 4*nring;
+	  else
+	    ringpix = 4*Nside;
+	  
+	  //ring on equator doesn't have a reflection
+	  if(nring != 2*Nside)
 	    {
-	      firstRing = plan.firstRingTasks[ThisTask];
-	      lastRing = plan.lastRingTasks[ThisTask];
-	      mapvec_complex = (fftwf_complex*) mapvec;
-	      
-	      sprintf(fname,"%s/%s.%ld",rayTraceData.HEALPixLensPlaneMapPath,
-		      rayTraceData.HEALPixLensPlaneMapName,rayTraceData.CurrentPlaneNum);
-	      
-	      fp = fopen(fname,"r");
-	      assert(fp != NULL);
-	      fseek(fp,plan.northStartIndGlobalMap[0]*sizeof(float),SEEK_SET);
-	      
-	      //read all of the northern rings
-	      for(nring=firstRing;nring<=lastRing;++nring)
-		{
-		  if(nring < Nside)
-		    ringpix = 4*nring;
-		  else
-		    ringpix = 4*Nside;
-		  
-		  mapvec = (float*) (mapvec_complex+plan.northStartIndMapvec[nring-firstRing]);
-		  fread(mapvec,(size_t) ringpix,sizeof(float),fp);
-		}
-	      
-	      //now read southern rings - they are opposite order since HEALPix reflects
-	      // over the equator
-	      fseek(fp,plan.southStartIndGlobalMap[lastRing-firstRing]*sizeof(float),SEEK_SET);
-	      for(nring=lastRing;nring>=firstRing;nring--)
-		{
-		  if(nring < Nside)
-		    ringpix = 4*nring;
-		  else
-		    ringpix = 4*Nside;
-		  
-		  //ring on equator doesn't have a reflection
-		  if(nring != 2*Nside)
-		    {
-		      mapvec = (float*) (mapvec_complex+plan.southStartIndMapvec[nring-firstRing]);
-		      fread(mapvec,(size_t) ringpix,sizeof(float),fp);
-		    }
-		}
-	      
-	      fclose(fp);
-	      mapvec = (float*) mapvec_complex;
+	      mapvec = (float*) (mapvec_complex+plan.southStartIndMapvec[nring-firstRing]);
+	      fread(mapvec,(size_t) ringpix,sizeof(float),fp);
 	    }
-	  
-	  ////////////////////////////////////
-	  MPI_Barrier(MPI_COMM_WORLD);
-	  ////////////////////////////////////
 	}
       
+      fclose(fp);
+      mapvec = (float*) mapvec_complex;
+      io_throttle_end();
+      
       logProfileTag(PROFILETAG_PARTIO);
       
       if(ThisTask == 0)
 	fprintf(stderr,"read HEALPix lens plane maps in %lf seconds.\n",getTimeProfileTag(PROFILETAG_PARTIO));
+      io_throttle_report("HEALPix lens plane map");
       
       logProfileTag(PROFILETAG_SHT);
       
@@ -451,9 +459,12 @@ void do_healpix_sht_poisson_solve(double densfact, double backdens)
     }
 #endif
   
-  /* step 3 - multiply by densfact and subtract backdens */
+  /* step 3 - multiply by densfact and subtract backdens - outside of the ray tracing domain the density is zero */
   firstRing = plan.firstRingTasks[ThisTask];
   lastRing = plan.lastRingTasks[ThisTask];
+#ifndef USE_FULLSKY_PARTDIST
+  get_cutsky_mask(plan);
+#endif
   mapvec_complex = (fftwf_complex*) mapvec;
   for(nring=firstRing;nring<=lastRing;++nring)
     {
@@ -462,41 +473,24 @@ void do_healpix_sht_poisson_solve(double densfact, double backdens)
       else
 	ringpix = 4*Nside;
       
-      mapvec = (float*) (mapvec_complex+plan.northStartIndMapvec[nring-firstRing]);
-      for(i=0;i<ringpix;++i)
+      for(n=0;n<2;++n)
 	{
-	  mapvec[i] *= (float) (densfact/poissonHEALPixArea*MASS_SCALE);
-#ifndef USE_FULLSKY_PARTDIST
-	  ring = i + plan.northStartIndGlobalMap[nring-firstRing];
-	  ring2ang(ring,&theta,&phi,rayTraceData.poissonOrder);
-	  ang2radec(theta,phi,&ra,&dec);
-	  if(!(test_vaccell(ra,dec)))
-	    mapvec[i] -= (float) backdens;
+	  //ring on equator doesn't have a reflection
+	  if(n == 1 && nring == 2*Nside)
+	    continue;
+	  
+	  if(n == 0)
+	    mapvec = (float*) (mapvec_complex+plan.northStartIndMapvec[nring-firstRing]);
 	  else
-	    mapvec[i] = 0.0;
-#else
-	  mapvec[i] -= (float) backdens;
-#endif
-	}
-      
-      if(nring != 2*Nside)
-	{
-	  mapvec = (float*) (mapvec_complex+plan.southStartIndMapvec[nring-firstRing]);
-	  for(i=0;i<ringpix;++i)
-	    {
-	      mapvec[i] *= (float) (densfact/poissonHEALPixArea*MASS_SCALE);
+	    mapvec = (float*) (mapvec_complex+plan.southStartIndMapvec[nring-firstRing]);
+	  
 #ifndef USE_FULLSKY_PARTDIST
-	      ring = i + plan.southStartIndGlobalMap[nring-firstRing];
-	      ring2ang(ring,&theta,&phi,rayTraceData.poissonOrder);
-	      ang2radec(theta,phi,&ra,&dec);
-	      if(!(test_vaccell(ra,dec)))
-		mapvec[i] -= (float) backdens;
-	      else
-		mapvec[i] = 0.0;
+	  k = 2*(nring-1) + n;
+	  scale_subtract_ring(mapvec,ringpix,(float) (densfact/poissonHEALPixArea*MASS_SCALE),(float) backdens,
+			      cutSkyMask.runs+2*cutSkyMask.ringRunStart[k],cutSkyMask.ringNumRuns[k]);
 #else
-	      mapvec[i] -= (float) backdens;
+	  scale_subtract_ring(mapvec,ringpix,(float) (densfact/poissonHEALPixArea*MASS_SCALE),(float) backdens,NULL,-1);
 #endif
-	    }
 	}
     }
   mapvec = (float*) mapvec_complex;
@@ -523,6 +517,7 @@ void do_healpix_sht_poisson_solve(double densfact, double backdens)
   map2almTime += MPI_Wtime();
   if(ThisTask == 0)
     fprintf(stderr,"map -> alm took %lf seocnds.\n",map2almTime);
+  progress_lcparts_prefetch();
   i = 0;
   for(m=plan.firstMTasks[ThisTask];m<=plan.lastMTasks[ThisTask];++m)
     for(l=m;l<=plan.lmax;++l)
@@ -575,6 +570,7 @@ void do_healpix_sht_poisson_solve(double densfact, double backdens)
   if(ThisTask == 0)
     fprintf(stderr,"alm -> map took %lf seocnds.\n",alm2mapTime);
 #endif
+  progress_lcparts_prefetch();
   
   free(alm_real);
   free(alm_imag);
@@ -661,8 +657,6 @@ void do_healpix_sht_poisson_solve(double densfact, double backdens)
   
   logProfileTag(PROFILETAG_SHT);
   
-  healpixsht_destroy_plan(plan);
-  
 #ifdef SHTONLY
   //now set ray defl and shear comps with long range part
   long doNotHaveCell;
@@ -673,9 +667,9 @@ void do_healpix_sht_poisson_solve(double densfact, double backdens)
         {
           for(j=0;j<bundleCells[i].Nrays;++j)
             {
-              rvec[0] = bundleCells[i].rays[j].n[0];
-              rvec[1] = bundleCells[i].rays[j].n[1];
-              rvec[2] = bundleCells[i].rays[j].n[2];
+	      rvec[0] = RAY_N(bundleCells[i],j,0);
+	      rvec[1] = RAY_N(bundleCells[i],j,1);
+	      rvec[2] = RAY_N(bundleCells[i],j,2);
               
 	      doNotHaveCell = shearinterp_comp(rvec,&lenspot,alpha,U);
 	      //DO NOT USE THIS doNotHaveCell = shearinterp_poly(rvec,&lenspot,alpha,U);
@@ -684,19 +678,19 @@ void do_healpix_sht_poisson_solve(double densfact, double backdens)
 		{
 		  vec2ang(rvec,&theta,&phi);
 		  fprintf(stderr,"%d: buffer region for HEALPix map is not big enough for long range force interp! - theta,phi = %le|%le, nest = %ld, doNotHaveCell = %ld\n",
-			  ThisTask,theta,phi,bundleCells[i].rays[j].nest,doNotHaveCell);
+			  ThisTask,theta,phi,RAY_NEST(bundleCells[i],j),doNotHaveCell);
 		  MPI_Abort(MPI_COMM_WORLD,123);
 		}
 	      
-	      bundleCells[i].rays[j].phi = lenspot;
+	      RAY_PHI(bundleCells[i],j) = lenspot;
 	      
-	      bundleCells[i].rays[j].alpha[0] += -1.0*alpha[0];
-              bundleCells[i].rays[j].alpha[1] += -1.0*alpha[1];
+	      RAY_ALPHA(bundleCells[i],j,0) += -1.0*alpha[0];
+	      RAY_ALPHA(bundleCells[i],j,1) += -1.0*alpha[1];
 	      
-              bundleCells[i].rays[j].U[0] += U[0];
-              bundleCells[i].rays[j].U[1] += U[1];
-              bundleCells[i].rays[j].U[2] += U[2];
-              bundleCells[i].rays[j].U[3] += U[3];
+	      RAY_U(bundleCells[i],j,0) += U[0];
+	      RAY_U(bundleCells[i],j,1) += U[1];
+	      RAY_U(bundleCells[i],j,2) += U[2];
+	      RAY_U(bundleCells[i],j,3) += U[3];
             }
         }
     }
@@ -1311,3 +1305,115 @@ static void write_localmap(char name[], HEALPixMapCell *localMapCells, long NumL
 #undef DEBUG_IO
 #endif
 #endif
+
+#ifndef USE_FULLSKY_PARTDIST
+static void get_cutsky_mask(HEALPixSHTPlan plan)
+{
+  long firstRing = plan.firstRingTasks[ThisTask];
+  long lastRing = plan.lastRingTasks[ThisTask];
+  long Nside = order2nside(rayTraceData.poissonOrder);
+  long nring,ringpix,n,i,k,ring,inDomain,lastInDomain;
+  double theta,phi,ra,dec;
+  
+  if(cutSkyMask.order != rayTraceData.poissonOrder)
+    {
+      if(cutSkyMask.ringRunStart != NULL)
+	free(cutSkyMask.ringRunStart);
+      if(cutSkyMask.ringNumRuns != NULL)
+	free(cutSkyMask.ringNumRuns);
+      if(cutSkyMask.runs != NULL)
+	free(cutSkyMask.runs);
+      
+      cutSkyMask.order = rayTraceData.poissonOrder;
+      cutSkyMask.ringRunStart = (long*)malloc(sizeof(long)*2*2*Nside);
+      assert(cutSkyMask.ringRunStart != NULL);
+      cutSkyMask.ringNumRuns = (long*)malloc(sizeof(long)*2*2*Nside);
+      assert(cutSkyMask.ringNumRuns != NULL);
+      for(k=0;k<2*2*Nside;++k)
+	{
+	  cutSkyMask.ringRunStart[k] = -1;
+	  cutSkyMask.ringNumRuns[k] = 0;
+	}
+      cutSkyMask.Nruns = 0;
+      cutSkyMask.NrunsAlloc = 4*Nside;
+      cutSkyMask.runs = (long*)malloc(sizeof(long)*2*cutSkyMask.NrunsAlloc);
+      assert(cutSkyMask.runs != NULL);
+    }
+  
+  for(nring=firstRing;nring<=lastRing;++nring)
+    {
+      if(nring < Nside)
+	ringpix = 4*nring;
+      else
+	ringpix = 4*Nside;
+      
+      for(n=0;n<2;++n)
+	{
+	  k = 2*(nring-1) + n;
+	  if(cutSkyMask.ringRunStart[k] >= 0)
+	    continue;
+	  
+	  cutSkyMask.ringRunStart[k] = cutSkyMask.Nruns;
+	  if(n == 1 && nring == 2*Nside)
+	    continue;
+	  
+	  lastInDomain = 0;
+	  for(i=0;i<ringpix;++i)
+	    {
+	      if(n == 0)
+		ring = i + plan.northStartIndGlobalMap[nring-firstRing];
+	      else
+		ring = i + plan.southStartIndGlobalMap[nring-firstRing];
+	      ring2ang(ring,&theta,&phi,rayTraceData.poissonOrder);
+	      ang2radec(theta,phi,&ra,&dec);
+	      inDomain = !(test_vaccell(ra,dec));
+	      
+	      if(inDomain && !lastInDomain)
+		{
+		  if(cutSkyMask.Nruns >= cutSkyMask.NrunsAlloc)
+		    {
+		      cutSkyMask.NrunsAlloc *= 2;
+		      cutSkyMask.runs = (long*)realloc(cutSkyMask.runs,sizeof(long)*2*cutSkyMask.NrunsAlloc);
+		      assert(cutSkyMask.runs != NULL);
+		    }
+		  cutSkyMask.runs[2*cutSkyMask.Nruns] = i;
+		  cutSkyMask.Nruns += 1;
+		}
+	      if(inDomain)
+		cutSkyMask.runs[2*cutSkyMask.Nruns-1] = i+1;
+	      
+	      lastInDomain = inDomain;
+	    }
+	  cutSkyMask.ringNumRuns[k] = cutSkyMask.Nruns - cutSkyMask.ringRunStart[k];
+	}
+    }
+}
+#endif
+
+/* multiplies a ring by fac and subtracts backdens in the runs [runs[2*r],runs[2*r+1]) of the ring and sets the rest of 
+   the ring to zero - if Nruns < 0 the whole ring is used */
+static void scale_subtract_ring(float *ringvec, long ringpix, float fac, float backdens, long *runs, long Nruns)
+{
+  long i,r,start,end,prev;
+  
+  if(Nruns < 0)
+    {
+      for(i=0;i<ringpix;++i)
+	ringvec[i] = ringvec[i]*fac - backdens;
+      return;
+    }
+  
+  prev = 0;
+  for(r=0;r<Nruns;++r)
+    {
+      start = runs[2*r];
+      end = runs[2*r+1];
+      for(i=prev;i<start;++i)
+	ringvec[i] = 0.0;
+      for(i=start;i<end;++i)
+	ringvec[i] = ringvec[i]*fac - backdens;
+      prev = end;
+    }
+  for(i=prev;i<ringpix;++i)
+    ringvec[i] = 0.0;
+}